@@ -1,27 +1,84 @@
 #include "main.h"
 #include "leds.h"
 #include "hardware_drivers.h"
+#include "param_store.h"
+#include "uart_cmd.h"
+#include "adc_input.h"
+#include "app.h"
+#include "low_power.h"
+#include "hd_trace.h"
 
 int main(void) {
+    /* Settings, overridden by values saved in flash */
+    LED_EffectConfigTypeDef config;
+    uint32_t effect = PARAM_EFFECT_WAVE;
+    uint32_t wave_enable;
+    uint32_t value;
+
     /* Initialize system and LEDs */
     HD_System_Init();
     LED_Init();
-    
-    /* Start PWM wave */
-    LED_StartPWMWave();
-    LED_SetWaveSpeed(1);    // Medium speed
-    LED_SetPWMPeriod(1500);  // Wave period
-    
-    /* Alternative: Start LED sequence */
-    // LED_Sequence(200);  // 200ms per LED
-
-    /* Main loop - now empty since everything works on interrupts */
+
+    /* Load saved settings */
+    PARAM_Init();
+    LED_GetEffectConfig(&config);
+    if (PARAM_Get(PARAM_WAVE_SPEED, &value) == HD_OK) {
+        config.wave_speed = value;
+    }
+    if (PARAM_Get(PARAM_PWM_PERIOD, &value) == HD_OK && value != 0) {
+        config.pwm_period = value;
+    }
+    if (PARAM_Get(PARAM_BRIGHTNESS, &value) == HD_OK) {
+        config.brightness = (uint8_t)value;
+    }
+    PARAM_Get(PARAM_EFFECT, &effect);
+    wave_enable = (effect != PARAM_EFFECT_SEQUENCE);
+    PARAM_Get(PARAM_WAVE_ENABLE, &wave_enable);
+
+    /* Same config whichever effect starts, a later wave uses it too */
+    LED_SetEffectConfig(&config);
+    if (effect == PARAM_EFFECT_SEQUENCE) {
+        /* Start LED sequence */
+        LED_Sequence(200);  // 200ms per LED
+    }
+    if (wave_enable) {
+        /* Start PWM wave */
+        LED_StartPWMWave();
+    }
+
+    /* Live control over the debug UART */
+    UCMD_Init();
+
+    /* Ambient light input scales the LED brightness */
+    ADCIN_Init();
+
+    /* Button driven application tasks */
+    APP_Init();
+
+    /* RTC for deep sleep between slow LED changes */
+    if (LP_Init() == HD_OK) {
+#ifdef HD_LOW_POWER
+        LP_Enable(true);
+#endif
+    }
+
+    /* Event trace from here on, when compiled in (HD_TRACE_ENABLE) */
+    HD_TraceStart();
+
+    /* Main loop - renders wave frames, pin output is done in timer interrupts */
     while(1) {
-        // All LED processing is done in timer interrupts
+        // LED_Process() in the timer interrupt only drives the pins,
+        // the wave itself is computed here at thread level
+        LED_Render();
+        // Execute received UART command frames
+        UCMD_Process();
+        // Flush changed settings to flash, one record per pass
+        PARAM_Process();
+        // Resume the application coroutines
+        APP_Process();
         // You can add other non-time-critical tasks here
-        __NOP();
 				//LED_Process();
-        // Or add small delay to reduce CPU usage
-        // HD_Delay_ms_blocking(1);
+        // Sleep until the next interrupt, counted as idle for HD_GetCpuLoad()
+        HD_Idle();
     }
 }
\ No newline at end of file
@@ -4,5 +4,20 @@
 #include <stdint.h>
 #include "leds.h"
 #include "button.h"
+#include "coro.h"
+
+/* Application tasks, resumed in turn by APP_Process() */
+typedef CORO_ResultTypeDef (*APP_TaskFuncTypeDef)(CORO_TypeDef* co);
+
+typedef struct {
+    uint32_t resumes;
+    uint32_t total_cycles;
+    uint32_t max_cycles;        /* worst single resume */
+} APP_StatsTypeDef;
+
+/* Function prototypes */
+void APP_Init(void);
+void APP_Process(void);
+const APP_StatsTypeDef* APP_GetStats(void);
 
 #endif /* APP_H */
@@ -0,0 +1,76 @@
+#ifndef CORO_H
+#define CORO_H
+
+#include <stdint.h>
+#include "hardware_drivers.h"
+
+/* Stackless coroutines (protothreads) for sequential application code.
+ *
+ * A coroutine is a function taking its CORO_TypeDef, resumed by the
+ * scheduler until it returns CORO_DONE. The body sits between
+ * CORO_BEGIN and CORO_END; every CORO_AWAIT_xxx returns to the
+ * scheduler and continues at the same place on a later resume. The
+ * whole saved state is the line number and one wait value, so there is
+ * no heap and no stack per task.
+ *
+ * Rules that come with it: local variables do not survive an await
+ * (keep them in static or task data), and the body must not contain a
+ * switch statement of its own around an await. */
+
+typedef enum {
+    CORO_WAITING = 0,
+    CORO_DONE    = 1
+} CORO_ResultTypeDef;
+
+typedef struct {
+    uint16_t line;          // resume point, 0 = start
+    uint32_t mark;          // deadline or counter value of the current await
+} CORO_TypeDef;
+
+#define CORO_INIT(co)       do { (co)->line = 0; } while (0)
+
+#define CORO_BEGIN(co)      switch ((co)->line) { case 0:
+
+#define CORO_END(co)        } (co)->line = 0; return CORO_DONE
+
+/* Returns to the scheduler until cond is true */
+#define CORO_AWAIT(co, cond)                                    \
+    do {                                                        \
+        (co)->line = __LINE__; case __LINE__:                   \
+        if (!(cond)) {                                          \
+            return CORO_WAITING;                                \
+        }                                                       \
+    } while (0)
+
+/* Gives the other tasks one turn */
+#define CORO_YIELD(co)                                          \
+    do {                                                        \
+        (co)->mark = 0;                                         \
+        (co)->line = __LINE__; case __LINE__:                   \
+        if ((co)->mark++ == 0) {                                \
+            return CORO_WAITING;                                \
+        }                                                       \
+    } while (0)
+
+/* co_await delay(ms) */
+#define CORO_AWAIT_DELAY(co, ms)                                \
+    do {                                                        \
+        (co)->mark = HD_GetTick() + (ms);                       \
+        CORO_AWAIT(co, (int32_t)(HD_GetTick() - (co)->mark) >= 0); \
+    } while (0)
+
+/* co_await button_event(): the next press of btn */
+#define CORO_AWAIT_BUTTON(co, btn)                              \
+    do {                                                        \
+        (co)->mark = BTN_GetPressCount(btn);                    \
+        CORO_AWAIT(co, BTN_GetPressCount(btn) != (co)->mark);   \
+    } while (0)
+
+/* co_await frame_done(): the next frame rendered by the LED engine */
+#define CORO_AWAIT_FRAME(co)                                    \
+    do {                                                        \
+        (co)->mark = LED_GetFrameCount();                       \
+        CORO_AWAIT(co, LED_GetFrameCount() != (co)->mark);      \
+    } while (0)
+
+#endif /* CORO_H */
@@ -1,3 +1,128 @@
 #include "app.h"
 #include "main.h"
 #include "hardware_drivers.h"
+#include "param_store.h"
+
+/* Sequential behaviours written as coroutines (coro.h). Each task keeps
+ * its own data in statics, the scheduler only holds one CORO_TypeDef
+ * per task. */
+
+#define APP_SEQUENCE_DELAY      200     // ms per LED in sequence mode
+#define APP_DIM_STEP            8       // brightness change per frame
+
+static CORO_ResultTypeDef effect_task(CORO_TypeDef* co);
+static CORO_ResultTypeDef dimmer_task(CORO_TypeDef* co);
+
+static const APP_TaskFuncTypeDef tasks[] = {
+    effect_task,
+    dimmer_task,
+};
+
+#define APP_TASK_COUNT  (sizeof(tasks) / sizeof(tasks[0]))
+
+static CORO_TypeDef task_state[APP_TASK_COUNT];
+static uint32_t task_done = 0;          // bit n set when task n returned CORO_DONE
+static APP_StatsTypeDef stats;
+
+// dimmer_task data, kept across awaits
+static const uint8_t dim_levels[] = { 255, 96, 24 };
+static uint8_t dim_index = 0;
+static uint8_t dim_level = 255;
+
+/**
+  * @brief  UP switches between wave and sequence and saves the choice
+  */
+static CORO_ResultTypeDef effect_task(CORO_TypeDef* co)
+{
+    CORO_BEGIN(co);
+    while (1) {
+        CORO_AWAIT_BUTTON(co, BTN_UP);
+
+        if (LED_PWMWaveIsActive()) {
+            LED_StopPWMWave();
+            LED_Sequence(APP_SEQUENCE_DELAY);
+            PARAM_Set(PARAM_EFFECT, PARAM_EFFECT_SEQUENCE);
+        } else {
+            LED_SequenceStop();
+            LED_StartPWMWave();
+            PARAM_Set(PARAM_EFFECT, PARAM_EFFECT_WAVE);
+        }
+    }
+    CORO_END(co);
+}
+
+/**
+  * @brief  DOWN steps through the brightness levels, fading one step
+  *         per rendered frame
+  */
+static CORO_ResultTypeDef dimmer_task(CORO_TypeDef* co)
+{
+    CORO_BEGIN(co);
+    while (1) {
+        CORO_AWAIT_BUTTON(co, BTN_DOWN);
+        dim_index = (uint8_t)((dim_index + 1) % sizeof(dim_levels));
+
+        while (dim_level != dim_levels[dim_index]) {
+            uint8_t target = dim_levels[dim_index];
+
+            if (dim_level > target) {
+                dim_level = (dim_level - target > APP_DIM_STEP) ? dim_level - APP_DIM_STEP : target;
+            } else {
+                dim_level = (target - dim_level > APP_DIM_STEP) ? dim_level + APP_DIM_STEP : target;
+            }
+            LED_SetBrightness(dim_level);
+            CORO_AWAIT_FRAME(co);
+        }
+    }
+    CORO_END(co);
+}
+
+/**
+  * @brief  Initializes the buttons and starts every task
+  */
+void APP_Init(void)
+{
+    BTN_Init();
+    for (uint32_t i = 0; i < APP_TASK_COUNT; i++) {
+        CORO_INIT(&task_state[i]);
+    }
+    task_done = 0;
+}
+
+/**
+  * @brief  Resumes every unfinished task once (main loop)
+  * @note   Resume cost is measured with the cycle counter, see APP_GetStats
+  */
+void APP_Process(void)
+{
+    BTN_Process(HD_GetTick());
+
+    for (uint32_t i = 0; i < APP_TASK_COUNT; i++) {
+        uint32_t start;
+        uint32_t cycles;
+
+        if (task_done & (1UL << i)) {
+            continue;
+        }
+
+        start = DWT->CYCCNT;
+        if (tasks[i](&task_state[i]) == CORO_DONE) {
+            task_done |= 1UL << i;
+        }
+        cycles = DWT->CYCCNT - start;
+
+        stats.resumes++;
+        stats.total_cycles += cycles;
+        if (cycles > stats.max_cycles) {
+            stats.max_cycles = cycles;
+        }
+    }
+}
+
+/**
+  * @brief  Task resume statistics, total / resumes is the mean cost
+  */
+const APP_StatsTypeDef* APP_GetStats(void)
+{
+    return &stats;
+}
@@ -0,0 +1,39 @@
+#ifndef ADC_INPUT_H
+#define ADC_INPUT_H
+
+#include <stdint.h>
+#include "hardware_drivers.h"
+
+/* Ambient light / potentiometer input on ADC7 (PD7) */
+#define ADCIN_PORT              MDR_PORTD
+#define ADCIN_PIN               PORT_Pin_7
+
+/* One DMA half holds one block, the filter runs once per block */
+#define ADCIN_BLOCK_SHIFT       5
+#define ADCIN_BLOCK_SIZE        (1U << ADCIN_BLOCK_SHIFT)
+
+/* One-pole IIR after decimation: y += (x - y) >> ADCIN_IIR_SHIFT */
+#define ADCIN_IIR_SHIFT         3
+
+/* Filtered level below ADCIN_MIN_LEVEL never dims the LEDs further */
+#define ADCIN_MIN_LEVEL         16
+
+/* Microphone instead of the light sensor: sample at about 9 kHz and pass
+ * every block to the sound analyser (audio_fft.c) instead of dimming */
+// #define ADCIN_AUDIO
+
+#ifdef ADCIN_AUDIO
+#define ADCIN_PRESCALER         ADC_CLK_div_32
+#else
+#define ADCIN_PRESCALER         ADC_CLK_div_512
+#endif
+
+/* Function prototypes */
+void ADCIN_Init(void);
+void ADCIN_DMAHandler(void);
+uint16_t ADCIN_FilterBlock(const uint16_t* samples);
+uint16_t ADCIN_GetFiltered(void);
+uint32_t ADCIN_GetBlockCount(void);
+uint32_t ADCIN_GetOverrunCount(void);
+
+#endif /* ADC_INPUT_H */
@@ -0,0 +1,47 @@
+#ifndef AUDIO_FFT_H
+#define AUDIO_FFT_H
+
+#include <stdint.h>
+#include "hardware_drivers.h"
+#include "led_compositor.h"
+
+/* Sound-reactive LED layer: one ADC block per Q15 FFT, the spectrum is
+ * split into one octave band per LED.
+ *
+ * Cortex-M3 has no DSP instructions, so the kernel is a plain radix-2
+ * decimation in time with a quarter-wave twiddle table and block
+ * floating point: a stage whose input could overflow is shifted right
+ * first and the shift counted in the block exponent. */
+
+/* One ADC block (ADCIN_BLOCK_SIZE) per transform */
+#define AFFT_LOG2               5
+#define AFFT_SIZE               (1U << AFFT_LOG2)
+
+/* Largest transform the twiddle table covers. Transform and band
+ * analysis run at thread level once per block; measure AFFT_GetCycles()
+ * on the board before raising AFFT_LOG2. */
+#define AFFT_MAX_LOG2           6
+#define AFFT_MAX_SIZE           (1U << AFFT_MAX_LOG2)
+
+/* Band level mapping. Levels are 8 * log2(band power), so 8 units per
+ * 3 dB. A full-scale sine in one bin is AFFT_FULL_SCALE_Q3 and shows as
+ * 255; AFFT_RANGE_Q3 below that shows as 0. */
+#define AFFT_FULL_SCALE_Q3      (16 * (13 + AFFT_LOG2))
+#define AFFT_RANGE_Q3           128
+
+/* Level units a band loses per block when the sound stops */
+#define AFFT_DECAY              12
+
+typedef struct {
+    int16_t re;
+    int16_t im;
+} AFFT_ComplexTypeDef;
+
+/* Function prototypes */
+int32_t AFFT_Transform(AFFT_ComplexTypeDef* x, uint32_t log2n);
+void AFFT_Reset(void);
+void AFFT_PushBlock(const uint16_t* samples);
+LCOMP_Pixel4 AFFT_Next(void);
+uint32_t AFFT_GetCycles(void);
+
+#endif /* AUDIO_FFT_H */
@@ -0,0 +1,28 @@
+#ifndef BUTTON_H
+#define BUTTON_H
+
+#include <stdint.h>
+#include "hardware_drivers.h"
+
+/* Button pin map, same scheme as LED_PIN_MAP.
+ * X(arg, btn, port, pin): buttons are active low, internal pull-up on. */
+#define BTN_PIN_MAP(X, arg) \
+    X(arg, BTN_UP,   B, 5)  \
+    X(arg, BTN_DOWN, E, 1)
+
+#define BTN_ENUM_ENTRY(arg, btn, port, pin)     btn,
+typedef enum {
+    BTN_PIN_MAP(BTN_ENUM_ENTRY, _)
+    BTN_COUNT
+} BTN_TypeDef;
+
+/* A level must be stable this long to count */
+#define BTN_DEBOUNCE_MS     20
+
+/* Function prototypes */
+void BTN_Init(void);
+void BTN_Process(uint32_t now);
+uint8_t BTN_IsPressed(BTN_TypeDef btn);
+uint32_t BTN_GetPressCount(BTN_TypeDef btn);
+
+#endif /* BUTTON_H */
@@ -5,6 +5,21 @@
 #include <stdbool.h>
 #include <MDR32FxQI_rst_clk.h>
 #include <MDR32FxQI_timer.h>
+#include "hd_fast.h"
+
+/* Fast boot: HD_System_Init writes precomputed register images for the
+ * LED ports and TIMER1 instead of going through the SPL init structures,
+ * and the first LED frame is produced right after init, not 1 ms later.
+ * HD_GetBootCycles counts from HD_System_Init, SystemInit is not in it */
+// #define HD_FAST_BOOT
+
+/* Low power: HD_Idle() sleeps on the RTC clock through long gaps between
+ * LED changes (slow sequences), see low_power.h for what stops meanwhile */
+// #define HD_LOW_POWER
+
+/* Event trace ring (hd_trace.h): interrupt entry/exit, frames, sequence
+ * steps and commands, for tools/trace2json.py */
+// #define HD_TRACE_ENABLE
 
 /* Error codes */
 typedef enum {
@@ -23,19 +38,62 @@ HD_StatusTypeDef HD_Delay_ms(uint32_t ms);
 HD_StatusTypeDef HD_Delay_us(uint32_t us);
 void HD_Delay_ms_blocking(uint32_t ms);
 void HD_Delay_us_blocking(uint32_t us);
-uint32_t HD_GetTick(void);
+/* HD_GetTick() is inline, see hd_fast.h */
 void HD_IncrementTick(void);
+void HD_AdvanceTick(uint32_t ms);
 
 /* Timer functions */
+#define HD_TIMER1_MAX_US    60000UL     /* 16-bit ARR at 1 us per count */
+
 void HD_Timer1_Init(void);
-void TIMER1_IRQHandler(void);
+HD_StatusTypeDef HD_Timer1_ScheduleUs(uint32_t us);
+void HD_Timer1_Kick(void);
+uint32_t HD_GetTimer1Wakeups(void);
+uint32_t HD_GetOverrunCount(void);
+
+/* CPU load accounting. Idle is the time spent in HD_Idle(), the rest
+ * of every second is busy. Loads are in 1/1000. Handler loads exclude
+ * the handlers that preempted them, so they add up. */
+#define HD_CPU_LOAD_LIMIT   950     /* seconds above: counted, DEBUG asserts */
+
+typedef enum {
+    HD_LOAD_1S  = 0,
+    HD_LOAD_10S = 1,
+    HD_LOAD_60S = 2
+} HD_LoadWindowTypeDef;
+
+typedef enum {
+    HD_ISR_SYSTICK = 0,
+    HD_ISR_TIMER1  = 1,
+    HD_ISR_DMA     = 2,
+    HD_ISR_TIMER2  = 3,         /* LED matrix scan, LED_MATRIX builds */
+    HD_ISR_COUNT
+} HD_IsrTypeDef;
+
+void HD_Idle(void);
+uint32_t HD_GetCpuLoad(HD_LoadWindowTypeDef window);
+uint32_t HD_GetIsrLoad(HD_IsrTypeDef isr);
+uint32_t HD_GetOverloadCount(void);
 
 /* System functions */
 void HD_System_Init(void);
 uint32_t HD_GetSystemClock(void);
+uint32_t HD_GetBootCycles(void);
+
+/* TIMER1 entry to LED pin output, CPU cycles */
+typedef struct {
+    uint32_t last;
+    uint32_t min;
+    uint32_t max;
+} HD_LatencyTypeDef;
+
+void HD_RecordPinLatency(void);
+void HD_LatchBootCycles(void);
+const HD_LatencyTypeDef* HD_GetPinLatency(void);
 
 /* Utility functions */
 void HD_AssertFailed(const char* file, uint32_t line);
+uint16_t HD_CRC16(const uint8_t* data, uint32_t length);
 
 /* Assert macro */
 #ifdef DEBUG
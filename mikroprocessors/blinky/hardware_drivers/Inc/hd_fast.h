@@ -0,0 +1,109 @@
+#ifndef HD_FAST_H
+#define HD_FAST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <MDR32FxQI_timer.h>
+#include <MDR32FxQI_dma.h>
+
+/* Header-only register access for the interrupt hot paths. The SPL
+ * equivalents live in their own objects and cost a call plus parameter
+ * checks each; these compile to one or two loads/stores in place. */
+
+/* Tick counter, incremented by SysTick_Handler only */
+extern volatile uint32_t HD_TickCounter;
+
+/* DWT cycle count latched at Timer1_IRQHandler entry */
+extern uint32_t HD_Timer1EntryCycles;
+
+/**
+  * @brief  Get current tick count
+  */
+static inline uint32_t HD_GetTick(void)
+{
+    return HD_TickCounter;
+}
+
+/* TIMER -------------------------------------------------------------------*/
+
+/* TIMER_GetITStatus: flag set and its interrupt enabled */
+static inline uint32_t HD_TIMER_ITPending(MDR_TIMER_TypeDef* timer, uint32_t flag)
+{
+    return timer->STATUS & timer->IE & flag;
+}
+
+/* TIMER_GetFlagStatus */
+static inline uint32_t HD_TIMER_FlagSet(MDR_TIMER_TypeDef* timer, uint32_t flag)
+{
+    return timer->STATUS & flag;
+}
+
+/* TIMER_ClearFlag: writing 1 leaves a flag unchanged, so no read-modify-write
+ * that could drop an event raised in between */
+static inline void HD_TIMER_ClearFlag(MDR_TIMER_TypeDef* timer, uint32_t flag)
+{
+    timer->STATUS = ~flag;
+}
+
+/* PORT --------------------------------------------------------------------*/
+
+/* Replaces the pins in mask with bits, other pins keep their level */
+static inline void HD_PORT_WriteMasked(MDR_PORT_TypeDef* port, uint32_t mask, uint32_t bits)
+{
+    port->RXTX = (port->RXTX & ~mask) | bits;
+}
+
+static inline uint32_t HD_PORT_Read(MDR_PORT_TypeDef* port)
+{
+    return port->RXTX;
+}
+
+/* Bit-band ----------------------------------------------------------------*/
+
+/* Cortex-M3 maps every bit of the first MB of peripheral space to its own
+ * word at 0x42000000. A store to that word changes only that bit, in one
+ * bus transaction, so it cannot lose a write made by an interrupt. */
+#define HD_PERIPH_BASE          0x40000000UL
+#define HD_PERIPH_BB_BASE       0x42000000UL
+#define HD_PERIPH_BB_SIZE       0x00100000UL
+
+/* Alias address of bit 'bit' of the peripheral register at 'addr'.
+ * Plain integer arithmetic, usable in constant expressions. */
+#define HD_BITBAND_ADDR(addr, bit) \
+    (HD_PERIPH_BB_BASE + (((uint32_t)(addr) - HD_PERIPH_BASE) << 5) + ((uint32_t)(bit) << 2))
+
+#define HD_BITBAND_IN_RANGE(addr) \
+    ((uint32_t)(addr) >= HD_PERIPH_BASE && (uint32_t)(addr) < HD_PERIPH_BASE + HD_PERIPH_BB_SIZE)
+
+/* The alias word itself, reads back 0 or 1 */
+#define HD_BITBAND(addr, bit)   (*(__IO uint32_t*)HD_BITBAND_ADDR(addr, bit))
+
+/* RXTX of MDR_PORTx, as an integer for HD_BITBAND_ADDR */
+#define HD_PORT_RXTX_ADDR(base) ((base) + offsetof(MDR_PORT_TypeDef, RXTX))
+
+/* DMA ---------------------------------------------------------------------*/
+
+/* cycle_ctrl, bits [2:0] of a control word, reads 0 (stop) once the
+ * structure's cycle is complete and until software reloads it */
+#define HD_DMA_CYCLE_CTRL_MASK  0x7UL
+
+/* True when the primary (alternate = 0) or alternate structure of the
+ * channel has finished its cycle. In ping-pong mode a channel with both
+ * finished has stopped and must be re-enabled. */
+static inline uint32_t HD_DMA_StructDone(uint32_t channel, uint32_t alternate)
+{
+    const DMA_CtrlDataTypeDef* table = (const DMA_CtrlDataTypeDef*)(uintptr_t)
+        (alternate ? MDR_DMA->ALT_CTRL_BASE_PTR : MDR_DMA->CTRL_BASE_PTR);
+
+    return (table[channel].DMA_Control & HD_DMA_CYCLE_CTRL_MASK) == 0;
+}
+
+/* SysTick -----------------------------------------------------------------*/
+
+/* CPU cycles into the current 1 ms tick, SysTick counts down */
+static inline uint32_t HD_SysTick_Elapsed(void)
+{
+    return SysTick->LOAD - SysTick->VAL;
+}
+
+#endif /* HD_FAST_H */
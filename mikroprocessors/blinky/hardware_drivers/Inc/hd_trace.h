@@ -0,0 +1,104 @@
+#ifndef HD_TRACE_H
+#define HD_TRACE_H
+
+#include <stdint.h>
+#include "hardware_drivers.h"
+
+/* Event trace: a RAM ring of 8-byte records written from interrupts and
+ * thread code, read by a debugger memory dump and turned into a
+ * Chrome/Perfetto trace by tools/trace2json.py. Everything below
+ * disappears when HD_TRACE_ENABLE is not defined.
+ *
+ * Record: word 0 = cycles since the previous record << 8 | event id,
+ *         word 1 = event argument.
+ * Gaps are kept mod 2^24 cycles; the SysTick anchor every
+ * HD_TRACE_ANCHOR_MS keeps real gaps below that up to 65 MHz. */
+
+/* X(name, kind, label): kind is BEGIN/END of a slice or INSTANT.
+ * tools/trace2json.py reads this list, keep one entry per line. */
+#define HD_TRACE_EVENTS(X) \
+    X(ANCHOR,        INSTANT, "tick")           \
+    X(SYSTICK_BEGIN, BEGIN,   "SysTick")        \
+    X(SYSTICK_END,   END,     "SysTick")        \
+    X(TIMER1_BEGIN,  BEGIN,   "TIMER1")         \
+    X(TIMER1_END,    END,     "TIMER1")         \
+    X(DMA_BEGIN,     BEGIN,   "DMA")            \
+    X(DMA_END,       END,     "DMA")            \
+    X(TIMER2_BEGIN,  BEGIN,   "TIMER2")         \
+    X(TIMER2_END,    END,     "TIMER2")         \
+    X(FRAME,         INSTANT, "frame")          \
+    X(SEQ_STEP,      INSTANT, "sequence step")  \
+    X(COMMAND,       INSTANT, "command")        \
+    X(PARAMS,        INSTANT, "params")
+
+/* Ids start at 1, a zero record is an unused slot */
+#define HD_TRACE_ENUM_ENTRY(name, kind, label)  HD_EV_##name,
+typedef enum {
+    HD_EV_NONE = 0,
+    HD_TRACE_EVENTS(HD_TRACE_ENUM_ENTRY)
+    HD_EV_COUNT
+} HD_TraceEventTypeDef;
+
+#define HD_TRACE_DEPTH          128     /* power of 2, at most 256 */
+#define HD_TRACE_ANCHOR_MS      256
+#define HD_TRACE_MAGIC          0x52544448UL    /* "HDTR" */
+
+typedef struct {
+    uint32_t stamp;             /* delta cycles << 8 | HD_EV_xxx */
+    uint32_t arg;
+} HD_TraceRecordTypeDef;
+
+/* Dump sizeof(HD_TraceBuffer) bytes from &HD_TraceBuffer for the decoder */
+typedef struct {
+    uint32_t magic;
+    uint32_t clock_hz;
+    uint32_t depth;
+    volatile uint32_t state;    /* last timestamp << 8 | next slot */
+    volatile uint32_t enabled;
+    HD_TraceRecordTypeDef ring[HD_TRACE_DEPTH];
+} HD_TraceBufferTypeDef;
+
+#ifdef HD_TRACE_ENABLE
+
+typedef char hd_trace_depth_ok[((HD_TRACE_DEPTH & (HD_TRACE_DEPTH - 1)) == 0 &&
+                                HD_TRACE_DEPTH <= 256) ? 1 : -1];
+
+extern HD_TraceBufferTypeDef HD_TraceBuffer;
+
+/**
+  * @brief  Appends one record
+  * @note   Slot and timestamp are claimed together with LDREX/STREX, so
+  *         an interrupt that preempts the claim makes it retry and the
+  *         ring stays in time order without masking interrupts
+  */
+static inline void HD_TraceWrite(uint32_t event, uint32_t arg)
+{
+    uint32_t state, now, slot;
+
+    do {
+        state = __LDREXW(&HD_TraceBuffer.state);
+        now = DWT->CYCCNT;
+        slot = state & (HD_TRACE_DEPTH - 1);
+    } while (__STREXW((now << 8) | ((slot + 1) & (HD_TRACE_DEPTH - 1)), &HD_TraceBuffer.state));
+
+    HD_TraceBuffer.ring[slot].arg = arg;
+    HD_TraceBuffer.ring[slot].stamp = (((now - (state >> 8)) & 0x00FFFFFFUL) << 8) | event;
+}
+
+#define HD_TRACE(event, arg) \
+    do { if (HD_TraceBuffer.enabled) HD_TraceWrite(HD_EV_##event, (uint32_t)(arg)); } while (0)
+
+void HD_TraceStart(void);
+void HD_TraceStop(void);
+void HD_TraceClear(void);
+
+#else
+
+#define HD_TRACE(event, arg)    ((void)0)
+#define HD_TraceStart()         ((void)0)
+#define HD_TraceStop()          ((void)0)
+#define HD_TraceClear()         ((void)0)
+
+#endif /* HD_TRACE_ENABLE */
+
+#endif /* HD_TRACE_H */
@@ -0,0 +1,43 @@
+#ifndef LED_COMPOSITOR_H
+#define LED_COMPOSITOR_H
+
+#include <stdint.h>
+#include "hardware_drivers.h"
+
+/* Four 8-bit LED channels packed in one word, LED n in byte n.
+ * Cortex-M3 has no SIMD, so blending works on all four at once with
+ * plain 32-bit (SWAR) arithmetic. */
+typedef uint32_t LCOMP_Pixel4;
+
+#define LCOMP_CHANNELS          4
+#define LCOMP_LAYER_COUNT       4
+
+/* Layers used by the LED engine, bottom to top */
+#define LCOMP_LAYER_WAVE        0
+#define LCOMP_LAYER_SEQUENCE    1
+#define LCOMP_LAYER_PATTERN     2
+#define LCOMP_LAYER_AUDIO       3
+
+/* Blend modes, applied when a layer is drawn over the layers below it */
+typedef enum {
+    LCOMP_BLEND_MAX   = 0,  /* per channel maximum */
+    LCOMP_BLEND_ADD   = 1,  /* saturating add */
+    LCOMP_BLEND_ALPHA = 2   /* opacity is the alpha */
+} LCOMP_BlendTypeDef;
+
+/* SWAR helpers */
+LCOMP_Pixel4 LCOMP_Scale(LCOMP_Pixel4 x, uint32_t factor);
+LCOMP_Pixel4 LCOMP_AddSat(LCOMP_Pixel4 x, LCOMP_Pixel4 y);
+LCOMP_Pixel4 LCOMP_Max(LCOMP_Pixel4 x, LCOMP_Pixel4 y);
+LCOMP_Pixel4 LCOMP_Alpha(LCOMP_Pixel4 top, LCOMP_Pixel4 bottom, uint32_t alpha);
+
+/* Layer control */
+void LCOMP_SetFrame(uint8_t layer, LCOMP_Pixel4 frame);
+void LCOMP_SetOpacity(uint8_t layer, uint8_t opacity);
+void LCOMP_SetBlend(uint8_t layer, LCOMP_BlendTypeDef mode);
+void LCOMP_Enable(uint8_t layer, uint8_t enable);
+void LCOMP_Crossfade(uint8_t from_layer, uint8_t to_layer, uint32_t duration_ms);
+LCOMP_Pixel4 LCOMP_Compose(uint32_t now);
+uint32_t LCOMP_GetComposeCycles(void);
+
+#endif /* LED_COMPOSITOR_H */
@@ -0,0 +1,60 @@
+#ifndef LED_MATRIX_H
+#define LED_MATRIX_H
+
+#include <stdint.h>
+#include "hardware_drivers.h"
+#include "leds.h"
+#include "led_compositor.h"
+
+/* Row/column multiplexed LED matrix on TIMER2.
+ *
+ * Pin maps, X(arg, index, port, pin). Rows source current (active high),
+ * columns sink it (active low). This is the 8x8 wiring; a 16x16 matrix
+ * only needs 16 entries in each map. Pins must not be LED_PIN_MAP pins. */
+#define LMTX_ROW_MAP(X, arg) \
+    X(arg, 0, A, 0)          \
+    X(arg, 1, A, 2)          \
+    X(arg, 2, A, 4)          \
+    X(arg, 3, A, 6)          \
+    X(arg, 4, A, 7)          \
+    X(arg, 5, C, 0)          \
+    X(arg, 6, C, 1)          \
+    X(arg, 7, E, 0)
+
+#define LMTX_COL_MAP(X, arg) \
+    X(arg, 0, B, 6)          \
+    X(arg, 1, B, 7)          \
+    X(arg, 2, B, 8)          \
+    X(arg, 3, B, 9)          \
+    X(arg, 4, B, 10)         \
+    X(arg, 5, F, 2)          \
+    X(arg, 6, F, 3)          \
+    X(arg, 7, F, 4)
+
+#define LMTX_ROW_ACTIVE_HIGH    1
+#define LMTX_COL_ACTIVE_HIGH    0
+
+#define LMTX_COUNT_ENTRY(arg, idx, port, pin)   arg##idx,
+enum { LMTX_ROW_MAP(LMTX_COUNT_ENTRY, LMTX_ROW_) LMTX_ROWS };
+enum { LMTX_COL_MAP(LMTX_COUNT_ENTRY, LMTX_COL_) LMTX_COLS };
+
+/* Per-port pin masks, 0 for ports without matrix pins */
+#define LMTX_MASK_IF_PORT(p, idx, port, pin) \
+    | ((LED_PORTID_##port == LED_PORTID_##p) ? (1UL << (pin)) : 0UL)
+#define LMTX_ROW_MASK(p)    (0UL LMTX_ROW_MAP(LMTX_MASK_IF_PORT, p))
+#define LMTX_COL_MASK(p)    (0UL LMTX_COL_MAP(LMTX_MASK_IF_PORT, p))
+
+/* Binary code modulation: each row slot shows bit b of every pixel for
+ * LMTX_BAM_BASE_US << b, so 2^LMTX_BAM_BITS levels per pixel.
+ * 8 rows x 15 x 32 us = 3.84 ms per refresh (260 Hz). */
+#define LMTX_BAM_BITS       4
+#define LMTX_BAM_BASE_US    32
+
+/* Function prototypes */
+void LMTX_Init(void);
+void LMTX_SetPixels(const uint8_t* levels);
+void LMTX_SetChannels(LCOMP_Pixel4 channels);
+uint32_t LMTX_GetRefreshCount(void);
+void LMTX_ScanHandler(void);
+
+#endif /* LED_MATRIX_H */
@@ -0,0 +1,43 @@
+#ifndef LED_PATTERN_H
+#define LED_PATTERN_H
+
+#include <stdint.h>
+#include "hardware_drivers.h"
+#include "led_compositor.h"
+
+/* Compressed light show, produced by tools/ledpat.py and kept in flash.
+ *
+ * Header, little endian:
+ *   0  'L' 'P'
+ *   2  version (LPAT_VERSION)
+ *   3  flags (LPAT_FLAG_xxx)
+ *   4  frame count, u16
+ *   6  frame time in ms, u16
+ *   8  palette size, 0..LPAT_PALETTE_MAX
+ *   9  palette, one LCOMP_Pixel4 (u32) per entry
+ *
+ * Followed by one opcode per decoded frame or run of frames:
+ *   00..3F  PAL   frame = palette[op]
+ *   40..7F  RUN   previous frame shown (op & 0x3F) + 1 more times
+ *   80..8F  DELTA one byte per set bit of (op & 0x0F), added (mod 256)
+ *                 to that LED of the previous frame
+ * The frame before the first one is all off. */
+
+#define LPAT_VERSION            1
+#define LPAT_HEADER_SIZE        9
+#define LPAT_PALETTE_MAX        64
+#define LPAT_FLAG_LOOP          0x01    /* restart after the last frame */
+
+#define LPAT_OP_PAL             0x00
+#define LPAT_OP_RUN             0x40
+#define LPAT_OP_DELTA           0x80
+#define LPAT_OP_MASK            0xC0
+
+/* Function prototypes */
+HD_StatusTypeDef LPAT_Start(const uint8_t* data, uint32_t size, uint32_t now);
+void LPAT_Stop(void);
+uint8_t LPAT_IsActive(void);
+LCOMP_Pixel4 LPAT_Next(uint32_t now);
+uint32_t LPAT_GetDecodeCycles(void);
+
+#endif /* LED_PATTERN_H */
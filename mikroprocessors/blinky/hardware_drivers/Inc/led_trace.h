@@ -0,0 +1,32 @@
+#ifndef LED_TRACE_H
+#define LED_TRACE_H
+
+#include <stdint.h>
+#include "hardware_drivers.h"
+
+/* Recorded LED pin edges, oldest are overwritten */
+#define LTRACE_DEPTH            256
+
+/* Per-LED timing measured from the recorded edges */
+typedef struct {
+    uint32_t edges;
+    uint32_t periods;           /* complete rising-to-rising periods */
+    uint32_t high_cycles;       /* total time high over those periods */
+    uint32_t total_cycles;      /* total length of those periods */
+    uint32_t min_period;        /* CPU cycles */
+    uint32_t max_period;        /* CPU cycles, max - min is the jitter */
+} LTRACE_StatsTypeDef;
+
+/* Text sink for the VCD export, e.g. a UART write */
+typedef void (*LTRACE_PutsTypeDef)(const char* text);
+
+/* Function prototypes */
+void LTRACE_Reset(void);
+void LTRACE_Sample(uint32_t led_bits);
+const LTRACE_StatsTypeDef* LTRACE_GetStats(uint8_t led);
+uint32_t LTRACE_GetDutyPermille(uint8_t led);
+uint32_t LTRACE_GetFrequencyHz(uint8_t led);
+uint32_t LTRACE_GetJitterCycles(uint8_t led);
+void LTRACE_ExportVCD(LTRACE_PutsTypeDef puts_fn);
+
+#endif /* LED_TRACE_H */
@@ -4,31 +4,57 @@
 #include <stdint.h>
 #include "hardware_drivers.h"
 
+/* LED pin map - the only place LED pins are listed.
+ * X(arg, led, port, pin): port is the MDR_PORTx letter, pin the bit number.
+ * Enum, masks, config table and init code are all generated from it. */
+#define LED_PIN_MAP(X, arg) \
+    X(arg, LED1, C, 2)      \
+    X(arg, LED2, A, 1)      \
+    X(arg, LED3, A, 5)      \
+    X(arg, LED4, A, 3)
+
+/* Every MDR_PORTx that can carry an LED */
+#define LED_FOR_EACH_PORT(X) X(A) X(B) X(C) X(D) X(E) X(F)
+
 /* LED definitions */
+#define LED_ENUM_ENTRY(arg, led, port, pin)     led,
 typedef enum {
-    LED1 = 0,  /* PORTA Pin 1 */
-    LED2 = 1,  /* PORTA Pin 5 */
-    LED3 = 2,  /* PORTA Pin 3 */
-    LED4 = 3,  /* PORTC Pin 2 */
+    LED_PIN_MAP(LED_ENUM_ENTRY, _)
     LED_COUNT
 } LED_TypeDef;
 
-/* LED pins configuration with bit masks */
-#define LED1_PIN    PORT_Pin_2
-#define LED1_PORT   MDR_PORTC
-#define LED1_MASK   (1UL << 2)
+/* Compile-time pin masks */
+#define LED_PORTID_A    0
+#define LED_PORTID_B    1
+#define LED_PORTID_C    2
+#define LED_PORTID_D    3
+#define LED_PORTID_E    4
+#define LED_PORTID_F    5
+#define LED_PORTID_COUNT 6
+
+#define LED_PIN_MASK(pin)                       (1UL << (pin))
+#define LED_MASK_IF_PORT(p, led, port, pin) \
+    | ((LED_PORTID_##port == LED_PORTID_##p) ? LED_PIN_MASK(pin) : 0UL)
+
+#define LED_MASK2_IF_PORT(p, led, port, pin) \
+    | ((LED_PORTID_##port == LED_PORTID_##p) ? (3UL << (2 * (pin))) : 0UL)
+
+/* All LED pins on MDR_PORTp merged into one mask, 0 if the port is unused */
+#define LED_PORT_MASK(p)    (0UL LED_PIN_MAP(LED_MASK_IF_PORT, p))
+/* Same for the 2-bit-per-pin FUNC and PWR fields */
+#define LED_PORT_MASK2(p)   (0UL LED_PIN_MAP(LED_MASK2_IF_PORT, p))
+/* PWR field value selecting PORT_SPEED_FAST for every LED pin */
+#define LED_PORT_PWR_FAST(p) (LED_PORT_MASK2(p) & 0xAAAAAAAAUL)
 
-#define LED2_PIN    PORT_Pin_1
-#define LED2_PORT   MDR_PORTA  
-#define LED2_MASK   (1UL << 1)
+/* Bit-band alias word of an LED pin in its port RXTX, 1 = on */
+#define LED_PIN_ALIAS(port, pin) \
+    HD_BITBAND_ADDR(HD_PORT_RXTX_ADDR(MDR_PORT##port##_BASE), pin)
 
-#define LED3_PIN    PORT_Pin_5
-#define LED3_PORT   MDR_PORTA
-#define LED3_MASK   (1UL << 5)
+/* Also show every rendered frame on the row/column matrix (led_matrix.c) */
+// #define LED_MATRIX
 
-#define LED4_PIN    PORT_Pin_3
-#define LED4_PORT   MDR_PORTA
-#define LED4_MASK   (1UL << 3)
+/* LED pin edge recorder (led_trace.c), samples every LED pin write */
+// #define LED_TRACE
 
 /* Smart bit manipulation macros */
 #define BIT_SET(reg, mask)      ((reg) |= (mask))
@@ -36,39 +62,253 @@ typedef enum {
 #define BIT_TGL(reg, mask)      ((reg) ^= (mask))
 #define BIT_GET(reg, mask)      (((reg) & (mask)) != 0)
 
-/* LED direct register operations */
-#define LED_REG_ON(port)        BIT_SET((port)->RXTX, mask)
-#define LED_REG_OFF(port)       BIT_CLR((port)->RXTX, mask)
-#define LED_REG_TOGGLE(port)    BIT_TGL((port)->RXTX, mask)
-
 /* PWM Wave parameters */
 #define DEFAULT_PWM_PERIOD  1500
 #define DEFAULT_WAVE_SPEED  1
+#define LED_PWM_STEPS       100
+#define LED_PWM_BITS        7       /* bits needed for 0..LED_PWM_STEPS */
+#define LED_NO_EVENT        0xFFFFFFFFUL
+
+/* Wave frame cache. The wave repeats every pwm_period / gcd(pwm_period,
+ * wave_speed) distinct frames; each is computed once, the first time it
+ * plays, and looked up after that. A cycle longer than the budget is
+ * computed every frame as before. */
+#define LED_WAVE_CACHE_BYTES    6144    /* 4 bytes per frame, default cycle is 1500 */
+#define LED_WAVE_CACHE_FRAMES   (LED_WAVE_CACHE_BYTES / 4)
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;            /* frames computed and stored */
+    uint32_t bypassed;          /* frames computed, cycle over budget */
+    uint32_t cycle_frames;      /* frames in the current cycle */
+    uint32_t bytes_used;        /* frames plus valid bits in use */
+} LED_WaveCacheStatsTypeDef;
+
+/* Adaptive quality, each level keeps the reductions of the ones below */
+typedef enum {
+    LED_QUALITY_FULL        = 0,
+    LED_QUALITY_HALF_RATE   = 1,    /* wave advances every 2nd tick */
+    LED_QUALITY_COARSE_PWM  = 2,    /* duty in steps of 4 - fewer edges */
+    LED_QUALITY_SKIP_FRAMES = 3     /* only every 4th frame is rendered */
+} LED_QualityTypeDef;
+
+/* Pin output modes. PWM repeats a LED_PWM_STEPS-tick pattern (10 Hz at
+ * 1 ms ticks); sigma-delta spreads the on-ticks evenly over time from the
+ * full 8-bit level, pushing the flicker energy to high frequencies. */
+typedef enum {
+    LED_OUTPUT_PWM = 0,
+    LED_OUTPUT_SD1 = 1,         /* first-order sigma-delta */
+    LED_OUTPUT_SD2 = 2          /* second-order, noise shaped further up */
+} LED_OutputModeTypeDef;
+
+#define LED_SD_FULL_SCALE       255
+
+/* Sequence chasers. Each is a run of 'width' lit LEDs kept as a bitmask
+ * (bit n = LED n) and moved one LED per step: rotated for FORWARD and
+ * BACKWARD, shifted and turned round at the ends for BOUNCE. */
+typedef enum {
+    LED_CHASE_FORWARD  = 0,     /* towards higher LED numbers, wraps */
+    LED_CHASE_BACKWARD = 1,     /* towards lower LED numbers, wraps */
+    LED_CHASE_BOUNCE   = 2      /* back and forth between the ends */
+} LED_ChaseTypeDef;
+
+typedef struct {
+    uint8_t first;              /* lowest LED of the run at start */
+    uint8_t width;              /* 1..LED_COUNT */
+    LED_ChaseTypeDef mode;
+} LED_ChaserTypeDef;
+
+#define LED_CHASERS_MAX         4
+#define LED_ALL_MASK            ((1UL << LED_COUNT) - 1)
+
+#define LED_QUALITY_WINDOW_MS   1000    /* policy evaluation period */
+#define LED_QUALITY_DEGRADE_AT  2       /* overruns + drops per window */
+#define LED_QUALITY_RECOVER_MS  10000   /* clean time before stepping up */
+
+/* Effect parameters used by LED_Render, published as a whole.
+ * Writers (thread level, one at a time) bump seq to odd, write, bump
+ * it to even again; the renderer takes a copy at a frame start only if
+ * seq was even and unchanged around the copy, so a frame never mixes
+ * fields of two configs and nobody masks interrupts or waits. */
+typedef struct {
+    uint32_t wave_speed;
+    uint32_t pwm_period;        /* must not be 0 */
+    uint8_t  brightness;        /* 0..255 global scaler */
+} LED_EffectConfigTypeDef;
+
+typedef struct {
+    volatile uint32_t seq;      /* odd while being written */
+    LED_EffectConfigTypeDef config;
+} LED_ConfigBlockTypeDef;
+
+/* Batched parameter update, applied as a whole before the next rendered
+ * frame: config fields and effect changes show up in the same frame. */
+#define LED_PARAM_WAVE_SPEED    (1UL << 0)
+#define LED_PARAM_PWM_PERIOD    (1UL << 1)
+#define LED_PARAM_SEQUENCE      (1UL << 2)
+#define LED_PARAM_BRIGHTNESS    (1UL << 3)
+#define LED_PARAM_WAVE_ENABLE   (1UL << 4)
+
+typedef struct {
+    uint32_t fields;            /* LED_PARAM_xxx bits that are valid */
+    uint32_t wave_speed;
+    uint32_t pwm_period;        /* must not be 0 */
+    uint32_t sequence_delay;    /* 0 stops the sequence */
+    uint8_t  brightness;        /* 0..255 global scaler */
+    uint8_t  wave_enable;
+} LED_ParamsTypeDef;
+
+/* Brightness frame published from LED_Render() to LED_Process().
+ * The duty of every LED is also kept bit-sliced: plane[port][b] holds the
+ * RXTX pin mask of all LEDs on that port whose duty has bit b set. */
+typedef struct {
+    uint8_t level[LED_COUNT];   /* PWM duty, 0..LED_PWM_STEPS */
+    uint8_t value[LED_COUNT];   /* composed level 0..255, sigma-delta input */
+    uint32_t plane[LED_PORTID_COUNT][LED_PWM_BITS];
+} LED_FrameTypeDef;
+
+/**
+  * @brief  Bit-sliced duty > step compare for every pin of a port at once
+  * @note   LED_PWM_BITS word operations whatever the number of pins
+  * @param  plane: LED_PWM_BITS duty bit planes of the port, MSB last
+  * @param  step: current PWM step
+  * @param  pins: LED pins of the port
+  * @retval Pins to drive high
+  */
+static inline uint32_t LED_PwmCompare(const uint32_t* plane, uint32_t step, uint32_t pins)
+{
+    uint32_t gt = 0;    // Pins already known to have duty > step
+    uint32_t eq = pins; // Pins whose duty matches step in the bits so far
+
+    for (int b = LED_PWM_BITS - 1; b >= 0; b--) {
+        uint32_t s = 0UL - ((step >> b) & 1UL);
+        gt |= eq & plane[b] & ~s;
+        eq &= ~(plane[b] ^ s);
+    }
+    return gt;
+}
+
+/* Complete state of the LED engine. The driver runs one instance; it is
+ * kept in one object so the engine can be reset, inspected or swapped as
+ * a whole (LED_SetEngine). Pin map, compositor and pattern decoder are
+ * hardware-wide and not part of it. */
+typedef struct {
+    // Single LED control
+    uint8_t led_state[LED_COUNT];
+    uint32_t led_start[LED_COUNT];
+
+    // Sequence control
+    uint8_t sequence_active;
+    uint8_t chaser_count;
+    uint8_t chase_backward;                 /* bit n: chaser n moves down */
+    uint8_t chase_bounce;                   /* bit n: chaser n bounces */
+    uint32_t chase_mask[LED_CHASERS_MAX];
+    uint32_t sequence_start_time;
+    uint32_t led_on_time;
+    volatile uint32_t sequence_frame;       /* LCOMP_Pixel4 */
+
+    // Effect parameters: published block and the copy in use
+    LED_ConfigBlockTypeDef published;
+    LED_EffectConfigTypeDef config;
+    uint32_t config_seq;
+
+    // PWM wave control
+    uint32_t pwm_counter;
+    uint8_t wave_active;
+    uint32_t last_pwm_update;
+    uint32_t pwm_step;
+    uint32_t last_process_time;
+
+    // Output mode and sigma-delta integrators
+    LED_OutputModeTypeDef output_mode;
+    int32_t sd_acc1[LED_COUNT];
+    int32_t sd_acc2[LED_COUNT];
+
+    // Compressed pattern playback
+    uint8_t pattern_active;
+
+    // Sound-reactive band levels (audio_fft.c)
+    uint8_t audio_active;
+
+    // Adaptive quality
+    volatile LED_QualityTypeDef quality;
+    volatile uint32_t window_faults;
+    uint32_t window_start;
+    uint32_t clean_since;
+    volatile uint32_t frame_drops;
+    uint32_t render_count;
+
+    // Output scaling, brightness is in the effect config
+    uint8_t ambient_level;
+
+    // Batched update handed from thread level to LED_Process()
+    LED_ParamsTypeDef pending_params;
+    volatile uint8_t params_pending;
+
+    // Double-buffered frames: LED_Render() fills the back buffer,
+    // LED_Process() only reads the front one
+    LED_FrameTypeDef frames[2];
+    LED_FrameTypeDef * volatile front_frame;
+    volatile uint8_t frame_request;
+    volatile uint32_t frames_rendered;
+} LED_EngineTypeDef;
 
 
 /* Function prototypes - Basic LED control */
 void LED_Init(void);
+void LED_EngineInit(LED_EngineTypeDef* engine);
+LED_EngineTypeDef* LED_SetEngine(LED_EngineTypeDef* engine);
 void LED_On(LED_TypeDef led);
 void LED_On_ms(LED_TypeDef led, uint32_t ms);
 void LED_Off(LED_TypeDef led);
 void LED_Toggle(LED_TypeDef led);
 void LED_SetState(LED_TypeDef led, uint8_t state);
+/* Pin readback through the bit-band alias, 1 = pin high. Follows the PWM
+ * and sequence output too, not only the last LED_On/Off/SetState call. */
 uint8_t LED_GetState(LED_TypeDef led);
 void LED_AllOn(void);
 void LED_AllOff(void);
 void LED_Process(void);
+void LED_Render(void);
+bool LED_RenderPending(void);
+uint32_t LED_GetFrameCount(void);
+uint32_t LED_GetPinBits(void);
+uint32_t LED_NextEventUs(void);
+void LED_ReportOverrun(void);
+LED_QualityTypeDef LED_GetQualityLevel(void);
+const LED_WaveCacheStatsTypeDef* LED_GetWaveCacheStats(void);
+uint32_t LED_GetFrameDrops(void);
 
 /* Function prototypes - Sequence control */
 void LED_Sequence(uint32_t delay_time);
+HD_StatusTypeDef LED_SequenceChasers(const LED_ChaserTypeDef* chasers, uint8_t count,
+                                     uint32_t delay_time);
 void LED_SequenceStop(void);
 uint8_t LED_SequenceIsActive(void);
 
+/* Function prototypes - Compressed pattern playback */
+HD_StatusTypeDef LED_StartPattern(const uint8_t* data, uint32_t size);
+void LED_StopPattern(void);
+uint8_t LED_PatternIsActive(void);
+
+/* Function prototypes - Sound-reactive layer, needs ADCIN_AUDIO */
+void LED_StartAudio(void);
+void LED_StopAudio(void);
+uint8_t LED_AudioIsActive(void);
+
 /* Function prototypes - PWM Wave control */
 void LED_StartPWMWave(void);
 void LED_StopPWMWave(void);
-void LED_SetWaveSpeed(uint32_t speed);
-void LED_SetPWMPeriod(uint32_t period);
+HD_StatusTypeDef LED_SetWaveSpeed(uint32_t speed);
+HD_StatusTypeDef LED_SetPWMPeriod(uint32_t period);
 uint8_t LED_PWMWaveIsActive(void);
+HD_StatusTypeDef LED_SetBrightness(uint8_t level);
+void LED_SetAmbientLevel(uint8_t level);
+void LED_SetOutputMode(LED_OutputModeTypeDef mode);
+LED_OutputModeTypeDef LED_GetOutputMode(void);
+HD_StatusTypeDef LED_SubmitParams(const LED_ParamsTypeDef* params);
+HD_StatusTypeDef LED_SetEffectConfig(const LED_EffectConfigTypeDef* config);
+void LED_GetEffectConfig(LED_EffectConfigTypeDef* config);
 void LED_ProcessPWM(void);
 
 
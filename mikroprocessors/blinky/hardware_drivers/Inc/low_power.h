@@ -0,0 +1,36 @@
+#ifndef LOW_POWER_H
+#define LOW_POWER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware_drivers.h"
+
+/* RTC-timed deep sleep for slow effects. While sleeping, SysTick and
+ * TIMER1 are stopped, the CPU runs from LSE (LSI if LSE does not start)
+ * and HSI is switched off. An RTC alarm wakes the core shortly before
+ * the next LED change, then clocks, tick counter and DWT are restored.
+ *
+ * Peripherals clocked from HSI stop too: UART reception and ADC sampling
+ * pause while asleep, so enable only when those are not needed. */
+
+#define LP_RTC_DIV          32          /* LSE 32768 Hz -> 1024 counts/s */
+#define LP_MIN_SLEEP_MS     20          /* shorter gaps stay in plain WFI */
+#define LP_WAKE_US          1500        /* HSI start + clock switch back */
+#define LP_DRIFT_PPM        0           /* RTC source error, + = runs fast */
+
+typedef struct {
+    uint32_t sleeps;
+    uint32_t slept_ms;
+    int32_t last_late_counts;   /* wake vs. alarm, RTC counts; checks LP_WAKE_US */
+    int32_t max_late_counts;
+    uint32_t rtc_hz;            /* 0 until LP_Init found a clock */
+} LP_StatsTypeDef;
+
+/* Function prototypes */
+HD_StatusTypeDef LP_Init(void);
+void LP_Enable(bool enable);
+HD_StatusTypeDef LP_Sleep(uint32_t us);
+const LP_StatsTypeDef* LP_GetStats(void);
+void BACKUP_IRQHandler(void);
+
+#endif /* LOW_POWER_H */
@@ -0,0 +1,42 @@
+#ifndef PARAM_STORE_H
+#define PARAM_STORE_H
+
+#include <stdint.h>
+#include "hardware_drivers.h"
+
+/* Flash area used by the store: the last two 4 KB pages of main flash.
+ * The scatter file (RTE/Device/MDR32F9Q2I/MDR32F9Q2I.sct) ends IROM1
+ * there so code never lands here. */
+#define PARAM_PAGE_SIZE         0x1000UL
+#define PARAM_PAGE0_ADDR        0x0801E000UL
+#define PARAM_PAGE1_ADDR        (PARAM_PAGE0_ADDR + PARAM_PAGE_SIZE)
+
+/* Page header: magic + generation, then 8-byte records until the page end */
+#define PARAM_PAGE_MAGIC        0x504D5331UL    /* "PMS1" */
+#define PARAM_HEADER_SIZE       8UL
+#define PARAM_RECORD_SIZE       8UL
+
+/* Stored parameters */
+typedef enum {
+    PARAM_WAVE_SPEED  = 0,
+    PARAM_PWM_PERIOD  = 1,
+    PARAM_EFFECT      = 2,
+    PARAM_BRIGHTNESS  = 3,
+    PARAM_WAVE_ENABLE = 4,
+    PARAM_KEY_COUNT
+} PARAM_KeyTypeDef;
+
+/* Values for PARAM_EFFECT */
+typedef enum {
+    PARAM_EFFECT_WAVE = 0,
+    PARAM_EFFECT_SEQUENCE = 1
+} PARAM_EffectTypeDef;
+
+/* Function prototypes */
+void PARAM_Init(void);
+HD_StatusTypeDef PARAM_Get(PARAM_KeyTypeDef key, uint32_t* value);
+HD_StatusTypeDef PARAM_Set(PARAM_KeyTypeDef key, uint32_t value);
+HD_StatusTypeDef PARAM_Process(void);
+uint8_t PARAM_IsBusy(void);
+
+#endif /* PARAM_STORE_H */
@@ -0,0 +1,51 @@
+#ifndef UART_CMD_H
+#define UART_CMD_H
+
+#include <stdint.h>
+#include "hardware_drivers.h"
+
+/* Frame format on the wire:
+ *   COBS( seq | cmd len data | cmd len data | ... | crc16_hi crc16_lo ) 0x00
+ * CRC16 (HD_CRC16) covers seq and all commands. All commands of one frame
+ * are applied together before the next rendered frame. The device
+ * answers every frame with COBS( seq status ) 0x00. */
+
+/* Receive DMA: two ping-pong halves of one contiguous ring */
+#define UCMD_RX_HALF_SIZE       64
+#define UCMD_MAX_FRAME          48
+
+/* Reply queue, drained into the UART TX FIFO by UCMD_Process */
+#define UCMD_TX_SIZE            64      /* power of two, 16 replies */
+
+/* Commands */
+#define UCMD_SET_WAVE_SPEED     0x01    /* u32 LE */
+#define UCMD_SET_PWM_PERIOD     0x02    /* u32 LE, not 0 */
+#define UCMD_SET_SEQUENCE       0x03    /* u32 LE delay in ms, 0 = stop */
+#define UCMD_SET_BRIGHTNESS     0x04    /* u8 */
+#define UCMD_SET_WAVE_ENABLE    0x05    /* u8 */
+#define UCMD_SAVE               0x06    /* no data, persist this frame's values */
+
+/* Reply status, same values as HD_StatusTypeDef */
+#define UCMD_REPLY_OK           HD_OK
+#define UCMD_REPLY_ERROR        HD_ERROR
+#define UCMD_REPLY_BUSY         HD_BUSY
+
+/* Link statistics */
+typedef struct {
+    uint32_t frames_ok;
+    uint32_t frames_bad;        /* COBS, CRC or command errors */
+    uint32_t frames_busy;       /* previous batch not applied yet */
+    uint32_t bytes_rx;
+    uint32_t rx_overruns;       /* RX DMA stopped with both halves full */
+    uint32_t rx_lapped;         /* ring overwritten before it was read */
+    uint32_t replies_dropped;   /* reply queue full */
+    uint32_t max_parse_cycles;  /* delimiter seen to batch submitted */
+} UCMD_StatsTypeDef;
+
+/* Function prototypes */
+void UCMD_Init(void);
+void UCMD_Process(void);
+void UCMD_RxDMAHandler(void);
+const UCMD_StatsTypeDef* UCMD_GetStats(void);
+
+#endif /* UART_CMD_H */
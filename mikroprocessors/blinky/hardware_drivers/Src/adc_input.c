@@ -0,0 +1,189 @@
+#include "adc_input.h"
+#include "main.h"
+#include "leds.h"
+#include "audio_fft.h"
+#include "MDR32FxQI_adc.h"
+#include "MDR32FxQI_dma.h"
+#include "hd_fast.h"
+
+/* ADC1 converts continuously, DMA moves every result into one of two
+ * ping-pong halves, and the CPU only runs when a half is full. */
+
+#define ADCIN_DMA_CHANNEL       DMA_Channel_ADC1
+
+static uint16_t adc_buf[2][ADCIN_BLOCK_SIZE];
+static DMA_CtrlDataInitTypeDef adc_pri;
+static DMA_CtrlDataInitTypeDef adc_alt;
+
+// Filter state, Q16 fraction of the 12-bit full scale
+static uint32_t iir_state = 0;
+static volatile uint16_t filtered = 0;
+static volatile uint32_t block_count = 0;
+static volatile uint32_t overrun_count = 0;
+
+/**
+  * @brief  Starts continuous ADC1 conversion into the ping-pong DMA buffer
+  */
+void ADCIN_Init(void)
+{
+    PORT_InitTypeDef port_init;
+    ADC_InitTypeDef adc_init;
+    ADCx_InitTypeDef adc1_init;
+    DMA_ChannelInitTypeDef dma_init;
+
+    RST_CLK_PCLKcmd(RST_CLK_PCLK_PORTD | RST_CLK_PCLK_ADC | RST_CLK_PCLK_DMA, ENABLE);
+
+    PORT_StructInit(&port_init);
+    port_init.PORT_Pin = ADCIN_PIN;
+    port_init.PORT_OE = PORT_OE_IN;
+    port_init.PORT_MODE = PORT_MODE_ANALOG;
+    PORT_Init(ADCIN_PORT, &port_init);
+
+    ADC_DeInit();
+    ADC_StructInit(&adc_init);
+    ADC_Init(&adc_init);
+
+    /* Sample rate is set by the ADC clock divider and start delay */
+    ADCx_StructInit(&adc1_init);
+    adc1_init.ADC_ClockSource = ADC_CLOCK_SOURCE_CPU;
+    adc1_init.ADC_SamplingMode = ADC_SAMPLING_MODE_CYCLIC_CONV;
+    adc1_init.ADC_ChannelSwitching = ADC_CH_SWITCHING_Disable;
+    adc1_init.ADC_ChannelNumber = ADC_CH_ADC7;
+    adc1_init.ADC_LevelControl = ADC_LEVEL_CONTROL_Disable;
+    adc1_init.ADC_VRefSource = ADC_VREF_SOURCE_INTERNAL;
+    adc1_init.ADC_IntVRefSource = ADC_INT_VREF_SOURCE_INEXACT;
+    adc1_init.ADC_Prescaler = ADCIN_PRESCALER;
+    adc1_init.ADC_DelayGo = 7;
+    ADC1_Init(&adc1_init);
+
+    /* Low half-word of ADC1_RESULT is the 12-bit sample */
+    adc_pri.DMA_SourceBaseAddr = (uint32_t)(uintptr_t)&MDR_ADC->ADC1_RESULT;
+    adc_pri.DMA_DestBaseAddr = (uint32_t)(uintptr_t)adc_buf[0];
+    adc_pri.DMA_SourceIncSize = DMA_SourceIncNo;
+    adc_pri.DMA_DestIncSize = DMA_DestIncHalfword;
+    adc_pri.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    adc_pri.DMA_Mode = DMA_Mode_PingPong;
+    adc_pri.DMA_CycleSize = ADCIN_BLOCK_SIZE;
+    adc_pri.DMA_NumContinuous = DMA_Transfers_1;
+    adc_pri.DMA_SourceProtCtrl = DMA_SourcePrivileged;
+    adc_pri.DMA_DestProtCtrl = DMA_DestPrivileged;
+
+    adc_alt = adc_pri;
+    adc_alt.DMA_DestBaseAddr = (uint32_t)(uintptr_t)adc_buf[1];
+
+    dma_init.DMA_PriCtrlData = &adc_pri;
+    dma_init.DMA_AltCtrlData = &adc_alt;
+    dma_init.DMA_Priority = DMA_Priority_Default;
+    dma_init.DMA_UseBurst = DMA_BurstClear;
+    dma_init.DMA_SelectDataStructure = DMA_CTRL_DATA_PRIMARY;
+    DMA_Init(ADCIN_DMA_CHANNEL, &dma_init);
+
+    NVIC_SetPriority(DMA_IRQn, 3);
+    NVIC_EnableIRQ(DMA_IRQn);
+    DMA_Cmd(ADCIN_DMA_CHANNEL, ENABLE);
+
+    ADC1_Cmd(ENABLE);
+    ADC1_Start();
+}
+
+/**
+  * @brief  Filters one finished block and passes it on
+  */
+static void process_block(const uint16_t* samples)
+{
+    uint16_t level = ADCIN_FilterBlock(samples);
+
+    filtered = level;
+    block_count++;
+#ifdef ADCIN_AUDIO
+    AFFT_PushBlock(samples);
+#else
+    LED_SetAmbientLevel((uint8_t)((level >> 4) < ADCIN_MIN_LEVEL ? ADCIN_MIN_LEVEL : (level >> 4)));
+#endif
+}
+
+/**
+  * @brief  Decimates one block and runs the IIR on the result
+  * @param  samples: ADCIN_BLOCK_SIZE raw ADC1_RESULT values
+  * @retval Filtered 12-bit level
+  */
+uint16_t ADCIN_FilterBlock(const uint16_t* samples)
+{
+    uint32_t sum = 0;
+    uint32_t x;
+
+    for (uint32_t i = 0; i < ADCIN_BLOCK_SIZE; i++) {
+        sum += samples[i] & 0x0FFFU;
+    }
+
+    /* Block mean in Q16, then y += (x - y) / 2^ADCIN_IIR_SHIFT */
+    x = sum << (16 - ADCIN_BLOCK_SHIFT);
+    if (x >= iir_state) {
+        iir_state += (x - iir_state) >> ADCIN_IIR_SHIFT;
+    } else {
+        iir_state -= (iir_state - x) >> ADCIN_IIR_SHIFT;
+    }
+
+    return (uint16_t)(iir_state >> 16);
+}
+
+/**
+  * @brief  Handles finished blocks (DMA interrupt context)
+  * @note   The DMA interrupt is shared; a half is done when its control
+  *         structure reads stopped. The order comes from the channel, not
+  *         from a copy kept here that a DMA_Init would leave stale: it
+  *         points at the half it fills next, or with both done at the
+  *         older one it stopped on. Samples were missed only if the
+  *         channel got to a stopped half, then it is disabled: it is
+  *         re-enabled and an overrun is counted.
+  */
+void ADCIN_DMAHandler(void)
+{
+    uint32_t done[2];
+    uint32_t half;
+
+    done[0] = HD_DMA_StructDone(ADCIN_DMA_CHANNEL, 0);
+    done[1] = HD_DMA_StructDone(ADCIN_DMA_CHANNEL, 1);
+    half = (DMA_GetFlagStatus(ADCIN_DMA_CHANNEL, DMA_FLAG_CHNL_ALT) != RESET);
+    if (!(done[0] && done[1])) {
+        half ^= 1U;
+    }
+
+    for (uint32_t i = 0; i < 2; i++, half ^= 1U) {
+        if (done[half]) {
+            /* Re-armed half is written only after the other one fills */
+            DMA_CtrlInit(ADCIN_DMA_CHANNEL, half ? DMA_CTRL_DATA_ALTERNATE : DMA_CTRL_DATA_PRIMARY,
+                         half ? &adc_alt : &adc_pri);
+            process_block(adc_buf[half]);
+        }
+    }
+
+    if ((done[0] || done[1]) && DMA_GetFlagStatus(ADCIN_DMA_CHANNEL, DMA_FLAG_CHNL_ENA) == RESET) {
+        overrun_count++;
+        DMA_Cmd(ADCIN_DMA_CHANNEL, ENABLE);
+    }
+}
+
+/**
+  * @brief  Latest filtered 12-bit level
+  */
+uint16_t ADCIN_GetFiltered(void)
+{
+    return filtered;
+}
+
+/**
+  * @brief  Number of blocks processed since init
+  */
+uint32_t ADCIN_GetBlockCount(void)
+{
+    return block_count;
+}
+
+/**
+  * @brief  Times the DMA channel stopped with both halves full
+  */
+uint32_t ADCIN_GetOverrunCount(void)
+{
+    return overrun_count;
+}
@@ -0,0 +1,230 @@
+#include "audio_fft.h"
+#include "adc_input.h"
+#include "main.h"
+
+/* The DMA interrupt only copies a finished ADC block (AFFT_PushBlock);
+ * transform and band analysis run at thread level from LED_Render. */
+
+typedef char afft_size_is_one_block[(AFFT_SIZE == ADCIN_BLOCK_SIZE) ? 1 : -1];
+typedef char afft_size_in_table[(AFFT_LOG2 >= 5 && AFFT_LOG2 <= AFFT_MAX_LOG2) ? 1 : -1];
+
+/* sin(2*pi*k / AFFT_MAX_SIZE) in Q15, k = 0..AFFT_MAX_SIZE/4 */
+static const int16_t sine_q15[AFFT_MAX_SIZE / 4 + 1] = {
+        0,  3212,  6393,  9512, 12539, 15446, 18204, 20787,
+    23170, 25329, 27245, 28898, 30273, 31356, 32137, 32609,
+    32767
+};
+
+/* Below this every |re|, |im| is at most 0x2000, so every value has a
+ * complex magnitude of at most sqrt(2) * 0x2000. With |w| <= 1 a
+ * butterfly output a +- w*b is at most |a| + |b|, twice the largest
+ * input magnitude: 2 * sqrt(2) * 0x2000 = 23170 < 32768, so no
+ * component of the stage's output can overflow */
+#define AFFT_SAFE_BITS          0x1FFFU
+
+static uint16_t input[AFFT_SIZE];
+static volatile uint8_t input_ready = 0;
+static AFFT_ComplexTypeDef work[AFFT_SIZE];
+static uint8_t band_level[LCOMP_CHANNELS];
+static LCOMP_Pixel4 frame = 0;
+static uint32_t fft_cycles = 0;
+
+/* OR of all |re| and |im| (one's complement for negatives), an upper
+ * bound of the largest magnitude bit */
+static uint32_t magnitude_bits(const AFFT_ComplexTypeDef* x, uint32_t n)
+{
+    uint32_t bits = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        bits |= (uint32_t)(x[i].re ^ (x[i].re >> 15)) | (uint32_t)(x[i].im ^ (x[i].im >> 15));
+    }
+    return bits & 0xFFFFU;
+}
+
+static void scale_half(AFFT_ComplexTypeDef* x, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        x[i].re >>= 1;
+        x[i].im >>= 1;
+    }
+}
+
+/* In-place bit reversal permutation */
+static void bit_reverse(AFFT_ComplexTypeDef* x, uint32_t n)
+{
+    uint32_t j = 0;
+
+    for (uint32_t i = 0; i < n - 1; i++) {
+        if (i < j) {
+            AFFT_ComplexTypeDef t = x[i];
+
+            x[i] = x[j];
+            x[j] = t;
+        }
+        uint32_t bit = n >> 1;
+        while (j & bit) {
+            j ^= bit;
+            bit >>= 1;
+        }
+        j |= bit;
+    }
+}
+
+/**
+  * @brief  In-place forward FFT, Q15 with block floating point
+  * @param  x: 2^log2n values, natural order in and out
+  * @param  log2n: transform size, at most AFFT_MAX_LOG2
+  * @retval Block exponent: the true spectrum is x * 2^exponent
+  */
+int32_t AFFT_Transform(AFFT_ComplexTypeDef* x, uint32_t log2n)
+{
+    uint32_t n = 1UL << log2n;
+    int32_t exponent = 0;
+
+    bit_reverse(x, n);
+
+    for (uint32_t half = 1; half < n; half <<= 1) {
+        /* Twiddle k of this stage is table step k * stride */
+        uint32_t stride = AFFT_MAX_SIZE / (2 * half);
+
+        if (magnitude_bits(x, n) > AFFT_SAFE_BITS) {
+            scale_half(x, n);
+            exponent++;
+        }
+
+        for (uint32_t k = 0; k < half; k++) {
+            uint32_t t = k * stride;
+            int32_t c, s;
+
+            /* w = cos - j sin of 2*pi*t / AFFT_MAX_SIZE, t < AFFT_MAX_SIZE/2 */
+            if (t <= AFFT_MAX_SIZE / 4) {
+                c = sine_q15[AFFT_MAX_SIZE / 4 - t];
+                s = sine_q15[t];
+            } else {
+                c = -sine_q15[t - AFFT_MAX_SIZE / 4];
+                s = sine_q15[AFFT_MAX_SIZE / 2 - t];
+            }
+
+            for (uint32_t i = k; i < n; i += 2 * half) {
+                AFFT_ComplexTypeDef *a = &x[i];
+                AFFT_ComplexTypeDef *b = &x[i + half];
+                int32_t pr = (b->re * c + b->im * s) >> 15;
+                int32_t pi = (b->im * c - b->re * s) >> 15;
+
+                b->re = (int16_t)(a->re - pr);
+                b->im = (int16_t)(a->im - pi);
+                a->re = (int16_t)(a->re + pr);
+                a->im = (int16_t)(a->im + pi);
+            }
+        }
+    }
+    return exponent;
+}
+
+/* 8 * log2(x), x > 0, mantissa linearly interpolated */
+static uint32_t log2_q3(uint64_t x)
+{
+    uint32_t hi = (uint32_t)(x >> 32);
+    uint32_t n = hi ? 63U - __CLZ(hi) : 31U - __CLZ((uint32_t)x);
+    uint32_t top = (uint32_t)((n >= 3) ? (x >> (n - 3)) : (x << (3 - n)));
+
+    return n * 8 + (top & 7U);
+}
+
+/**
+  * @brief  Clears the band levels and drops a pending block
+  */
+void AFFT_Reset(void)
+{
+    input_ready = 0;
+    frame = 0;
+    for (uint32_t b = 0; b < LCOMP_CHANNELS; b++) {
+        band_level[b] = 0;
+    }
+}
+
+/**
+  * @brief  Takes a finished ADC block (DMA interrupt context)
+  * @note   Dropped while the previous block has not been analysed yet
+  * @param  samples: AFFT_SIZE raw ADC1_RESULT values
+  */
+void AFFT_PushBlock(const uint16_t* samples)
+{
+    if (input_ready) {
+        return;
+    }
+    for (uint32_t i = 0; i < AFFT_SIZE; i++) {
+        input[i] = samples[i] & 0x0FFFU;
+    }
+    input_ready = 1;
+}
+
+/**
+  * @brief  Current band levels, updated when a new block has arrived
+  * @note   Band n covers octave n of bins 1..AFFT_SIZE/2-1 and drives
+  *         LED n. Levels rise at once and fall by AFFT_DECAY per block.
+  * @retval Frame for the audio layer
+  */
+LCOMP_Pixel4 AFFT_Next(void)
+{
+    uint32_t start;
+    uint32_t sum = 0;
+    int32_t mean;
+    int32_t exponent;
+
+    if (!input_ready) {
+        return frame;
+    }
+
+    start = DWT->CYCCNT;
+
+    /* Remove DC, 12-bit to Q15 */
+    for (uint32_t i = 0; i < AFFT_SIZE; i++) {
+        sum += input[i];
+    }
+    mean = (int32_t)(sum >> AFFT_LOG2);
+    for (uint32_t i = 0; i < AFFT_SIZE; i++) {
+        work[i].re = (int16_t)((input[i] - mean) * 8);
+        work[i].im = 0;
+    }
+    input_ready = 0;
+
+    exponent = AFFT_Transform(work, AFFT_LOG2);
+
+    frame = 0;
+    for (uint32_t b = 0; b < LCOMP_CHANNELS; b++) {
+        uint32_t lo = 1UL << ((b * (AFFT_LOG2 - 1)) / LCOMP_CHANNELS);
+        uint32_t hi = 1UL << (((b + 1) * (AFFT_LOG2 - 1)) / LCOMP_CHANNELS);
+        uint64_t power = 0;
+        int32_t level = 0;
+
+        for (uint32_t k = lo; k < hi; k++) {
+            power += (uint64_t)((int32_t)work[k].re * work[k].re) +
+                     (uint64_t)((int32_t)work[k].im * work[k].im);
+        }
+        if (power != 0) {
+            level = ((int32_t)log2_q3(power) + 16 * exponent -
+                     (AFFT_FULL_SCALE_Q3 - AFFT_RANGE_Q3)) * 255 / AFFT_RANGE_Q3;
+            level = (level < 0) ? 0 : (level > 255) ? 255 : level;
+        }
+        if (level < band_level[b] - AFFT_DECAY) {
+            level = band_level[b] - AFFT_DECAY;
+        }
+        band_level[b] = (uint8_t)((level < 0) ? 0 : level);
+        frame |= (LCOMP_Pixel4)band_level[b] << (8 * b);
+    }
+
+    start = DWT->CYCCNT - start;
+    if (start > fft_cycles) {
+        fft_cycles = start;
+    }
+    return frame;
+}
+
+/**
+  * @brief  Worst CPU cycles spent on one block (transform and bands)
+  */
+uint32_t AFFT_GetCycles(void)
+{
+    return fft_cycles;
+}
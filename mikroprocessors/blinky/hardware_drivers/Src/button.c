@@ -0,0 +1,81 @@
+#include "button.h"
+#include "main.h"
+
+/* Debounced push buttons. Pins are sampled through their bit-band alias,
+ * a press is counted once the level has been stable for BTN_DEBOUNCE_MS.
+ * Press counts only grow, so any number of readers can wait for the
+ * next press by remembering the count they last saw. */
+
+typedef struct {
+    __IO uint32_t* bb;      // Bit-band alias of the pin in RXTX
+    uint8_t raw;            // Last sampled level, 1 = pressed
+    uint8_t stable;         // Debounced level
+    uint32_t changed_at;    // Tick of the last raw change
+    volatile uint32_t presses;
+} BTN_StateTypeDef;
+
+#define BTN_STATE_ENTRY(arg, btn, port, pin) \
+    [btn] = { (__IO uint32_t*)HD_BITBAND_ADDR(HD_PORT_RXTX_ADDR(MDR_PORT##port##_BASE), pin) },
+
+static BTN_StateTypeDef buttons[BTN_COUNT] = {
+    BTN_PIN_MAP(BTN_STATE_ENTRY, _)
+};
+
+#define BTN_PORT_INIT(arg, btn, port, pin)                      \
+    RST_CLK_PCLKcmd(RST_CLK_PCLK_PORT##port, ENABLE);           \
+    port_init.PORT_Pin = (uint16_t)(1U << (pin));               \
+    PORT_Init(MDR_PORT##port, &port_init);
+
+/**
+  * @brief  Configures the button pins as inputs with pull-up
+  */
+void BTN_Init(void)
+{
+    PORT_InitTypeDef port_init;
+
+    PORT_StructInit(&port_init);
+    port_init.PORT_OE = PORT_OE_IN;
+    port_init.PORT_MODE = PORT_MODE_DIGITAL;
+    port_init.PORT_PULL_UP = PORT_PULL_UP_ON;
+    port_init.PORT_SPEED = PORT_SPEED_SLOW;
+
+    BTN_PIN_MAP(BTN_PORT_INIT, _)
+}
+
+/**
+  * @brief  Samples and debounces all buttons
+  * @param  now: current tick, call at least every few ms
+  */
+void BTN_Process(uint32_t now)
+{
+    for (uint32_t i = 0; i < BTN_COUNT; i++) {
+        BTN_StateTypeDef *b = &buttons[i];
+        uint8_t level = (uint8_t)(*b->bb == 0);
+
+        if (level != b->raw) {
+            b->raw = level;
+            b->changed_at = now;
+        } else if (level != b->stable && (now - b->changed_at) >= BTN_DEBOUNCE_MS) {
+            b->stable = level;
+            if (level) {
+                b->presses++;
+            }
+        }
+    }
+}
+
+/**
+  * @brief  Debounced button level
+  */
+uint8_t BTN_IsPressed(BTN_TypeDef btn)
+{
+    return (btn < BTN_COUNT) ? buttons[btn].stable : 0;
+}
+
+/**
+  * @brief  Number of presses since init
+  */
+uint32_t BTN_GetPressCount(BTN_TypeDef btn)
+{
+    return (btn < BTN_COUNT) ? buttons[btn].presses : 0;
+}
@@ -1,31 +1,148 @@
 #include "hardware_drivers.h"
 #include "main.h"
 #include "leds.h"
+#include "uart_cmd.h"
+#include "adc_input.h"
+#include "low_power.h"
+#include "hd_trace.h"
+#ifdef LED_MATRIX
+#include "led_matrix.h"
+#endif
 #include "MDR32FxQI_rst_clk.h"
 #include "MDR32FxQI_port.h"
 #include "MDR32FxQI_timer.h"
 
+/* Bit-band alias mapping, ARM reference values for both ends of the region */
+typedef char hd_bitband_first[(HD_BITBAND_ADDR(0x40000000UL, 0) == 0x42000000UL) ? 1 : -1];
+typedef char hd_bitband_last[(HD_BITBAND_ADDR(0x400FFFFCUL, 31) == 0x43FFFFFCUL) ? 1 : -1];
+typedef char hd_bitband_word[(HD_BITBAND_ADDR(0x40020000UL, 5) == 0x42400014UL) ? 1 : -1];
+
 /* Private variables */
-static volatile uint32_t tick_counter = 0;
+volatile uint32_t HD_TickCounter = 0;
+uint32_t HD_Timer1EntryCycles = 0;
 static uint32_t system_clock = 8000000; /* Default 8 MHz */
+static volatile uint32_t boot_cycles = 0;
+static HD_LatencyTypeDef pin_latency = { 0, 0xFFFFFFFFUL, 0 };
+
+/* TIMER1 event scheduling */
+static volatile uint32_t timer1_wakeups = 0;
+static volatile uint32_t timer1_overruns = 0;
+static volatile uint8_t timer1_in_handler = 0;   // LED_Process running in Timer1_IRQHandler
+
+/* CPU load accounting, running cycle totals wrap and are used as deltas */
+#define HD_LOAD_ONE         65536UL     /* Q16 */
+#define HD_LOAD_ALPHA_10S   6237UL      /* (1 - e^(-1/10)) in Q16 */
+#define HD_LOAD_ALPHA_60S   1083UL      /* (1 - e^(-1/60)) in Q16 */
+
+static volatile uint32_t idle_cycles = 0;
+static uint32_t isr_cycles[HD_ISR_COUNT];
+static uint32_t window_cycles = 0;
+static uint32_t window_idle = 0;
+static uint32_t window_isr[HD_ISR_COUNT];
+static uint32_t load[3];                /* Q16, indexed by HD_LoadWindowTypeDef */
+static uint32_t isr_load[HD_ISR_COUNT]; /* Q16, last second */
+static volatile uint32_t isr_total = 0; /* Sum of isr_cycles[] */
+static volatile uint32_t overload_count = 0;
+
+static void HD_UpdateLoad(void);
+
+/**
+  * @brief  Charges a handler with its own cycles, at handler exit
+  * @note   Handlers that preempted it added theirs to isr_total in the
+  *         meantime; that difference is taken off so nothing is counted
+  *         twice. Runs masked, a preemption between the read and the
+  *         write of isr_total would lose the inner handler's cycles.
+  * @param  isr: handler being left
+  * @param  start: DWT->CYCCNT at handler entry
+  * @param  nested: isr_total at handler entry
+  */
+static inline void HD_IsrAccount(HD_IsrTypeDef isr, uint32_t start, uint32_t nested)
+{
+    uint32_t primask = __get_PRIMASK();
+    uint32_t self;
+
+    __disable_irq();
+    self = (DWT->CYCCNT - start) - (isr_total - nested);
+    isr_cycles[isr] += self;
+    isr_total += self;
+    __set_PRIMASK(primask);
+}
 
 /* SysTick interrupt handler */
 void SysTick_Handler(void)
 {
+    uint32_t start = DWT->CYCCNT;
+    uint32_t nested = isr_total;
+
+    HD_TRACE(SYSTICK_BEGIN, 0);
     HD_IncrementTick();
+    if ((HD_TickCounter % 1000) == 0) {
+        HD_UpdateLoad();
+    }
+    if ((HD_TickCounter % HD_TRACE_ANCHOR_MS) == 0) {
+        HD_TRACE(ANCHOR, HD_TickCounter);
+    }
+    HD_TRACE(SYSTICK_END, 0);
+    HD_IsrAccount(HD_ISR_SYSTICK, start, nested);
 }
 
 /* TIMER1 interrupt handler for LED processing */
-void TIMER1_IRQHandler(void)
+void Timer1_IRQHandler(void)
 {
-    if (TIMER_GetITStatus(MDR_TIMER1, TIMER_STATUS_CNT_ARR)) {
-        TIMER_ClearITPendingBit(MDR_TIMER1, TIMER_STATUS_CNT_ARR);
+    uint32_t start = DWT->CYCCNT;
+    uint32_t nested = isr_total;
+
+    HD_Timer1EntryCycles = start;
+    HD_TRACE(TIMER1_BEGIN, 0);
+    if (HD_TIMER_ITPending(MDR_TIMER1, TIMER_STATUS_CNT_ARR)) {
+        HD_TIMER_ClearFlag(MDR_TIMER1, TIMER_STATUS_CNT_ARR);
         
-        /* Call LED process function */
+        /* Call LED process function, it may start effects that kick */
+        timer1_in_handler = 1;
         LED_Process();
+        timer1_in_handler = 0;
+        timer1_wakeups++;
+
+        /* Sleep until the next pin change instead of a fixed 1 ms.
+         * Overrun: the next event was already due before we got here,
+         * or another period elapsed while processing (flag pending again) */
+        if (HD_Timer1_ScheduleUs(LED_NextEventUs()) != HD_OK ||
+            HD_TIMER_FlagSet(MDR_TIMER1, TIMER_STATUS_CNT_ARR)) {
+            timer1_overruns++;
+            LED_ReportOverrun();
+        }
     }
+    HD_TRACE(TIMER1_END, 0);
+    HD_IsrAccount(HD_ISR_TIMER1, start, nested);
 }
 
+/* DMA interrupt handler, shared by every channel in ping-pong mode */
+void DMA_IRQHandler(void)
+{
+    uint32_t start = DWT->CYCCNT;
+    uint32_t nested = isr_total;
+
+    HD_TRACE(DMA_BEGIN, 0);
+    UCMD_RxDMAHandler();
+    ADCIN_DMAHandler();
+    HD_TRACE(DMA_END, 0);
+    HD_IsrAccount(HD_ISR_DMA, start, nested);
+}
+
+#ifdef LED_MATRIX
+/* TIMER2 interrupt handler, LED matrix scan */
+void Timer2_IRQHandler(void)
+{
+    uint32_t start = DWT->CYCCNT;
+    uint32_t nested = isr_total;
+
+    HD_TRACE(TIMER2_BEGIN, 0);
+    LMTX_ScanHandler();
+    HD_TRACE(TIMER2_END, 0);
+    HD_IsrAccount(HD_ISR_TIMER2, start, nested);
+}
+#endif
+
 /**
   * @brief  Initialize TIMER1 for LED processing
   * @param  None
@@ -44,9 +161,9 @@ void HD_Timer1_Init(void)
     /* Initialize timer structure */
     TIMER_CntStructInit(&timer_init);
     
-    /* Configure timer for 1ms period */
-    timer_init.TIMER_Prescaler = 0;          /* No prescaler */
-    timer_init.TIMER_Period = (system_clock / 1000) - 1;  /* 1ms period */
+    /* Configure timer for 1us counts, first event after 1ms */
+    timer_init.TIMER_Prescaler = (system_clock / 1000000) - 1;
+    timer_init.TIMER_Period = 1000 - 1;
     timer_init.TIMER_CounterMode = TIMER_CntMode_ClkFixedDir;
     timer_init.TIMER_CounterDirection = TIMER_CntDir_Up;
     timer_init.TIMER_EventSource = TIMER_EvSrc_TIM_CLK;
@@ -75,6 +192,80 @@ void HD_Timer1_Init(void)
 }
 
 
+/**
+  * @brief  Arms TIMER1 to fire once after the given delay
+  * @note   Called from Timer1_IRQHandler, CNT has just restarted from 0.
+  *         Delays longer than HD_TIMER1_MAX_US wake up early and the
+  *         LED engine simply schedules the rest.
+  * @param  us: delay in microseconds, LED_NO_EVENT for none
+  * @retval HD_OK, HD_TIMEOUT if the event was already due
+  */
+HD_StatusTypeDef HD_Timer1_ScheduleUs(uint32_t us)
+{
+    HD_StatusTypeDef status = HD_OK;
+    uint32_t cnt;
+
+    if (us > HD_TIMER1_MAX_US) {
+        us = HD_TIMER1_MAX_US;
+    }
+    if (us == 0) {
+        us = 1;
+    }
+
+    /* Never set ARR behind the counter, it would run a full 16-bit lap */
+    cnt = MDR_TIMER1->CNT;
+    if (us <= cnt + 1) {
+        us = cnt + 2;
+        status = HD_TIMEOUT;
+    }
+    MDR_TIMER1->ARR = us - 1;
+    return status;
+}
+
+/**
+  * @brief  Makes TIMER1 fire within a few microseconds
+  * @note   Used when the LED output changes outside the scheduled events.
+  *         Does nothing from LED_Process: the handler schedules the next
+  *         event right after it, and a kicked counter would make that
+  *         look like an overrun.
+  * @param  None
+  * @retval None
+  */
+void HD_Timer1_Kick(void)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    if (timer1_in_handler) {
+        return;
+    }
+
+    __disable_irq();
+    if (MDR_TIMER1->ARR > 2) {
+        MDR_TIMER1->CNT = MDR_TIMER1->ARR - 2;
+    }
+    __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Number of TIMER1 LED events since boot
+  * @param  None
+  * @retval Wakeups, compare with HD_GetTick() for interrupts saved
+  */
+uint32_t HD_GetTimer1Wakeups(void)
+{
+    return timer1_wakeups;
+}
+
+/**
+  * @brief  Number of TIMER1 LED events that ran over their budget
+  * @param  None
+  * @retval Overrun count since boot
+  */
+uint32_t HD_GetOverrunCount(void)
+{
+    return timer1_overruns;
+}
+
 /**
   * @brief  Initialize delay functionality using SysTick timer
   * @param  None
@@ -171,25 +362,196 @@ void HD_Delay_us_blocking(uint32_t us)
 }
 
 /**
-  * @brief  Get current tick count
+  * @brief  Increment tick counter (called from SysTick interrupt)
   * @param  None
-  * @retval Current tick value
+  * @retval None
   */
-uint32_t HD_GetTick(void)
+void HD_IncrementTick(void)
 {
-    return tick_counter;
+    HD_TickCounter++;
 }
 
 /**
-  * @brief  Increment tick counter (called from SysTick interrupt)
+  * @brief  Advance tick counter by time spent with SysTick stopped
+  * @param  ms: elapsed milliseconds
+  * @retval None
+  */
+void HD_AdvanceTick(uint32_t ms)
+{
+    HD_TickCounter += ms;
+}
+
+/**
+  * @brief  Sleeps until the next interrupt and counts the time as idle
+  * @note   Call once per pass of the main loop. Interrupts are masked
+  *         around the check so a frame requested just before WFI still
+  *         wakes the core; the handler runs after the idle time is taken.
   * @param  None
   * @retval None
   */
-void HD_IncrementTick(void)
+void HD_Idle(void)
 {
-    tick_counter++;
+    uint32_t start;
+
+    __disable_irq();
+    if (!LED_RenderPending()) {
+        start = DWT->CYCCNT;
+        /* Long gap to the next LED change: RTC deep sleep if enabled */
+        if (LP_Sleep(LED_NextEventUs()) != HD_OK) {
+            __WFI();
+        }
+        idle_cycles += DWT->CYCCNT - start;
+    }
+    __enable_irq();
+}
+
+/* y += (x - y) * alpha, all Q16 */
+static uint32_t HD_LoadAverage(uint32_t y, uint32_t x, uint32_t alpha)
+{
+    if (x >= y) {
+        return y + (((x - y) * alpha) >> 16);
+    }
+    return y - (((y - x) * alpha) >> 16);
 }
 
+/**
+  * @brief  Closes a one second window (SysTick context)
+  * @param  None
+  * @retval None
+  */
+static void HD_UpdateLoad(void)
+{
+    uint32_t now = DWT->CYCCNT;
+    uint32_t idle = idle_cycles;
+    uint32_t total = now - window_cycles;
+    uint32_t busy = total - (idle - window_idle);
+    uint32_t sample;
+
+    if (total == 0) {
+        return;
+    }
+
+    sample = (uint32_t)(((uint64_t)busy * HD_LOAD_ONE) / total);
+    load[HD_LOAD_1S] = sample;
+    load[HD_LOAD_10S] = HD_LoadAverage(load[HD_LOAD_10S], sample, HD_LOAD_ALPHA_10S);
+    load[HD_LOAD_60S] = HD_LoadAverage(load[HD_LOAD_60S], sample, HD_LOAD_ALPHA_60S);
+
+    for (uint32_t i = 0; i < HD_ISR_COUNT; i++) {
+        isr_load[i] = (uint32_t)(((uint64_t)(isr_cycles[i] - window_isr[i]) * HD_LOAD_ONE) / total);
+        window_isr[i] = isr_cycles[i];
+    }
+
+    window_cycles = now;
+    window_idle = idle;
+
+    /* Counted in every build, DEBUG builds stop here to be looked at */
+    if (((sample * 1000) >> 16) > HD_CPU_LOAD_LIMIT) {
+        overload_count++;
+    }
+    HD_ASSERT(((sample * 1000) >> 16) <= HD_CPU_LOAD_LIMIT);
+}
+
+/**
+  * @brief  CPU load averaged over a window
+  * @param  window: HD_LOAD_1S, HD_LOAD_10S or HD_LOAD_60S
+  * @retval Busy time in 1/1000
+  */
+uint32_t HD_GetCpuLoad(HD_LoadWindowTypeDef window)
+{
+    if ((uint32_t)window > HD_LOAD_60S) {
+        return 0;
+    }
+    return (load[window] * 1000 + (HD_LOAD_ONE / 2)) >> 16;
+}
+
+/**
+  * @brief  Share of the last second spent in one interrupt handler
+  * @param  isr: HD_ISR_SYSTICK, HD_ISR_TIMER1, HD_ISR_DMA or HD_ISR_TIMER2
+  * @retval Busy time in 1/1000
+  */
+uint32_t HD_GetIsrLoad(HD_IsrTypeDef isr)
+{
+    if ((uint32_t)isr >= HD_ISR_COUNT) {
+        return 0;
+    }
+    return (isr_load[isr] * 1000 + (HD_LOAD_ONE / 2)) >> 16;
+}
+
+/**
+  * @brief  Seconds whose load went over HD_CPU_LOAD_LIMIT
+  * @param  None
+  * @retval Count since boot
+  */
+uint32_t HD_GetOverloadCount(void)
+{
+    return overload_count;
+}
+
+/**
+  * @brief  Start the DWT cycle counter used for boot latency measurement
+  * @param  None
+  * @retval None
+  */
+static void HD_CycleCounter_Init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+#ifdef HD_FAST_BOOT
+/* Register image helpers, one pass per port that has LED pins */
+#define HD_PORT_CLOCK_IF_USED(p) \
+    | ((LED_PORT_MASK(p) != 0) ? RST_CLK_PCLK_PORT##p : 0UL)
+
+#define HD_PORT_IMAGE(p)                                                        \
+    if (LED_PORT_MASK(p) != 0) {                                                \
+        MDR_PORT##p->RXTX   &= ~LED_PORT_MASK(p);                               \
+        MDR_PORT##p->OE     |= LED_PORT_MASK(p);                                \
+        MDR_PORT##p->FUNC   &= ~LED_PORT_MASK2(p);                              \
+        MDR_PORT##p->ANALOG |= LED_PORT_MASK(p);                                \
+        MDR_PORT##p->PULL   &= ~(LED_PORT_MASK(p) | (LED_PORT_MASK(p) << 16));  \
+        MDR_PORT##p->PD     &= ~(LED_PORT_MASK(p) | (LED_PORT_MASK(p) << 16));  \
+        MDR_PORT##p->PWR     = (MDR_PORT##p->PWR & ~LED_PORT_MASK2(p))          \
+                               | LED_PORT_PWR_FAST(p);                          \
+        MDR_PORT##p->GFEN   &= ~LED_PORT_MASK(p);                               \
+    }
+
+/**
+  * @brief  Fast boot init: precomputed register images, no SPL structures
+  * @param  None
+  * @retval None
+  */
+static void HD_FastBoot_Init(void)
+{
+    uint32_t period = 1000 - 1;
+
+    /* All peripheral clocks in one store */
+    MDR_RST_CLK->PER_CLOCK |= RST_CLK_PCLK_TIMER1 LED_FOR_EACH_PORT(HD_PORT_CLOCK_IF_USED);
+
+    /* LED ports: digital, output, fast, no pulls, low */
+    LED_FOR_EACH_PORT(HD_PORT_IMAGE)
+
+    /* SysTick 1 ms tick */
+    HD_Delay_Init();
+
+    /* TIMER1: HCLK/1, 1 us counts, up counter, update on ARR.
+     * CNT starts one count before ARR so the first frame is not delayed */
+    MDR_RST_CLK->TIM_CLOCK = (MDR_RST_CLK->TIM_CLOCK & ~0xFFUL) | RST_CLK_TIM_CLOCK_TIM1_CLK_EN;
+    MDR_TIMER1->CNTRL  = 0;
+    MDR_TIMER1->PSG    = (system_clock / 1000000) - 1;
+    MDR_TIMER1->ARR    = period;
+    MDR_TIMER1->CNT    = period - 1;
+    MDR_TIMER1->STATUS = 0;
+    MDR_TIMER1->IE     = TIMER_STATUS_CNT_ARR;
+
+    NVIC_SetPriority(Timer1_IRQn, 1);
+    NVIC_EnableIRQ(Timer1_IRQn);
+
+    MDR_TIMER1->CNTRL  = TIMER_CNTRL_CNT_EN;
+}
+#endif /* HD_FAST_BOOT */
+
 /**
   * @brief  Initialize system hardware
   * @param  None
@@ -197,12 +559,18 @@ void HD_IncrementTick(void)
   */
 void HD_System_Init(void)
 {
+    /* Boot latency is counted from here to the first LED frame */
+    HD_CycleCounter_Init();
+
+#ifdef HD_FAST_BOOT
+    HD_FastBoot_Init();
+#else
 		/* Register init */
 		MDR_RST_CLK->PER_CLOCK |= (0x01 <<23);
 		MDR_PORTC->RXTX &= ~(0x01 <<2);
 		MDR_PORTC->OE |= (0x01 <<2);
 		MDR_PORTC-> FUNC &= ~(0x03 << 2*2);
-		MDR_PORTC->ANALOG |= ~(0x01 <<2);
+		MDR_PORTC->ANALOG |= (0x01 <<2);
 		MDR_PORTC-> PULL &= ~(0x01 << (2));
 		MDR_PORTC-> PULL &= ~(0x01 << (2+16));
 		MDR_PORTC-> PD &= ~(0x01 << (2));
@@ -214,6 +582,7 @@ void HD_System_Init(void)
     
     /* Initialize TIMER1 for LED processing */
     HD_Timer1_Init();
+#endif
     
     /* Additional hardware initialization can be added here */
 }
@@ -228,6 +597,80 @@ uint32_t HD_GetSystemClock(void)
     return system_clock;
 }
 
+/**
+  * @brief  Get boot-to-first-frame latency
+  * @note   SystemInit and the C startup run before HD_System_Init starts
+  *         the count and are not included
+  * @param  None
+  * @retval CPU cycles from HD_System_Init entry to the first rendered
+  *         frame reaching the pins, 0 if none has been output yet
+  */
+uint32_t HD_GetBootCycles(void)
+{
+    return boot_cycles;
+}
+
+/**
+  * @brief  CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+  * @param  data: bytes to checksum
+  * @param  length: number of bytes
+  * @retval CRC value
+  */
+uint16_t HD_CRC16(const uint8_t* data, uint32_t length)
+{
+    uint16_t crc = 0xFFFF;
+
+    while (length--) {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+/**
+  * @brief  Records TIMER1 entry to pin output latency
+  * @note   Called by LED_Process right after the port stores
+  * @param  None
+  * @retval None
+  */
+void HD_RecordPinLatency(void)
+{
+    uint32_t cycles = DWT->CYCCNT - HD_Timer1EntryCycles;
+
+    pin_latency.last = cycles;
+    if (cycles < pin_latency.min) {
+        pin_latency.min = cycles;
+    }
+    if (cycles > pin_latency.max) {
+        pin_latency.max = cycles;
+    }
+}
+
+/**
+  * @brief  Latches boot-to-first-frame latency, later calls are ignored
+  * @note   Called by LED_Process after it writes a rendered frame
+  * @param  None
+  * @retval None
+  */
+void HD_LatchBootCycles(void)
+{
+    if (boot_cycles == 0) {
+        boot_cycles = DWT->CYCCNT;
+    }
+}
+
+/**
+  * @brief  TIMER1 entry to LED pin output latency, min/max since boot
+  * @param  None
+  * @retval Latency in CPU cycles
+  */
+const HD_LatencyTypeDef* HD_GetPinLatency(void)
+{
+    return &pin_latency;
+}
+
 /**
   * @brief  Assert failure handler
   * @param  file: Source file name where assert failed
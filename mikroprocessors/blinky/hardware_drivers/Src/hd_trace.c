@@ -0,0 +1,45 @@
+#include "hd_trace.h"
+
+#ifdef HD_TRACE_ENABLE
+
+HD_TraceBufferTypeDef HD_TraceBuffer = {
+    .magic = HD_TRACE_MAGIC,
+    .depth = HD_TRACE_DEPTH,
+};
+
+/**
+  * @brief  Starts recording, the ring keeps what it already holds
+  * @note   The first new record is timed from here, the gap to the
+  *         records from before the stop is not kept
+  */
+void HD_TraceStart(void)
+{
+    HD_TraceBuffer.clock_hz = HD_GetSystemClock();
+    HD_TraceBuffer.state = DWT->CYCCNT << 8 | (HD_TraceBuffer.state & (HD_TRACE_DEPTH - 1));
+    HD_TraceBuffer.enabled = 1;
+}
+
+/**
+  * @brief  Stops recording, e.g. to freeze the ring before a dump
+  */
+void HD_TraceStop(void)
+{
+    HD_TraceBuffer.enabled = 0;
+}
+
+/**
+  * @brief  Empties the ring
+  */
+void HD_TraceClear(void)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    for (uint32_t i = 0; i < HD_TRACE_DEPTH; i++) {
+        HD_TraceBuffer.ring[i] = (HD_TraceRecordTypeDef){0};
+    }
+    HD_TraceBuffer.state = DWT->CYCCNT << 8;
+    __set_PRIMASK(primask);
+}
+
+#endif /* HD_TRACE_ENABLE */
@@ -0,0 +1,189 @@
+#include "led_compositor.h"
+#include "main.h"
+
+/* Byte lane masks */
+#define LANE_EVEN       0x00FF00FFUL
+#define LANE_HIGH       0x80808080UL
+#define LANE_LOW7       0x7F7F7F7FUL
+
+typedef struct {
+    LCOMP_Pixel4 frame;
+    uint8_t opacity;
+    uint8_t mode;
+    uint8_t enabled;
+} LCOMP_LayerTypeDef;
+
+typedef struct {
+    uint8_t from;
+    uint8_t to;
+    uint8_t active;
+    uint32_t start;
+    uint32_t duration;
+} LCOMP_FadeTypeDef;
+
+static LCOMP_LayerTypeDef layers[LCOMP_LAYER_COUNT];
+static LCOMP_FadeTypeDef fade;
+static uint32_t compose_cycles = 0;
+
+/**
+  * @brief  x * factor / 256 for every channel, factor 0..256
+  */
+LCOMP_Pixel4 LCOMP_Scale(LCOMP_Pixel4 x, uint32_t factor)
+{
+    uint32_t even = (((x & LANE_EVEN) * factor) >> 8) & LANE_EVEN;
+    uint32_t odd  = (((x >> 8) & LANE_EVEN) * factor) & ~LANE_EVEN;
+    return even | odd;
+}
+
+/**
+  * @brief  min(x + y, 255) for every channel
+  */
+LCOMP_Pixel4 LCOMP_AddSat(LCOMP_Pixel4 x, LCOMP_Pixel4 y)
+{
+    uint32_t sum = (x & LANE_LOW7) + (y & LANE_LOW7);
+    uint32_t overflow = ((x & y) | ((x ^ y) & sum)) & LANE_HIGH;
+    uint32_t result = sum ^ ((x ^ y) & LANE_HIGH);
+
+    return result | ((overflow >> 7) * 0xFFUL);
+}
+
+/**
+  * @brief  max(x, y) for every channel
+  */
+LCOMP_Pixel4 LCOMP_Max(LCOMP_Pixel4 x, LCOMP_Pixel4 y)
+{
+    /* Bit 7 of each lane of t is set when the low 7 bits of x >= y */
+    uint32_t t = (x | LANE_HIGH) - (y & LANE_LOW7);
+    uint32_t ge = ((x & ~y) | (~(x ^ y) & t)) & LANE_HIGH;
+    uint32_t mask = (ge >> 7) * 0xFFUL;
+
+    return (x & mask) | (y & ~mask);
+}
+
+/**
+  * @brief  top * alpha + bottom * (1 - alpha) for every channel, alpha 0..256
+  */
+LCOMP_Pixel4 LCOMP_Alpha(LCOMP_Pixel4 top, LCOMP_Pixel4 bottom, uint32_t alpha)
+{
+    return LCOMP_Scale(top, alpha) + LCOMP_Scale(bottom, 256 - alpha);
+}
+
+/* Opacity 0..255 to a 0..256 factor so that 255 is exact */
+static uint32_t opacity_factor(uint8_t opacity)
+{
+    return opacity + (opacity >> 7);
+}
+
+void LCOMP_SetFrame(uint8_t layer, LCOMP_Pixel4 frame)
+{
+    if (layer < LCOMP_LAYER_COUNT) {
+        layers[layer].frame = frame;
+    }
+}
+
+void LCOMP_SetOpacity(uint8_t layer, uint8_t opacity)
+{
+    if (layer < LCOMP_LAYER_COUNT) {
+        layers[layer].opacity = opacity;
+    }
+}
+
+void LCOMP_SetBlend(uint8_t layer, LCOMP_BlendTypeDef mode)
+{
+    if (layer < LCOMP_LAYER_COUNT) {
+        layers[layer].mode = (uint8_t)mode;
+    }
+}
+
+void LCOMP_Enable(uint8_t layer, uint8_t enable)
+{
+    if (layer < LCOMP_LAYER_COUNT) {
+        layers[layer].enabled = enable;
+    }
+}
+
+/**
+  * @brief  Fades from_layer out and to_layer in over duration_ms
+  * @note   Both layers are enabled, from_layer is disabled at the end
+  */
+void LCOMP_Crossfade(uint8_t from_layer, uint8_t to_layer, uint32_t duration_ms)
+{
+    if (from_layer >= LCOMP_LAYER_COUNT || to_layer >= LCOMP_LAYER_COUNT) {
+        return;
+    }
+    fade.from = from_layer;
+    fade.to = to_layer;
+    fade.start = HD_GetTick();
+    fade.duration = duration_ms ? duration_ms : 1;
+    layers[from_layer].enabled = 1;
+    layers[to_layer].enabled = 1;
+    fade.active = 1;
+}
+
+/* Advances a running crossfade by setting both layer opacities */
+static void update_fade(uint32_t now)
+{
+    uint32_t elapsed = now - fade.start;
+    uint32_t level;
+
+    if (elapsed >= fade.duration) {
+        layers[fade.from].enabled = 0;
+        layers[fade.from].opacity = 255;
+        layers[fade.to].opacity = 255;
+        fade.active = 0;
+        return;
+    }
+
+    level = (elapsed * 255) / fade.duration;
+    layers[fade.to].opacity = (uint8_t)level;
+    layers[fade.from].opacity = (uint8_t)(255 - level);
+}
+
+/**
+  * @brief  Blends all enabled layers bottom to top
+  * @note   Fixed cost: one pass over LCOMP_LAYER_COUNT layers
+  * @param  now: current tick, drives crossfades
+  * @retval Composed frame
+  */
+LCOMP_Pixel4 LCOMP_Compose(uint32_t now)
+{
+    uint32_t start = DWT->CYCCNT;
+    LCOMP_Pixel4 out = 0;
+
+    if (fade.active) {
+        update_fade(now);
+    }
+
+    for (uint32_t i = 0; i < LCOMP_LAYER_COUNT; i++) {
+        const LCOMP_LayerTypeDef *layer = &layers[i];
+        uint32_t factor;
+
+        if (!layer->enabled) {
+            continue;
+        }
+        factor = opacity_factor(layer->opacity);
+
+        switch (layer->mode) {
+        case LCOMP_BLEND_ADD:
+            out = LCOMP_AddSat(out, LCOMP_Scale(layer->frame, factor));
+            break;
+        case LCOMP_BLEND_ALPHA:
+            out = LCOMP_Alpha(layer->frame, out, factor);
+            break;
+        default:
+            out = LCOMP_Max(out, LCOMP_Scale(layer->frame, factor));
+            break;
+        }
+    }
+
+    compose_cycles = DWT->CYCCNT - start;
+    return out;
+}
+
+/**
+  * @brief  CPU cycles spent in the last LCOMP_Compose call
+  */
+uint32_t LCOMP_GetComposeCycles(void)
+{
+    return compose_cycles;
+}
@@ -0,0 +1,197 @@
+#include "led_matrix.h"
+#include "main.h"
+
+/* Every TIMER2 event ends one BAM slice and starts the next: blank the
+ * rows, write the precomputed column image of the new (row, bit) to each
+ * column port, switch the row on with one bit-band store, and set the
+ * slice length. Cost is the same for every slice whatever the content.
+ *
+ * Images are built at thread level into a back buffer and swapped in at
+ * the end of a full refresh, so a refresh never mixes two frames. */
+
+typedef uint32_t LMTX_ImageTypeDef[LMTX_BAM_BITS][LMTX_ROWS][LED_PORTID_COUNT];
+
+typedef struct {
+    uint8_t port_id;
+    uint32_t mask;
+} LMTX_PinTypeDef;
+
+#define LMTX_PIN_ENTRY(arg, idx, port, pin)     [idx] = { LED_PORTID_##port, 1UL << (pin) },
+#define LMTX_ROW_BB_ENTRY(arg, idx, port, pin) \
+    [idx] = (__IO uint32_t*)HD_BITBAND_ADDR(HD_PORT_RXTX_ADDR(MDR_PORT##port##_BASE), pin),
+
+/* Matrix pins must not be LED pins, the LED outputs write whole ports */
+#define LMTX_CHECK_PORT(p) \
+    typedef char lmtx_no_led_pins_##p[((LMTX_ROW_MASK(p) | LMTX_COL_MASK(p)) & LED_PORT_MASK(p)) ? -1 : 1];
+LED_FOR_EACH_PORT(LMTX_CHECK_PORT)
+
+static const LMTX_PinTypeDef col_pins[LMTX_COLS] = { LMTX_COL_MAP(LMTX_PIN_ENTRY, _) };
+static __IO uint32_t* const row_bb[LMTX_ROWS] = { LMTX_ROW_MAP(LMTX_ROW_BB_ENTRY, _) };
+
+/* Inactive levels, as RXTX bits under the masks */
+#define LMTX_ROW_OFF(p)     (LMTX_ROW_ACTIVE_HIGH ? 0UL : LMTX_ROW_MASK(p))
+#define LMTX_COL_OFF(p)     (LMTX_COL_ACTIVE_HIGH ? 0UL : LMTX_COL_MASK(p))
+
+#define LMTX_PORT_INIT(p)                                               \
+    if ((LMTX_ROW_MASK(p) | LMTX_COL_MASK(p)) != 0) {                   \
+        RST_CLK_PCLKcmd(RST_CLK_PCLK_PORT##p, ENABLE);                  \
+        HD_PORT_WriteMasked(MDR_PORT##p, LMTX_ROW_MASK(p) | LMTX_COL_MASK(p), \
+                            LMTX_ROW_OFF(p) | LMTX_COL_OFF(p));         \
+        port_init.PORT_Pin = (uint16_t)(LMTX_ROW_MASK(p) | LMTX_COL_MASK(p)); \
+        PORT_Init(MDR_PORT##p, &port_init);                             \
+    }
+
+#define LMTX_PORT_BLANK(p)                                              \
+    if (LMTX_ROW_MASK(p) != 0) {                                        \
+        HD_PORT_WriteMasked(MDR_PORT##p, LMTX_ROW_MASK(p), LMTX_ROW_OFF(p)); \
+    }
+
+#define LMTX_PORT_COLS(p)                                               \
+    if (LMTX_COL_MASK(p) != 0) {                                        \
+        HD_PORT_WriteMasked(MDR_PORT##p, LMTX_COL_MASK(p), image[LED_PORTID_##p]); \
+    }
+
+#define LMTX_COL_OFF_ENTRY(p)   [LED_PORTID_##p] = LMTX_COL_OFF(p),
+
+static const uint32_t col_off[LED_PORTID_COUNT] = { LED_FOR_EACH_PORT(LMTX_COL_OFF_ENTRY) };
+
+static LMTX_ImageTypeDef images[2];
+static LMTX_ImageTypeDef * volatile front = &images[0];
+static volatile uint8_t swap_pending = 0;
+static uint8_t scan_row = 0;
+static uint8_t scan_bit = 0;
+static volatile uint32_t refresh_count = 0;
+
+/**
+  * @brief  Configures the matrix pins and starts the TIMER2 row scan
+  */
+void LMTX_Init(void)
+{
+    PORT_InitTypeDef port_init;
+    TIMER_CntInitTypeDef timer_init;
+    uint8_t off[LMTX_ROWS * LMTX_COLS] = {0};
+
+    PORT_StructInit(&port_init);
+    port_init.PORT_OE = PORT_OE_OUT;
+    port_init.PORT_MODE = PORT_MODE_DIGITAL;
+    port_init.PORT_SPEED = PORT_SPEED_FAST;
+    LED_FOR_EACH_PORT(LMTX_PORT_INIT)
+
+    LMTX_SetPixels(off);
+    front = &images[0];
+    swap_pending = 0;
+
+    /* TIMER2 counts microseconds like TIMER1, ARR is the slice length */
+    RST_CLK_PCLKcmd(RST_CLK_PCLK_TIMER2, ENABLE);
+    TIMER_BRGInit(MDR_TIMER2, TIMER_HCLKdiv1);
+    TIMER_CntStructInit(&timer_init);
+    timer_init.TIMER_Prescaler = (HD_GetSystemClock() / 1000000) - 1;
+    timer_init.TIMER_Period = LMTX_BAM_BASE_US - 1;
+    timer_init.TIMER_CounterMode = TIMER_CntMode_ClkFixedDir;
+    timer_init.TIMER_CounterDirection = TIMER_CntDir_Up;
+    timer_init.TIMER_EventSource = TIMER_EvSrc_TIM_CLK;
+    timer_init.TIMER_ARR_UpdateMode = TIMER_ARR_Update_Immediately;
+    TIMER_CntInit(MDR_TIMER2, &timer_init);
+    TIMER_ITConfig(MDR_TIMER2, TIMER_STATUS_CNT_ARR, ENABLE);
+    TIMER_ClearFlag(MDR_TIMER2, TIMER_STATUS_Msk);
+
+    /* Same priority as TIMER1: the two never preempt each other's
+     * masked port writes */
+    NVIC_SetPriority(Timer2_IRQn, 1);
+    NVIC_EnableIRQ(Timer2_IRQn);
+    TIMER_Cmd(MDR_TIMER2, ENABLE);
+}
+
+/**
+  * @brief  Builds the column images of a frame and queues it
+  * @param  levels: LMTX_ROWS * LMTX_COLS pixel levels 0..255, row major
+  * @note   Thread level. Returns without effect while the previous
+  *         frame has not been taken by the scan yet.
+  */
+void LMTX_SetPixels(const uint8_t* levels)
+{
+    LMTX_ImageTypeDef *back;
+
+    if (swap_pending) {
+        return;
+    }
+    back = (front == &images[0]) ? &images[1] : &images[0];
+
+    for (uint32_t b = 0; b < LMTX_BAM_BITS; b++) {
+        uint32_t bit = 1UL << (8 - LMTX_BAM_BITS + b);
+
+        for (uint32_t r = 0; r < LMTX_ROWS; r++) {
+            uint32_t *image = (*back)[b][r];
+
+            for (uint32_t p = 0; p < LED_PORTID_COUNT; p++) {
+                image[p] = col_off[p];
+            }
+            for (uint32_t c = 0; c < LMTX_COLS; c++) {
+                if (levels[r * LMTX_COLS + c] & bit) {
+                    image[col_pins[c].port_id] ^= col_pins[c].mask;
+                }
+            }
+        }
+    }
+
+    __DMB();
+    swap_pending = 1;
+}
+
+/**
+  * @brief  Shows an LED engine frame: channel n lights row band n
+  * @param  channels: composed frame from the wave/sequence engine
+  */
+void LMTX_SetChannels(LCOMP_Pixel4 channels)
+{
+    uint8_t levels[LMTX_ROWS * LMTX_COLS];
+
+    for (uint32_t r = 0; r < LMTX_ROWS; r++) {
+        uint8_t level = (uint8_t)(channels >> (8 * ((r * LCOMP_CHANNELS) / LMTX_ROWS)));
+
+        for (uint32_t c = 0; c < LMTX_COLS; c++) {
+            levels[r * LMTX_COLS + c] = level;
+        }
+    }
+    LMTX_SetPixels(levels);
+}
+
+/**
+  * @brief  Number of completed refreshes (all rows, all bits)
+  */
+uint32_t LMTX_GetRefreshCount(void)
+{
+    return refresh_count;
+}
+
+/**
+  * @brief  Shows the next BAM slice (TIMER2 interrupt context)
+  * @note   Called by Timer2_IRQHandler, which does the load accounting
+  */
+void LMTX_ScanHandler(void)
+{
+    const uint32_t *image;
+
+    HD_TIMER_ClearFlag(MDR_TIMER2, TIMER_STATUS_CNT_ARR);
+
+    /* Advance to the next slice, swap frames between refreshes */
+    if (++scan_bit >= LMTX_BAM_BITS) {
+        scan_bit = 0;
+        if (++scan_row >= LMTX_ROWS) {
+            scan_row = 0;
+            refresh_count++;
+            if (swap_pending) {
+                front = (front == &images[0]) ? &images[1] : &images[0];
+                swap_pending = 0;
+            }
+        }
+    }
+    image = (*front)[scan_bit][scan_row];
+
+    /* Blank, columns, row on: no pixel of the old row shows new columns */
+    LED_FOR_EACH_PORT(LMTX_PORT_BLANK)
+    LED_FOR_EACH_PORT(LMTX_PORT_COLS)
+    *row_bb[scan_row] = LMTX_ROW_ACTIVE_HIGH;
+
+    MDR_TIMER2->ARR = (LMTX_BAM_BASE_US << scan_bit) - 1;
+}
@@ -0,0 +1,221 @@
+#include "led_pattern.h"
+#include "main.h"
+
+/* Streaming decoder for compressed patterns. The pattern is read in
+ * place from flash, RAM holds only the decoder position and the last
+ * frame. Every call decodes at most one frame, and one frame is at most
+ * one opcode plus LCOMP_CHANNELS delta bytes, so the cost per render is
+ * bounded whatever the pattern. */
+
+typedef struct {
+    const uint8_t* data;
+    const uint8_t* stream;      // first opcode
+    uint32_t pos;               // next opcode, offset from stream
+    uint32_t palette_size;
+    uint32_t frame_count;
+    uint32_t frame_index;       // frames decoded in this pass
+    uint32_t frame_ms;
+    uint32_t next_due;          // tick of the next frame
+    uint8_t run_left;           // repeats left of the current RUN
+    uint8_t flags;
+    uint8_t active;
+    LCOMP_Pixel4 frame;
+} LPAT_DecoderTypeDef;
+
+static LPAT_DecoderTypeDef decoder;
+static uint32_t decode_cycles = 0;
+
+/* Unaligned little endian reads, the pattern is a byte array */
+static uint32_t read_u16(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t read_u32(const uint8_t* p)
+{
+    return read_u16(p) | (read_u16(p + 2) << 16);
+}
+
+/* Number of delta bytes following a DELTA opcode */
+static uint32_t delta_bytes(uint8_t op)
+{
+    uint32_t mask = op & 0x0FU;
+
+    mask = mask - ((mask >> 1) & 0x5U);
+    return (mask & 0x3U) + ((mask >> 2) & 0x3U);
+}
+
+/**
+  * @brief  Checks the whole opcode stream once, so decoding needs no
+  *         bounds checks
+  * @retval HD_OK if every opcode is valid and the frames add up
+  */
+static HD_StatusTypeDef validate(const uint8_t* stream, uint32_t length,
+                                 uint32_t palette_size, uint32_t frame_count)
+{
+    uint32_t pos = 0;
+    uint32_t frames = 0;
+
+    while (pos < length) {
+        uint8_t op = stream[pos++];
+
+        switch (op & LPAT_OP_MASK) {
+        case LPAT_OP_PAL:
+            if (op >= palette_size) {
+                return HD_ERROR;
+            }
+            frames++;
+            break;
+        case LPAT_OP_RUN:
+            frames += (op & 0x3FU) + 1;
+            break;
+        default:
+            if ((op & 0xF0U) != LPAT_OP_DELTA) {
+                return HD_ERROR;
+            }
+            pos += delta_bytes(op);
+            frames++;
+            break;
+        }
+    }
+
+    return (pos == length && frames == frame_count) ? HD_OK : HD_ERROR;
+}
+
+/**
+  * @brief  Starts playing a compressed pattern
+  * @param  data: pattern image, must stay valid while playing
+  * @param  size: image size in bytes
+  * @param  now: current tick, the first frame is due immediately
+  * @retval HD_OK, HD_ERROR if the image is malformed
+  */
+HD_StatusTypeDef LPAT_Start(const uint8_t* data, uint32_t size, uint32_t now)
+{
+    uint32_t palette_size;
+    uint32_t stream_offset;
+    uint32_t frame_count;
+    uint32_t frame_ms;
+
+    if (data == 0 || size < LPAT_HEADER_SIZE ||
+        data[0] != 'L' || data[1] != 'P' || data[2] != LPAT_VERSION) {
+        return HD_ERROR;
+    }
+
+    frame_count = read_u16(&data[4]);
+    frame_ms = read_u16(&data[6]);
+    palette_size = data[8];
+    stream_offset = LPAT_HEADER_SIZE + palette_size * 4;
+
+    if (frame_count == 0 || frame_ms == 0 ||
+        palette_size > LPAT_PALETTE_MAX || size < stream_offset ||
+        validate(&data[stream_offset], size - stream_offset,
+                 palette_size, frame_count) != HD_OK) {
+        return HD_ERROR;
+    }
+
+    decoder.active = 0;
+    decoder.data = data;
+    decoder.stream = &data[stream_offset];
+    decoder.pos = 0;
+    decoder.palette_size = palette_size;
+    decoder.frame_count = frame_count;
+    decoder.frame_index = 0;
+    decoder.frame_ms = frame_ms;
+    decoder.next_due = now;
+    decoder.run_left = 0;
+    decoder.flags = data[3];
+    decoder.frame = 0;
+    decoder.active = 1;
+    return HD_OK;
+}
+
+/**
+  * @brief  Stops decoding, the last frame is kept
+  */
+void LPAT_Stop(void)
+{
+    decoder.active = 0;
+}
+
+uint8_t LPAT_IsActive(void)
+{
+    return decoder.active;
+}
+
+/* Decodes one frame into decoder.frame */
+static void decode_frame(void)
+{
+    uint8_t op;
+
+    if (decoder.run_left != 0) {
+        decoder.run_left--;
+        return;
+    }
+
+    op = decoder.stream[decoder.pos++];
+    switch (op & LPAT_OP_MASK) {
+    case LPAT_OP_PAL:
+        decoder.frame = read_u32(&decoder.data[LPAT_HEADER_SIZE + op * 4U]);
+        break;
+    case LPAT_OP_RUN:
+        decoder.run_left = op & 0x3FU;
+        break;
+    default:
+        for (uint32_t i = 0; i < LCOMP_CHANNELS; i++) {
+            if (op & (1U << i)) {
+                uint32_t lane = (decoder.frame >> (8 * i)) + decoder.stream[decoder.pos++];
+
+                decoder.frame = (decoder.frame & ~(0xFFUL << (8 * i))) |
+                                ((lane & 0xFFUL) << (8 * i));
+            }
+        }
+        break;
+    }
+}
+
+/**
+  * @brief  Current pattern frame, advanced when its time has come
+  * @note   Called once per render. A late render still decodes only one
+  *         frame; the due time advances by one frame time, so the
+  *         pattern catches up over the following renders.
+  * @param  now: current tick
+  * @retval Frame for the pattern layer
+  */
+LCOMP_Pixel4 LPAT_Next(uint32_t now)
+{
+    uint32_t start;
+
+    if (!decoder.active || (int32_t)(now - decoder.next_due) < 0) {
+        return decoder.frame;
+    }
+
+    start = DWT->CYCCNT;
+    if (decoder.frame_index >= decoder.frame_count) {
+        if (!(decoder.flags & LPAT_FLAG_LOOP)) {
+            decoder.active = 0;
+            return decoder.frame;
+        }
+        decoder.pos = 0;
+        decoder.frame_index = 0;
+        decoder.run_left = 0;
+        decoder.frame = 0;
+    }
+
+    decode_frame();
+    decoder.frame_index++;
+    decoder.next_due += decoder.frame_ms;
+
+    start = DWT->CYCCNT - start;
+    if (start > decode_cycles) {
+        decode_cycles = start;
+    }
+    return decoder.frame;
+}
+
+/**
+  * @brief  Worst CPU cycles spent decoding one frame
+  */
+uint32_t LPAT_GetDecodeCycles(void)
+{
+    return decode_cycles;
+}
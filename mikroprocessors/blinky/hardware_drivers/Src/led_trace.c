@@ -0,0 +1,227 @@
+#include "led_trace.h"
+#include "main.h"
+#include "leds.h"
+
+/* Edge recorder for the LED pins. LTRACE_Sample is called after every
+ * RXTX write with the current pin levels; only changes are stored,
+ * timestamped with the DWT cycle counter. */
+
+typedef struct {
+    uint32_t time;              // DWT cycles
+    uint32_t bits;              // Bit n = LED n pin level after the change
+} LTRACE_EventTypeDef;
+
+static LTRACE_EventTypeDef events[LTRACE_DEPTH];
+static uint32_t event_count = 0;    // Total recorded, index = count % depth
+static uint32_t last_bits = 0;
+static volatile uint8_t paused = 0;
+
+static LTRACE_StatsTypeDef stats[LED_COUNT];
+static uint32_t last_rise[LED_COUNT];
+static uint32_t last_fall[LED_COUNT];
+static uint8_t seen_rise[LED_COUNT];
+
+/**
+  * @brief  Clears recorded edges and statistics
+  */
+void LTRACE_Reset(void)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    event_count = 0;
+    for (int i = 0; i < LED_COUNT; i++) {
+        stats[i] = (LTRACE_StatsTypeDef){0};
+        stats[i].min_period = 0xFFFFFFFFUL;
+        seen_rise[i] = 0;
+    }
+    __set_PRIMASK(primask);
+}
+
+/* Updates the timing statistics of one LED on an edge */
+static void update_stats(uint8_t led, uint32_t time, uint8_t level)
+{
+    LTRACE_StatsTypeDef *st = &stats[led];
+
+    st->edges++;
+    if (!level) {
+        last_fall[led] = time;
+        return;
+    }
+
+    if (seen_rise[led]) {
+        uint32_t period = time - last_rise[led];
+
+        st->periods++;
+        st->total_cycles += period;
+        st->high_cycles += last_fall[led] - last_rise[led];
+        if (period < st->min_period) {
+            st->min_period = period;
+        }
+        if (period > st->max_period) {
+            st->max_period = period;
+        }
+    }
+    last_rise[led] = time;
+    seen_rise[led] = 1;
+}
+
+/**
+  * @brief  Records the LED pin levels if any of them changed
+  * @param  led_bits: bit n set when LED n is on
+  */
+void LTRACE_Sample(uint32_t led_bits)
+{
+    uint32_t primask;
+    uint32_t changed;
+    uint32_t time;
+
+    if (led_bits == last_bits || paused) {
+        return;
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    time = DWT->CYCCNT;
+    changed = led_bits ^ last_bits;
+    last_bits = led_bits;
+
+    events[event_count % LTRACE_DEPTH].time = time;
+    events[event_count % LTRACE_DEPTH].bits = led_bits;
+    event_count++;
+
+    for (uint8_t i = 0; i < LED_COUNT; i++) {
+        if (changed & (1UL << i)) {
+            update_stats(i, time, (led_bits >> i) & 1U);
+        }
+    }
+    __set_PRIMASK(primask);
+}
+
+const LTRACE_StatsTypeDef* LTRACE_GetStats(uint8_t led)
+{
+    return &stats[led % LED_COUNT];
+}
+
+/**
+  * @brief  Measured duty cycle in 1/1000
+  */
+uint32_t LTRACE_GetDutyPermille(uint8_t led)
+{
+    const LTRACE_StatsTypeDef *st = LTRACE_GetStats(led);
+
+    if (st->total_cycles == 0) {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)st->high_cycles * 1000) / st->total_cycles);
+}
+
+/**
+  * @brief  Measured mean frequency in Hz
+  */
+uint32_t LTRACE_GetFrequencyHz(uint8_t led)
+{
+    const LTRACE_StatsTypeDef *st = LTRACE_GetStats(led);
+
+    if (st->total_cycles == 0) {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)HD_GetSystemClock() * st->periods) / st->total_cycles);
+}
+
+/**
+  * @brief  Peak-to-peak period jitter in CPU cycles
+  */
+uint32_t LTRACE_GetJitterCycles(uint8_t led)
+{
+    const LTRACE_StatsTypeDef *st = LTRACE_GetStats(led);
+
+    return st->periods ? (st->max_period - st->min_period) : 0;
+}
+
+/* Copies text, returns the end of the written string */
+static char* put_str(char* out, const char* text)
+{
+    while (*text) {
+        *out++ = *text++;
+    }
+    *out = '\0';
+    return out;
+}
+
+/* Unsigned to decimal text, returns the end of the written string */
+static char* put_uint(char* out, uint64_t value)
+{
+    char tmp[20];
+    int n = 0;
+
+    do {
+        tmp[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    while (n) {
+        *out++ = tmp[--n];
+    }
+    *out = '\0';
+    return out;
+}
+
+/**
+  * @brief  Writes the recorded edges as a VCD file for GTKWave
+  * @note   Times in ns, relative to the oldest kept event: VCD allows
+  *         only 1, 10 or 100 of a unit, so the cycle counts are scaled
+  *         rather than declared as a 125 ns unit. Recording is paused
+  *         while exporting.
+  */
+void LTRACE_ExportVCD(LTRACE_PutsTypeDef puts_fn)
+{
+    char line[40];
+    char *p;
+    uint32_t first, count;
+    uint32_t base = 0;
+    uint32_t prev_bits = 0;
+    uint32_t clock_hz = HD_GetSystemClock();
+
+    paused = 1;
+    count = (event_count < LTRACE_DEPTH) ? event_count : LTRACE_DEPTH;
+    first = event_count - count;
+
+    puts_fn("$timescale 1 ns $end\n");
+    puts_fn("$scope module leds $end\n");
+    for (uint32_t i = 0; i < LED_COUNT; i++) {
+        char id[2] = { (char)('a' + i), '\0' };
+
+        p = put_str(line, "$var wire 1 ");
+        p = put_str(p, id);
+        p = put_str(p, " LED");
+        p = put_uint(p, i + 1);
+        put_str(p, " $end\n");
+        puts_fn(line);
+    }
+    puts_fn("$upscope $end\n$enddefinitions $end\n");
+
+    if (count != 0) {
+        base = events[first % LTRACE_DEPTH].time;
+        prev_bits = ~events[first % LTRACE_DEPTH].bits;
+    }
+    for (uint32_t n = first; n < first + count; n++) {
+        const LTRACE_EventTypeDef *ev = &events[n % LTRACE_DEPTH];
+
+        p = put_str(line, "#");
+        p = put_uint(p, (uint64_t)(ev->time - base) * 1000000000ULL / clock_hz);
+        put_str(p, "\n");
+        puts_fn(line);
+
+        for (uint32_t i = 0; i < LED_COUNT; i++) {
+            if ((ev->bits ^ prev_bits) & (1UL << i)) {
+                line[0] = (char)('0' + ((ev->bits >> i) & 1U));
+                line[1] = (char)('a' + i);
+                line[2] = '\n';
+                line[3] = '\0';
+                puts_fn(line);
+            }
+        }
+        prev_bits = ev->bits;
+    }
+    paused = 0;
+}
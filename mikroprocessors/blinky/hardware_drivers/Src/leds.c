@@ -1,59 +1,168 @@
 #include "leds.h"
 #include "main.h"
+#include "led_compositor.h"
+#include "led_pattern.h"
+#include "audio_fft.h"
+#include "hd_trace.h"
 #include <math.h>
 
+#ifdef LED_MATRIX
+#include "led_matrix.h"
+#endif
+
+#ifdef LED_TRACE
+#include "led_trace.h"
+#define LED_TRACE_SAMPLE()      LTRACE_Sample(LED_GetPinBits())
+#else
+#define LED_TRACE_SAMPLE()      ((void)0)
+#endif
+
+/* Every LED is one byte lane of an LCOMP_Pixel4 */
+typedef char led_count_fits_compositor[(LED_COUNT <= LCOMP_CHANNELS) ? 1 : -1];
+typedef char led_pwm_bits_fit_steps[((1UL << LED_PWM_BITS) > LED_PWM_STEPS) ? 1 : -1];
+
+/* Every LED pin must be reachable through the peripheral bit-band region */
+#define LED_BITBAND_CHECK(arg, led, port, pin) \
+    typedef char led_bitband_##led[HD_BITBAND_IN_RANGE(MDR_PORT##port##_BASE) && (pin) < 32 ? 1 : -1];
+LED_PIN_MAP(LED_BITBAND_CHECK, _)
+
 /* LED configuration structure with direct register access */
 typedef struct {
-    __IO uint32_t* reg;     // Pointer to RXTX register
+    __IO uint32_t* bb;      // Bit-band alias of the pin in RXTX, atomic writes
     uint32_t mask;          // Bit mask for this LED
-    uint8_t state;
-    uint32_t start_time;
+    uint8_t port_id;        // LED_PORTID_x, selects the bit-plane set
 } LED_ConfigTypeDef;
 
 /* LED configuration array with direct register access */
-static LED_ConfigTypeDef LED_Config[LED_COUNT] = {
-    {&LED1_PORT->RXTX, LED1_MASK, 0, 0},
-    {&LED2_PORT->RXTX, LED2_MASK, 0, 0},
-    {&LED3_PORT->RXTX, LED3_MASK, 0, 0},
-    {&LED4_PORT->RXTX, LED4_MASK, 0, 0}
+#define LED_CONFIG_ENTRY(arg, led, port, pin) \
+    [led] = {(__IO uint32_t*)LED_PIN_ALIAS(port, pin), LED_PIN_MASK(pin), LED_PORTID_##port},
+
+static const LED_ConfigTypeDef LED_Config[LED_COUNT] = {
+    LED_PIN_MAP(LED_CONFIG_ENTRY, _)
 };
 
-// Sequence control variables
-static uint8_t sequence_active = 0;
-static uint8_t current_led = 0;
-static uint32_t sequence_start_time = 0;
-static uint32_t led_on_time = 0;
+/* Per-port init, folded away by the compiler for ports without LEDs */
+#define LED_PORT_INIT(p)                                        \
+    if (LED_PORT_MASK(p) != 0) {                                \
+        RST_CLK_PCLKcmd(RST_CLK_PCLK_PORT##p, ENABLE);          \
+        Port_InitStructure.PORT_Pin = LED_PORT_MASK(p);         \
+        PORT_Init(MDR_PORT##p, &Port_InitStructure);            \
+    }
 
-// PWM Wave control variables
-static uint32_t pwm_counter = 0;
-static uint32_t pwm_period = DEFAULT_PWM_PERIOD;
-static uint32_t wave_speed = DEFAULT_WAVE_SPEED;
-static uint8_t wave_active = 0;
-static uint32_t last_pwm_update = 0;
-static const uint32_t pwm_update_interval = 0; // 10ms update interval
+/* Whole-group operations: one bit-band store per LED, each atomic and
+ * with a constant address */
+#define LED_PIN_WRITE(value, led, port, pin) \
+    *(__IO uint32_t*)LED_PIN_ALIAS(port, pin) = (value);
 
+/* Sigma-delta output: one RXTX store per used port */
+#define LED_PORT_SD(p)                                                          \
+    if (LED_PORT_MASK(p) != 0) {                                                \
+        HD_PORT_WriteMasked(MDR_PORT##p, LED_PORT_MASK(p), on[LED_PORTID_##p]); \
+    }
+
+/* PWM output: one bit-sliced compare and one RXTX store per used port */
+#define LED_PORT_PWM(p)                                                         \
+    if (LED_PORT_MASK(p) != 0) {                                                \
+        uint32_t on = LED_PwmCompare(frame->plane[LED_PORTID_##p], step,        \
+                                     LED_PORT_MASK(p));                         \
+        HD_PORT_WriteMasked(MDR_PORT##p, LED_PORT_MASK(p), on);                 \
+    }
+
+/* Engine state, see LED_EngineTypeDef. All code goes through 'eng'. */
+#define LED_DEFAULT_CONFIG \
+    { .wave_speed = DEFAULT_WAVE_SPEED, .pwm_period = DEFAULT_PWM_PERIOD, .brightness = 255 }
+
+static LED_EngineTypeDef led_engine = {
+    .published = { .config = LED_DEFAULT_CONFIG },
+    .config = LED_DEFAULT_CONFIG,
+    .ambient_level = 255,
+    .front_frame = &led_engine.frames[0],
+};
+static LED_EngineTypeDef *eng = &led_engine;
+
+#define LED_EFFECT_ACTIVE()     (eng->wave_active || eng->sequence_active || \
+                                 eng->pattern_active || eng->audio_active)
+
+/* Wave frame cache, shared by all engine instances and rebuilt when the
+ * wave parameters or the engine change. Only LED_Render reads and fills
+ * it; writers elsewhere just mark it stale. */
+static LCOMP_Pixel4 wave_cache[LED_WAVE_CACHE_FRAMES];
+static uint32_t wave_cache_valid[(LED_WAVE_CACHE_FRAMES + 31) / 32];
+static uint32_t wave_cache_step = 1;        /* gcd(pwm_period, wave_speed) */
+static volatile uint8_t wave_cache_stale = 1;
+static LED_WaveCacheStatsTypeDef wave_cache_stats;
+
+static void wave_cache_invalidate(void)
+{
+    wave_cache_stale = 1;
+}
 
 void LED_Init(void)
 {
+#ifndef HD_FAST_BOOT
     PORT_InitTypeDef Port_InitStructure;
     
-    /* Enable clocks for PORTA and PORTC */
-    RST_CLK_PCLKcmd(RST_CLK_PCLK_PORTA, ENABLE);
-    Port_InitStructure.PORT_Pin = PORT_Pin_1 | PORT_Pin_3 | PORT_Pin_5;
-    Port_InitStructure.PORT_OE = PORT_OE_OUT;
-    Port_InitStructure.PORT_MODE = PORT_MODE_DIGITAL;
-    Port_InitStructure.PORT_SPEED = PORT_SPEED_FAST;
-    PORT_Init(MDR_PORTA, &Port_InitStructure);
-    
-    RST_CLK_PCLKcmd(RST_CLK_PCLK_PORTC, ENABLE);
-    Port_InitStructure.PORT_Pin = PORT_Pin_2;
+    PORT_StructInit(&Port_InitStructure);
     Port_InitStructure.PORT_OE = PORT_OE_OUT;
     Port_InitStructure.PORT_MODE = PORT_MODE_DIGITAL;
     Port_InitStructure.PORT_SPEED = PORT_SPEED_FAST;
-    PORT_Init(MDR_PORTC, &Port_InitStructure);
+
+    /* Enable clocks and configure every port that has LED pins */
+    LED_FOR_EACH_PORT(LED_PORT_INIT)
+#endif /* Fast boot: ports already written by HD_System_Init */
+
+    /* Wave and sequence layers, both fully opaque and max-blended */
+    LCOMP_SetOpacity(LCOMP_LAYER_WAVE, 255);
+    LCOMP_SetBlend(LCOMP_LAYER_WAVE, LCOMP_BLEND_MAX);
+    LCOMP_SetOpacity(LCOMP_LAYER_SEQUENCE, 255);
+    LCOMP_SetBlend(LCOMP_LAYER_SEQUENCE, LCOMP_BLEND_MAX);
+    LCOMP_SetOpacity(LCOMP_LAYER_PATTERN, 255);
+    LCOMP_SetBlend(LCOMP_LAYER_PATTERN, LCOMP_BLEND_MAX);
+    LCOMP_SetOpacity(LCOMP_LAYER_AUDIO, 255);
+    LCOMP_SetBlend(LCOMP_LAYER_AUDIO, LCOMP_BLEND_MAX);
 
     /* Turn off all LEDs initially using bit operations */
     LED_AllOff();
+
+#ifdef LED_MATRIX
+    LMTX_Init();
+#endif
+}
+
+/**
+  * @brief  Resets an engine instance to the power-on defaults
+  * @param  engine: instance to reset
+  */
+void LED_EngineInit(LED_EngineTypeDef* engine)
+{
+    *engine = (LED_EngineTypeDef){
+        .published = { .config = LED_DEFAULT_CONFIG },
+        .config = LED_DEFAULT_CONFIG,
+        .ambient_level = 255,
+    };
+    engine->front_frame = &engine->frames[0];
+}
+
+/**
+  * @brief  Makes another engine instance the one driven by the LED API
+  * @note   Pins keep their level until the next output of the new
+  *         instance. Switched with interrupts masked, so LED_Process
+  *         never sees a half-switched engine.
+  * @param  engine: instance to use, NULL selects the built-in one
+  * @retval Previously used instance
+  */
+LED_EngineTypeDef* LED_SetEngine(LED_EngineTypeDef* engine)
+{
+    LED_EngineTypeDef *previous = eng;
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    eng = engine ? engine : &led_engine;
+    eng->frame_request = 1;
+    wave_cache_invalidate();
+    __set_PRIMASK(primask);
+    HD_Timer1_Kick();
+    return previous;
 }
 
 /**
@@ -62,9 +171,10 @@ void LED_Init(void)
 void LED_On(LED_TypeDef led)
 {
     uint32_t idx = (uint32_t)led & (LED_COUNT - 1);  // Bitwise bounds check
-    BIT_SET(*LED_Config[idx].reg, LED_Config[idx].mask);
-    LED_Config[idx].state = 1;
-    LED_Config[idx].start_time = HD_GetTick();
+    *LED_Config[idx].bb = 1;
+    LED_TRACE_SAMPLE();
+    eng->led_state[idx] = 1;
+    eng->led_start[idx] = HD_GetTick();
 }
 
 /**
@@ -86,20 +196,24 @@ void LED_On_ms(LED_TypeDef led, uint32_t ms) {
 void LED_Off(LED_TypeDef led)
 {
     uint32_t idx = (uint32_t)led & (LED_COUNT - 1);  // Bitwise bounds check
-    BIT_CLR(*LED_Config[idx].reg, LED_Config[idx].mask);
-    LED_Config[idx].state = 0;
-    LED_Config[idx].start_time = 0;
+    *LED_Config[idx].bb = 0;
+    LED_TRACE_SAMPLE();
+    eng->led_state[idx] = 0;
+    eng->led_start[idx] = 0;
 }
 
 /**
   * @brief  Toggles specified LED using direct register access
+  * @note   Read then write of the alias word: other pins are never
+  *         touched, but a concurrent write to this LED can be lost
   */
 void LED_Toggle(LED_TypeDef led)
 {
     uint32_t idx = (uint32_t)led & (LED_COUNT - 1);  // Bitwise bounds check
-    BIT_TGL(*LED_Config[idx].reg, LED_Config[idx].mask);
-    LED_Config[idx].state ^= 1U;  // Toggle state using XOR
-    LED_Config[idx].start_time = HD_GetTick() & -(LED_Config[idx].state == 1); // Smart conditional update
+    *LED_Config[idx].bb ^= 1U;
+    LED_TRACE_SAMPLE();
+    eng->led_state[idx] ^= 1U;  // Toggle state using XOR
+    eng->led_start[idx] = HD_GetTick() & -(eng->led_state[idx] == 1); // Smart conditional update
 }
 
 /**
@@ -109,21 +223,84 @@ void LED_SetState(LED_TypeDef led, uint8_t state)
 {
     uint32_t idx = (uint32_t)led & (LED_COUNT - 1);
     
-    // Single line with ternary operator
-    state ? BIT_SET(*LED_Config[idx].reg, LED_Config[idx].mask) : 
-            BIT_CLR(*LED_Config[idx].reg, LED_Config[idx].mask);
+    // Single atomic store, any non-zero state turns the LED on
+    *LED_Config[idx].bb = (state != 0);
+    LED_TRACE_SAMPLE();
     
-    LED_Config[idx].state = state;
-    LED_Config[idx].start_time = HD_GetTick() & -(state == 1); // Update time only when turning on
+    eng->led_state[idx] = state;
+    eng->led_start[idx] = HD_GetTick() & -(state == 1); // Update time only when turning on
 }
 
 /**
-  * @brief  Gets current LED state
+  * @brief  Reads back the LED pin level
+  * @retval 1 when the pin is high, whoever drove it
   */
 uint8_t LED_GetState(LED_TypeDef led)
 {
     uint32_t idx = (uint32_t)led & (LED_COUNT - 1);
-    return LED_Config[idx].state;
+    // Read back the pin, PWM output does not track per-LED state
+    return (uint8_t)*LED_Config[idx].bb;
+}
+
+/**
+  * @brief  Reads back all LED pins
+  * @retval Bit n set when LED n is on
+  */
+uint32_t LED_GetPinBits(void)
+{
+    uint32_t bits = 0;
+
+    for (int i = 0; i < LED_COUNT; i++) {
+        bits |= *LED_Config[i].bb << i;
+    }
+    return bits;
+}
+
+/* Sequence layer frame of every LED bitmask: bit n lights byte lane n */
+#define LED_MASK_LANES(m) \
+    ((((m) & 1U) ? 0xFFUL : 0) | (((m) & 2U) ? 0xFF00UL : 0) | \
+     (((m) & 4U) ? 0xFF0000UL : 0) | (((m) & 8U) ? 0xFF000000UL : 0))
+
+static const LCOMP_Pixel4 mask_frame[1U << LCOMP_CHANNELS] = {
+    LED_MASK_LANES(0),  LED_MASK_LANES(1),  LED_MASK_LANES(2),  LED_MASK_LANES(3),
+    LED_MASK_LANES(4),  LED_MASK_LANES(5),  LED_MASK_LANES(6),  LED_MASK_LANES(7),
+    LED_MASK_LANES(8),  LED_MASK_LANES(9),  LED_MASK_LANES(10), LED_MASK_LANES(11),
+    LED_MASK_LANES(12), LED_MASK_LANES(13), LED_MASK_LANES(14), LED_MASK_LANES(15)
+};
+
+/**
+  * @brief  Moves every chaser one LED and publishes the combined frame
+  * @note   Interrupt context. A few instructions per chaser, however
+  *         many LEDs there are.
+  */
+static void sequence_step(void)
+{
+    uint32_t lit = 0;
+
+    for (uint32_t n = 0; n < eng->chaser_count; n++) {
+        uint32_t m = eng->chase_mask[n];
+        uint32_t bit = 1UL << n;
+
+        if (eng->chase_bounce & bit) {
+            /* Turn round at the end it is moving towards */
+            uint32_t edge = (eng->chase_backward & bit) ? 1UL : (1UL << (LED_COUNT - 1));
+
+            if (m & edge) {
+                eng->chase_backward ^= bit;
+            }
+            if (m != LED_ALL_MASK) {
+                m = (eng->chase_backward & bit) ? (m >> 1) : (m << 1);
+            }
+        } else if (eng->chase_backward & bit) {
+            m = ((m >> 1) | (m << (LED_COUNT - 1))) & LED_ALL_MASK;
+        } else {
+            m = ((m << 1) | (m >> (LED_COUNT - 1))) & LED_ALL_MASK;
+        }
+        eng->chase_mask[n] = m;
+        lit |= m;
+    }
+    eng->sequence_frame = mask_frame[lit];
+    HD_TRACE(SEQ_STEP, lit);
 }
 
 /**
@@ -131,14 +308,67 @@ uint8_t LED_GetState(LED_TypeDef led)
   */
 void LED_Sequence(uint32_t delay_time)
 {
-    sequence_active = 1;
-    current_led = 0;
-    sequence_start_time = HD_GetTick();
-    led_on_time = delay_time;
-    
-    // Turn on first LED
-    BIT_SET(*LED_Config[current_led].reg, LED_Config[current_led].mask);
-    LED_Config[current_led].state = 1;
+    static const LED_ChaserTypeDef single = { 0, 1, LED_CHASE_FORWARD };
+
+    LED_SequenceChasers(&single, 1, delay_time);
+}
+
+/**
+  * @brief  Starts a sequence of several chasers moving at once
+  * @note   Chasers may overlap, the lit LEDs are their union
+  * @param  chasers: chaser table, copied
+  * @param  count: 1..LED_CHASERS_MAX
+  * @param  delay_time: ms per step
+  * @retval HD_OK, HD_ERROR if a chaser does not fit the LEDs
+  */
+HD_StatusTypeDef LED_SequenceChasers(const LED_ChaserTypeDef* chasers, uint8_t count,
+                                     uint32_t delay_time)
+{
+    uint32_t mask[LED_CHASERS_MAX];
+    uint8_t backward = 0;
+    uint8_t bounce = 0;
+    uint32_t lit = 0;
+    uint32_t primask;
+
+    if (count == 0 || count > LED_CHASERS_MAX) {
+        return HD_ERROR;
+    }
+    for (uint32_t n = 0; n < count; n++) {
+        if (chasers[n].width == 0 || chasers[n].first + chasers[n].width > LED_COUNT) {
+            return HD_ERROR;
+        }
+    }
+
+    /* Built aside, then swapped in masked: LED_Process steps the table
+     * from TIMER1 and may itself be the caller (apply_params) */
+    for (uint32_t n = 0; n < count; n++) {
+        mask[n] = ((1UL << chasers[n].width) - 1) << chasers[n].first;
+        if (chasers[n].mode == LED_CHASE_BACKWARD) {
+            backward |= 1U << n;
+        } else if (chasers[n].mode == LED_CHASE_BOUNCE) {
+            bounce |= 1U << n;
+        }
+        lit |= mask[n];
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint32_t n = 0; n < count; n++) {
+        eng->chase_mask[n] = mask[n];
+    }
+    eng->chase_backward = backward;
+    eng->chase_bounce = bounce;
+    eng->chaser_count = count;
+    eng->sequence_start_time = HD_GetTick();
+    eng->led_on_time = delay_time;
+
+    // Start positions lit in the sequence layer, drawn from the next frame on
+    eng->sequence_frame = mask_frame[lit];
+    eng->frame_request = 1;
+    eng->sequence_active = 1;
+    __set_PRIMASK(primask);
+    HD_Timer1_Kick();
+    return HD_OK;
 }
 
 /**
@@ -146,8 +376,11 @@ void LED_Sequence(uint32_t delay_time)
   */
 void LED_SequenceStop(void)
 {
-    sequence_active = 0;
-    LED_AllOff();
+    eng->sequence_active = 0;
+    eng->frame_request = 1;
+    if (!LED_EFFECT_ACTIVE()) {
+        LED_AllOff();
+    }
 }
 
 /**
@@ -155,103 +388,730 @@ void LED_SequenceStop(void)
   */
 uint8_t LED_SequenceIsActive(void)
 {
-    return sequence_active;
+    return eng->sequence_active;
 }
 
 /**
-  * @brief  Turns on all LEDs using bit operations
+  * @brief  Turns on all LEDs using bit-band stores
   */
 void LED_AllOn(void)
 {
+    LED_PIN_MAP(LED_PIN_WRITE, 1)
+    LED_TRACE_SAMPLE();
     for (int i = 0; i < LED_COUNT; i++) {
-        BIT_SET(*LED_Config[i].reg, LED_Config[i].mask);
-        LED_Config[i].state = 1;
+        eng->led_state[i] = 1;
     }
 }
 
 /**
-  * @brief  Turns off all LEDs using bit operations
+  * @brief  Turns off all LEDs using bit-band stores
   */
 void LED_AllOff(void)
 {
+    LED_PIN_MAP(LED_PIN_WRITE, 0)
+    LED_TRACE_SAMPLE();
     for (int i = 0; i < LED_COUNT; i++) {
-        BIT_CLR(*LED_Config[i].reg, LED_Config[i].mask);
-        LED_Config[i].state = 0;
+        eng->led_state[i] = 0;
     }
 }
 
 /* PWM Wave functions */
-static uint32_t calculate_pwm_value(uint8_t led_index, uint32_t counter) {
-    uint32_t phase_shift = (pwm_period / LED_COUNT) * led_index;
-    uint32_t position = (counter + phase_shift) % pwm_period;
+static uint32_t calculate_wave_level(uint8_t led_index, uint32_t counter) {
+    uint32_t phase_shift = (eng->config.pwm_period / LED_COUNT) * led_index;
+    uint32_t position = (counter + phase_shift) % eng->config.pwm_period;
     
-    float angle = (2.0f * 3.14159f * position) / pwm_period;
+    float angle = (2.0f * 3.14159f * position) / eng->config.pwm_period;
     float sine_value = (sinf(angle) + 1.0f) / 2.0f;
     
-    return (uint32_t)(sine_value * 100);
+    return (uint32_t)(sine_value * 255);
 }
 
-static void set_led_pwm(LED_TypeDef led, uint32_t pwm_value) {
-    static uint32_t pwm_step = 0;
-    pwm_step = (pwm_step + 1) % 100;
-    
-    if (pwm_step < pwm_value) {
-        LED_On(led);
-    } else {
-        LED_Off(led);
+/**
+  * @brief  Frame LED_Process() is not reading, free to fill
+  */
+static LED_FrameTypeDef* back_frame(void)
+{
+    return (eng->front_frame == &eng->frames[0]) ? &eng->frames[1] : &eng->frames[0];
+}
+
+/**
+  * @brief  Fills the bit planes of a frame from its duty levels
+  */
+static void slice_frame(LED_FrameTypeDef* frame)
+{
+    for (int p = 0; p < LED_PORTID_COUNT; p++) {
+        for (int b = 0; b < LED_PWM_BITS; b++) {
+            frame->plane[p][b] = 0;
+        }
+    }
+    for (int i = 0; i < LED_COUNT; i++) {
+        for (int b = 0; b < LED_PWM_BITS; b++) {
+            if (frame->level[i] & (1U << b)) {
+                frame->plane[LED_Config[i].port_id][b] |= LED_Config[i].mask;
+            }
+        }
     }
 }
 
 void LED_StartPWMWave(void) {
-    wave_active = 1;
-    pwm_counter = 0;
-    last_pwm_update = HD_GetTick();
+    LED_FrameTypeDef* back;
+
+    /* Wave restarts at position 0, rebuild the cache with it */
+    eng->pwm_counter = 0;
+    wave_cache_invalidate();
+    eng->last_pwm_update = HD_GetTick();
+
+    /* Dark frame through the back buffer, the ISR keeps reading the front */
+    back = back_frame();
+    for (int i = 0; i < LED_COUNT; i++) {
+        back->level[i] = 0;
+        back->value[i] = 0;
+    }
+    slice_frame(back);
+    eng->front_frame = back;
+    eng->frame_request = 1;
+    eng->wave_active = 1;
+    HD_Timer1_Kick();
 }
 
 void LED_StopPWMWave(void) {
-    wave_active = 0;
-    LED_AllOff();
+    eng->wave_active = 0;
+    eng->frame_request = 1;
+    if (!LED_EFFECT_ACTIVE()) {
+        LED_AllOff();
+    }
+}
+
+/**
+  * @brief  Plays a compressed pattern (see led_pattern.h) on its own layer
+  * @param  data: pattern image in flash
+  * @param  size: image size in bytes
+  * @retval HD_OK, HD_ERROR if the image is malformed
+  */
+HD_StatusTypeDef LED_StartPattern(const uint8_t* data, uint32_t size)
+{
+    if (LPAT_Start(data, size, HD_GetTick()) != HD_OK) {
+        return HD_ERROR;
+    }
+    eng->pattern_active = 1;
+    eng->frame_request = 1;
+    HD_Timer1_Kick();
+    return HD_OK;
 }
 
-void LED_SetWaveSpeed(uint32_t speed) {
-    wave_speed = speed;
+/**
+  * @brief  Stops the pattern and removes its layer
+  */
+void LED_StopPattern(void)
+{
+    LPAT_Stop();
+    eng->pattern_active = 0;
+    eng->frame_request = 1;
+    if (!LED_EFFECT_ACTIVE()) {
+        LED_AllOff();
+    }
 }
 
-void LED_SetPWMPeriod(uint32_t period) {
-    pwm_period = period;
+uint8_t LED_PatternIsActive(void)
+{
+    return eng->pattern_active;
+}
+
+/**
+  * @brief  Shows the sound band levels on their own layer
+  * @note   Blocks come from the ADC only when ADCIN_AUDIO is defined,
+  *         otherwise the layer stays dark
+  */
+void LED_StartAudio(void)
+{
+    AFFT_Reset();
+    eng->audio_active = 1;
+    eng->frame_request = 1;
+    HD_Timer1_Kick();
+}
+
+/**
+  * @brief  Removes the sound layer
+  */
+void LED_StopAudio(void)
+{
+    eng->audio_active = 0;
+    eng->frame_request = 1;
+    if (!LED_EFFECT_ACTIVE()) {
+        LED_AllOff();
+    }
+}
+
+uint8_t LED_AudioIsActive(void)
+{
+    return eng->audio_active;
+}
+
+/**
+  * @brief  Publishes a new effect config (thread level, single writer)
+  */
+static void config_publish(const LED_EffectConfigTypeDef* config)
+{
+    eng->published.seq++;
+    __DMB();
+    eng->published.config = *config;
+    __DMB();
+    eng->published.seq++;
+}
+
+/**
+  * @brief  Takes the latest published config (LED_Render context)
+  * @note   Never waits: a block being written, or rewritten while it
+  *         was copied, leaves the previous config in use for one more
+  *         frame
+  * @retval 1 if a new config was taken
+  */
+static uint8_t config_acquire(void)
+{
+    uint32_t seq = eng->published.seq;
+    LED_EffectConfigTypeDef copy;
+
+    if ((seq & 1U) || seq == eng->config_seq) {
+        return 0;
+    }
+    __DMB();
+    copy = eng->published.config;
+    __DMB();
+    if (eng->published.seq != seq) {
+        return 0;
+    }
+    eng->config = copy;
+    eng->config_seq = seq;
+    return 1;
+}
+
+/**
+  * @brief  Replaces all effect parameters at once
+  * @note   Thread level only; used from the next rendered frame on
+  * @retval HD_OK, HD_ERROR if the config is invalid
+  */
+HD_StatusTypeDef LED_SetEffectConfig(const LED_EffectConfigTypeDef* config)
+{
+    if (config->pwm_period == 0) {
+        return HD_ERROR;
+    }
+    config_publish(config);
+    HD_Timer1_Kick();
+    return HD_OK;
+}
+
+/**
+  * @brief  Latest published effect parameters
+  * @note   Retries while a publish is in progress or overtook the copy
+  */
+void LED_GetEffectConfig(LED_EffectConfigTypeDef* config)
+{
+    uint32_t seq;
+
+    do {
+        seq = eng->published.seq;
+        __DMB();
+        *config = eng->published.config;
+        __DMB();
+    } while ((seq & 1U) || eng->published.seq != seq);
+}
+
+HD_StatusTypeDef LED_SetWaveSpeed(uint32_t speed) {
+    LED_EffectConfigTypeDef config;
+
+    LED_GetEffectConfig(&config);
+    config.wave_speed = speed;
+    return LED_SetEffectConfig(&config);
+}
+
+HD_StatusTypeDef LED_SetPWMPeriod(uint32_t period) {
+    LED_EffectConfigTypeDef config;
+
+    LED_GetEffectConfig(&config);
+    config.pwm_period = period;
+    return LED_SetEffectConfig(&config);
 }
 
 uint8_t LED_PWMWaveIsActive(void) {
-    return wave_active;
+    return eng->wave_active;
+}
+
+HD_StatusTypeDef LED_SetBrightness(uint8_t level) {
+    LED_EffectConfigTypeDef config;
+
+    LED_GetEffectConfig(&config);
+    config.brightness = level;
+    return LED_SetEffectConfig(&config);
+}
+
+void LED_SetAmbientLevel(uint8_t level) {
+    eng->ambient_level = level;
+}
+
+/**
+  * @brief  Submits a multi-parameter update
+  * @note   The whole batch, config fields and effect enables, is applied
+  *         by LED_Render before the next frame it builds, so no frame
+  *         shows part of an update
+  * @retval HD_BUSY if the previous update was not applied yet,
+  *         HD_ERROR if the update is invalid
+  */
+HD_StatusTypeDef LED_SubmitParams(const LED_ParamsTypeDef* params)
+{
+    if (eng->params_pending) {
+        return HD_BUSY;
+    }
+    if ((params->fields & LED_PARAM_PWM_PERIOD) && params->pwm_period == 0) {
+        return HD_ERROR;
+    }
+
+    HD_TRACE(PARAMS, params->fields);
+    eng->pending_params = *params;
+    __DMB();
+    eng->params_pending = 1;
+    return HD_OK;
+}
+
+/**
+  * @brief  Applies a submitted update (LED_Render context, frame boundary)
+  */
+static void apply_params(void)
+{
+    const LED_ParamsTypeDef *p = &eng->pending_params;
+    LED_EffectConfigTypeDef config;
+
+    if (p->fields & (LED_PARAM_WAVE_SPEED | LED_PARAM_PWM_PERIOD | LED_PARAM_BRIGHTNESS)) {
+        LED_GetEffectConfig(&config);
+        if (p->fields & LED_PARAM_WAVE_SPEED) {
+            config.wave_speed = p->wave_speed;
+        }
+        if (p->fields & LED_PARAM_PWM_PERIOD) {
+            config.pwm_period = p->pwm_period;
+        }
+        if (p->fields & LED_PARAM_BRIGHTNESS) {
+            config.brightness = p->brightness;
+        }
+        LED_SetEffectConfig(&config);
+    }
+    if (p->fields & LED_PARAM_WAVE_ENABLE) {
+        if (p->wave_enable && !eng->wave_active) {
+            LED_StartPWMWave();
+        } else if (!p->wave_enable && eng->wave_active) {
+            LED_StopPWMWave();
+        }
+    }
+    if (p->fields & LED_PARAM_SEQUENCE) {
+        if (p->sequence_delay != 0) {
+            LED_Sequence(p->sequence_delay);
+        } else if (eng->sequence_active) {
+            LED_SequenceStop();
+        }
+    }
+    __DMB();
+    eng->params_pending = 0;
+}
+
+/**
+  * @brief  One sigma-delta step of one LED (TIMER1 interrupt context)
+  * @note   First order: add the level, on when the accumulator carries.
+  *         Second order: two integrators on the bipolar error, on when
+  *         the second is non-negative. Full off/on bypass the modulator.
+  * @retval 1 if the LED is on for this tick
+  */
+static uint32_t sigma_delta_step(int i, uint32_t value)
+{
+    int32_t y;
+
+    if (value == 0 || value >= LED_SD_FULL_SCALE) {
+        return value != 0;
+    }
+
+    if (eng->output_mode == LED_OUTPUT_SD1) {
+        eng->sd_acc1[i] += (int32_t)value;
+        if (eng->sd_acc1[i] >= LED_SD_FULL_SCALE) {
+            eng->sd_acc1[i] -= LED_SD_FULL_SCALE;
+            return 1;
+        }
+        return 0;
+    }
+
+    /* Last output is kept as the sign of the second integrator */
+    y = (eng->sd_acc2[i] >= 0) ? LED_SD_FULL_SCALE : -LED_SD_FULL_SCALE;
+    eng->sd_acc1[i] += (2 * (int32_t)value - LED_SD_FULL_SCALE) - y;
+    eng->sd_acc2[i] += eng->sd_acc1[i] - y;
+    return eng->sd_acc2[i] >= 0;
+}
+
+/**
+  * @brief  Selects PWM or sigma-delta pin output
+  */
+void LED_SetOutputMode(LED_OutputModeTypeDef mode)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    for (int i = 0; i < LED_COUNT; i++) {
+        eng->sd_acc1[i] = 0;
+        eng->sd_acc2[i] = -1;
+    }
+    eng->output_mode = mode;
+    __set_PRIMASK(primask);
+    HD_Timer1_Kick();
+}
+
+LED_OutputModeTypeDef LED_GetOutputMode(void)
+{
+    return eng->output_mode;
+}
+
+/* Non-zero when two frames differ in any LED duty */
+static uint8_t frame_changed(const LED_FrameTypeDef* a, const LED_FrameTypeDef* b)
+{
+    for (int i = 0; i < LED_COUNT; i++) {
+        if (a->level[i] != b->level[i] || a->value[i] != b->value[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+  * @brief  Time until the next LED pin change
+  * @note   Called by the TIMER1 handler right after LED_Process to arm
+  *         the next event, so nothing runs on ticks where no pin changes
+  * @retval Microseconds, LED_NO_EVENT if nothing is scheduled
+  */
+uint32_t LED_NextEventUs(void)
+{
+    uint32_t next = LED_NO_EVENT;
+
+    if (eng->wave_active) {
+        /* Wave phase moves every tick, every 2nd one when degraded */
+        return (eng->quality >= LED_QUALITY_HALF_RATE) ? 2000 : 1000;
+    }
+    if (eng->pattern_active || eng->audio_active) {
+        /* Pattern frames are timed in ticks, ADC blocks arrive every few */
+        return 1000;
+    }
+    if (eng->output_mode != LED_OUTPUT_PWM && LED_EFFECT_ACTIVE()) {
+        /* Sigma-delta decides every tick for LEDs between off and full */
+        for (int i = 0; i < LED_COUNT; i++) {
+            uint32_t value = eng->front_frame->value[i];
+
+            if (value != 0 && value < LED_SD_FULL_SCALE) {
+                return 1000;
+            }
+        }
+    }
+
+    if (eng->sequence_active) {
+        const LED_FrameTypeDef *frame = eng->front_frame;
+        uint32_t elapsed = HD_GetTick() - eng->sequence_start_time;
+        uint32_t left = (elapsed < eng->led_on_time) ? (eng->led_on_time - elapsed) : 1;
+
+        next = left * 1000;
+
+        /* Duty edges: off when the step reaches the duty, on again at 0 */
+        for (int i = 0; i < LED_COUNT; i++) {
+            uint32_t level = frame->level[i];
+            uint32_t steps;
+
+            if (level == 0 || level >= LED_PWM_STEPS) {
+                continue;
+            }
+            steps = (level > eng->pwm_step) ? (level - eng->pwm_step) : (LED_PWM_STEPS - eng->pwm_step);
+            if (steps * 1000 < next) {
+                next = steps * 1000;
+            }
+        }
+    }
+    return next;
+}
+
+/**
+  * @brief  Drops all cached frames and sizes the cache for the current
+  *         wave parameters (LED_Render context)
+  */
+static void wave_cache_rebuild(void)
+{
+    uint32_t a = eng->config.pwm_period;
+    uint32_t b = eng->config.wave_speed % eng->config.pwm_period;
+    uint32_t cycle;
+
+    wave_cache_stale = 0;
+    while (b != 0) {
+        uint32_t t = a % b;
+
+        a = b;
+        b = t;
+    }
+    wave_cache_step = a;
+    cycle = eng->config.pwm_period / a;
+
+    for (uint32_t i = 0; i < (LED_WAVE_CACHE_FRAMES + 31) / 32; i++) {
+        wave_cache_valid[i] = 0;
+    }
+    wave_cache_stats.cycle_frames = cycle;
+    wave_cache_stats.bytes_used = (cycle <= LED_WAVE_CACHE_FRAMES) ?
+                                  cycle * 4 + ((cycle + 31) / 32) * 4 : 0;
+}
+
+/**
+  * @brief  Wave layer frame at the current wave position
+  */
+static LCOMP_Pixel4 wave_frame(void)
+{
+    uint32_t index;
+    LCOMP_Pixel4 wave = 0;
+
+    if (wave_cache_stale) {
+        wave_cache_rebuild();
+    }
+
+    index = eng->pwm_counter / wave_cache_step;
+    if (wave_cache_stats.cycle_frames <= LED_WAVE_CACHE_FRAMES &&
+        (wave_cache_valid[index / 32] & (1UL << (index % 32)))) {
+        wave_cache_stats.hits++;
+        return wave_cache[index];
+    }
+
+    for (int i = 0; i < LED_COUNT; i++) {
+        wave |= calculate_wave_level(i, eng->pwm_counter) << (8 * i);
+    }
+    if (wave_cache_stats.cycle_frames <= LED_WAVE_CACHE_FRAMES) {
+        wave_cache[index] = wave;
+        wave_cache_valid[index / 32] |= 1UL << (index % 32);
+        wave_cache_stats.misses++;
+    } else {
+        wave_cache_stats.bypassed++;
+    }
+    return wave;
+}
+
+/**
+  * @brief  Renders the next frame into the back buffer (thread level)
+  * @note   Wave and sequence are separate compositor layers, so both can
+  *         run at once. Wave position follows elapsed ticks, so a slow
+  *         render only lowers the frame rate, never the wave speed or
+  *         output timing.
+  */
+void LED_Render(void)
+{
+    LED_FrameTypeDef *back;
+    LCOMP_Pixel4 out;
+    uint8_t changed;
+    uint32_t current_time;
+    uint32_t scale;
+
+    /* Frame boundary: take a batched update as a whole, its config is
+     * then picked up below together with its effect changes */
+    if (eng->params_pending) {
+        apply_params();
+    }
+
+    if (!eng->frame_request || !LED_EFFECT_ACTIVE()) {
+        return;
+    }
+
+    /* Frame boundary: switch to a newly published config */
+    if (config_acquire()) {
+        wave_cache_invalidate();
+    }
+    scale = ((uint32_t)eng->config.brightness * eng->ambient_level) / 255;
+
+    /* Degraded: keep showing the current frame for 3 of 4 requests */
+    if (eng->quality >= LED_QUALITY_SKIP_FRAMES && (eng->render_count++ & 3U) != 0) {
+        eng->frame_request = 0;
+        return;
+    }
+
+    current_time = HD_GetTick();
+
+    if (eng->wave_active) {
+        eng->pwm_counter = (eng->pwm_counter + eng->config.wave_speed * (current_time - eng->last_pwm_update)) % eng->config.pwm_period;
+        LCOMP_SetFrame(LCOMP_LAYER_WAVE, wave_frame());
+    }
+    eng->last_pwm_update = current_time;
+    LCOMP_Enable(LCOMP_LAYER_WAVE, eng->wave_active);
+
+    LCOMP_SetFrame(LCOMP_LAYER_SEQUENCE, eng->sequence_frame);
+    LCOMP_Enable(LCOMP_LAYER_SEQUENCE, eng->sequence_active);
+
+    if (eng->pattern_active) {
+        LCOMP_SetFrame(LCOMP_LAYER_PATTERN, LPAT_Next(current_time));
+
+        /* A pattern without LPAT_FLAG_LOOP ends after its last frame time */
+        if (!LPAT_IsActive()) {
+            LED_StopPattern();
+            if (!LED_EFFECT_ACTIVE()) {
+                return;
+            }
+        }
+    }
+    LCOMP_Enable(LCOMP_LAYER_PATTERN, eng->pattern_active);
+
+    if (eng->audio_active) {
+        LCOMP_SetFrame(LCOMP_LAYER_AUDIO, AFFT_Next());
+    }
+    LCOMP_Enable(LCOMP_LAYER_AUDIO, eng->audio_active);
+
+    out = LCOMP_Scale(LCOMP_Compose(current_time), scale + (scale >> 7));
+#ifdef LED_MATRIX
+    LMTX_SetChannels(out);
+#endif
+
+    /* Byte lanes 0..255 to PWM duty 0..LED_PWM_STEPS */
+    back = back_frame();
+    for (int i = 0; i < LED_COUNT; i++) {
+        back->value[i] = (uint8_t)(out >> (8 * i));
+        back->level[i] = (uint8_t)((back->value[i] * LED_PWM_STEPS + 127) / 255);
+        if (eng->quality >= LED_QUALITY_COARSE_PWM && back->level[i] < LED_PWM_STEPS) {
+            back->level[i] &= (uint8_t)~3U;
+        }
+    }
+    slice_frame(back);
+
+    /* Single aligned word store - the ISR sees either the old or the new frame */
+    eng->frame_request = 0;
+    changed = frame_changed(eng->front_frame, back);
+    eng->front_frame = back;
+    eng->frames_rendered++;
+    HD_TRACE(FRAME, eng->frames_rendered);
+
+    /* The output ISR only wakes for scheduled edges, tell it about new ones */
+    if (changed) {
+        HD_Timer1_Kick();
+    }
+}
+
+/**
+  * @brief  Number of frames LED_Render() has published
+  */
+uint32_t LED_GetFrameCount(void)
+{
+    return eng->frames_rendered;
+}
+
+/**
+  * @brief  True when LED_Render() has a batched update or a frame to produce
+  */
+bool LED_RenderPending(void)
+{
+    return eng->params_pending || (eng->frame_request && LED_EFFECT_ACTIVE());
+}
+
+/**
+  * @brief  Counts an output deadline miss (TIMER1 interrupt context)
+  */
+void LED_ReportOverrun(void)
+{
+    eng->window_faults++;
+}
+
+/**
+  * @brief  Current adaptive quality level
+  */
+LED_QualityTypeDef LED_GetQualityLevel(void)
+{
+    return eng->quality;
+}
+
+/**
+  * @brief  Wave frame cache counters and memory in use
+  */
+const LED_WaveCacheStatsTypeDef* LED_GetWaveCacheStats(void)
+{
+    return &wave_cache_stats;
+}
+
+/**
+  * @brief  Frames the renderer did not deliver in time
+  */
+uint32_t LED_GetFrameDrops(void)
+{
+    return eng->frame_drops;
+}
+
+/**
+  * @brief  Quality policy, evaluated once per LED_QUALITY_WINDOW_MS
+  * @note   Degrades one level at a time when a window sees too many
+  *         overruns or dropped frames, recovers one level after
+  *         LED_QUALITY_RECOVER_MS without any
+  */
+static void update_quality(uint32_t current_time)
+{
+    if ((current_time - eng->window_start) < LED_QUALITY_WINDOW_MS) {
+        return;
+    }
+
+    if (eng->window_faults >= LED_QUALITY_DEGRADE_AT) {
+        if (eng->quality < LED_QUALITY_SKIP_FRAMES) {
+            eng->quality = (LED_QualityTypeDef)(eng->quality + 1);
+        }
+        eng->clean_since = current_time;
+    } else if (eng->window_faults != 0) {
+        eng->clean_since = current_time;
+    } else if ((current_time - eng->clean_since) >= LED_QUALITY_RECOVER_MS &&
+               eng->quality > LED_QUALITY_FULL) {
+        eng->quality = (LED_QualityTypeDef)(eng->quality - 1);
+        eng->clean_since = current_time;
+    }
+
+    eng->window_faults = 0;
+    eng->window_start = current_time;
 }
 
 /**
   * @brief  Main LED process function called from timer interrupt
+  * @note   Only compares the front frame against the PWM step and drives
+  *         the pins, its cost does not depend on the effect being rendered
+  *         nor on the number of LEDs per port
   */
 void LED_Process(void){
     uint32_t current_time = HD_GetTick();
-    
-    /* Process PWM Wave if active */
-    if (wave_active) {
-        if ((current_time - last_pwm_update) >= pwm_update_interval) {
-            last_pwm_update = current_time;
-            
-            pwm_counter = (pwm_counter + wave_speed) % pwm_period;
-            
+
+    /* Output the published frame */
+    if (LED_EFFECT_ACTIVE()) {
+        const LED_FrameTypeDef *frame = eng->front_frame;
+        uint32_t step;
+
+        /* Wave frame requested on an earlier tick and still not rendered */
+        if (eng->frame_request && eng->wave_active && current_time != eng->last_process_time) {
+            eng->frame_drops++;
+            eng->window_faults++;
+        }
+
+        if (eng->output_mode != LED_OUTPUT_PWM) {
+            uint32_t on[LED_PORTID_COUNT] = {0};
+
+            /* One modulator step per event, the mode keeps events at 1 ms */
             for (int i = 0; i < LED_COUNT; i++) {
-                uint32_t pwm_value = calculate_pwm_value(i, pwm_counter);
-                set_led_pwm((LED_TypeDef)i, pwm_value);
+                if (sigma_delta_step(i, frame->value[i])) {
+                    on[LED_Config[i].port_id] |= LED_Config[i].mask;
+                }
             }
+            LED_FOR_EACH_PORT(LED_PORT_SD)
+        } else {
+            /* Events are not periodic, advance by the ticks actually elapsed */
+            eng->pwm_step = (eng->pwm_step + (current_time - eng->last_process_time)) % LED_PWM_STEPS;
+            step = eng->pwm_step;
+            LED_FOR_EACH_PORT(LED_PORT_PWM)
+        }
+        HD_RecordPinLatency();
+        if (eng->frames_rendered != 0) {
+            HD_LatchBootCycles();
         }
+        LED_TRACE_SAMPLE();
+        eng->frame_request = 1;
     }
     
-    /* Process LED sequence if active */
-    if (sequence_active) {
-        if ((current_time - sequence_start_time) >= led_on_time) {
-            LED_Off((LED_TypeDef)current_led);
-            current_led = (current_led + 1) % LED_COUNT;
-            LED_On((LED_TypeDef)current_led);
-            sequence_start_time = current_time;
+    /* Step LED sequence if active, the renderer draws it */
+    if (eng->sequence_active) {
+        if ((current_time - eng->sequence_start_time) >= eng->led_on_time) {
+            sequence_step();
+            eng->sequence_start_time = current_time;
         }
     }
+    update_quality(current_time);
+    eng->last_process_time = current_time;
 }
\ No newline at end of file
@@ -0,0 +1,161 @@
+#include "low_power.h"
+#include "main.h"
+#include "MDR32FxQI_bkp.h"
+
+#define LP_MAX_SLEEP_MS     1000        /* buttons are polled at least this often */
+
+static bool enabled = false;
+static uint32_t sleep_clock = RST_CLK_CPUclkLSE;
+static uint32_t frac_q16 = 0;           // ms fraction carried to the next wake
+static uint32_t wake_event = 0;         // TIMER1 event count at the last wake
+static LP_StatsTypeDef stats;
+
+/**
+  * @brief  Starts the RTC from LSE, or LSI if LSE does not come up
+  * @retval HD_OK, HD_TIMEOUT if neither low-speed clock starts
+  */
+HD_StatusTypeDef LP_Init(void)
+{
+    uint32_t source_hz = LSE_Value;
+
+    RST_CLK_PCLKcmd(RST_CLK_PCLK_BKP, ENABLE);
+
+    RST_CLK_LSEconfig(RST_CLK_LSE_ON);
+    if (RST_CLK_LSEstatus() == SUCCESS) {
+        BKP_RTCclkSource(BKP_RTC_LSEclk);
+        sleep_clock = RST_CLK_CPUclkLSE;
+    } else {
+        RST_CLK_LSEconfig(RST_CLK_LSE_OFF);
+        RST_CLK_LSIcmd(ENABLE);
+        if (RST_CLK_LSIstatus() != SUCCESS) {
+            return HD_TIMEOUT;
+        }
+        BKP_RTCclkSource(BKP_RTC_LSIclk);
+        sleep_clock = RST_CLK_CPUclkLSI;
+        source_hz = LSI_Value;
+    }
+
+    BKP_RTC_WaitForUpdate();
+    BKP_RTC_SetPrescaler(LP_RTC_DIV);
+    BKP_RTC_WaitForUpdate();
+    BKP_RTC_ITConfig(BKP_RTC_IT_ALRF, ENABLE);
+    BKP_RTC_Enable(ENABLE);
+
+    NVIC_SetPriority(BACKUP_IRQn, 3);
+    NVIC_EnableIRQ(BACKUP_IRQn);
+
+    stats.rtc_hz = source_hz / LP_RTC_DIV;
+    return HD_OK;
+}
+
+/**
+  * @brief  Allows or forbids deep sleep in HD_Idle()
+  */
+void LP_Enable(bool enable)
+{
+    enabled = enable && (stats.rtc_hz != 0);
+}
+
+/* RTC alarm: only wakes the core, the flag is cleared here */
+void BACKUP_IRQHandler(void)
+{
+    MDR_BKP->RTC_CS |= BKP_RTC_CS_ALRF;
+}
+
+/* RTC counts to ms, keeping the fraction and correcting the drift */
+static uint32_t counts_to_ms(uint32_t counts)
+{
+    uint64_t q16 = (((uint64_t)counts * (1000UL << 16)) / stats.rtc_hz) + frac_q16;
+
+    q16 -= (uint64_t)(((int64_t)q16 * LP_DRIFT_PPM) / 1000000);
+    frac_q16 = (uint32_t)(q16 & 0xFFFFU);
+    return (uint32_t)(q16 >> 16);
+}
+
+/**
+  * @brief  Sleeps in the low-power clock until shortly before us
+  * @note   Called from HD_Idle with interrupts masked. Any interrupt
+  *         ends the sleep early; the time actually slept is measured
+  *         on the RTC, so the tick stays right either way. After a wake
+  *         the next gap is only trusted once TIMER1 has handled the
+  *         kicked event: until then LED_NextEventUs still describes the
+  *         time before the sleep.
+  * @param  us: time until the next LED change, LED_NO_EVENT if none
+  * @retval HD_OK if slept, HD_BUSY if the gap is too short or disabled
+  */
+HD_StatusTypeDef LP_Sleep(uint32_t us)
+{
+    uint32_t cycles_start;
+    uint32_t cpu_clock;
+    uint32_t counts;
+    uint32_t start, alarm, now;
+    uint32_t ms;
+    int32_t late;
+
+    if (!enabled || us < LP_MIN_SLEEP_MS * 1000UL || HD_GetTimer1Wakeups() == wake_event) {
+        return HD_BUSY;
+    }
+    if (us > LP_MAX_SLEEP_MS * 1000UL) {
+        us = LP_MAX_SLEEP_MS * 1000UL;
+    }
+
+    /* Alarm early by the wake latency, rounding down wakes earlier still */
+    counts = (uint32_t)(((uint64_t)(us - LP_WAKE_US) * stats.rtc_hz) / 1000000UL);
+    if (counts == 0) {
+        return HD_BUSY;
+    }
+
+    /* Stop the 1 ms timers */
+    cycles_start = DWT->CYCCNT;
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+    MDR_TIMER1->CNTRL &= ~TIMER_CNTRL_CNT_EN;
+
+    start = BKP_RTC_GetCounter();
+    alarm = start + counts;
+    BKP_RTC_WaitForUpdate();
+    BKP_RTC_SetAlarm(alarm);
+    BKP_RTC_WaitForUpdate();
+
+    /* Down to the RTC clock, HSI off */
+    cpu_clock = MDR_RST_CLK->CPU_CLOCK;
+    RST_CLK_CPUclkSelection(sleep_clock);
+    RST_CLK_HSIcmd(DISABLE);
+
+    __WFI();
+
+    /* HSI back, then the saved CPU clock selection */
+    RST_CLK_HSIcmd(ENABLE);
+    RST_CLK_HSIstatus();
+    MDR_RST_CLK->CPU_CLOCK = cpu_clock;
+
+    now = BKP_RTC_GetCounter();
+    late = (int32_t)(now - alarm);
+    ms = counts_to_ms(now - start);
+
+    /* Time moves on as if the core had been running */
+    HD_AdvanceTick(ms);
+    DWT->CYCCNT = cycles_start + ms * (HD_GetSystemClock() / 1000);
+
+    SysTick->VAL = 0;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+    MDR_TIMER1->CNTRL |= TIMER_CNTRL_CNT_EN;
+    wake_event = HD_GetTimer1Wakeups();
+    HD_Timer1_Kick();
+
+    stats.sleeps++;
+    stats.slept_ms += ms;
+    stats.last_late_counts = late;
+    if (late > stats.max_late_counts) {
+        stats.max_late_counts = late;
+    }
+    return HD_OK;
+}
+
+/**
+  * @brief  Sleep statistics; late counts above LP_WAKE_US mean the
+  *         wake latency model is too optimistic
+  */
+const LP_StatsTypeDef* LP_GetStats(void)
+{
+    return &stats;
+}
@@ -0,0 +1,312 @@
+#include "param_store.h"
+#include "main.h"
+#include "MDR32FxQI_eeprom.h"
+
+/* Log-structured parameter store in two main flash pages.
+ *
+ * Page layout:
+ *   +0  magic       written last when a page is (re)built - commit mark
+ *   +4  generation  highest valid generation is the active page
+ *   +8  records     appended in order, never rewritten
+ *
+ * Record layout (two words, value programmed first):
+ *   word0  [31:24] key  [23:16] ~key  [15:0] CRC16(key, value)
+ *   word1  value
+ *
+ * A record torn by power loss fails its CRC and is skipped, a page torn
+ * during compaction has no magic and the previous page stays active. */
+
+#define PARAM_ERASED            0xFFFFFFFFUL
+#define PARAM_NO_PAGE           0xFFUL
+
+typedef enum {
+    PARAM_STATE_IDLE = 0,
+    PARAM_STATE_ERASE,
+    PARAM_STATE_COPY,
+    PARAM_STATE_COMMIT
+} PARAM_StateTypeDef;
+
+/* RAM index: latest value of every key, O(1) reads */
+static uint32_t param_value[PARAM_KEY_COUNT];
+static volatile uint32_t param_valid = 0;   // Bit per key: value present
+static volatile uint32_t param_dirty = 0;   // Bit per key: not yet in flash
+
+// Log position
+static uint8_t active_page = PARAM_NO_PAGE;
+static uint32_t active_generation = 0;
+static uint32_t write_offset = PARAM_HEADER_SIZE;
+
+// Compaction state
+static PARAM_StateTypeDef param_state = PARAM_STATE_IDLE;
+static uint32_t copy_key = 0;
+static uint32_t copy_offset = PARAM_HEADER_SIZE;
+
+static uint32_t page_addr(uint8_t page)
+{
+    return page ? PARAM_PAGE1_ADDR : PARAM_PAGE0_ADDR;
+}
+
+static uint32_t flash_read(uint32_t addr)
+{
+    return *(const volatile uint32_t*)(uintptr_t)addr;
+}
+
+/* Flash is not readable while it is being programmed, and the vector table
+ * and every handler live in it, so interrupts are held off for the whole
+ * operation: about 40 us for a word, 40 ms for a page erase. Interrupts
+ * raised meanwhile are taken once, late, when the mask drops: TIMER1 LED
+ * output holds its levels through an erase, and the SysTick expiries past
+ * the pending one are added back to the tick here. */
+typedef struct {
+    uint32_t primask;
+    uint32_t cycles;    // DWT->CYCCNT at the start
+    uint32_t systick;   // SysTick->VAL at the start
+} PARAM_StallTypeDef;
+
+static void flash_stall_begin(PARAM_StallTypeDef* stall)
+{
+    stall->primask = __get_PRIMASK();
+    __disable_irq();
+    stall->cycles = DWT->CYCCNT;
+    stall->systick = SysTick->VAL;
+}
+
+static void flash_stall_end(const PARAM_StallTypeDef* stall)
+{
+    uint32_t elapsed = DWT->CYCCNT - stall->cycles;
+    uint32_t period = (SysTick->LOAD & SysTick_LOAD_RELOAD_Msk) + 1;
+
+    /* First expiry systick + 1 cycles in, then one per period */
+    if ((SysTick->CTRL & SysTick_CTRL_ENABLE_Msk) && elapsed > stall->systick) {
+        HD_AdvanceTick((elapsed - stall->systick - 1) / period);
+    }
+    __set_PRIMASK(stall->primask);
+}
+
+static void flash_program(uint32_t addr, uint32_t data)
+{
+    PARAM_StallTypeDef stall;
+
+    flash_stall_begin(&stall);
+    EEPROM_ProgramWord(addr, EEPROM_Main_Bank_Select, data);
+    flash_stall_end(&stall);
+}
+
+static void flash_erase(uint32_t addr)
+{
+    PARAM_StallTypeDef stall;
+
+    flash_stall_begin(&stall);
+    EEPROM_ErasePage(addr, EEPROM_Main_Bank_Select);
+    flash_stall_end(&stall);
+}
+
+static uint16_t record_crc(uint32_t key, uint32_t value)
+{
+    uint8_t buf[5];
+
+    buf[0] = (uint8_t)key;
+    buf[1] = (uint8_t)value;
+    buf[2] = (uint8_t)(value >> 8);
+    buf[3] = (uint8_t)(value >> 16);
+    buf[4] = (uint8_t)(value >> 24);
+    return HD_CRC16(buf, sizeof(buf));
+}
+
+static uint32_t record_header(uint32_t key, uint32_t value)
+{
+    return (key << 24) | ((~key & 0xFFUL) << 16) | record_crc(key, value);
+}
+
+static uint8_t record_is_valid(uint32_t word0, uint32_t word1)
+{
+    uint32_t key = word0 >> 24;
+
+    if (((word0 >> 16) & 0xFFUL) != (~key & 0xFFUL) || key >= PARAM_KEY_COUNT) {
+        return 0;
+    }
+    return (word0 & 0xFFFFUL) == record_crc(key, word1);
+}
+
+static void record_write(uint32_t addr, uint32_t key, uint32_t value)
+{
+    flash_program(addr + 4, value);
+    flash_program(addr, record_header(key, value));
+}
+
+/**
+  * @brief  Replays the active page into the RAM index
+  */
+static void page_scan(uint8_t page)
+{
+    uint32_t base = page_addr(page);
+    uint32_t offset;
+
+    write_offset = PARAM_PAGE_SIZE;
+    for (offset = PARAM_HEADER_SIZE; offset < PARAM_PAGE_SIZE; offset += PARAM_RECORD_SIZE) {
+        uint32_t word0 = flash_read(base + offset);
+        uint32_t word1 = flash_read(base + offset + 4);
+
+        if (word0 == PARAM_ERASED && word1 == PARAM_ERASED) {
+            write_offset = offset;
+            break;
+        }
+        if (record_is_valid(word0, word1)) {
+            param_value[word0 >> 24] = word1;
+            param_valid |= 1UL << (word0 >> 24);
+        }
+    }
+}
+
+/**
+  * @brief  Erases a page and makes it the active one with no records
+  */
+static void page_format(uint8_t page, uint32_t generation)
+{
+    uint32_t base = page_addr(page);
+
+    flash_erase(base);
+    flash_program(base + 4, generation);
+    flash_program(base, PARAM_PAGE_MAGIC);
+    active_page = page;
+    active_generation = generation;
+    write_offset = PARAM_HEADER_SIZE;
+}
+
+/**
+  * @brief  Builds the RAM index from flash (called once at boot)
+  */
+void PARAM_Init(void)
+{
+    uint32_t generation[2];
+    uint8_t valid[2];
+
+    RST_CLK_PCLKcmd(RST_CLK_PCLK_EEPROM, ENABLE);
+
+    for (uint8_t page = 0; page < 2; page++) {
+        valid[page] = (flash_read(page_addr(page)) == PARAM_PAGE_MAGIC);
+        generation[page] = flash_read(page_addr(page) + 4);
+    }
+
+    param_valid = 0;
+    param_dirty = 0;
+    param_state = PARAM_STATE_IDLE;
+
+    if (valid[0] && valid[1]) {
+        active_page = (generation[1] > generation[0]) ? 1 : 0;
+    } else if (valid[0] || valid[1]) {
+        active_page = valid[1] ? 1 : 0;
+    } else {
+        page_format(0, 1);
+        return;
+    }
+
+    active_generation = generation[active_page];
+    page_scan(active_page);
+}
+
+/**
+  * @brief  Reads a parameter from the RAM index
+  * @retval HD_OK if the key has a stored value, HD_ERROR otherwise
+  *         (value is left untouched so callers can preload a default)
+  */
+HD_StatusTypeDef PARAM_Get(PARAM_KeyTypeDef key, uint32_t* value)
+{
+    if ((uint32_t)key >= PARAM_KEY_COUNT || !(param_valid & (1UL << key))) {
+        return HD_ERROR;
+    }
+    *value = param_value[key];
+    return HD_OK;
+}
+
+/**
+  * @brief  Updates a parameter, the flash write is done later by PARAM_Process
+  */
+HD_StatusTypeDef PARAM_Set(PARAM_KeyTypeDef key, uint32_t value)
+{
+    if ((uint32_t)key >= PARAM_KEY_COUNT) {
+        return HD_ERROR;
+    }
+    if ((param_valid & (1UL << key)) && param_value[key] == value) {
+        return HD_OK;
+    }
+    param_value[key] = value;
+    param_valid |= 1UL << key;
+    param_dirty |= 1UL << key;
+    return HD_OK;
+}
+
+/**
+  * @brief  Does at most one flash step (call from the main loop)
+  * @note   A step is one record append (two words, about 80 us) or one
+  *         compaction step. The page erase at the start of a compaction
+  *         stalls the core with interrupts masked for about 40 ms, LED
+  *         output included; it comes once per page of appends.
+  * @retval HD_BUSY while work is pending, HD_OK when flash is up to date
+  */
+HD_StatusTypeDef PARAM_Process(void)
+{
+    uint8_t other = active_page ^ 1U;
+
+    switch (param_state) {
+    case PARAM_STATE_IDLE:
+        if (param_dirty == 0) {
+            return HD_OK;
+        }
+        if (write_offset + PARAM_RECORD_SIZE > PARAM_PAGE_SIZE) {
+            param_state = PARAM_STATE_ERASE;
+            return HD_BUSY;
+        }
+        for (uint32_t key = 0; key < PARAM_KEY_COUNT; key++) {
+            if (param_dirty & (1UL << key)) {
+                param_dirty &= ~(1UL << key);
+                record_write(page_addr(active_page) + write_offset, key, param_value[key]);
+                write_offset += PARAM_RECORD_SIZE;
+                break;
+            }
+        }
+        return param_dirty ? HD_BUSY : HD_OK;
+
+    case PARAM_STATE_ERASE:
+        /* Wear levelling: pages alternate on every compaction */
+        flash_erase(page_addr(other));
+        copy_key = 0;
+        copy_offset = PARAM_HEADER_SIZE;
+        param_state = PARAM_STATE_COPY;
+        return HD_BUSY;
+
+    case PARAM_STATE_COPY:
+        /* Keys set after being copied stay dirty and are appended later */
+        while (copy_key < PARAM_KEY_COUNT && !(param_valid & (1UL << copy_key))) {
+            copy_key++;
+        }
+        if (copy_key < PARAM_KEY_COUNT) {
+            param_dirty &= ~(1UL << copy_key);
+            record_write(page_addr(other) + copy_offset, copy_key, param_value[copy_key]);
+            copy_offset += PARAM_RECORD_SIZE;
+            copy_key++;
+        } else {
+            param_state = PARAM_STATE_COMMIT;
+        }
+        return HD_BUSY;
+
+    case PARAM_STATE_COMMIT:
+        flash_program(page_addr(other) + 4, active_generation + 1);
+        flash_program(page_addr(other), PARAM_PAGE_MAGIC);
+        active_page = other;
+        active_generation++;
+        write_offset = copy_offset;
+        param_state = PARAM_STATE_IDLE;
+        return param_dirty ? HD_BUSY : HD_OK;
+    }
+
+    return HD_ERROR;
+}
+
+/**
+  * @brief  Check if flash writes are pending
+  */
+uint8_t PARAM_IsBusy(void)
+{
+    return (param_dirty != 0) || (param_state != PARAM_STATE_IDLE);
+}
@@ -0,0 +1,407 @@
+#include "uart_cmd.h"
+#include "main.h"
+#include "leds.h"
+#include "param_store.h"
+#include "hd_trace.h"
+#include "hd_fast.h"
+#include "MDR32FxQI_uart.h"
+#include "MDR32FxQI_dma.h"
+
+/* Command link on the debug UART pins from MDR32FxQI_config.h */
+#if defined (_USE_DEBUG_UART_)
+#define UCMD_UART               DEBUG_UART
+#define UCMD_UART_PORT          DEBUG_UART_PORT
+#define UCMD_UART_PINS          DEBUG_UART_PINS
+#define UCMD_UART_PINS_FUNCTION DEBUG_UART_PINS_FUNCTION
+#define UCMD_BAUD_RATE          DEBUG_BAUD_RATE
+#else
+#define UCMD_UART               MDR_UART2
+#define UCMD_UART_PORT          MDR_PORTF
+#define UCMD_UART_PINS          (PORT_Pin_0 | PORT_Pin_1)
+#define UCMD_UART_PINS_FUNCTION PORT_FUNC_OVERRID
+#define UCMD_BAUD_RATE          115200
+#endif
+
+#define UCMD_DMA_CHANNEL        DMA_Channel_UART2_RX
+#define UCMD_RX_SIZE            (2 * UCMD_RX_HALF_SIZE)
+
+/* Ping-pong halves are adjacent, so the DMA fills one ring. Positions
+ * count bytes since UCMD_Init, the ring index is the position modulo
+ * UCMD_RX_SIZE (a power of two, so the counts may wrap). */
+static uint8_t rx_buf[UCMD_RX_SIZE];
+static uint32_t rx_consumed = 0;    // First byte not consumed yet
+static volatile uint32_t rx_halves = 0;     // Halves completed and re-armed
+static uint32_t frame_start = 0;    // First byte of the frame being received
+static uint32_t frame_len = 0;
+static uint8_t frame_overflow = 0;
+
+/* Only frames that straddle the ring wrap are copied here */
+static uint8_t wrap_buf[UCMD_MAX_FRAME];
+
+/* Replies wait here for room in the UART TX FIFO, same counting as RX */
+static uint8_t tx_buf[UCMD_TX_SIZE];
+static uint32_t tx_queued = 0;
+static uint32_t tx_sent = 0;
+
+static DMA_CtrlDataInitTypeDef rx_pri;
+static DMA_CtrlDataInitTypeDef rx_alt;
+
+static UCMD_StatsTypeDef stats;
+
+/**
+  * @brief  Configures UART pins, UART and the ping-pong RX DMA channel
+  */
+void UCMD_Init(void)
+{
+    PORT_InitTypeDef port_init;
+    UART_InitTypeDef uart_init;
+    DMA_ChannelInitTypeDef dma_init;
+
+    RST_CLK_PCLKcmd(RST_CLK_PCLK_PORTF | RST_CLK_PCLK_UART2 | RST_CLK_PCLK_DMA, ENABLE);
+
+    PORT_StructInit(&port_init);
+    port_init.PORT_Pin = UCMD_UART_PINS;
+    port_init.PORT_FUNC = UCMD_UART_PINS_FUNCTION;
+    port_init.PORT_MODE = PORT_MODE_DIGITAL;
+    port_init.PORT_SPEED = PORT_SPEED_MAXFAST;
+    PORT_Init(UCMD_UART_PORT, &port_init);
+
+    UART_BRGInit(UCMD_UART, UART_HCLKdiv1);
+    uart_init.UART_BaudRate = UCMD_BAUD_RATE;
+    uart_init.UART_WordLength = UART_WordLength8b;
+    uart_init.UART_StopBits = UART_StopBits1;
+    uart_init.UART_Parity = UART_Parity_No;
+    uart_init.UART_FIFOMode = UART_FIFO_ON;
+    uart_init.UART_HardwareFlowControl = UART_HardwareFlowControl_RXE | UART_HardwareFlowControl_TXE;
+    UART_Init(UCMD_UART, &uart_init);
+
+    /* Both halves move single bytes from DR into the ring */
+    rx_pri.DMA_SourceBaseAddr = (uint32_t)(uintptr_t)&UCMD_UART->DR;
+    rx_pri.DMA_DestBaseAddr = (uint32_t)(uintptr_t)&rx_buf[0];
+    rx_pri.DMA_SourceIncSize = DMA_SourceIncNo;
+    rx_pri.DMA_DestIncSize = DMA_DestIncByte;
+    rx_pri.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    rx_pri.DMA_Mode = DMA_Mode_PingPong;
+    rx_pri.DMA_CycleSize = UCMD_RX_HALF_SIZE;
+    rx_pri.DMA_NumContinuous = DMA_Transfers_1;
+    rx_pri.DMA_SourceProtCtrl = DMA_SourcePrivileged;
+    rx_pri.DMA_DestProtCtrl = DMA_DestPrivileged;
+
+    rx_alt = rx_pri;
+    rx_alt.DMA_DestBaseAddr = (uint32_t)(uintptr_t)&rx_buf[UCMD_RX_HALF_SIZE];
+
+    dma_init.DMA_PriCtrlData = &rx_pri;
+    dma_init.DMA_AltCtrlData = &rx_alt;
+    dma_init.DMA_Priority = DMA_Priority_High;
+    dma_init.DMA_UseBurst = DMA_BurstClear;
+    dma_init.DMA_SelectDataStructure = DMA_CTRL_DATA_PRIMARY;
+    DMA_Init(UCMD_DMA_CHANNEL, &dma_init);
+
+    UART_DMACmd(UCMD_UART, UART_DMA_RXE, ENABLE);
+    UART_Cmd(UCMD_UART, ENABLE);
+
+    /* DMA interrupt only re-arms the finished half, lowest priority */
+    NVIC_SetPriority(DMA_IRQn, 3);
+    NVIC_EnableIRQ(DMA_IRQn);
+    DMA_Cmd(UCMD_DMA_CHANNEL, ENABLE);
+}
+
+/**
+  * @brief  Re-arms every half that completed (DMA interrupt context)
+  * @note   Reads the control structures rather than remembering which
+  *         half was active: when both halves fill between two interrupts
+  *         the channel stops, it is re-armed, re-enabled and counted as
+  *         an RX overrun (bytes received meanwhile are lost)
+  */
+void UCMD_RxDMAHandler(void)
+{
+    uint32_t pri_done = HD_DMA_StructDone(UCMD_DMA_CHANNEL, 0);
+    uint32_t alt_done = HD_DMA_StructDone(UCMD_DMA_CHANNEL, 1);
+
+    if (pri_done) {
+        DMA_CtrlInit(UCMD_DMA_CHANNEL, DMA_CTRL_DATA_PRIMARY, &rx_pri);
+    }
+    if (alt_done) {
+        DMA_CtrlInit(UCMD_DMA_CHANNEL, DMA_CTRL_DATA_ALTERNATE, &rx_alt);
+    }
+    rx_halves += pri_done + alt_done;
+    if (pri_done && alt_done) {
+        stats.rx_overruns++;
+        DMA_Cmd(UCMD_DMA_CHANNEL, ENABLE);
+    }
+}
+
+/**
+  * @brief  Position the DMA will write next
+  * @note   The half in use, its count and the completed halves are read
+  *         again until none of them moved meanwhile. Halves alternate
+  *         from the primary one, so the half in use gives the parity of
+  *         the halves completed: at most one of them is not re-armed yet.
+  */
+static uint32_t rx_received(void)
+{
+    uint32_t halves;
+    uint32_t alt;
+    uint32_t left;
+
+    do {
+        halves = rx_halves;
+        alt = (DMA_GetFlagStatus(UCMD_DMA_CHANNEL, DMA_FLAG_CHNL_ALT) != RESET);
+        left = DMA_GetCurrTransferCounter(UCMD_DMA_CHANNEL,
+                   alt ? DMA_CTRL_DATA_ALTERNATE : DMA_CTRL_DATA_PRIMARY);
+    } while (halves != rx_halves ||
+             alt != (DMA_GetFlagStatus(UCMD_DMA_CHANNEL, DMA_FLAG_CHNL_ALT) != RESET));
+
+    halves += (halves ^ alt) & 1U;
+    return halves * UCMD_RX_HALF_SIZE + (UCMD_RX_HALF_SIZE - left);
+}
+
+/**
+  * @brief  COBS decode in place (output never overtakes input)
+  * @retval Decoded length, 0 on a malformed frame
+  */
+static uint32_t cobs_decode(uint8_t* buf, uint32_t len)
+{
+    uint32_t in = 0;
+    uint32_t out = 0;
+
+    while (in < len) {
+        uint8_t code = buf[in++];
+
+        if (code == 0 || in + code - 1 > len) {
+            return 0;
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            buf[out++] = buf[in++];
+        }
+        if (code != 0xFF && in < len) {
+            buf[out++] = 0;
+        }
+    }
+    return out;
+}
+
+static uint32_t get_u32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+  * @brief  Moves queued reply bytes into the UART TX FIFO while it has room
+  */
+static void tx_pump(void)
+{
+    while (tx_sent != tx_queued && UART_GetFlagStatus(UCMD_UART, UART_FLAG_TXFF) == RESET) {
+        UART_SendData(UCMD_UART, tx_buf[tx_sent % UCMD_TX_SIZE]);
+        tx_sent++;
+    }
+}
+
+/**
+  * @brief  Queues a reply frame, dropped if the queue has no room for it
+  */
+static void send_reply(uint8_t seq, uint8_t status)
+{
+    uint8_t frame[4];
+
+    /* COBS of {seq, status}: neither byte is 0 in the common case */
+    if (seq != 0 && status != 0) {
+        frame[0] = 3; frame[1] = seq; frame[2] = status; frame[3] = 0;
+    } else if (seq != 0) {
+        frame[0] = 2; frame[1] = seq; frame[2] = 1; frame[3] = 0;
+    } else if (status != 0) {
+        frame[0] = 1; frame[1] = 2; frame[2] = status; frame[3] = 0;
+    } else {
+        frame[0] = 1; frame[1] = 1; frame[2] = 1; frame[3] = 0;
+    }
+
+    if (UCMD_TX_SIZE - (tx_queued - tx_sent) < sizeof(frame)) {
+        stats.replies_dropped++;
+        return;
+    }
+    for (uint32_t i = 0; i < sizeof(frame); i++) {
+        tx_buf[tx_queued % UCMD_TX_SIZE] = frame[i];
+        tx_queued++;
+    }
+}
+
+/**
+  * @brief  Parses one decoded frame in place and submits it as one batch
+  */
+static uint8_t execute_frame(const uint8_t* buf, uint32_t len)
+{
+    LED_ParamsTypeDef params = {0};
+    uint8_t save = 0;
+    uint32_t pos = 1;
+    HD_StatusTypeDef status;
+
+    if (len < 3 || HD_CRC16(buf, len - 2) != (((uint16_t)buf[len - 2] << 8) | buf[len - 1])) {
+        return UCMD_REPLY_ERROR;
+    }
+    len -= 2;
+
+    while (pos + 2 <= len) {
+        uint8_t cmd = buf[pos];
+        uint8_t size = buf[pos + 1];
+        const uint8_t* data = &buf[pos + 2];
+
+        if (pos + 2 + size > len) {
+            return UCMD_REPLY_ERROR;
+        }
+        HD_TRACE(COMMAND, cmd);
+
+        switch (cmd) {
+        case UCMD_SET_WAVE_SPEED:
+            if (size != 4) return UCMD_REPLY_ERROR;
+            params.fields |= LED_PARAM_WAVE_SPEED;
+            params.wave_speed = get_u32(data);
+            break;
+        case UCMD_SET_PWM_PERIOD:
+            if (size != 4) return UCMD_REPLY_ERROR;
+            params.fields |= LED_PARAM_PWM_PERIOD;
+            params.pwm_period = get_u32(data);
+            break;
+        case UCMD_SET_SEQUENCE:
+            if (size != 4) return UCMD_REPLY_ERROR;
+            params.fields |= LED_PARAM_SEQUENCE;
+            params.sequence_delay = get_u32(data);
+            break;
+        case UCMD_SET_BRIGHTNESS:
+            if (size != 1) return UCMD_REPLY_ERROR;
+            params.fields |= LED_PARAM_BRIGHTNESS;
+            params.brightness = data[0];
+            break;
+        case UCMD_SET_WAVE_ENABLE:
+            if (size != 1) return UCMD_REPLY_ERROR;
+            params.fields |= LED_PARAM_WAVE_ENABLE;
+            params.wave_enable = data[0];
+            break;
+        case UCMD_SAVE:
+            save = 1;
+            break;
+        default:
+            return UCMD_REPLY_ERROR;
+        }
+        pos += 2 + size;
+    }
+    if (pos != len) {
+        return UCMD_REPLY_ERROR;
+    }
+
+    status = LED_SubmitParams(&params);
+    if (status == HD_OK && save) {
+        if (params.fields & LED_PARAM_WAVE_SPEED) {
+            PARAM_Set(PARAM_WAVE_SPEED, params.wave_speed);
+        }
+        if (params.fields & LED_PARAM_PWM_PERIOD) {
+            PARAM_Set(PARAM_PWM_PERIOD, params.pwm_period);
+        }
+        if (params.fields & LED_PARAM_SEQUENCE) {
+            PARAM_Set(PARAM_EFFECT, params.sequence_delay ? PARAM_EFFECT_SEQUENCE : PARAM_EFFECT_WAVE);
+        }
+        if (params.fields & LED_PARAM_BRIGHTNESS) {
+            PARAM_Set(PARAM_BRIGHTNESS, params.brightness);
+        }
+        if (params.fields & LED_PARAM_WAVE_ENABLE) {
+            PARAM_Set(PARAM_WAVE_ENABLE, params.wave_enable);
+        }
+    }
+    return (uint8_t)status;
+}
+
+/**
+  * @brief  Handles a complete frame ending just before the delimiter
+  */
+static void handle_frame(void)
+{
+    uint32_t start = DWT->CYCCNT;
+    uint8_t* frame;
+    uint32_t len;
+    uint8_t status;
+    uint32_t cycles;
+
+    if (frame_overflow) {
+        stats.frames_bad++;
+        return;
+    }
+    if (frame_len == 0) {
+        return;
+    }
+
+    if (frame_start + frame_len <= UCMD_RX_SIZE) {
+        frame = &rx_buf[frame_start];
+    } else {
+        uint32_t first = UCMD_RX_SIZE - frame_start;
+        for (uint32_t i = 0; i < frame_len; i++) {
+            wrap_buf[i] = (i < first) ? rx_buf[frame_start + i] : rx_buf[i - first];
+        }
+        frame = wrap_buf;
+    }
+
+    len = cobs_decode(frame, frame_len);
+    status = len ? execute_frame(frame, len) : UCMD_REPLY_ERROR;
+
+    if (status == UCMD_REPLY_OK) {
+        stats.frames_ok++;
+        cycles = DWT->CYCCNT - start;
+        if (cycles > stats.max_parse_cycles) {
+            stats.max_parse_cycles = cycles;
+        }
+    } else if (status == UCMD_REPLY_BUSY) {
+        stats.frames_busy++;
+    } else {
+        stats.frames_bad++;
+    }
+    send_reply(len ? frame[0] : 0, status);
+}
+
+/**
+  * @brief  Consumes received bytes, executes complete frames and sends
+  *         queued replies (main loop)
+  */
+void UCMD_Process(void)
+{
+    uint32_t received = rx_received();
+
+    if (received - rx_consumed > UCMD_RX_SIZE) {
+        /* The DMA went round the ring over bytes not read yet: skip to
+         * what it writes next. Unless the last byte was a delimiter the
+         * next one ends a torn frame, which is dropped. */
+        stats.rx_lapped++;
+        rx_consumed = received;
+        frame_len = 0;
+        frame_overflow = (rx_buf[(received - 1) % UCMD_RX_SIZE] != 0);
+    }
+
+    while (rx_consumed != received) {
+        uint32_t index = rx_consumed % UCMD_RX_SIZE;
+        uint8_t byte = rx_buf[index];
+
+        stats.bytes_rx++;
+        if (byte == 0) {
+            handle_frame();
+            frame_len = 0;
+            frame_overflow = 0;
+        } else {
+            if (frame_len == 0) {
+                frame_start = index;
+            }
+            if (frame_len < UCMD_MAX_FRAME) {
+                frame_len++;
+            } else {
+                frame_overflow = 1;
+            }
+        }
+        rx_consumed++;
+    }
+
+    tx_pump();
+}
+
+/**
+  * @brief  Returns link statistics
+  */
+const UCMD_StatsTypeDef* UCMD_GetStats(void)
+{
+    return &stats;
+}
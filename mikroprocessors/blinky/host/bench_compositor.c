@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "led_compositor.h"
+
+/* SWAR blend helpers of the compositor (led_compositor.c) against the
+ * per-channel loops they stand for, four 8-bit channels per word. Both
+ * must give the same pixel for every input pair, and no helper may be
+ * slower than its loop. The time per pixel of each and the per-channel
+ * over SWAR ratio are printed. Host time, so only the ratios matter. */
+
+#define BENCH_PIXELS        1024        /* random inputs, reused per round */
+#define BENCH_ROUNDS        2000        /* passes over the inputs per measurement */
+#define BENCH_REPEATS       25          /* best of, kernels interleaved, against host noise */
+#define BENCH_MIN_RATIO     1.0         /* per-channel over SWAR time */
+
+typedef LCOMP_Pixel4 (*BENCH_BlendTypeDef)(LCOMP_Pixel4 x, LCOMP_Pixel4 y, uint32_t factor);
+
+typedef struct {
+    const char* name;
+    BENCH_BlendTypeDef scalar;
+    BENCH_BlendTypeDef swar;
+} BENCH_KernelTypeDef;
+
+static LCOMP_Pixel4 in_x[BENCH_PIXELS];
+static LCOMP_Pixel4 in_y[BENCH_PIXELS];
+static uint32_t in_factor[BENCH_PIXELS];
+static volatile LCOMP_Pixel4 sink;
+
+static uint64_t host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t lane(LCOMP_Pixel4 p, uint32_t i)
+{
+    return (p >> (8 * i)) & 0xFFU;
+}
+
+/* The per-channel loops: one byte at a time */
+static __attribute__((noinline)) LCOMP_Pixel4 scalar_scale(LCOMP_Pixel4 x, LCOMP_Pixel4 y, uint32_t factor)
+{
+    LCOMP_Pixel4 out = 0;
+
+    for (uint32_t i = 0; i < LCOMP_CHANNELS; i++) {
+        out |= ((lane(x, i) * factor) >> 8) << (8 * i);
+    }
+    return out;
+}
+
+static __attribute__((noinline)) LCOMP_Pixel4 scalar_add_sat(LCOMP_Pixel4 x, LCOMP_Pixel4 y, uint32_t factor)
+{
+    LCOMP_Pixel4 out = 0;
+
+    for (uint32_t i = 0; i < LCOMP_CHANNELS; i++) {
+        uint32_t sum = lane(x, i) + lane(y, i);
+
+        out |= (sum > 255 ? 255 : sum) << (8 * i);
+    }
+    return out;
+}
+
+static __attribute__((noinline)) LCOMP_Pixel4 scalar_max(LCOMP_Pixel4 x, LCOMP_Pixel4 y, uint32_t factor)
+{
+    LCOMP_Pixel4 out = 0;
+
+    for (uint32_t i = 0; i < LCOMP_CHANNELS; i++) {
+        out |= (lane(x, i) > lane(y, i) ? lane(x, i) : lane(y, i)) << (8 * i);
+    }
+    return out;
+}
+
+static __attribute__((noinline)) LCOMP_Pixel4 scalar_alpha(LCOMP_Pixel4 x, LCOMP_Pixel4 y, uint32_t factor)
+{
+    LCOMP_Pixel4 out = 0;
+
+    for (uint32_t i = 0; i < LCOMP_CHANNELS; i++) {
+        out |= (((lane(x, i) * factor) >> 8) + ((lane(y, i) * (256 - factor)) >> 8)) << (8 * i);
+    }
+    return out;
+}
+
+/* The helpers under the same signature */
+static __attribute__((noinline)) LCOMP_Pixel4 swar_scale(LCOMP_Pixel4 x, LCOMP_Pixel4 y, uint32_t factor)
+{
+    return LCOMP_Scale(x, factor);
+}
+
+static __attribute__((noinline)) LCOMP_Pixel4 swar_add_sat(LCOMP_Pixel4 x, LCOMP_Pixel4 y, uint32_t factor)
+{
+    return LCOMP_AddSat(x, y);
+}
+
+static __attribute__((noinline)) LCOMP_Pixel4 swar_max(LCOMP_Pixel4 x, LCOMP_Pixel4 y, uint32_t factor)
+{
+    return LCOMP_Max(x, y);
+}
+
+static __attribute__((noinline)) LCOMP_Pixel4 swar_alpha(LCOMP_Pixel4 x, LCOMP_Pixel4 y, uint32_t factor)
+{
+    return LCOMP_Alpha(x, y, factor);
+}
+
+static const BENCH_KernelTypeDef kernels[] = {
+    { "scale",   scalar_scale,   swar_scale },
+    { "add sat", scalar_add_sat, swar_add_sat },
+    { "max",     scalar_max,     swar_max },
+    { "alpha",   scalar_alpha,   swar_alpha },
+};
+
+#define BENCH_KERNELS   (sizeof(kernels) / sizeof(kernels[0]))
+
+/* ns per pixel of one run */
+static double measure(BENCH_BlendTypeDef blend)
+{
+    uint64_t start = host_ns();
+    LCOMP_Pixel4 acc = 0;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        for (uint32_t i = 0; i < BENCH_PIXELS; i++) {
+            acc ^= blend(in_x[i], in_y[i], in_factor[i]);
+        }
+    }
+    sink = acc;
+    return (double)(host_ns() - start) / ((double)BENCH_ROUNDS * BENCH_PIXELS);
+}
+
+/* Random pixels, with the lane edge values 0, 127, 128 and 255 mixed in */
+static LCOMP_Pixel4 random_pixel(void)
+{
+    static const uint8_t edges[] = { 0x00, 0x7F, 0x80, 0xFF };
+    LCOMP_Pixel4 p = 0;
+
+    for (uint32_t i = 0; i < LCOMP_CHANNELS; i++) {
+        uint32_t v = (rand() & 1) ? (uint32_t)(rand() & 0xFF) : edges[rand() & 3];
+
+        p |= v << (8 * i);
+    }
+    return p;
+}
+
+int main(void)
+{
+    double scalar_ns[BENCH_KERNELS], swar_ns[BENCH_KERNELS];
+    int failed = 0;
+
+    srand(1);
+    for (uint32_t i = 0; i < BENCH_PIXELS; i++) {
+        in_x[i] = random_pixel();
+        in_y[i] = random_pixel();
+        in_factor[i] = (i < 2) ? i * 256 : (uint32_t)(rand() % 257);
+    }
+
+    for (uint32_t k = 0; k < BENCH_KERNELS; k++) {
+        for (uint32_t i = 0; i < BENCH_PIXELS; i++) {
+            LCOMP_Pixel4 want = kernels[k].scalar(in_x[i], in_y[i], in_factor[i]);
+            LCOMP_Pixel4 got = kernels[k].swar(in_x[i], in_y[i], in_factor[i]);
+
+            if (got != want) {
+                printf("FAIL %s %08X, %08X, %u: SWAR %08X, per channel %08X\n", kernels[k].name, in_x[i], in_y[i],
+                       in_factor[i], got, want);
+                failed++;
+                break;
+            }
+        }
+        scalar_ns[k] = swar_ns[k] = 1e30;
+    }
+
+    /* Best of BENCH_REPEATS, every kernel once per repeat so host load
+     * changes hit all of them alike */
+    for (int r = 0; r < BENCH_REPEATS; r++) {
+        for (uint32_t k = 0; k < BENCH_KERNELS; k++) {
+            double ns = measure(kernels[k].scalar);
+
+            if (ns < scalar_ns[k]) {
+                scalar_ns[k] = ns;
+            }
+            ns = measure(kernels[k].swar);
+            if (ns < swar_ns[k]) {
+                swar_ns[k] = ns;
+            }
+        }
+    }
+
+    printf("blend    per-channel ns/pixel  SWAR ns/pixel  ratio\n");
+    for (uint32_t k = 0; k < BENCH_KERNELS; k++) {
+        printf("%-7s  %20.2f  %13.2f  %5.2f\n", kernels[k].name, scalar_ns[k], swar_ns[k],
+               scalar_ns[k] / swar_ns[k]);
+        if (scalar_ns[k] < BENCH_MIN_RATIO * swar_ns[k]) {
+            printf("FAIL %s: SWAR %.2fx the per-channel time\n", kernels[k].name, swar_ns[k] / scalar_ns[k]);
+            failed++;
+        }
+    }
+    printf("%s SWAR blend helpers\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
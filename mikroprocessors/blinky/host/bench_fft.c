@@ -0,0 +1,145 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "vmcu.h"
+#include "audio_fft.h"
+
+/* Q15 FFT of the sound-reactive layer (audio_fft.c) against a double
+ * precision DFT of the same integer input, for every transform size the
+ * twiddle table covers. Two tones, one near full scale and one 14 dB
+ * below, in bins across the spectrum; the block floating point result
+ * scaled by its exponent must stay AFFT_TEST_MIN_SNR_DB above the error.
+ * Then the band mapping: a sine in one bin, 12 dB quieter each step,
+ * must lose 64 level units per step (8 per 3 dB over AFFT_RANGE_Q3)
+ * from about 255 at full scale. Host time per block is printed for
+ * reference; target cycles are AFFT_GetCycles() on the board. */
+
+#define AFFT_TEST_MIN_SNR_DB    55.0
+#define AFFT_TEST_LEVEL_STEP    64      /* per 12 dB */
+#define AFFT_TEST_LEVEL_TOL     4
+#define AFFT_TEST_BAND_BIN      5       /* third band at 32 points */
+#define AFFT_TEST_BLOCKS        20000
+#define AFFT_TEST_REPEATS       5
+
+static volatile LCOMP_Pixel4 sink;
+
+static uint64_t host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Signal to error power of one transform, in dB */
+static double transform_snr(uint32_t log2n, uint32_t bin, int32_t* exponent)
+{
+    uint32_t n = 1UL << log2n;
+    AFFT_ComplexTypeDef x[AFFT_MAX_SIZE];
+    int16_t in[AFFT_MAX_SIZE];
+    double signal = 0, error = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        double v = 16000.0 * sin(2 * M_PI * bin * i / n + 0.3) + 3000.0 * cos(2 * M_PI * (bin + 2) * i / n);
+
+        in[i] = (int16_t)lrint(v);
+        x[i].re = in[i];
+        x[i].im = 0;
+    }
+    *exponent = AFFT_Transform(x, log2n);
+
+    for (uint32_t k = 0; k < n; k++) {
+        double re = 0, im = 0, dr, di;
+
+        for (uint32_t i = 0; i < n; i++) {
+            re += in[i] * cos(2 * M_PI * k * i / n);
+            im -= in[i] * sin(2 * M_PI * k * i / n);
+        }
+        dr = ldexp(x[k].re, *exponent) - re;
+        di = ldexp(x[k].im, *exponent) - im;
+        signal += re * re + im * im;
+        error += dr * dr + di * di;
+    }
+    return 10.0 * log10(signal / error);
+}
+
+/* One ADC block, a sine of amplitude amp in bin AFFT_TEST_BAND_BIN */
+static void sine_block(uint16_t* samples, int32_t amp)
+{
+    for (uint32_t i = 0; i < AFFT_SIZE; i++) {
+        samples[i] = (uint16_t)(2048 + lrint(amp * sin(2 * M_PI * AFFT_TEST_BAND_BIN * i / AFFT_SIZE)));
+    }
+}
+
+static uint32_t band_of_bin(uint32_t bin)
+{
+    uint32_t b = 0;
+
+    while (b + 1 < LCOMP_CHANNELS && bin >= (1UL << (((b + 1) * (AFFT_LOG2 - 1)) / LCOMP_CHANNELS))) {
+        b++;
+    }
+    return b;
+}
+
+int main(void)
+{
+    uint16_t samples[AFFT_SIZE];
+    uint32_t band = band_of_bin(AFFT_TEST_BAND_BIN);
+    int32_t last = -1;
+    double best = 1e30;
+    int failed = 0;
+
+    VM_Init();      /* DWT, read by AFFT_Next */
+
+    printf("points  bin  exponent  SNR dB\n");
+    for (uint32_t log2n = AFFT_LOG2; log2n <= AFFT_MAX_LOG2; log2n++) {
+        uint32_t n = 1UL << log2n;
+
+        for (uint32_t bin = 1; bin + 2 < n / 2; bin += 3) {
+            int32_t exponent;
+            double snr = transform_snr(log2n, bin, &exponent);
+
+            printf("%6u  %3u  %8d  %6.1f\n", n, bin, exponent, snr);
+            if (snr < AFFT_TEST_MIN_SNR_DB) {
+                printf("FAIL %u points, bin %u: %.1f dB, needs %.1f dB\n", n, bin, snr, AFFT_TEST_MIN_SNR_DB);
+                failed++;
+            }
+        }
+    }
+
+    printf("amplitude  band %u level\n", band + 1);
+    for (int32_t amp = 2047; amp > 8; amp /= 4) {
+        int32_t expected = (last < 0) ? 255 : last - AFFT_TEST_LEVEL_STEP;
+        int32_t level;
+
+        sine_block(samples, amp);
+        AFFT_Reset();
+        AFFT_PushBlock(samples);
+        level = (int32_t)((AFFT_Next() >> (8 * band)) & 0xFF);
+        printf("%9d  %12d\n", amp, level);
+        if (abs(level - expected) > AFFT_TEST_LEVEL_TOL) {
+            printf("FAIL amplitude %d: level %d, expected %d\n", amp, level, expected);
+            failed++;
+        }
+        last = level;
+    }
+
+    sine_block(samples, 1000);
+    for (int r = 0; r < AFFT_TEST_REPEATS; r++) {
+        uint64_t start = host_ns();
+        double ns;
+
+        for (uint32_t i = 0; i < AFFT_TEST_BLOCKS; i++) {
+            AFFT_PushBlock(samples);
+            sink = AFFT_Next();
+        }
+        ns = (double)(host_ns() - start) / AFFT_TEST_BLOCKS;
+        if (ns < best) {
+            best = ns;
+        }
+    }
+    printf("%u-point block with bands: %.0f host ns\n", AFFT_SIZE, best);
+    printf("%s Q15 FFT against DFT\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vmcu.h"
+#include "led_pattern.h"
+
+/* Compressed pattern decoder (led_pattern.c) on the patterns in
+ * patterns/, compiled by tools/ledpat.py at build time. The decoded
+ * frames must equal the source frames; the table gives the compression
+ * ratio and the decoder's host time per frame. sparkle changes every LED
+ * every frame, a full DELTA each time, so it is the decoder's worst case
+ * and bounds its cost per render.
+ *
+ *   bench_pattern [patterns dir]
+ */
+
+#define BENCH_PASSES        2000        /* loops of the pattern per measurement */
+#define BENCH_REPEATS       5           /* best of, against host noise */
+#define BENCH_MAX_FRAMES    1024
+
+typedef struct {
+    const char* name;
+    const uint8_t* image;
+    const uint32_t* size;
+    double min_ratio;           /* 0: incompressible by design */
+} BENCH_PatternTypeDef;
+
+extern const uint8_t breathe_pattern[], chase_pattern[], sparkle_pattern[];
+extern const uint32_t breathe_pattern_size, chase_pattern_size, sparkle_pattern_size;
+
+static const BENCH_PatternTypeDef patterns[] = {
+    { "breathe", breathe_pattern, &breathe_pattern_size, 1.5 },
+    { "chase",   chase_pattern,   &chase_pattern_size,   4.0 },
+    { "sparkle", sparkle_pattern, &sparkle_pattern_size, 0.0 },
+};
+
+#define BENCH_PATTERNS  (sizeof(patterns) / sizeof(patterns[0]))
+
+static const char* pattern_dir = "patterns";
+static LCOMP_Pixel4 source[BENCH_MAX_FRAMES];
+static LCOMP_Pixel4 decoded[BENCH_MAX_FRAMES];
+static volatile LCOMP_Pixel4 sink;
+
+static uint64_t host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Source frames, same text format as tools/ledpat.py reads */
+static int read_frames(const char* name)
+{
+    char path[512], line[256];
+    int count = 0;
+    FILE* f;
+
+    snprintf(path, sizeof(path), "%s/%s.txt", pattern_dir, name);
+    f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL && count < BENCH_MAX_FRAMES) {
+        LCOMP_Pixel4 frame = 0;
+        char* p = line;
+        char* end;
+        int lanes = 0;
+
+        line[strcspn(line, "#")] = '\0';
+        for (long v = strtol(p, &end, 0); end != p && lanes < LCOMP_CHANNELS; v = strtol(p, &end, 0)) {
+            frame |= (LCOMP_Pixel4)(v & 0xFF) << (8 * lanes++);
+            p = end + strspn(end, " ,\t");
+        }
+        if (lanes != 0) {
+            source[count++] = frame;
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+/**
+  * @brief  Decodes frames from the start of the pattern, one per
+  *         LPAT_Next call as the render does; looping patterns wrap
+  * @param  out: decoded frames, NULL to only time the decoder
+  * @retval HD_ERROR if the decoder rejects the image
+  */
+static HD_StatusTypeDef decode(const BENCH_PatternTypeDef* pat, uint32_t frames, LCOMP_Pixel4* out)
+{
+    uint32_t frame_ms = pat->image[6] | (pat->image[7] << 8);
+    uint32_t now = 0;
+    LCOMP_Pixel4 acc = 0;
+
+    if (LPAT_Start(pat->image, *pat->size, now) != HD_OK) {
+        return HD_ERROR;
+    }
+    for (uint32_t i = 0; i < frames; i++, now += frame_ms) {
+        LCOMP_Pixel4 frame = LPAT_Next(now);
+
+        if (out != NULL) {
+            out[i] = frame;
+        }
+        acc ^= frame;
+    }
+    sink = acc;
+    return HD_OK;
+}
+
+int main(int argc, char** argv)
+{
+    int failed = 0;
+
+    if (argc > 1) {
+        pattern_dir = argv[1];
+    }
+    VM_Init();      /* DWT, read by the decoder */
+
+    printf("pattern   frames  raw B  packed B  ratio  ns/frame\n");
+    for (uint32_t p = 0; p < BENCH_PATTERNS; p++) {
+        const BENCH_PatternTypeDef* pat = &patterns[p];
+        int frames = read_frames(pat->name);
+        double best = 1e30, ratio;
+        uint32_t mismatch;
+
+        if (frames <= 0) {
+            printf("FAIL %s: no source frames\n", pat->name);
+            failed++;
+            continue;
+        }
+        if (decode(pat, (uint32_t)frames, decoded) != HD_OK) {
+            printf("FAIL %s: image rejected by LPAT_Start\n", pat->name);
+            failed++;
+            continue;
+        }
+        for (mismatch = 0; mismatch < (uint32_t)frames && decoded[mismatch] == source[mismatch]; mismatch++) {
+        }
+        if (mismatch != (uint32_t)frames) {
+            printf("FAIL %s: frame %u decodes to %08X, source %08X\n", pat->name, mismatch,
+                   (unsigned)decoded[mismatch], (unsigned)source[mismatch]);
+            failed++;
+            continue;
+        }
+
+        for (int r = 0; r < BENCH_REPEATS; r++) {
+            uint64_t start = host_ns();
+            double ns;
+
+            decode(pat, (uint32_t)frames * BENCH_PASSES, NULL);
+            ns = (double)(host_ns() - start) / ((double)BENCH_PASSES * frames);
+            if (ns < best) {
+                best = ns;
+            }
+        }
+
+        ratio = (double)frames * LCOMP_CHANNELS / *pat->size;
+        printf("%-8s  %6d  %5d  %8u  %5.2f  %8.1f\n", pat->name, frames, frames * LCOMP_CHANNELS,
+               *pat->size, ratio, best);
+        if (ratio < pat->min_ratio) {
+            printf("FAIL %s: ratio %.2f under %.2f\n", pat->name, ratio, pat->min_ratio);
+            failed++;
+        }
+    }
+    printf("%s pattern decoder\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
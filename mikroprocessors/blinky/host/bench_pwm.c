@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "leds.h"
+
+/* Bit-sliced PWM compare (LED_PwmCompare) against the per-LED compare it
+ * replaced, for 4 to 32 channels on one port. Both must give the same pin
+ * mask for every step; the sliced kernel must cost the same per step
+ * whatever the channel count. Host time, so only the ratios matter. */
+
+#define BENCH_ROUNDS        2000        /* full PWM periods per measurement */
+#define BENCH_REPEATS       25          /* best of, sizes interleaved, against host noise */
+#define BENCH_MAX_GROWTH    1.5         /* sliced cost 32 vs 4 channels */
+
+static const uint32_t channel_counts[] = { 4, 8, 16, 24, 32 };
+
+#define BENCH_SIZES     (sizeof(channel_counts) / sizeof(channel_counts[0]))
+
+static uint8_t duty[32];
+static uint32_t plane[LED_PWM_BITS];
+static volatile uint32_t sink;
+
+static uint64_t host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* The old output loop: one compare per LED per step */
+static __attribute__((noinline)) uint32_t per_led_compare(uint32_t channels, uint32_t step)
+{
+    uint32_t on = 0;
+
+    for (uint32_t i = 0; i < channels; i++) {
+        if (duty[i] > step) {
+            on |= 1UL << i;
+        }
+    }
+    return on;
+}
+
+static __attribute__((noinline)) uint32_t sliced_compare(uint32_t pins, uint32_t step)
+{
+    return LED_PwmCompare(plane, step, pins);
+}
+
+static void slice(uint32_t channels)
+{
+    for (int b = 0; b < LED_PWM_BITS; b++) {
+        plane[b] = 0;
+        for (uint32_t i = 0; i < channels; i++) {
+            if (duty[i] & (1U << b)) {
+                plane[b] |= 1UL << i;
+            }
+        }
+    }
+}
+
+/* ns per PWM step of one run */
+static double measure(uint32_t (*compare)(uint32_t, uint32_t), uint32_t arg)
+{
+    uint64_t start = host_ns();
+    uint32_t acc = 0;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        for (uint32_t step = 0; step < LED_PWM_STEPS; step++) {
+            acc ^= compare(arg, step);
+        }
+    }
+    sink = acc;
+    return (double)(host_ns() - start) / ((double)BENCH_ROUNDS * LED_PWM_STEPS);
+}
+
+static uint32_t pins_of(uint32_t channels)
+{
+    return (channels == 32) ? 0xFFFFFFFFUL : ((1UL << channels) - 1);
+}
+
+int main(void)
+{
+    double per_led_ns[BENCH_SIZES], sliced_ns[BENCH_SIZES];
+    int failed = 0;
+
+    srand(1);
+    for (uint32_t i = 0; i < 32; i++) {
+        duty[i] = (uint8_t)(rand() % (LED_PWM_STEPS + 1));
+    }
+
+    for (uint32_t n = 0; n < BENCH_SIZES; n++) {
+        uint32_t channels = channel_counts[n];
+
+        slice(channels);
+        for (uint32_t step = 0; step < LED_PWM_STEPS; step++) {
+            if (sliced_compare(pins_of(channels), step) != per_led_compare(channels, step)) {
+                printf("FAIL %u channels, step %u: sliced mask differs\n", channels, step);
+                failed++;
+                break;
+            }
+        }
+        per_led_ns[n] = sliced_ns[n] = 1e30;
+    }
+
+    /* Best of BENCH_REPEATS, every size once per repeat so host load
+     * changes hit all of them alike */
+    for (int r = 0; r < BENCH_REPEATS; r++) {
+        for (uint32_t n = 0; n < BENCH_SIZES; n++) {
+            double ns;
+
+            slice(channel_counts[n]);
+            ns = measure(per_led_compare, channel_counts[n]);
+            if (ns < per_led_ns[n]) {
+                per_led_ns[n] = ns;
+            }
+            ns = measure(sliced_compare, pins_of(channel_counts[n]));
+            if (ns < sliced_ns[n]) {
+                sliced_ns[n] = ns;
+            }
+        }
+    }
+
+    printf("channels  per-LED ns/step  sliced ns/step\n");
+    for (uint32_t n = 0; n < BENCH_SIZES; n++) {
+        printf("%8u  %15.2f  %14.2f\n", channel_counts[n], per_led_ns[n], sliced_ns[n]);
+    }
+    if (sliced_ns[BENCH_SIZES - 1] > BENCH_MAX_GROWTH * sliced_ns[0]) {
+        printf("FAIL sliced cost grew %.2fx from %u to %u channels\n", sliced_ns[BENCH_SIZES - 1] / sliced_ns[0],
+               channel_counts[0], channel_counts[BENCH_SIZES - 1]);
+        failed++;
+    }
+    printf("%s bit-sliced PWM compare\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "vmcu.h"
+#include "hardware_drivers.h"
+
+/* Boot-to-first-frame latency of one firmware variant, for test_fast_boot.
+ *   boot_time_<variant> [call_cycles]
+ * Boots twice, the first boot formats the parameter store, with every SPL
+ * and CMSIS call charged call_cycles (VM_Config.call_cycles), and prints
+ *   <HD_GetBootCycles> <LED pin levels, port A..F, after the first frame>
+ * from the second one. Built once per variant (Makefile). */
+
+#define BOOT_TIME_SETUP_AT  VM_MS(60)
+#define BOOT_TIME_RUN       VM_MS(20)
+
+typedef struct {
+    uint32_t boot_cycles;
+    uint32_t levels[VM_PORT_COUNT];     /* right after the first frame */
+    VM_Time first_frame;
+} BOOT_TIME_ResultTypeDef;
+
+static BOOT_TIME_ResultTypeDef* result;
+
+/* Pin levels once the first frame is latched, at its timestamp */
+static void on_pin(VM_Time t, VM_PortTypeDef port, uint32_t pin, uint32_t level)
+{
+    if (result->first_frame == 0 || t == result->first_frame) {
+        result->levels[port] = (result->levels[port] & ~(1UL << pin)) | (level << pin);
+    }
+    if (result->first_frame == 0 && HD_GetBootCycles() != 0) {
+        result->first_frame = t;
+    }
+}
+
+static int boot_once(void* arg)
+{
+    VM_Boot();
+    VM_RunUntil(BOOT_TIME_SETUP_AT);
+    return 0;
+}
+
+static int boot(void* arg)
+{
+    VM_SetPinHook(on_pin);
+    VM_Boot();
+    VM_RunUntil(BOOT_TIME_RUN);
+    result->boot_cycles = HD_GetBootCycles();
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    VM_Config.call_cycles = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 0;
+    result = mmap(NULL, sizeof(*result), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (result == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(result, 0, sizeof(*result));
+    if (VM_RunIsolated(boot_once, NULL) != 0 || VM_RunIsolated(boot, NULL) != 0) {
+        fprintf(stderr, "device run failed\n");
+        return 1;
+    }
+    printf("%u", result->boot_cycles);
+    for (uint32_t p = 0; p < VM_PORT_COUNT; p++) {
+        printf(" %04X", result->levels[p]);
+    }
+    printf("\n");
+    return 0;
+}
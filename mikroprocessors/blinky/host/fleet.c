@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "vmcu.h"
+#include "wave.h"
+#include "link.h"
+#include "uart_cmd.h"
+#include "leds.h"
+#include "hardware_drivers.h"
+
+/* Fleet simulator: one virtual board per configuration of the sweep
+ * (PWM period x wave speed x sequence delay x brightness), each set over
+ * the UART link right after boot, run for FLEET_RUN of virtual time and
+ * reduced to per-configuration metrics in a CSV file.
+ *
+ * A sweep of one process per device: the compositor, pattern decoder,
+ * ADC input, link, the peripheral registers at their fixed addresses and
+ * the virtual MCU itself are one per program, so every device gets its
+ * own address space and virtual clock from VM_RunIsolated. Worker
+ * processes take the next configuration from a shared atomic index and
+ * fork a device for it; the wall time is printed, not judged.
+ *
+ *   fleet [-j workers] [-o results.csv]
+ */
+
+#define FLEET_COMMAND_AT    VM_MS(10)
+#define FLEET_FROM          VM_MS(200)
+#define FLEET_RUN           VM_MS(1000)
+#define FLEET_MAX_WORKERS   64
+
+typedef struct {
+    uint32_t pwm_period;
+    uint32_t wave_speed;
+    uint32_t sequence_ms;       /* 0: wave only */
+    uint8_t brightness;
+} FLEET_ConfigTypeDef;
+
+typedef struct {
+    int rc;                     /* VM_RunIsolated exit status */
+    uint8_t reply_status;       /* 0xFF: no reply */
+    uint32_t frames;
+    uint32_t timer1;
+    uint32_t overruns;
+    uint32_t drops;
+    uint32_t quality;
+    double duty[LED_COUNT];
+    double led1_hz;
+    double host_ms;
+} FLEET_ResultTypeDef;
+
+/* Shared by the parent, the workers and the devices */
+typedef struct {
+    uint32_t next;              /* next configuration to take */
+    FLEET_ResultTypeDef results[];
+} FLEET_SharedTypeDef;
+
+static const uint32_t pwm_periods[] = { 300, 750, 1500, 3000, 6000 };
+static const uint32_t wave_speeds[] = { 1, 2, 3, 5, 8, 13 };
+static const uint32_t sequences_ms[] = { 0, 20, 50, 100, 200 };
+static const uint8_t brightnesses[] = { 64, 255 };
+
+#define COUNT_OF(a)     (sizeof(a) / sizeof((a)[0]))
+
+static FLEET_ConfigTypeDef* configs;
+static uint32_t config_count;
+static FLEET_SharedTypeDef* shared;
+
+static uint64_t host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void build_sweep(void)
+{
+    config_count = COUNT_OF(pwm_periods) * COUNT_OF(wave_speeds) * COUNT_OF(sequences_ms) * COUNT_OF(brightnesses);
+    configs = calloc(config_count, sizeof(*configs));
+    config_count = 0;
+    if (configs == NULL) {
+        return;
+    }
+    for (uint32_t p = 0; p < COUNT_OF(pwm_periods); p++) {
+        for (uint32_t w = 0; w < COUNT_OF(wave_speeds); w++) {
+            for (uint32_t s = 0; s < COUNT_OF(sequences_ms); s++) {
+                for (uint32_t b = 0; b < COUNT_OF(brightnesses); b++) {
+                    configs[config_count++] = (FLEET_ConfigTypeDef){
+                        pwm_periods[p], wave_speeds[w], sequences_ms[s], brightnesses[b]
+                    };
+                }
+            }
+        }
+    }
+}
+
+/**
+  * @brief  One board: boot, configure over the link, run, measure
+  *         (device process)
+  */
+static int run_device(void* arg)
+{
+    uint32_t index = (uint32_t)(uintptr_t)arg;
+    const FLEET_ConfigTypeDef* c = &configs[index];
+    FLEET_ResultTypeDef* r = &shared->results[index];
+    LINK_CommandsTypeDef cmds = {0};
+    LINK_ReplyTypeDef reply;
+    WAVE_SummaryTypeDef wave;
+
+    VM_Boot();
+    WAVE_Init(WAVE_LedProbes, WAVE_LedProbeCount);
+    VM_RunUntil(FLEET_COMMAND_AT);
+
+    LINK_AddU32(&cmds, UCMD_SET_PWM_PERIOD, c->pwm_period);
+    LINK_AddU32(&cmds, UCMD_SET_WAVE_SPEED, c->wave_speed);
+    LINK_AddU32(&cmds, UCMD_SET_SEQUENCE, c->sequence_ms);
+    LINK_AddU8(&cmds, UCMD_SET_BRIGHTNESS, c->brightness);
+    LINK_Send(1, &cmds);
+    VM_RunUntil(FLEET_RUN);
+
+    r->reply_status = (LINK_PollReplies(&reply, 1) == 1) ? reply.status : 0xFF;
+    r->frames = LED_GetFrameCount();
+    r->timer1 = HD_GetTimer1Wakeups();
+    r->overruns = HD_GetOverrunCount();
+    r->drops = LED_GetFrameDrops();
+    r->quality = LED_GetQualityLevel();
+    for (uint32_t i = 0; i < WAVE_LedProbeCount && i < LED_COUNT; i++) {
+        WAVE_Summarize(i, FLEET_FROM, FLEET_RUN, &wave);
+        r->duty[i] = wave.duty;
+        if (i == 0) {
+            r->led1_hz = wave.freq_hz;
+        }
+    }
+    WAVE_Free();
+    return 0;
+}
+
+/* Takes configurations until none are left (worker process) */
+static void worker(void)
+{
+    uint32_t i;
+
+    while ((i = __atomic_fetch_add(&shared->next, 1, __ATOMIC_RELAXED)) < config_count) {
+        uint64_t start = host_ns();
+
+        shared->results[i].rc = VM_RunIsolated(run_device, (void*)(uintptr_t)i);
+        shared->results[i].host_ms = (double)(host_ns() - start) / 1e6;
+    }
+}
+
+/**
+  * @brief  Runs the whole sweep on a pool of workers
+  * @retval Wall time in seconds, negative if a worker cannot start
+  */
+static double run_sweep(uint32_t workers)
+{
+    uint64_t start = host_ns();
+    uint32_t started = 0;
+
+    shared->next = 0;
+    memset(shared->results, 0, config_count * sizeof(shared->results[0]));
+    fflush(NULL);
+    for (uint32_t w = 0; w < workers; w++) {
+        pid_t pid = fork();
+
+        if (pid == 0) {
+            worker();
+            _exit(0);
+        }
+        if (pid > 0) {
+            started++;
+        }
+    }
+    while (wait(NULL) > 0) {
+    }
+    return started ? (double)(host_ns() - start) / 1e9 : -1.0;
+}
+
+/* Warm-up boot: the first boot formats the shared parameter flash, done
+ * once here instead of racing in every device */
+static int boot_once(void* arg)
+{
+    VM_Boot();
+    VM_RunUntil(VM_MS(60));
+    return 0;
+}
+
+static int write_csv(const char* path)
+{
+    FILE* out = fopen(path, "w");
+
+    if (out == NULL) {
+        perror(path);
+        return -1;
+    }
+    fprintf(out, "pwm_period,wave_speed,sequence_ms,brightness,rc,reply,frames,timer1,overruns,drops,quality,");
+    for (uint32_t i = 0; i < LED_COUNT; i++) {
+        fprintf(out, "duty%u,", i + 1);
+    }
+    fprintf(out, "led1_hz,host_ms\n");
+    for (uint32_t n = 0; n < config_count; n++) {
+        const FLEET_ConfigTypeDef* c = &configs[n];
+        const FLEET_ResultTypeDef* r = &shared->results[n];
+
+        fprintf(out, "%u,%u,%u,%u,%d,%u,%u,%u,%u,%u,%u,", c->pwm_period, c->wave_speed, c->sequence_ms,
+                c->brightness, r->rc, r->reply_status, r->frames, r->timer1, r->overruns, r->drops, r->quality);
+        for (uint32_t i = 0; i < LED_COUNT; i++) {
+            fprintf(out, "%.4f,", r->duty[i]);
+        }
+        fprintf(out, "%.3f,%.2f\n", r->led1_hz, r->host_ms);
+    }
+    return fclose(out);
+}
+
+int main(int argc, char** argv)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t workers = (cpus > 0) ? (uint32_t)cpus : 1;
+    const char* csv = "fleet.csv";
+    uint32_t failed = 0, overruns = 0, drops = 0;
+    double seconds;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            workers = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            csv = argv[++i];
+        } else {
+            fprintf(stderr, "usage: fleet [-j workers] [-o results.csv]\n");
+            return 2;
+        }
+    }
+    if (workers < 1 || workers > FLEET_MAX_WORKERS) {
+        workers = 1;
+    }
+
+    build_sweep();
+    shared = mmap(NULL, sizeof(*shared) + config_count * sizeof(shared->results[0]), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (configs == NULL || shared == MAP_FAILED) {
+        perror("fleet");
+        return 1;
+    }
+    if (VM_RunIsolated(boot_once, NULL) != 0) {
+        printf("FAIL warm-up boot\n");
+        return 1;
+    }
+
+    seconds = run_sweep(workers);
+    if (seconds < 0) {
+        printf("FAIL no worker started\n");
+        return 1;
+    }
+    for (uint32_t n = 0; n < config_count; n++) {
+        const FLEET_ResultTypeDef* r = &shared->results[n];
+
+        if (r->rc != 0 || r->reply_status != UCMD_REPLY_OK || r->frames == 0) {
+            const FLEET_ConfigTypeDef* c = &configs[n];
+
+            printf("FAIL period %u speed %u sequence %u brightness %u: exit %d reply %u frames %u\n",
+                   c->pwm_period, c->wave_speed, c->sequence_ms, c->brightness, r->rc, r->reply_status, r->frames);
+            failed++;
+        }
+        overruns += r->overruns;
+        drops += r->drops;
+    }
+    if (write_csv(csv) != 0) {
+        failed++;
+    }
+
+    printf("%u configurations, %u workers, %.2f s, %.0f configurations/s, %.1f s virtual each\n",
+           config_count, workers, seconds, config_count / seconds, (double)FLEET_RUN / VM_CPU_HZ);
+    printf("overruns %u drops %u over the fleet, metrics in %s\n", overruns, drops, csv);
+    if (overruns != 0) {
+        printf("FAIL output overruns in the sweep\n");
+        failed++;
+    }
+    printf("%s fleet sweep\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
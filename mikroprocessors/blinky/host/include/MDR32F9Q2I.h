@@ -0,0 +1,376 @@
+/* Host build stand-in for the MDR32F9Q2I device header.
+ *
+ * Register blocks keep the layout and base address of the real part.
+ * vmcu.c maps memory at those addresses, so the firmware's constant
+ * addresses, bit-band aliases and offsetof() arithmetic work unchanged.
+ * CMSIS intrinsics are calls into the virtual MCU. */
+#ifndef MDR32F9Q2I_H
+#define MDR32F9Q2I_H
+
+#include <stdint.h>
+
+#define __IO    volatile
+#define __I     volatile const
+#define __O     volatile
+
+#define __STATIC_INLINE         static inline
+#define __STATIC_FORCEINLINE    static inline
+#define __WEAK                  __attribute__((weak))
+#define __ALIGNED(x)            __attribute__((aligned(x)))
+#define __RAMFUNC
+
+typedef enum { DISABLE = 0, ENABLE = !DISABLE } FunctionalState;
+typedef enum { RESET = 0, SET = !RESET } FlagStatus, ITStatus;
+typedef enum { ERROR = 0, SUCCESS = !ERROR } ErrorStatus;
+
+typedef enum {
+    NonMaskableInt_IRQn = -14,
+    HardFault_IRQn      = -13,
+    SVCall_IRQn         = -5,
+    PendSV_IRQn         = -2,
+    SysTick_IRQn        = -1,
+    MIL_STD_1553B2_IRQn = 0,
+    MIL_STD_1553B1_IRQn = 1,
+    USB_IRQn            = 2,
+    CAN1_IRQn           = 3,
+    CAN2_IRQn           = 4,
+    DMA_IRQn            = 5,
+    UART1_IRQn          = 6,
+    UART2_IRQn          = 7,
+    SSP1_IRQn           = 8,
+    BUSY_IRQn           = 9,
+    ARINC429R_IRQn      = 10,
+    POWER_IRQn          = 11,
+    WWDG_IRQn           = 12,
+    Timer4_IRQn         = 13,
+    Timer1_IRQn         = 14,
+    Timer2_IRQn         = 15,
+    Timer3_IRQn         = 16,
+    ADC_IRQn            = 17,
+    ETHERNET_IRQn       = 18,
+    SSP3_IRQn           = 19,
+    SSP2_IRQn           = 20,
+    ARINC429T1_IRQn     = 21,
+    ARINC429T2_IRQn     = 22,
+    ARINC429T3_IRQn     = 23,
+    ARINC429T4_IRQn     = 24,
+    BKP_IRQn            = 27,
+    BACKUP_IRQn         = 27,
+    EXT_INT1_IRQn       = 28,
+    EXT_INT2_IRQn       = 29,
+    EXT_INT3_IRQn       = 30,
+    EXT_INT4_IRQn       = 31
+} IRQn_Type;
+
+/* Peripherals ------------------------------------------------------------*/
+
+typedef struct {
+    __IO uint32_t RXTX;
+    __IO uint32_t OE;
+    __IO uint32_t FUNC;
+    __IO uint32_t ANALOG;
+    __IO uint32_t PULL;
+    __IO uint32_t PD;
+    __IO uint32_t PWR;
+    __IO uint32_t GFEN;
+    __IO uint32_t SETTX;
+    __IO uint32_t CLRTX;
+    __IO uint32_t RDTX;
+} MDR_PORT_TypeDef;
+
+typedef struct {
+    __IO uint32_t CNT;
+    __IO uint32_t PSG;
+    __IO uint32_t ARR;
+    __IO uint32_t CNTRL;
+    __IO uint32_t CCR1;
+    __IO uint32_t CCR2;
+    __IO uint32_t CCR3;
+    __IO uint32_t CCR4;
+    __IO uint32_t CH1_CNTRL;
+    __IO uint32_t CH2_CNTRL;
+    __IO uint32_t CH3_CNTRL;
+    __IO uint32_t CH4_CNTRL;
+    __IO uint32_t CH1_CNTRL1;
+    __IO uint32_t CH2_CNTRL1;
+    __IO uint32_t CH3_CNTRL1;
+    __IO uint32_t CH4_CNTRL1;
+    __IO uint32_t CH1_DTG;
+    __IO uint32_t CH2_DTG;
+    __IO uint32_t CH3_DTG;
+    __IO uint32_t CH4_DTG;
+    __IO uint32_t BRKETR_CNTRL;
+    __IO uint32_t STATUS;
+    __IO uint32_t IE;
+    __IO uint32_t DMA_RE;
+    __IO uint32_t CH1_CNTRL2;
+    __IO uint32_t CH2_CNTRL2;
+    __IO uint32_t CH3_CNTRL2;
+    __IO uint32_t CH4_CNTRL2;
+    __IO uint32_t CCR11;
+    __IO uint32_t CCR21;
+    __IO uint32_t CCR31;
+    __IO uint32_t CCR41;
+} MDR_TIMER_TypeDef;
+
+typedef struct {
+    __IO uint32_t CLOCK_STATUS;
+    __IO uint32_t PLL_CONTROL;
+    __IO uint32_t HS_CONTROL;
+    __IO uint32_t CPU_CLOCK;
+    __IO uint32_t USB_CLOCK;
+    __IO uint32_t ADC_MCO_CLOCK;
+    __IO uint32_t RTC_CLOCK;
+    __IO uint32_t PER_CLOCK;
+    __IO uint32_t CAN_CLOCK;
+    __IO uint32_t TIM_CLOCK;
+    __IO uint32_t UART_CLOCK;
+    __IO uint32_t SSP_CLOCK;
+} MDR_RST_CLK_TypeDef;
+
+typedef struct {
+    __IO uint32_t REG_00;
+    __IO uint32_t REG_01;
+    __IO uint32_t REG_02;
+    __IO uint32_t REG_03;
+    __IO uint32_t REG_04;
+    __IO uint32_t REG_05;
+    __IO uint32_t REG_06;
+    __IO uint32_t REG_07;
+    __IO uint32_t REG_08;
+    __IO uint32_t REG_09;
+    __IO uint32_t REG_0A;
+    __IO uint32_t REG_0B;
+    __IO uint32_t REG_0C;
+    __IO uint32_t REG_0D;
+    __IO uint32_t REG_0E;
+    __IO uint32_t REG_0F;
+    __IO uint32_t RTC_CNT;
+    __IO uint32_t RTC_DIV;
+    __IO uint32_t RTC_PRL;
+    __IO uint32_t RTC_ALRM;
+    __IO uint32_t RTC_CS;
+} MDR_BKP_TypeDef;
+
+typedef struct {
+    __IO uint32_t DR;
+    __IO uint32_t RSR_ECR;
+         uint32_t RESERVED0[4];
+    __IO uint32_t FR;
+         uint32_t RESERVED1;
+    __IO uint32_t ILPR;
+    __IO uint32_t IBRD;
+    __IO uint32_t FBRD;
+    __IO uint32_t LCR_H;
+    __IO uint32_t CR;
+    __IO uint32_t IFLS;
+    __IO uint32_t IMSC;
+    __IO uint32_t RIS;
+    __IO uint32_t MIS;
+    __IO uint32_t ICR;
+    __IO uint32_t DMACR;
+} MDR_UART_TypeDef;
+
+typedef struct {
+    __IO uint32_t ADC1_CFG;
+    __IO uint32_t ADC2_CFG;
+    __IO uint32_t ADC1_H_LEVEL;
+    __IO uint32_t ADC2_H_LEVEL;
+    __IO uint32_t ADC1_L_LEVEL;
+    __IO uint32_t ADC2_L_LEVEL;
+    __IO uint32_t ADC1_RESULT;
+    __IO uint32_t ADC2_RESULT;
+    __IO uint32_t ADC1_STATUS;
+    __IO uint32_t ADC2_STATUS;
+    __IO uint32_t ADC1_CHSEL;
+    __IO uint32_t ADC2_CHSEL;
+} MDR_ADC_TypeDef;
+
+/* PL230 uDMA controller */
+typedef struct {
+    __I  uint32_t STATUS;
+    __O  uint32_t CFG;
+    __IO uint32_t CTRL_BASE_PTR;
+    __I  uint32_t ALT_CTRL_BASE_PTR;
+    __I  uint32_t WAITONREQ_STATUS;
+    __O  uint32_t CHNL_SW_REQUEST;
+    __IO uint32_t CHNL_USEBURST_SET;
+    __O  uint32_t CHNL_USEBURST_CLR;
+    __IO uint32_t CHNL_REQ_MASK_SET;
+    __O  uint32_t CHNL_REQ_MASK_CLR;
+    __IO uint32_t CHNL_ENABLE_SET;
+    __O  uint32_t CHNL_ENABLE_CLR;
+    __IO uint32_t CHNL_PRI_ALT_SET;
+    __O  uint32_t CHNL_PRI_ALT_CLR;
+    __IO uint32_t CHNL_PRIORITY_SET;
+    __O  uint32_t CHNL_PRIORITY_CLR;
+         uint32_t RESERVED0[3];
+    __IO uint32_t ERR_CLR;
+} MDR_DMA_TypeDef;
+
+#define MDR_PERIPH_BASE         0x40000000UL
+#define MDR_RST_CLK_BASE        0x40020000UL
+#define MDR_DMA_BASE            0x40028000UL
+#define MDR_UART1_BASE          0x40030000UL
+#define MDR_UART2_BASE          0x40038000UL
+#define MDR_TIMER1_BASE         0x40070000UL
+#define MDR_TIMER2_BASE         0x40078000UL
+#define MDR_TIMER3_BASE         0x40080000UL
+#define MDR_ADC_BASE            0x40088000UL
+#define MDR_PORTA_BASE          0x400A8000UL
+#define MDR_PORTB_BASE          0x400B0000UL
+#define MDR_PORTC_BASE          0x400B8000UL
+#define MDR_PORTD_BASE          0x400C0000UL
+#define MDR_PORTE_BASE          0x400C8000UL
+#define MDR_BKP_BASE            0x400D8000UL
+#define MDR_PORTF_BASE          0x400E8000UL
+
+#define MDR_RST_CLK             ((MDR_RST_CLK_TypeDef*)MDR_RST_CLK_BASE)
+#define MDR_DMA                 ((MDR_DMA_TypeDef*)MDR_DMA_BASE)
+#define MDR_UART1               ((MDR_UART_TypeDef*)MDR_UART1_BASE)
+#define MDR_UART2               ((MDR_UART_TypeDef*)MDR_UART2_BASE)
+#define MDR_TIMER1              ((MDR_TIMER_TypeDef*)MDR_TIMER1_BASE)
+#define MDR_TIMER2              ((MDR_TIMER_TypeDef*)MDR_TIMER2_BASE)
+#define MDR_TIMER3              ((MDR_TIMER_TypeDef*)MDR_TIMER3_BASE)
+#define MDR_ADC                 ((MDR_ADC_TypeDef*)MDR_ADC_BASE)
+#define MDR_PORTA               ((MDR_PORT_TypeDef*)MDR_PORTA_BASE)
+#define MDR_PORTB               ((MDR_PORT_TypeDef*)MDR_PORTB_BASE)
+#define MDR_PORTC               ((MDR_PORT_TypeDef*)MDR_PORTC_BASE)
+#define MDR_PORTD               ((MDR_PORT_TypeDef*)MDR_PORTD_BASE)
+#define MDR_PORTE               ((MDR_PORT_TypeDef*)MDR_PORTE_BASE)
+#define MDR_BKP                 ((MDR_BKP_TypeDef*)MDR_BKP_BASE)
+#define MDR_PORTF               ((MDR_PORT_TypeDef*)MDR_PORTF_BASE)
+
+#define TIMER_CNTRL_CNT_EN          (1UL << 0)
+#define TIMER_CNT_Msk               0xFFFFUL
+#define TIMER_STATUS_CNT_ZERO       (1UL << 0)
+#define TIMER_STATUS_CNT_ARR        (1UL << 1)
+#define TIMER_STATUS_CNT_ARR_Pos    1
+#define TIMER_STATUS_Msk            0x1FFFUL
+
+#define RST_CLK_TIM_CLOCK_TIM1_CLK_EN   (1UL << 24)
+#define RST_CLK_TIM_CLOCK_TIM2_CLK_EN   (1UL << 25)
+#define RST_CLK_TIM_CLOCK_TIM3_CLK_EN   (1UL << 26)
+
+#define UART_DMACR_RXDMAE       (1UL << 0)
+#define UART_DMACR_TXDMAE       (1UL << 1)
+#define UART_CR_UARTEN          (1UL << 0)
+
+#define ADC1_CFG_REG_ADON       (1UL << 0)
+#define ADC1_CFG_REG_GO         (1UL << 1)
+
+/* Cortex-M3 core -----------------------------------------------------------*/
+
+typedef struct {
+    __IO uint32_t CTRL;
+    __IO uint32_t LOAD;
+    __IO uint32_t VAL;
+    __I  uint32_t CALIB;
+} SysTick_Type;
+
+typedef struct {
+    __I  uint32_t CPUID;
+    __IO uint32_t ICSR;
+    __IO uint32_t VTOR;
+    __IO uint32_t AIRCR;
+    __IO uint32_t SCR;
+    __IO uint32_t CCR;
+} SCB_Type;
+
+typedef struct {
+    __IO uint32_t CTRL;
+    __IO uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+    __IO uint32_t DHCSR;
+    __O  uint32_t DCRSR;
+    __IO uint32_t DCRDR;
+    __IO uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define SCS_BASE                0xE000E000UL
+#define SysTick_BASE            (SCS_BASE + 0x0010UL)
+#define SCB_BASE                (SCS_BASE + 0x0D00UL)
+#define DWT_BASE                0xE0001000UL
+#define CoreDebug_BASE          0xE000EDF0UL
+
+#define SysTick                 ((SysTick_Type*)SysTick_BASE)
+#define SCB                     ((SCB_Type*)SCB_BASE)
+#define DWT                     ((DWT_Type*)DWT_BASE)
+#define CoreDebug               ((CoreDebug_Type*)CoreDebug_BASE)
+
+#define SysTick_CTRL_ENABLE_Msk     (1UL << 0)
+#define SysTick_CTRL_TICKINT_Msk    (1UL << 1)
+#define SysTick_CTRL_CLKSOURCE_Msk  (1UL << 2)
+#define SysTick_CTRL_COUNTFLAG_Msk  (1UL << 16)
+#define SysTick_LOAD_RELOAD_Msk     0xFFFFFFUL
+#define SCB_SCR_SLEEPDEEP_Msk       (1UL << 2)
+#define SCB_ICSR_PENDSTSET_Msk      (1UL << 26)
+#define DWT_CTRL_CYCCNTENA_Msk      (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24)
+
+extern uint32_t SystemCoreClock;
+
+/* NVIC and SysTick setup, implemented by the virtual MCU */
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority);
+void NVIC_SetPendingIRQ(IRQn_Type irq);
+void NVIC_ClearPendingIRQ(IRQn_Type irq);
+uint32_t NVIC_GetPendingIRQ(IRQn_Type irq);
+uint32_t SysTick_Config(uint32_t ticks);
+
+/* Interrupt masking and sleep go through the virtual MCU, which runs
+ * pending handlers when PRIMASK clears and moves time on in __WFI */
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+void __WFI(void);
+void VMCU_Nop(void);
+#define __NOP()     VMCU_Nop()
+
+/* Real fences: host stress tests run firmware code on several threads */
+#define __DMB()     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __DSB()     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __ISB()     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+/* Handlers never preempt a handler part-way on the host, so the
+ * exclusive pair always succeeds */
+static inline uint32_t __LDREXW(volatile uint32_t* addr)
+{
+    return *addr;
+}
+
+static inline uint32_t __STREXW(uint32_t value, volatile uint32_t* addr)
+{
+    *addr = value;
+    return 0;
+}
+
+static inline void __CLREX(void)
+{
+}
+
+static inline uint8_t __CLZ(uint32_t value)
+{
+    return (uint8_t)(value ? __builtin_clz(value) : 32);
+}
+
+static inline uint32_t __RBIT(uint32_t value)
+{
+    uint32_t result = 0;
+
+    for (int i = 0; i < 32; i++) {
+        result = (result << 1) | ((value >> i) & 1U);
+    }
+    return result;
+}
+
+static inline uint32_t __REV(uint32_t value)
+{
+    return __builtin_bswap32(value);
+}
+
+#endif /* MDR32F9Q2I_H */
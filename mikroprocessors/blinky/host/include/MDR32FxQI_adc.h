@@ -0,0 +1,65 @@
+/* Host build stand-in for the SPL ADC driver */
+#ifndef MDR32FxQI_ADC_H
+#define MDR32FxQI_ADC_H
+
+#include "MDR32FxQI_config.h"
+
+typedef struct {
+    uint32_t ADC_SynchronousMode;
+    uint32_t ADC_StartDelay;
+    uint32_t ADC_TempSensor;
+    uint32_t ADC_TempSensorAmplifier;
+    uint32_t ADC_TempSensorConversion;
+    uint32_t ADC_IntVRefConversion;
+    uint32_t ADC_IntVRefTrimming;
+} ADC_InitTypeDef;
+
+typedef struct {
+    uint32_t ADC_ClockSource;
+    uint32_t ADC_SamplingMode;
+    uint32_t ADC_ChannelSwitching;
+    uint32_t ADC_ChannelNumber;
+    uint32_t ADC_Channels;
+    uint32_t ADC_LevelControl;
+    uint32_t ADC_LowLevel;
+    uint32_t ADC_HighLevel;
+    uint32_t ADC_VRefSource;
+    uint32_t ADC_IntVRefSource;
+    uint32_t ADC_Prescaler;
+    uint32_t ADC_DelayGo;
+} ADCx_InitTypeDef;
+
+#define ADC_CLOCK_SOURCE_CPU            0U
+#define ADC_SAMPLING_MODE_SINGLE_CONV   0U
+#define ADC_SAMPLING_MODE_CYCLIC_CONV   1U
+#define ADC_CH_SWITCHING_Disable        0U
+#define ADC_LEVEL_CONTROL_Disable       0U
+#define ADC_VREF_SOURCE_INTERNAL        0U
+#define ADC_INT_VREF_SOURCE_INEXACT     0U
+
+#define ADC_CH_ADC0             0U
+#define ADC_CH_ADC7             7U
+
+/* DIVCLK field, CPU clock / 2^n per ADC clock */
+#define ADC_CLK_div_None        (0U << 12)
+#define ADC_CLK_div_2           (1U << 12)
+#define ADC_CLK_div_4           (2U << 12)
+#define ADC_CLK_div_8           (3U << 12)
+#define ADC_CLK_div_16          (4U << 12)
+#define ADC_CLK_div_32          (5U << 12)
+#define ADC_CLK_div_64          (6U << 12)
+#define ADC_CLK_div_128         (7U << 12)
+#define ADC_CLK_div_256         (8U << 12)
+#define ADC_CLK_div_512         (9U << 12)
+#define ADC_CLK_div_1024        (10U << 12)
+#define ADC_CLK_div_2048        (11U << 12)
+
+void ADC_DeInit(void);
+void ADC_StructInit(ADC_InitTypeDef* ADC_InitStruct);
+void ADC_Init(const ADC_InitTypeDef* ADC_InitStruct);
+void ADCx_StructInit(ADCx_InitTypeDef* ADCx_InitStruct);
+void ADC1_Init(const ADCx_InitTypeDef* ADCx_InitStruct);
+void ADC1_Cmd(FunctionalState NewState);
+void ADC1_Start(void);
+
+#endif /* MDR32FxQI_ADC_H */
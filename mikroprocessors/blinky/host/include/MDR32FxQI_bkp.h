@@ -0,0 +1,41 @@
+/* Host build stand-in for the SPL BKP (backup domain, RTC) driver */
+#ifndef MDR32FxQI_BKP_H
+#define MDR32FxQI_BKP_H
+
+#include "MDR32FxQI_config.h"
+
+/* RTC clock source */
+#define BKP_RTC_LSIclk          0x00U
+#define BKP_RTC_LSEclk          0x04U
+#define BKP_RTC_HSIclk          0x08U
+#define BKP_RTC_HSEclk          0x0CU
+
+/* RTC_CS: flags, then their interrupt enables */
+#define BKP_RTC_CS_OWF          (1U << 0)
+#define BKP_RTC_CS_SECF         (1U << 1)
+#define BKP_RTC_CS_ALRF         (1U << 2)
+#define BKP_RTC_CS_OWF_IE       (1U << 3)
+#define BKP_RTC_CS_SECF_IE      (1U << 4)
+#define BKP_RTC_CS_ALRF_IE      (1U << 5)
+#define BKP_RTC_CS_WEC          (1U << 6)
+
+#define BKP_RTC_IT_OWF          BKP_RTC_CS_OWF_IE
+#define BKP_RTC_IT_SECF         BKP_RTC_CS_SECF_IE
+#define BKP_RTC_IT_ALRF         BKP_RTC_CS_ALRF_IE
+#define BKP_RTC_FLAG_OWF        BKP_RTC_CS_OWF
+#define BKP_RTC_FLAG_SECF       BKP_RTC_CS_SECF
+#define BKP_RTC_FLAG_ALRF       BKP_RTC_CS_ALRF
+#define BKP_RTC_FLAG_WEC        BKP_RTC_CS_WEC
+
+void BKP_RTCclkSource(uint32_t RTC_CLK);
+void BKP_RTC_Enable(FunctionalState NewState);
+void BKP_RTC_Reset(FunctionalState NewState);
+void BKP_RTC_WaitForUpdate(void);
+void BKP_RTC_SetCounter(uint32_t CounterValue);
+uint32_t BKP_RTC_GetCounter(void);
+void BKP_RTC_SetAlarm(uint32_t AlarmValue);
+void BKP_RTC_SetPrescaler(uint32_t PrescalerValue);
+void BKP_RTC_ITConfig(uint32_t RTC_IT, FunctionalState NewState);
+FlagStatus BKP_RTC_GetFlagStatus(uint32_t RTC_FLAG);
+
+#endif /* MDR32FxQI_BKP_H */
@@ -0,0 +1,23 @@
+/* Host build stand-in for the SPL configuration header */
+#ifndef MDR32FxQI_CONFIG_H
+#define MDR32FxQI_CONFIG_H
+
+#include "MDR32F9Q2I.h"
+
+#define HSI_Value               ((uint32_t)8000000)
+#define HSE_Value               ((uint32_t)8000000)
+#define LSE_Value               ((uint32_t)32768)
+#define LSI_Value               ((uint32_t)40000)
+
+#define RTC_PRESCALER_VALUE     32768
+
+/* Debug UART, used by uart_cmd.c only when _USE_DEBUG_UART_ is defined */
+#define DEBUG_BAUD_RATE         115200
+#define DEBUG_UART              MDR_UART2
+#define DEBUG_UART_PORT         MDR_PORTF
+#define DEBUG_UART_PINS         (PORT_Pin_0 | PORT_Pin_1)
+#define DEBUG_UART_PINS_FUNCTION PORT_FUNC_OVERRID
+
+#define assert_param(expr)      ((void)0)
+
+#endif /* MDR32FxQI_CONFIG_H */
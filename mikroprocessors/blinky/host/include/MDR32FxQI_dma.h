@@ -0,0 +1,117 @@
+/* Host build stand-in for the SPL DMA driver. Init values are the PL230
+ * control word bit fields, as in the real SPL, so the virtual DMA
+ * controller decodes the control table exactly as the hardware does. */
+#ifndef MDR32FxQI_DMA_H
+#define MDR32FxQI_DMA_H
+
+#include "MDR32FxQI_config.h"
+
+/* One entry of the control table */
+typedef struct {
+    __IO uint32_t DMA_SourceEndAddr;
+    __IO uint32_t DMA_DestEndAddr;
+    __IO uint32_t DMA_Control;
+    __IO uint32_t DMA_Unused;
+} DMA_CtrlDataTypeDef;
+
+typedef struct {
+    uint32_t DMA_SourceBaseAddr;
+    uint32_t DMA_DestBaseAddr;
+    uint32_t DMA_SourceIncSize;
+    uint32_t DMA_DestIncSize;
+    uint32_t DMA_MemoryDataSize;
+    uint32_t DMA_Mode;
+    uint32_t DMA_CycleSize;
+    uint32_t DMA_NumContinuous;
+    uint32_t DMA_SourceProtCtrl;
+    uint32_t DMA_DestProtCtrl;
+} DMA_CtrlDataInitTypeDef;
+
+typedef struct {
+    DMA_CtrlDataInitTypeDef* DMA_PriCtrlData;
+    DMA_CtrlDataInitTypeDef* DMA_AltCtrlData;
+    uint32_t DMA_ProtCtrl;
+    uint8_t DMA_Priority;
+    uint8_t DMA_UseBurst;
+    uint8_t DMA_SelectDataStructure;
+} DMA_ChannelInitTypeDef;
+
+/* Control word fields */
+#define DMA_CTRL_CYCLE_Msk      0x00000007UL
+#define DMA_CTRL_N_MINUS_1_Pos  4
+#define DMA_CTRL_N_MINUS_1_Msk  (0x3FFUL << DMA_CTRL_N_MINUS_1_Pos)
+#define DMA_CTRL_R_POWER_Pos    14
+#define DMA_CTRL_SRC_SIZE_Pos   24
+#define DMA_CTRL_SRC_INC_Pos    26
+#define DMA_CTRL_DST_SIZE_Pos   28
+#define DMA_CTRL_DST_INC_Pos    30
+#define DMA_INC_NONE            3UL
+
+#define DMA_SourceIncByte       (0UL << DMA_CTRL_SRC_INC_Pos)
+#define DMA_SourceIncHalfword   (1UL << DMA_CTRL_SRC_INC_Pos)
+#define DMA_SourceIncWord       (2UL << DMA_CTRL_SRC_INC_Pos)
+#define DMA_SourceIncNo         (3UL << DMA_CTRL_SRC_INC_Pos)
+
+#define DMA_DestIncByte         (0UL << DMA_CTRL_DST_INC_Pos)
+#define DMA_DestIncHalfword     (1UL << DMA_CTRL_DST_INC_Pos)
+#define DMA_DestIncWord         (2UL << DMA_CTRL_DST_INC_Pos)
+#define DMA_DestIncNo           (3UL << DMA_CTRL_DST_INC_Pos)
+
+#define DMA_MemoryDataSize_Byte     ((0UL << DMA_CTRL_DST_SIZE_Pos) | (0UL << DMA_CTRL_SRC_SIZE_Pos))
+#define DMA_MemoryDataSize_HalfWord ((1UL << DMA_CTRL_DST_SIZE_Pos) | (1UL << DMA_CTRL_SRC_SIZE_Pos))
+#define DMA_MemoryDataSize_Word     ((2UL << DMA_CTRL_DST_SIZE_Pos) | (2UL << DMA_CTRL_SRC_SIZE_Pos))
+
+#define DMA_Mode_Stop           0UL
+#define DMA_Mode_Basic          1UL
+#define DMA_Mode_AutoRequest    2UL
+#define DMA_Mode_PingPong       3UL
+
+#define DMA_Transfers_1         (0UL << DMA_CTRL_R_POWER_Pos)
+#define DMA_Transfers_2         (1UL << DMA_CTRL_R_POWER_Pos)
+#define DMA_Transfers_4         (2UL << DMA_CTRL_R_POWER_Pos)
+#define DMA_Transfers_8         (3UL << DMA_CTRL_R_POWER_Pos)
+
+#define DMA_SourcePrivileged    (1UL << 18)
+#define DMA_DestPrivileged      (1UL << 21)
+
+#define DMA_Priority_Default    0
+#define DMA_Priority_High       1
+#define DMA_BurstClear          0
+#define DMA_BurstSet            1
+#define DMA_CTRL_DATA_PRIMARY   0
+#define DMA_CTRL_DATA_ALTERNATE 1
+
+/* Request lines */
+#define DMA_Channel_UART1_TX    0
+#define DMA_Channel_UART1_RX    1
+#define DMA_Channel_UART2_TX    2
+#define DMA_Channel_UART2_RX    3
+#define DMA_Channel_SSP1_TX     4
+#define DMA_Channel_SSP1_RX     5
+#define DMA_Channel_SSP2_TX     6
+#define DMA_Channel_SSP2_RX     7
+#define DMA_Channel_ADC1        8
+#define DMA_Channel_ADC2        9
+#define DMA_Channel_TIM1        10
+#define DMA_Channel_TIM2        11
+#define DMA_Channel_TIM3        12
+#define DMA_Channels_Number     32
+
+/* DMA_GetFlagStatus */
+#define DMA_FLAG_DMA_ENA        0
+#define DMA_FLAG_DMA_ERR        1
+#define DMA_FLAG_CHNL_ENA       2
+#define DMA_FLAG_CHNL_MASK      3
+#define DMA_FLAG_CHNL_WAIT      4
+#define DMA_FLAG_CHNL_BURST     5
+#define DMA_FLAG_CHNL_ALT       6
+#define DMA_FLAG_CHNL_PRIORITY  7
+
+void DMA_DeInit(void);
+void DMA_Init(uint8_t DMA_Channel, DMA_ChannelInitTypeDef* DMA_InitStruct);
+void DMA_CtrlInit(uint8_t DMA_Channel, uint8_t DMA_CtrlDataType, DMA_CtrlDataInitTypeDef* DMA_CtrlStruct);
+void DMA_Cmd(uint8_t DMA_Channel, FunctionalState NewState);
+FlagStatus DMA_GetFlagStatus(uint8_t DMA_Channel, uint8_t DMA_Flag);
+uint32_t DMA_GetCurrTransferCounter(uint8_t DMA_Channel, uint8_t DMA_CtrlData);
+
+#endif /* MDR32FxQI_DMA_H */
@@ -0,0 +1,14 @@
+/* Host build stand-in for the SPL EEPROM (flash controller) driver */
+#ifndef MDR32FxQI_EEPROM_H
+#define MDR32FxQI_EEPROM_H
+
+#include "MDR32FxQI_config.h"
+
+#define EEPROM_Main_Bank_Select 0U
+#define EEPROM_Info_Bank_Select 1U
+
+void EEPROM_ErasePage(uint32_t Address, uint32_t BankSelector);
+void EEPROM_ProgramWord(uint32_t Address, uint32_t BankSelector, uint32_t RawData);
+uint32_t EEPROM_ReadWord(uint32_t Address, uint32_t BankSelector);
+
+#endif /* MDR32FxQI_EEPROM_H */
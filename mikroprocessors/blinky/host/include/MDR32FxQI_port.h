@@ -0,0 +1,54 @@
+/* Host build stand-in for the SPL PORT driver */
+#ifndef MDR32FxQI_PORT_H
+#define MDR32FxQI_PORT_H
+
+#include "MDR32FxQI_config.h"
+
+typedef enum { PORT_OE_IN = 0, PORT_OE_OUT = 1 } PORT_OE_TypeDef;
+typedef enum { PORT_MODE_ANALOG = 0, PORT_MODE_DIGITAL = 1 } PORT_MODE_TypeDef;
+typedef enum { PORT_SPEED_OFF = 0, PORT_SPEED_SLOW = 1, PORT_SPEED_FAST = 2, PORT_SPEED_MAXFAST = 3 } PORT_SPEED_TypeDef;
+typedef enum { PORT_FUNC_PORT = 0, PORT_FUNC_MAIN = 1, PORT_FUNC_ALTER = 2, PORT_FUNC_OVERRID = 3 } PORT_FUNC_TypeDef;
+typedef enum { PORT_PULL_UP_OFF = 0, PORT_PULL_UP_ON = 1 } PORT_PULL_UP_TypeDef;
+typedef enum { PORT_PULL_DOWN_OFF = 0, PORT_PULL_DOWN_ON = 1 } PORT_PULL_DOWN_TypeDef;
+typedef enum { PORT_PD_SHM_OFF = 0, PORT_PD_SHM_ON = 1 } PORT_PD_SHM_TypeDef;
+typedef enum { PORT_PD_DRIVER = 0, PORT_PD_OPEN = 1 } PORT_PD_TypeDef;
+typedef enum { PORT_GFEN_OFF = 0, PORT_GFEN_ON = 1 } PORT_GFEN_TypeDef;
+
+typedef struct {
+    uint16_t PORT_Pin;
+    PORT_OE_TypeDef PORT_OE;
+    PORT_PULL_UP_TypeDef PORT_PULL_UP;
+    PORT_PULL_DOWN_TypeDef PORT_PULL_DOWN;
+    PORT_PD_SHM_TypeDef PORT_PD_SHM;
+    PORT_PD_TypeDef PORT_PD;
+    PORT_GFEN_TypeDef PORT_GFEN;
+    PORT_FUNC_TypeDef PORT_FUNC;
+    PORT_SPEED_TypeDef PORT_SPEED;
+    PORT_MODE_TypeDef PORT_MODE;
+} PORT_InitTypeDef;
+
+#define PORT_Pin_0              0x0001U
+#define PORT_Pin_1              0x0002U
+#define PORT_Pin_2              0x0004U
+#define PORT_Pin_3              0x0008U
+#define PORT_Pin_4              0x0010U
+#define PORT_Pin_5              0x0020U
+#define PORT_Pin_6              0x0040U
+#define PORT_Pin_7              0x0080U
+#define PORT_Pin_8              0x0100U
+#define PORT_Pin_9              0x0200U
+#define PORT_Pin_10             0x0400U
+#define PORT_Pin_11             0x0800U
+#define PORT_Pin_12             0x1000U
+#define PORT_Pin_13             0x2000U
+#define PORT_Pin_14             0x4000U
+#define PORT_Pin_15             0x8000U
+#define PORT_Pin_All            0xFFFFU
+
+void PORT_Init(MDR_PORT_TypeDef* PORTx, const PORT_InitTypeDef* PORT_InitStruct);
+void PORT_StructInit(PORT_InitTypeDef* PORT_InitStruct);
+uint8_t PORT_ReadInputDataBit(MDR_PORT_TypeDef* PORTx, uint32_t PORT_Pin);
+void PORT_SetBits(MDR_PORT_TypeDef* PORTx, uint32_t PORT_Pin);
+void PORT_ResetBits(MDR_PORT_TypeDef* PORTx, uint32_t PORT_Pin);
+
+#endif /* MDR32FxQI_PORT_H */
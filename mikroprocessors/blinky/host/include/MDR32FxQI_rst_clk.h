@@ -0,0 +1,56 @@
+/* Host build stand-in for the SPL RST_CLK driver */
+#ifndef MDR32FxQI_RST_CLK_H
+#define MDR32FxQI_RST_CLK_H
+
+#include "MDR32FxQI_config.h"
+
+/* PER_CLOCK bit of a peripheral: bits [19:15] of its base address */
+#define RST_CLK_PCLK_BIT(base)  (1UL << (((base) >> 15) & 0x1FUL))
+
+#define RST_CLK_PCLK_EEPROM     RST_CLK_PCLK_BIT(0x40018000UL)
+#define RST_CLK_PCLK_RST_CLK    RST_CLK_PCLK_BIT(MDR_RST_CLK_BASE)
+#define RST_CLK_PCLK_DMA        RST_CLK_PCLK_BIT(MDR_DMA_BASE)
+#define RST_CLK_PCLK_UART1      RST_CLK_PCLK_BIT(MDR_UART1_BASE)
+#define RST_CLK_PCLK_UART2      RST_CLK_PCLK_BIT(MDR_UART2_BASE)
+#define RST_CLK_PCLK_TIMER1     RST_CLK_PCLK_BIT(MDR_TIMER1_BASE)
+#define RST_CLK_PCLK_TIMER2     RST_CLK_PCLK_BIT(MDR_TIMER2_BASE)
+#define RST_CLK_PCLK_TIMER3     RST_CLK_PCLK_BIT(MDR_TIMER3_BASE)
+#define RST_CLK_PCLK_ADC        RST_CLK_PCLK_BIT(MDR_ADC_BASE)
+#define RST_CLK_PCLK_PORTA      RST_CLK_PCLK_BIT(MDR_PORTA_BASE)
+#define RST_CLK_PCLK_PORTB      RST_CLK_PCLK_BIT(MDR_PORTB_BASE)
+#define RST_CLK_PCLK_PORTC      RST_CLK_PCLK_BIT(MDR_PORTC_BASE)
+#define RST_CLK_PCLK_PORTD      RST_CLK_PCLK_BIT(MDR_PORTD_BASE)
+#define RST_CLK_PCLK_PORTE      RST_CLK_PCLK_BIT(MDR_PORTE_BASE)
+#define RST_CLK_PCLK_BKP        RST_CLK_PCLK_BIT(MDR_BKP_BASE)
+#define RST_CLK_PCLK_PORTF      RST_CLK_PCLK_BIT(MDR_PORTF_BASE)
+
+typedef enum {
+    RST_CLK_LSE_OFF     = 0,
+    RST_CLK_LSE_ON      = 1,
+    RST_CLK_LSE_Bypass  = 2
+} RST_CLK_LSE_Mode;
+
+typedef struct {
+    uint32_t CPU_CLK_Frequency;
+    uint32_t USB_CLK_Frequency;
+    uint32_t ADC_CLK_Frequency;
+    uint32_t RTCHSI_Frequency;
+    uint32_t RTCHSE_Frequency;
+} RST_CLK_FreqTypeDef;
+
+#define RST_CLK_CPUclkHSI       0x0000U
+#define RST_CLK_CPUclkCPU_C3    0x0100U
+#define RST_CLK_CPUclkLSE       0x0200U
+#define RST_CLK_CPUclkLSI       0x0300U
+
+void RST_CLK_PCLKcmd(uint32_t RST_CLK_PCLK, FunctionalState NewState);
+void RST_CLK_LSEconfig(RST_CLK_LSE_Mode RST_CLK_LSE);
+ErrorStatus RST_CLK_LSEstatus(void);
+void RST_CLK_LSIcmd(FunctionalState NewState);
+ErrorStatus RST_CLK_LSIstatus(void);
+void RST_CLK_HSIcmd(FunctionalState NewState);
+ErrorStatus RST_CLK_HSIstatus(void);
+void RST_CLK_CPUclkSelection(uint32_t CPU_CLK);
+void RST_CLK_GetClocksFreq(RST_CLK_FreqTypeDef* RST_CLK_Clocks);
+
+#endif /* MDR32FxQI_RST_CLK_H */
@@ -0,0 +1,51 @@
+/* Host build stand-in for the SPL TIMER driver */
+#ifndef MDR32FxQI_TIMER_H
+#define MDR32FxQI_TIMER_H
+
+#include "MDR32FxQI_config.h"
+
+typedef struct {
+    uint16_t TIMER_IniCounter;
+    uint16_t TIMER_Prescaler;
+    uint16_t TIMER_Period;
+    uint16_t TIMER_CounterMode;
+    uint16_t TIMER_CounterDirection;
+    uint16_t TIMER_EventSource;
+    uint16_t TIMER_FilterSampling;
+    uint16_t TIMER_ARR_UpdateMode;
+    uint16_t TIMER_ETR_FilterConf;
+    uint16_t TIMER_ETR_Prescaler;
+    uint16_t TIMER_ETR_Polarity;
+    uint16_t TIMER_BRK_Polarity;
+} TIMER_CntInitTypeDef;
+
+/* Counter setup values; the host timers always count up on the
+ * prescaled HCLK, so only the numeric fields matter */
+enum {
+    TIMER_HCLKdiv1                  = 0,
+    TIMER_CntMode_ClkFixedDir       = 0,
+    TIMER_CntDir_Up                 = 0,
+    TIMER_EvSrc_TIM_CLK             = 0,
+    TIMER_FDTS_TIMER_CLK_div_1      = 0,
+    TIMER_ARR_Update_Immediately    = 0,
+    TIMER_ARR_Update_On_CNT_Overflow = 1,
+    TIMER_Filter_1FF_at_TIMER_CLK   = 0,
+    TIMER_ETR_Prescaler_None        = 0,
+    TIMER_ETRPolarity_NonInverted   = 0,
+    TIMER_BRKPolarity_NonInverted   = 0
+};
+
+void TIMER_CntInit(MDR_TIMER_TypeDef* TIMERx, const TIMER_CntInitTypeDef* TIMER_CntInitStruct);
+void TIMER_CntStructInit(TIMER_CntInitTypeDef* TIMER_CntInitStruct);
+void TIMER_BRGInit(MDR_TIMER_TypeDef* TIMERx, uint32_t TIMER_HCLKdiv);
+void TIMER_ITConfig(MDR_TIMER_TypeDef* TIMERx, uint32_t TIMER_IT, FunctionalState NewState);
+void TIMER_ClearFlag(MDR_TIMER_TypeDef* TIMERx, uint32_t Flags);
+void TIMER_Cmd(MDR_TIMER_TypeDef* TIMERx, FunctionalState NewState);
+FlagStatus TIMER_GetFlagStatus(MDR_TIMER_TypeDef* TIMERx, uint32_t Flag);
+ITStatus TIMER_GetITStatus(MDR_TIMER_TypeDef* TIMERx, uint32_t TIMER_IT);
+void TIMER_ClearITPendingBit(MDR_TIMER_TypeDef* TIMERx, uint32_t TIMER_IT);
+void TIMER_SetCounter(MDR_TIMER_TypeDef* TIMERx, uint32_t Counter);
+uint32_t TIMER_GetCounter(MDR_TIMER_TypeDef* TIMERx);
+void TIMER_SetCntAutoreload(MDR_TIMER_TypeDef* TIMERx, uint32_t Autoreload);
+
+#endif /* MDR32FxQI_TIMER_H */
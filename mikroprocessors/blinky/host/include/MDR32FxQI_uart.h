@@ -0,0 +1,51 @@
+/* Host build stand-in for the SPL UART driver */
+#ifndef MDR32FxQI_UART_H
+#define MDR32FxQI_UART_H
+
+#include "MDR32FxQI_config.h"
+
+typedef struct {
+    uint32_t UART_BaudRate;
+    uint16_t UART_WordLength;
+    uint16_t UART_StopBits;
+    uint16_t UART_Parity;
+    uint16_t UART_FIFOMode;
+    uint16_t UART_HardwareFlowControl;
+} UART_InitTypeDef;
+
+#define UART_WordLength8b       0x0060U
+#define UART_StopBits1          0x0000U
+#define UART_Parity_No          0x0000U
+#define UART_FIFO_ON            0x0010U
+#define UART_FIFO_OFF           0x0000U
+
+/* CR bits */
+#define UART_HardwareFlowControl_TXE    0x0100U
+#define UART_HardwareFlowControl_RXE    0x0200U
+
+#define UART_HCLKdiv1           0U
+
+/* FR bits */
+#define UART_FLAG_BUSY          (1U << 3)
+#define UART_FLAG_RXFE          (1U << 4)
+#define UART_FLAG_TXFF          (1U << 5)
+#define UART_FLAG_RXFF          (1U << 6)
+#define UART_FLAG_TXFE          (1U << 7)
+
+/* DMACR bits */
+#define UART_DMA_RXE            (1U << 0)
+#define UART_DMA_TXE            (1U << 1)
+
+#define UART_IT_RT              (1U << 6)
+#define UART_IT_OE              (1U << 10)
+
+ErrorStatus UART_Init(MDR_UART_TypeDef* UARTx, UART_InitTypeDef* UART_InitStruct);
+void UART_StructInit(UART_InitTypeDef* UART_InitStruct);
+void UART_Cmd(MDR_UART_TypeDef* UARTx, FunctionalState NewState);
+void UART_BRGInit(MDR_UART_TypeDef* UARTx, uint32_t UART_BRG);
+void UART_DMACmd(MDR_UART_TypeDef* UARTx, uint32_t UART_DMAReq, FunctionalState NewState);
+void UART_SendData(MDR_UART_TypeDef* UARTx, uint16_t Data);
+uint16_t UART_ReceiveData(MDR_UART_TypeDef* UARTx);
+FlagStatus UART_GetFlagStatus(MDR_UART_TypeDef* UARTx, uint32_t UART_Flag);
+
+#endif /* MDR32FxQI_UART_H */
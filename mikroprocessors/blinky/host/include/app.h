@@ -0,0 +1,3 @@
+/* main.c includes "app.h"; the file is Logic/Inc/App.h, found on the
+ * case-insensitive Keil host only */
+#include "App.h"
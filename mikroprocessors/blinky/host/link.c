@@ -0,0 +1,110 @@
+#include <string.h>
+#include "link.h"
+#include "hardware_drivers.h"
+
+static uint8_t reply_buf[LINK_MAX_FRAME];
+static uint32_t reply_len = 0;
+
+static void add(LINK_CommandsTypeDef* cmds, uint8_t cmd, const uint8_t* data, uint8_t size)
+{
+    if (cmds->len + 2 + size > sizeof(cmds->data)) {
+        return;
+    }
+    cmds->data[cmds->len++] = cmd;
+    cmds->data[cmds->len++] = size;
+    memcpy(&cmds->data[cmds->len], data, size);
+    cmds->len += size;
+}
+
+void LINK_AddU32(LINK_CommandsTypeDef* cmds, uint8_t cmd, uint32_t value)
+{
+    uint8_t le[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+
+    add(cmds, cmd, le, sizeof(le));
+}
+
+void LINK_AddU8(LINK_CommandsTypeDef* cmds, uint8_t cmd, uint8_t value)
+{
+    add(cmds, cmd, &value, 1);
+}
+
+void LINK_AddEmpty(LINK_CommandsTypeDef* cmds, uint8_t cmd)
+{
+    add(cmds, cmd, NULL, 0);
+}
+
+/**
+  * @brief  COBS( seq | commands | crc16 ) 0x00, as uart_cmd.c expects
+  * @retval Frame length including the delimiter
+  */
+uint32_t LINK_BuildFrame(uint8_t seq, const LINK_CommandsTypeDef* cmds, uint8_t* out)
+{
+    uint8_t raw[LINK_MAX_FRAME + 3];
+    uint32_t raw_len = 0;
+    uint32_t code_pos = 0;
+    uint32_t len = 1;
+    uint16_t crc;
+
+    raw[raw_len++] = seq;
+    memcpy(&raw[raw_len], cmds->data, cmds->len);
+    raw_len += cmds->len;
+    crc = HD_CRC16(raw, raw_len);
+    raw[raw_len++] = (uint8_t)(crc >> 8);
+    raw[raw_len++] = (uint8_t)crc;
+
+    for (uint32_t i = 0; i < raw_len; i++) {
+        if (raw[i] == 0) {
+            out[code_pos] = (uint8_t)(len - code_pos);
+            code_pos = len++;
+        } else {
+            out[len++] = raw[i];
+            if (len - code_pos == 0xFF) {
+                out[code_pos] = 0xFF;
+                code_pos = len++;
+            }
+        }
+    }
+    out[code_pos] = (uint8_t)(len - code_pos);
+    out[len++] = 0;
+    return len;
+}
+
+void LINK_Send(uint8_t seq, const LINK_CommandsTypeDef* cmds)
+{
+    uint8_t frame[2 * LINK_MAX_FRAME];
+
+    VM_UartSend(frame, LINK_BuildFrame(seq, cmds, frame));
+}
+
+/**
+  * @brief  Decodes the replies received so far
+  * @retval Number stored in replies
+  */
+uint32_t LINK_PollReplies(LINK_ReplyTypeDef* replies, uint32_t max)
+{
+    uint8_t bytes[64];
+    VM_Time times[64];
+    uint32_t count = 0;
+    uint32_t n;
+
+    while (count < max && (n = VM_UartReceive(bytes, sizeof(bytes), times)) != 0) {
+        for (uint32_t i = 0; i < n; i++) {
+            if (bytes[i] != 0) {
+                if (reply_len < sizeof(reply_buf)) {
+                    reply_buf[reply_len++] = bytes[i];
+                }
+                continue;
+            }
+            /* COBS of two bytes: code, then the non-zero ones */
+            if (reply_len == 3 && count < max) {
+                uint8_t seq = (reply_buf[0] == 1) ? 0 : reply_buf[1];
+                uint8_t status = (reply_buf[0] == 1) ? ((reply_buf[1] == 1) ? 0 : reply_buf[2])
+                                                     : ((reply_buf[0] == 2) ? 0 : reply_buf[2]);
+
+                replies[count++] = (LINK_ReplyTypeDef){ times[i], seq, status };
+            }
+            reply_len = 0;
+        }
+    }
+    return count;
+}
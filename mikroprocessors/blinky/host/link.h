@@ -0,0 +1,33 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <stdint.h>
+#include "vmcu.h"
+
+/* Test side of the UART command link (uart_cmd.h): builds frames, puts
+ * them on the virtual UART2 line and decodes the replies. */
+
+#define LINK_MAX_FRAME      64
+
+/* One decoded reply */
+typedef struct {
+    VM_Time t;                  /* delimiter received */
+    uint8_t seq;
+    uint8_t status;
+} LINK_ReplyTypeDef;
+
+/* Command builder */
+typedef struct {
+    uint8_t data[LINK_MAX_FRAME];
+    uint32_t len;
+} LINK_CommandsTypeDef;
+
+/* Function prototypes */
+void LINK_AddU32(LINK_CommandsTypeDef* cmds, uint8_t cmd, uint32_t value);
+void LINK_AddU8(LINK_CommandsTypeDef* cmds, uint8_t cmd, uint8_t value);
+void LINK_AddEmpty(LINK_CommandsTypeDef* cmds, uint8_t cmd);
+uint32_t LINK_BuildFrame(uint8_t seq, const LINK_CommandsTypeDef* cmds, uint8_t* out);
+void LINK_Send(uint8_t seq, const LINK_CommandsTypeDef* cmds);
+uint32_t LINK_PollReplies(LINK_ReplyTypeDef* replies, uint32_t max);
+
+#endif /* LINK_H */
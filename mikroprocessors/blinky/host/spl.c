@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "vmcu.h"
+#include "vmcu_int.h"
+#include "MDR32FxQI_port.h"
+#include "MDR32FxQI_rst_clk.h"
+#include "MDR32FxQI_timer.h"
+#include "MDR32FxQI_eeprom.h"
+
+/* SPL functions that only write registers: PORT, TIMER, peripheral
+ * clocks, plus the flash controller. Register writes are taken by the
+ * virtual MCU at vm_call_end, as those of firmware code are. */
+
+#define VM_FLASH_PAGE_SIZE      0x1000UL
+#define VM_FLASH_ERASE_US       40000       /* page erase, CPU stalled */
+#define VM_FLASH_PROGRAM_US     40          /* word program */
+
+uint32_t SystemCoreClock = (uint32_t)VM_CPU_HZ;
+
+/* PORT --------------------------------------------------------------------*/
+
+/* Sets or clears the bits of mask in reg */
+static void port_field(volatile uint32_t* reg, uint32_t mask, uint32_t set)
+{
+    *reg = set ? (*reg | mask) : (*reg & ~mask);
+}
+
+void PORT_Init(MDR_PORT_TypeDef* PORTx, const PORT_InitTypeDef* PORT_InitStruct)
+{
+    vm_call_begin();
+    for (uint32_t pin = 0; pin < 16; pin++) {
+        uint32_t bit = 1UL << pin;
+        uint32_t two = 3UL << (2 * pin);
+
+        if (!(PORT_InitStruct->PORT_Pin & bit)) {
+            continue;
+        }
+        port_field(&PORTx->OE, bit, PORT_InitStruct->PORT_OE == PORT_OE_OUT);
+        PORTx->FUNC = (PORTx->FUNC & ~two) | ((uint32_t)PORT_InitStruct->PORT_FUNC << (2 * pin));
+        port_field(&PORTx->ANALOG, bit, PORT_InitStruct->PORT_MODE == PORT_MODE_DIGITAL);
+        port_field(&PORTx->PULL, bit << 16, PORT_InitStruct->PORT_PULL_UP == PORT_PULL_UP_ON);
+        port_field(&PORTx->PULL, bit, PORT_InitStruct->PORT_PULL_DOWN == PORT_PULL_DOWN_ON);
+        port_field(&PORTx->PD, bit << 16, PORT_InitStruct->PORT_PD_SHM == PORT_PD_SHM_ON);
+        port_field(&PORTx->PD, bit, PORT_InitStruct->PORT_PD == PORT_PD_OPEN);
+        PORTx->PWR = (PORTx->PWR & ~two) | ((uint32_t)PORT_InitStruct->PORT_SPEED << (2 * pin));
+        port_field(&PORTx->GFEN, bit, PORT_InitStruct->PORT_GFEN == PORT_GFEN_ON);
+    }
+    vm_call_end();
+}
+
+void PORT_StructInit(PORT_InitTypeDef* PORT_InitStruct)
+{
+    vm_call_begin();
+    PORT_InitStruct->PORT_Pin = PORT_Pin_All;
+    PORT_InitStruct->PORT_OE = PORT_OE_IN;
+    PORT_InitStruct->PORT_PULL_UP = PORT_PULL_UP_OFF;
+    PORT_InitStruct->PORT_PULL_DOWN = PORT_PULL_DOWN_OFF;
+    PORT_InitStruct->PORT_PD_SHM = PORT_PD_SHM_OFF;
+    PORT_InitStruct->PORT_PD = PORT_PD_DRIVER;
+    PORT_InitStruct->PORT_GFEN = PORT_GFEN_OFF;
+    PORT_InitStruct->PORT_FUNC = PORT_FUNC_PORT;
+    PORT_InitStruct->PORT_SPEED = PORT_SPEED_OFF;
+    PORT_InitStruct->PORT_MODE = PORT_MODE_ANALOG;
+    vm_call_end();
+}
+
+uint8_t PORT_ReadInputDataBit(MDR_PORT_TypeDef* PORTx, uint32_t PORT_Pin)
+{
+    vm_call_begin();
+    vm_call_end();
+    return (PORTx->RXTX & PORT_Pin) ? 1 : 0;
+}
+
+void PORT_SetBits(MDR_PORT_TypeDef* PORTx, uint32_t PORT_Pin)
+{
+    vm_call_begin();
+    PORTx->RXTX |= PORT_Pin;
+    vm_call_end();
+}
+
+void PORT_ResetBits(MDR_PORT_TypeDef* PORTx, uint32_t PORT_Pin)
+{
+    vm_call_begin();
+    PORTx->RXTX &= ~PORT_Pin;
+    vm_call_end();
+}
+
+/* RST_CLK -----------------------------------------------------------------*/
+
+void RST_CLK_PCLKcmd(uint32_t RST_CLK_PCLK, FunctionalState NewState)
+{
+    vm_call_begin();
+    port_field(&MDR_RST_CLK->PER_CLOCK, RST_CLK_PCLK, NewState != DISABLE);
+    vm_call_end();
+}
+
+/* TIMER -------------------------------------------------------------------*/
+
+void TIMER_CntInit(MDR_TIMER_TypeDef* TIMERx, const TIMER_CntInitTypeDef* TIMER_CntInitStruct)
+{
+    vm_call_begin();
+    TIMERx->CNTRL = 0;
+    TIMERx->CNT = TIMER_CntInitStruct->TIMER_IniCounter;
+    TIMERx->PSG = TIMER_CntInitStruct->TIMER_Prescaler;
+    TIMERx->ARR = TIMER_CntInitStruct->TIMER_Period;
+    vm_call_end();
+}
+
+void TIMER_CntStructInit(TIMER_CntInitTypeDef* TIMER_CntInitStruct)
+{
+    vm_call_begin();
+    memset(TIMER_CntInitStruct, 0, sizeof(*TIMER_CntInitStruct));
+    vm_call_end();
+}
+
+void TIMER_BRGInit(MDR_TIMER_TypeDef* TIMERx, uint32_t TIMER_HCLKdiv)
+{
+    uint32_t index = (uint32_t)(((uintptr_t)TIMERx - MDR_TIMER1_BASE) / (MDR_TIMER2_BASE - MDR_TIMER1_BASE));
+
+    vm_call_begin();
+    MDR_RST_CLK->TIM_CLOCK = (MDR_RST_CLK->TIM_CLOCK & ~(0xFFUL << (8 * index))) |
+                             (TIMER_HCLKdiv << (8 * index)) | (RST_CLK_TIM_CLOCK_TIM1_CLK_EN << index);
+    vm_call_end();
+}
+
+void TIMER_ITConfig(MDR_TIMER_TypeDef* TIMERx, uint32_t TIMER_IT, FunctionalState NewState)
+{
+    vm_call_begin();
+    port_field(&TIMERx->IE, TIMER_IT, NewState != DISABLE);
+    vm_call_end();
+}
+
+void TIMER_ClearFlag(MDR_TIMER_TypeDef* TIMERx, uint32_t Flags)
+{
+    vm_call_begin();
+    TIMERx->STATUS = ~Flags;
+    vm_call_end();
+}
+
+void TIMER_Cmd(MDR_TIMER_TypeDef* TIMERx, FunctionalState NewState)
+{
+    vm_call_begin();
+    port_field(&TIMERx->CNTRL, TIMER_CNTRL_CNT_EN, NewState != DISABLE);
+    vm_call_end();
+}
+
+FlagStatus TIMER_GetFlagStatus(MDR_TIMER_TypeDef* TIMERx, uint32_t Flag)
+{
+    vm_call_begin();
+    vm_call_end();
+    return (TIMERx->STATUS & Flag) ? SET : RESET;
+}
+
+ITStatus TIMER_GetITStatus(MDR_TIMER_TypeDef* TIMERx, uint32_t TIMER_IT)
+{
+    vm_call_begin();
+    vm_call_end();
+    return (TIMERx->STATUS & TIMERx->IE & TIMER_IT) ? SET : RESET;
+}
+
+void TIMER_ClearITPendingBit(MDR_TIMER_TypeDef* TIMERx, uint32_t TIMER_IT)
+{
+    TIMER_ClearFlag(TIMERx, TIMER_IT);
+}
+
+void TIMER_SetCounter(MDR_TIMER_TypeDef* TIMERx, uint32_t Counter)
+{
+    vm_call_begin();
+    TIMERx->CNT = Counter;
+    vm_call_end();
+}
+
+uint32_t TIMER_GetCounter(MDR_TIMER_TypeDef* TIMERx)
+{
+    vm_call_begin();
+    vm_call_end();
+    return TIMERx->CNT;
+}
+
+void TIMER_SetCntAutoreload(MDR_TIMER_TypeDef* TIMERx, uint32_t Autoreload)
+{
+    vm_call_begin();
+    TIMERx->ARR = Autoreload;
+    vm_call_end();
+}
+
+/* EEPROM ------------------------------------------------------------------*/
+
+/**
+  * @brief  Check if power fails during the flash operation about to start
+  */
+static uint32_t flash_power_fails(void)
+{
+    return VM_Config.flash_cut_at != 0 &&
+           vm_stats.flash_erases + vm_stats.flash_writes + 1 == VM_Config.flash_cut_at;
+}
+
+/* Ends the device process, flash keeps what the torn operation left */
+static void flash_power_cut(void)
+{
+    fflush(NULL);
+    _exit(VM_POWER_CUT);
+}
+
+/**
+  * @brief  Erases a 4 KB main flash page to 0xFF, the CPU stalls meanwhile
+  * @note   A power cut leaves the first half of the page as it was
+  */
+void EEPROM_ErasePage(uint32_t Address, uint32_t BankSelector)
+{
+    uint8_t* page = (uint8_t*)(uintptr_t)(Address & ~(VM_FLASH_PAGE_SIZE - 1));
+
+    (void)BankSelector;
+    vm_call_begin();
+    if (flash_power_fails()) {
+        memset(page + VM_FLASH_PAGE_SIZE / 2, 0xFF, VM_FLASH_PAGE_SIZE / 2);
+        flash_power_cut();
+    }
+    memset(page, 0xFF, VM_FLASH_PAGE_SIZE);
+    vm_stats.flash_erases++;
+    vm_wait_until(vm_now + VM_US(VM_FLASH_ERASE_US));
+    vm_call_end();
+}
+
+/**
+  * @brief  Programs a word, flash bits only go from 1 to 0
+  * @note   A power cut programs the low half-word only
+  */
+void EEPROM_ProgramWord(uint32_t Address, uint32_t BankSelector, uint32_t RawData)
+{
+    (void)BankSelector;
+    vm_call_begin();
+    if (flash_power_fails()) {
+        *(volatile uint32_t*)(uintptr_t)(Address & ~3UL) &= RawData | 0xFFFF0000UL;
+        flash_power_cut();
+    }
+    *(volatile uint32_t*)(uintptr_t)(Address & ~3UL) &= RawData;
+    vm_stats.flash_writes++;
+    vm_wait_until(vm_now + VM_US(VM_FLASH_PROGRAM_US));
+    vm_call_end();
+}
+
+uint32_t EEPROM_ReadWord(uint32_t Address, uint32_t BankSelector)
+{
+    (void)BankSelector;
+    return *(volatile uint32_t*)(uintptr_t)(Address & ~3UL);
+}
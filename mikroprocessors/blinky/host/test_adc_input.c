@@ -0,0 +1,245 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "vmcu.h"
+#include "adc_input.h"
+
+/* Light sensor input (adc_input.c) on the ADC1 and DMA models:
+ *   - step: a DC step from 1000 to 3000; after the step every block's
+ *     output must follow y += (x - y) / 2^ADCIN_IIR_SHIFT from the level
+ *     before it, within ADC_TEST_STEP_TOL, and settle on 3000
+ *   - sine: 1500 amplitude at 100 Hz, far above the block rate, around
+ *     2048; once settled the output must stay within ADC_TEST_SINE_TOL of
+ *     2048, the block mean and the IIR together take it down over 36 dB
+ *   - reinit: ADCIN_Init again with the DMA on its alternate half, as a
+ *     restart of the input does; the blocks must go on as before
+ * In every case one block per ADCIN_BLOCK_SIZE samples, at the rate of
+ * ADC1 on CPU/512 with ADC_TEST_CONVERSION_CLK clocks per conversion, no
+ * sample dropped by the DMA and no overrun. */
+
+#define ADC_TEST_CONVERSION_CLK 28      /* ADC clocks per conversion */
+#define ADC_TEST_PRESCALER_LOG2 9       /* ADC_CLK_div_512 */
+#define ADC_TEST_BLOCK_CYCLES   ((VM_Time)ADCIN_BLOCK_SIZE * (ADC_TEST_CONVERSION_CLK << ADC_TEST_PRESCALER_LOG2))
+#define ADC_TEST_POLL           VM_US(500)
+#define ADC_TEST_RUN            VM_MS(8000)
+#define ADC_TEST_STEP_AT        VM_MS(4000)
+#define ADC_TEST_SETTLED_AT     VM_MS(3500)
+#define ADC_TEST_STEP_TOL       2       /* Q16 truncation per block */
+#define ADC_TEST_SINE_HZ        100.0
+#define ADC_TEST_SINE_AMP       1500.0
+#define ADC_TEST_SINE_TOL       23      /* 1500 / 64 */
+#define ADC_TEST_MAX_BLOCKS     256
+
+typedef enum {
+    ADC_TEST_STEP = 0,
+    ADC_TEST_SINE,
+    ADC_TEST_REINIT,
+} ADC_TEST_CaseTypeDef;
+
+typedef struct {
+    uint32_t blocks;
+    VM_Time t[ADC_TEST_MAX_BLOCKS];     /* block seen done, to ADC_TEST_POLL */
+    uint16_t level[ADC_TEST_MAX_BLOCKS];
+    uint32_t block_count;
+    uint32_t samples;
+    uint32_t dropped;
+    uint32_t overruns;
+    uint32_t reinit_block;
+} ADC_TEST_ResultTypeDef;
+
+static const char* const names[] = { "step", "sine", "reinit" };
+
+#define ADC_TEST_CASES  (sizeof(names) / sizeof(names[0]))
+
+static ADC_TEST_ResultTypeDef* results;
+
+static uint16_t step_source(VM_Time t, void* arg)
+{
+    (void)arg;
+    return t < ADC_TEST_STEP_AT ? 1000 : 3000;
+}
+
+static uint16_t sine_source(VM_Time t, void* arg)
+{
+    (void)arg;
+    return (uint16_t)lrint(2048.0 + ADC_TEST_SINE_AMP * sin(2 * M_PI * ADC_TEST_SINE_HZ * (double)t / VM_CPU_HZ));
+}
+
+static uint16_t dc_source(VM_Time t, void* arg)
+{
+    (void)t;
+    (void)arg;
+    return 2000;
+}
+
+static int run_case(void* arg)
+{
+    ADC_TEST_CaseTypeDef which = (ADC_TEST_CaseTypeDef)(uintptr_t)arg;
+    ADC_TEST_ResultTypeDef* r = &results[which];
+    uint32_t seen;
+
+    VM_Config.adc_source = (which == ADC_TEST_STEP) ? step_source : (which == ADC_TEST_SINE) ? sine_source : dc_source;
+    VM_Boot();
+    VM_RunFor(ADC_TEST_POLL);
+    seen = ADCIN_GetBlockCount();
+
+    while (VM_Now() < ADC_TEST_RUN && r->blocks < ADC_TEST_MAX_BLOCKS) {
+        VM_RunFor(ADC_TEST_POLL);
+        if (ADCIN_GetBlockCount() != seen) {
+            seen = ADCIN_GetBlockCount();
+            r->t[r->blocks] = VM_Now();
+            r->level[r->blocks] = ADCIN_GetFiltered();
+            r->blocks++;
+            /* Restart on the alternate half: an odd number of blocks done */
+            if (which == ADC_TEST_REINIT && r->reinit_block == 0 && VM_Now() > ADC_TEST_STEP_AT && (seen & 1U)) {
+                ADCIN_Init();
+                r->reinit_block = r->blocks;
+            }
+        }
+    }
+    r->block_count = ADCIN_GetBlockCount();
+    r->samples = VM_GetStats()->adc_samples;
+    r->dropped = VM_GetStats()->adc_dropped;
+    r->overruns = ADCIN_GetOverrunCount();
+    return 0;
+}
+
+/* One block per ADCIN_BLOCK_SIZE samples, at the nominal block period */
+static int check_cadence(const char* name, const ADC_TEST_ResultTypeDef* r)
+{
+    int failed = 0;
+
+    if (r->samples / ADCIN_BLOCK_SIZE != r->block_count || r->dropped != 0 || r->overruns != 0) {
+        printf("FAIL %s: %u samples, %u blocks, %u dropped, %u overruns\n", name, r->samples, r->block_count,
+               r->dropped, r->overruns);
+        failed++;
+    }
+    for (uint32_t i = 1; i < r->blocks; i++) {
+        VM_Time gap = r->t[i] - r->t[i - 1];
+
+        if (i == r->reinit_block) {
+            continue;           /* a fresh block starts at the restart */
+        }
+        if (gap + ADC_TEST_POLL < ADC_TEST_BLOCK_CYCLES || gap > ADC_TEST_BLOCK_CYCLES + ADC_TEST_POLL) {
+            printf("FAIL %s: block %u after %.3f ms, period %.3f ms\n", name, i, (double)gap * 1000.0 / VM_CPU_HZ,
+                   (double)ADC_TEST_BLOCK_CYCLES * 1000.0 / VM_CPU_HZ);
+            failed++;
+            break;
+        }
+    }
+    return failed;
+}
+
+/* Every block after the step moves 1/2^ADCIN_IIR_SHIFT of the way */
+static int check_step(const ADC_TEST_ResultTypeDef* r)
+{
+    uint32_t first = 0;
+    double expected;
+
+    while (first < r->blocks && r->t[first] < ADC_TEST_STEP_AT + ADC_TEST_BLOCK_CYCLES + ADC_TEST_POLL) {
+        first++;
+    }
+    if (first == 0 || first + 8 > r->blocks) {
+        printf("FAIL step: %u blocks recorded\n", r->blocks);
+        return 1;
+    }
+    if (r->level[first - 2] < 1000 - ADC_TEST_STEP_TOL || r->level[first - 2] > 1000) {
+        printf("FAIL step: %u before the step, not settled on 1000\n", r->level[first - 2]);
+        return 1;
+    }
+    expected = r->level[first - 1];
+    for (uint32_t i = first; i < r->blocks; i++) {
+        expected += (3000.0 - expected) / (1 << ADCIN_IIR_SHIFT);
+        if (fabs(r->level[i] - expected) > ADC_TEST_STEP_TOL) {
+            printf("FAIL step: block %u after the step at %u, expected %.1f\n", i - first + 1, r->level[i], expected);
+            return 1;
+        }
+    }
+    if (3000 - r->level[r->blocks - 1] > ADC_TEST_STEP_TOL) {
+        printf("FAIL step: settles at %u\n", r->level[r->blocks - 1]);
+        return 1;
+    }
+    printf("step    %u -> %u, %u blocks after the step follow the IIR within %d\n", r->level[first - 2],
+           r->level[r->blocks - 1], r->blocks - first, ADC_TEST_STEP_TOL);
+    return 0;
+}
+
+static int check_sine(const ADC_TEST_ResultTypeDef* r)
+{
+    int worst = 0;
+
+    for (uint32_t i = 0; i < r->blocks; i++) {
+        int dev = (int)r->level[i] - 2048;
+
+        if (r->t[i] < ADC_TEST_SETTLED_AT) {
+            continue;
+        }
+        if (dev < 0) {
+            dev = -dev;
+        }
+        if (dev > worst) {
+            worst = dev;
+        }
+    }
+    printf("sine    %.0f Hz, amplitude %.0f: output within %d of 2048 (%.1f dB down)\n", ADC_TEST_SINE_HZ,
+           ADC_TEST_SINE_AMP, worst, 20.0 * log10(ADC_TEST_SINE_AMP / (worst ? worst : 1)));
+    if (worst > ADC_TEST_SINE_TOL) {
+        printf("FAIL sine: %d from 2048, limit %d\n", worst, ADC_TEST_SINE_TOL);
+        return 1;
+    }
+    return 0;
+}
+
+static int check_reinit(const ADC_TEST_ResultTypeDef* r)
+{
+    if (r->reinit_block == 0) {
+        printf("FAIL reinit: never restarted\n");
+        return 1;
+    }
+    for (uint32_t i = r->reinit_block; i < r->blocks; i++) {
+        if (r->level[i] < 2000 - ADC_TEST_STEP_TOL || r->level[i] > 2000) {
+            printf("FAIL reinit: block %u after the restart at %u\n", i - r->reinit_block + 1, r->level[i]);
+            return 1;
+        }
+    }
+    printf("reinit  restart after block %u, %u blocks after it\n", r->reinit_block, r->blocks - r->reinit_block);
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    results = mmap(NULL, ADC_TEST_CASES * sizeof(*results), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                   -1, 0);
+    if (results == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(results, 0, ADC_TEST_CASES * sizeof(*results));
+
+    for (uint32_t i = 0; i < ADC_TEST_CASES; i++) {
+        const ADC_TEST_ResultTypeDef* r = &results[i];
+
+        if (VM_RunIsolated(run_case, (void*)(uintptr_t)i) != 0) {
+            printf("FAIL %s: device run failed\n", names[i]);
+            failed++;
+            continue;
+        }
+        failed += check_cadence(names[i], r);
+        switch ((ADC_TEST_CaseTypeDef)i) {
+        case ADC_TEST_STEP:
+            failed += check_step(r);
+            break;
+        case ADC_TEST_SINE:
+            failed += check_sine(r);
+            break;
+        case ADC_TEST_REINIT:
+            failed += check_reinit(r);
+            break;
+        }
+    }
+    printf("%s ADC input filter and block cadence\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "vmcu.h"
+#include "leds.h"
+#include "hardware_drivers.h"
+#include "hd_fast.h"
+
+/* CPU load meter (HD_GetCpuLoad, HD_GetIsrLoad) against a known load.
+ * The TIMER1 handler's LED_Process is made to burn a fixed share of the
+ * time since its previous call (-Wl,--wrap=LED_Process), so TIMER1 takes
+ * that share of the CPU. Over one load window the meter must give
+ *   - TIMER1 load: the burnt cycles over the window
+ *   - CPU load: the window minus the time the virtual core slept
+ * each within LOAD_TEST_TOL, and a second over HD_CPU_LOAD_LIMIT must be
+ * counted as an overload, no other second. */
+
+#define LOAD_TEST_FROM      (VM_MS(2000) + VM_US(500))  /* just after a window closes */
+#define LOAD_TEST_WINDOW    VM_MS(1000)
+#define LOAD_TEST_TOL       5                           /* 1/1000 */
+
+typedef struct {
+    uint32_t permille;          /* TIMER1 share to burn */
+} LOAD_TEST_CaseTypeDef;
+
+typedef struct {
+    uint32_t cpu_load;
+    uint32_t timer1_load;
+    uint32_t overloads;
+    double burnt;               /* share of the window, 1/1000 */
+    double busy;                /* share the core was awake, 1/1000 */
+} LOAD_TEST_ResultTypeDef;
+
+static const LOAD_TEST_CaseTypeDef cases[] = {
+    { 0 },
+    { 100 },
+    { 500 },
+    { 970 },
+};
+
+#define LOAD_TEST_CASES     (sizeof(cases) / sizeof(cases[0]))
+
+static LOAD_TEST_ResultTypeDef* results;
+static uint32_t burn_permille;
+static VM_Time last_call;
+static VM_Time burnt;
+
+void __real_LED_Process(void);
+
+/* TIMER1 handler work, plus a burn that makes the share permille of
+ * the time since the previous call */
+void __wrap_LED_Process(void)
+{
+    VM_Time now = VM_Now();
+    VM_Time cycles = (now - last_call) * burn_permille / (1000 - burn_permille);
+
+    if (last_call != 0 && cycles != 0) {
+        VM_Busy(cycles);
+        burnt += cycles;
+    }
+    last_call = VM_Now();
+    __real_LED_Process();
+}
+
+static int run_case(void* arg)
+{
+    uint32_t index = (uint32_t)(uintptr_t)arg;
+    LOAD_TEST_ResultTypeDef* r = &results[index];
+    uint64_t asleep;
+    uint64_t slept;
+    VM_Time from_burnt;
+
+    burn_permille = cases[index].permille;
+    VM_Boot();
+    VM_RunUntil(LOAD_TEST_FROM);
+    asleep = VM_GetStats()->sleep_cycles;
+    from_burnt = burnt;
+
+    VM_RunUntil(LOAD_TEST_FROM + LOAD_TEST_WINDOW);
+    r->burnt = (double)(burnt - from_burnt) * 1000.0 / LOAD_TEST_WINDOW;
+    slept = VM_GetStats()->sleep_cycles - asleep;
+    r->busy = (double)(LOAD_TEST_WINDOW - (slept < LOAD_TEST_WINDOW ? slept : LOAD_TEST_WINDOW)) * 1000.0 /
+              LOAD_TEST_WINDOW;
+    r->cpu_load = HD_GetCpuLoad(HD_LOAD_1S);
+    r->timer1_load = HD_GetIsrLoad(HD_ISR_TIMER1);
+    r->overloads = HD_GetOverloadCount();
+    return 0;
+}
+
+static int near(uint32_t measured, double expected)
+{
+    return measured >= expected - LOAD_TEST_TOL && measured <= expected + LOAD_TEST_TOL;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    results = mmap(NULL, LOAD_TEST_CASES * sizeof(*results), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                   -1, 0);
+    if (results == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(results, 0, LOAD_TEST_CASES * sizeof(*results));
+
+    printf("burn   burnt  TIMER1 load  awake  CPU load  overloads\n");
+    for (uint32_t i = 0; i < LOAD_TEST_CASES; i++) {
+        LOAD_TEST_ResultTypeDef* r = &results[i];
+        uint32_t overloaded;
+
+        if (VM_RunIsolated(run_case, (void*)(uintptr_t)i) != 0) {
+            printf("FAIL burn %u: device run failed\n", cases[i].permille);
+            failed++;
+            continue;
+        }
+        overloaded = (r->busy > HD_CPU_LOAD_LIMIT);
+        printf("%4u  %6.1f  %11u  %5.1f  %8u  %9u\n", cases[i].permille, r->burnt, r->timer1_load, r->busy,
+               r->cpu_load, r->overloads);
+        if (!near(r->timer1_load, r->burnt)) {
+            printf("FAIL burn %u: TIMER1 load %u, burnt %.1f\n", cases[i].permille, r->timer1_load, r->burnt);
+            failed++;
+        }
+        if (!near(r->cpu_load, r->busy)) {
+            printf("FAIL burn %u: CPU load %u, awake %.1f\n", cases[i].permille, r->cpu_load, r->busy);
+            failed++;
+        }
+        if ((r->overloads != 0) != overloaded) {
+            printf("FAIL burn %u: %u overloads counted\n", cases[i].permille, r->overloads);
+            failed++;
+        }
+    }
+    printf("%s CPU load meter against a known handler load\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
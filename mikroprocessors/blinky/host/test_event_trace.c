@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "vmcu.h"
+#include "link.h"
+#include "uart_cmd.h"
+#include "leds.h"
+#include "hd_trace.h"
+
+/* Event trace ring (hd_trace.h) and its decoder, firmware built with
+ * HD_TRACE_ENABLE. The device runs in TRACE_TEST_STEP steps from boot;
+ * after each the new records are read off the ring, so the test holds
+ * every record ever written, timed backwards from the ring state. It
+ * checks
+ *   - every record lands in the step that wrote it, on DWT->CYCCNT
+ *   - one SysTick, TIMER1 and DMA slice per handler run the virtual MCU
+ *     counted (interrupt context), one frame record per LED_Render frame
+ *     in order and the command sent over the link (thread context)
+ *   - tools/trace2json.py turns a dump of the ring into exactly the
+ *     Chrome events of the records it still holds: once before the ring
+ *     first wraps and once at the end, many wraps later, where the oldest
+ *     record is the time origin and ENDs whose BEGIN was overwritten go
+ * On the host __LDREXW/__STREXW always succeed (include/MDR32F9Q2I.h):
+ * handlers only run at CMSIS calls, never inside HD_TraceWrite, so the
+ * claim loop is taken once and the retry path is not exercised here.
+ *
+ *   test_event_trace <trace2json.py> <dump directory>
+ */
+
+#define TRACE_TEST_STEP         VM_US(500)
+#define TRACE_TEST_COMMAND_AT   VM_MS(100)
+#define TRACE_TEST_RUN          VM_MS(400)
+#define TRACE_TEST_MAX_RECORDS  16384
+#define TRACE_TEST_MAX_STEP     (HD_TRACE_DEPTH / 2)    /* records per step */
+#define TRACE_TEST_TS_US        1e-3                    /* JSON rounding */
+
+typedef enum {
+    TRACE_TEST_INSTANT = 0,
+    TRACE_TEST_BEGIN,
+    TRACE_TEST_END,
+} TRACE_TEST_KindTypeDef;
+
+typedef struct {
+    uint32_t event;
+    uint32_t arg;
+    uint64_t cycles;            /* DWT->CYCCNT when written */
+} TRACE_TEST_RecordTypeDef;
+
+typedef struct {
+    uint32_t records;
+    uint32_t misplaced;         /* outside the step that wrote them */
+    uint32_t begins[HD_EV_COUNT];
+    uint64_t irq_counts[3];     /* SysTick, TIMER1, DMA since the baseline */
+    uint32_t frames;            /* LED_Render frames since the baseline */
+    uint32_t frame_gaps;        /* frame records not counting up by one */
+    uint32_t commands;
+    uint32_t clock_hz;
+    uint32_t dumped_at[2];      /* records written at each dump */
+    uint32_t overfull;          /* steps that may have wrapped the ring */
+    TRACE_TEST_RecordTypeDef log[TRACE_TEST_MAX_RECORDS];
+} TRACE_TEST_ResultTypeDef;
+
+#define TRACE_TEST_KIND(name, kind, label)      [HD_EV_##name] = TRACE_TEST_##kind,
+static const uint8_t kinds[HD_EV_COUNT] = {
+    HD_TRACE_EVENTS(TRACE_TEST_KIND)
+};
+
+#define TRACE_TEST_LABEL(name, kind, label)     [HD_EV_##name] = label,
+static const char* const labels[HD_EV_COUNT] = {
+    HD_TRACE_EVENTS(TRACE_TEST_LABEL)
+};
+
+static const IRQn_Type irqs[3] = { SysTick_IRQn, Timer1_IRQn, DMA_IRQn };
+static const uint32_t irq_events[3] = { HD_EV_SYSTICK_BEGIN, HD_EV_TIMER1_BEGIN, HD_EV_DMA_BEGIN };
+
+static TRACE_TEST_ResultTypeDef* result;
+static const char* dump_dir;
+
+/* Records the ring took since the last call, timed back from its state */
+static void collect(uint32_t* slot, uint64_t from, uint32_t* since_baseline)
+{
+    uint32_t state = HD_TraceBuffer.state;
+    uint32_t next = state & (HD_TRACE_DEPTH - 1);
+    uint32_t count = (next - *slot) & (HD_TRACE_DEPTH - 1);
+    uint64_t now = DWT->CYCCNT;
+    uint64_t t = now - ((now - (state >> 8)) & 0x00FFFFFFUL);
+    uint32_t first = result->records;
+
+    if (count > TRACE_TEST_MAX_STEP) {
+        result->overfull++;
+    }
+    if (result->records + count > TRACE_TEST_MAX_RECORDS) {
+        return;
+    }
+    /* Newest first: each record's delta leads back to the one before */
+    for (uint32_t n = count; n-- > 0;) {
+        const HD_TraceRecordTypeDef* r = &HD_TraceBuffer.ring[(*slot + n) & (HD_TRACE_DEPTH - 1)];
+        TRACE_TEST_RecordTypeDef* out = &result->log[first + n];
+
+        out->event = r->stamp & 0xFFU;
+        out->arg = r->arg;
+        out->cycles = t;
+        if (t < from || t > now) {
+            result->misplaced++;
+        }
+        t -= r->stamp >> 8;
+    }
+    for (uint32_t n = 0; n < count; n++) {
+        const TRACE_TEST_RecordTypeDef* r = &result->log[first + n];
+
+        if (since_baseline != NULL) {
+            result->begins[r->event < HD_EV_COUNT ? r->event : 0]++;
+        }
+        if (r->event == HD_EV_FRAME) {
+            if (since_baseline != NULL && r->arg != ++(*since_baseline)) {
+                result->frame_gaps++;
+                *since_baseline = r->arg;
+            }
+        } else if (r->event == HD_EV_COMMAND && r->arg == UCMD_SET_WAVE_SPEED) {
+            result->commands++;
+        }
+    }
+    result->records += count;
+    *slot = next;
+}
+
+/* Raw ring bytes as a debugger would dump them */
+static void dump(uint32_t index)
+{
+    char path[512];
+    FILE* out;
+
+    snprintf(path, sizeof(path), "%s/event_trace_%u.bin", dump_dir, index);
+    out = fopen(path, "wb");
+    if (out == NULL) {
+        perror(path);
+        return;
+    }
+    fwrite(&HD_TraceBuffer, sizeof(HD_TraceBuffer), 1, out);
+    fclose(out);
+    result->dumped_at[index] = result->records;
+}
+
+static int run(void* arg)
+{
+    LINK_CommandsTypeDef cmds = {0};
+    uint64_t irq_base[3];
+    uint32_t frame = 0;
+    uint32_t* frames = NULL;
+    uint32_t frames_base = 0;
+    uint32_t slot = 0;
+    uint8_t sent = 0;
+
+    VM_Boot();
+    for (VM_Time t = TRACE_TEST_STEP; t <= TRACE_TEST_RUN; t += TRACE_TEST_STEP) {
+        uint64_t from = DWT->CYCCNT;
+
+        VM_RunUntil(t);
+        collect(&slot, from, frames);
+        if (frames == NULL && HD_TraceBuffer.enabled) {
+            /* Baseline: counted from the next step on, both sides */
+            for (uint32_t i = 0; i < 3; i++) {
+                irq_base[i] = VM_GetIrqStats(irqs[i])->count;
+            }
+            frames_base = frame = LED_GetFrameCount();
+            frames = &frame;
+            memset(result->begins, 0, sizeof(result->begins));
+        }
+        if (!sent && t >= TRACE_TEST_COMMAND_AT) {
+            LINK_AddU32(&cmds, UCMD_SET_WAVE_SPEED, 3);
+            LINK_Send(1, &cmds);
+            sent = 1;
+        }
+        if (result->dumped_at[0] == 0 && result->records >= HD_TRACE_DEPTH / 2) {
+            dump(0);
+        }
+    }
+    HD_TraceStop();
+    dump(1);
+
+    result->clock_hz = HD_TraceBuffer.clock_hz;
+    for (uint32_t i = 0; i < 3; i++) {
+        result->irq_counts[i] = VM_GetIrqStats(irqs[i])->count - irq_base[i];
+    }
+    result->frames = LED_GetFrameCount() - frames_base;
+    return 0;
+}
+
+static int boot_once(void* arg)
+{
+    VM_Boot();
+    VM_RunUntil(VM_MS(60));
+    return 0;
+}
+
+/* The Chrome events trace2json.py makes of dump index, one per line */
+static FILE* decode(const char* decoder, uint32_t index)
+{
+    static const char script[] =
+        "import json, subprocess, sys\n"
+        "trace = json.loads(subprocess.check_output([sys.executable] + sys.argv[1:]))\n"
+        "for e in trace[\"traceEvents\"]:\n"
+        "    if e[\"ph\"] != \"M\":\n"
+        "        print(e[\"ph\"], e[\"tid\"], repr(e[\"ts\"]), e.get(\"args\", {}).get(\"arg\", 0), e[\"name\"],\n"
+        "              sep=\"\\t\")\n";
+    char command[2048];
+
+    snprintf(command, sizeof(command), "python3 -c '%s' %s %s/event_trace_%u.bin", script, decoder, dump_dir,
+             index);
+    return popen(command, "r");
+}
+
+/**
+  * @brief  Decodes one dump and compares it with the records it holds
+  * @retval Number of failures
+  */
+static int check_dump(const char* decoder, uint32_t index)
+{
+    uint32_t written = result->dumped_at[index];
+    uint32_t kept = (written < HD_TRACE_DEPTH) ? written : HD_TRACE_DEPTH;
+    const TRACE_TEST_RecordTypeDef* log = &result->log[written - kept];
+    uint32_t open_slices = 0;
+    uint32_t events = 0;
+    uint32_t mismatches = 0;
+    char line[256];
+    FILE* in = decode(decoder, index);
+
+    if (in == NULL) {
+        perror("python3");
+        return 1;
+    }
+    for (uint32_t i = 0; i < kept; i++) {
+        const TRACE_TEST_RecordTypeDef* r = &log[i];
+        uint32_t kind = (r->event < HD_EV_COUNT) ? kinds[r->event] : TRACE_TEST_INSTANT;
+        double ts = (double)(r->cycles - log[0].cycles) * 1e6 / result->clock_hz;
+        char ph = 'i';
+        uint32_t tid = 0;
+        char got_ph;
+        uint32_t got_tid;
+        double got_ts;
+        unsigned long got_arg;
+        char got_name[64];
+
+        if (kind == TRACE_TEST_BEGIN) {
+            ph = 'B';
+            tid = 1;
+            open_slices++;
+        } else if (kind == TRACE_TEST_END) {
+            if (open_slices == 0) {
+                continue;               /* its BEGIN was overwritten */
+            }
+            ph = 'E';
+            tid = 1;
+            open_slices--;
+        }
+        if (fgets(line, sizeof(line), in) == NULL ||
+            sscanf(line, "%c\t%u\t%lf\t%lu\t%63[^\n]", &got_ph, &got_tid, &got_ts, &got_arg, got_name) != 5) {
+            printf("FAIL dump %u: decoder stops after %u events, %u records kept\n", index, events, kept);
+            pclose(in);
+            return 1;
+        }
+        events++;
+        if (got_ph != ph || got_tid != tid || got_ts < ts - TRACE_TEST_TS_US || got_ts > ts + TRACE_TEST_TS_US ||
+            (ph == 'i' && got_arg != r->arg) || strcmp(got_name, labels[r->event]) != 0) {
+            if (mismatches++ == 0) {
+                printf("FAIL dump %u, record %u: decoded %c %u %.3f us %lu \"%s\", written %c %u %.3f us %u \"%s\"\n",
+                       index, i, got_ph, got_tid, got_ts, got_arg, got_name, ph, tid, ts, r->arg,
+                       labels[r->event]);
+            }
+        }
+    }
+    if (fgets(line, sizeof(line), in) != NULL) {
+        printf("FAIL dump %u: decoder has more events than the %u kept records\n", index, kept);
+        mismatches++;
+    }
+    if (pclose(in) != 0) {
+        printf("FAIL dump %u: decoder failed\n", index);
+        mismatches++;
+    }
+    printf("dump %u: %5u records written, %3u kept, %3u events decoded\n", index, written, kept, events);
+    return mismatches ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+    static const char* const irq_names[3] = { "SysTick", "TIMER1", "DMA" };
+    int failed = 0;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <trace2json.py> <dump directory>\n", argv[0]);
+        return 2;
+    }
+    dump_dir = argv[2];
+    result = mmap(NULL, sizeof(*result), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (result == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(result, 0, sizeof(*result));
+
+    /* First boot formats the parameter store */
+    if (VM_RunIsolated(boot_once, NULL) != 0 || VM_RunIsolated(run, NULL) != 0) {
+        printf("FAIL device run failed\n");
+        return 1;
+    }
+
+    printf("%u records, %u wraps of the %u-record ring, clock %u Hz\n", result->records,
+           result->records / HD_TRACE_DEPTH, HD_TRACE_DEPTH, result->clock_hz);
+    if (result->clock_hz != VM_CPU_HZ || result->records >= TRACE_TEST_MAX_RECORDS) {
+        printf("FAIL clock %u Hz or log full at %u records\n", result->clock_hz, result->records);
+        return 1;
+    }
+    if (result->misplaced != 0 || result->overfull != 0) {
+        printf("FAIL %u records timed outside their step, %u steps near a full ring\n", result->misplaced,
+               result->overfull);
+        failed++;
+    }
+    for (uint32_t i = 0; i < 3; i++) {
+        printf("%-7s  %5llu handler runs, %5u slices\n", irq_names[i], (unsigned long long)result->irq_counts[i],
+               result->begins[irq_events[i]]);
+        if (result->irq_counts[i] == 0 && i < 2) {
+            printf("FAIL %s never ran\n", irq_names[i]);
+            failed++;
+        }
+        if (result->begins[irq_events[i]] != result->irq_counts[i]) {
+            printf("FAIL %s: slices and handler runs differ\n", irq_names[i]);
+            failed++;
+        }
+    }
+    printf("frames   %5u rendered, %5u records\n", result->frames, result->begins[HD_EV_FRAME]);
+    if (result->frames == 0 || result->begins[HD_EV_FRAME] != result->frames || result->frame_gaps != 0) {
+        printf("FAIL frame records: %u gaps in the count\n", result->frame_gaps);
+        failed++;
+    }
+    if (result->commands != 1) {
+        printf("FAIL %u records of the command sent\n", result->commands);
+        failed++;
+    }
+    if (result->dumped_at[0] == 0 || result->dumped_at[0] >= HD_TRACE_DEPTH ||
+        result->dumped_at[1] < 2 * HD_TRACE_DEPTH) {
+        printf("FAIL dumps at %u and %u records, want one before and one well after the first wrap\n",
+               result->dumped_at[0], result->dumped_at[1]);
+        failed++;
+    } else {
+        failed += check_dump(argv[1], 0);
+        failed += check_dump(argv[1], 1);
+    }
+    printf("%s event trace ring and trace2json.py decode\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vmcu.h"
+
+/* HD_FAST_BOOT against the SPL init: boot-to-first-frame latency
+ * (HD_GetBootCycles) of the two firmware builds, each run by its
+ * boot_time_<variant> program.
+ *   test_fast_boot <boot_time_default> <boot_time_fastboot>
+ * Firmware code takes no virtual time, so the virtual MCU charges every SPL
+ * and CMSIS call FAST_BOOT_CALL_CYCLES; the register stores of the fast
+ * path stay free, so the saving is that of the calls it leaves out. Both
+ * builds must put the same levels on the LED pins with their first frame,
+ * the fast one must get there sooner, and with free calls the two must
+ * take the same time: the fast path must not move the first frame itself.
+ * SystemInit and the C startup run before HD_System_Init starts the count
+ * and are not in either figure. */
+
+#define FAST_BOOT_CALL_CYCLES   50      /* nominal SPL call, entry to return */
+
+typedef struct {
+    uint32_t boot_cycles;
+    uint32_t levels[VM_PORT_COUNT];
+} FAST_BOOT_RunTypeDef;
+
+/* Runs one boot_time program, 0 on success */
+static int run(const char* program, uint32_t call_cycles, FAST_BOOT_RunTypeDef* r)
+{
+    char command[512];
+    FILE* out;
+    int fields;
+
+    snprintf(command, sizeof(command), "%s %u", program, call_cycles);
+    out = popen(command, "r");
+    if (out == NULL) {
+        perror(program);
+        return -1;
+    }
+    fields = fscanf(out, "%u", &r->boot_cycles);
+    for (uint32_t p = 0; p < VM_PORT_COUNT && fields == 1 + (int)p; p++) {
+        fields += fscanf(out, "%x", &r->levels[p]);
+    }
+    if (pclose(out) != 0 || fields != 1 + VM_PORT_COUNT) {
+        printf("FAIL %s: no result\n", command);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    FAST_BOOT_RunTypeDef spl[2];
+    FAST_BOOT_RunTypeDef fast[2];
+    const uint32_t call_cycles[2] = { 0, FAST_BOOT_CALL_CYCLES };
+    int failed = 0;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <boot_time_default> <boot_time_fastboot>\n", argv[0]);
+        return 2;
+    }
+    for (uint32_t i = 0; i < 2; i++) {
+        if (run(argv[1], call_cycles[i], &spl[i]) != 0 || run(argv[2], call_cycles[i], &fast[i]) != 0) {
+            return 1;
+        }
+        printf("%3u cycles per call: SPL init %5u cycles, fast boot %5u cycles\n", call_cycles[i],
+               spl[i].boot_cycles, fast[i].boot_cycles);
+        if (memcmp(spl[i].levels, fast[i].levels, sizeof(spl[i].levels)) != 0) {
+            printf("FAIL first frame differs on the LED pins\n");
+            failed++;
+        }
+        if (spl[i].boot_cycles == 0 || fast[i].boot_cycles == 0) {
+            printf("FAIL no frame reached the pins\n");
+            failed++;
+        }
+    }
+    if (fast[0].boot_cycles != spl[0].boot_cycles) {
+        printf("FAIL with free calls fast boot takes %u cycles, SPL init %u\n", fast[0].boot_cycles,
+               spl[0].boot_cycles);
+        failed++;
+    }
+    if (fast[1].boot_cycles >= spl[1].boot_cycles) {
+        printf("FAIL fast boot no sooner than the SPL init\n");
+        failed++;
+    } else {
+        printf("fast boot saves %u cycles, %u calls\n", spl[1].boot_cycles - fast[1].boot_cycles,
+               (spl[1].boot_cycles - fast[1].boot_cycles + FAST_BOOT_CALL_CYCLES / 2) / FAST_BOOT_CALL_CYCLES);
+    }
+    printf("%s fast boot against the SPL init\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
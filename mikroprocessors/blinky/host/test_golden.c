@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vmcu.h"
+#include "wave.h"
+#include "link.h"
+#include "uart_cmd.h"
+#include "leds.h"
+#include "adc_input.h"
+
+/* Golden waveform tests: the firmware boots on the virtual MCU, gets its
+ * commands over the UART and runs for a second of virtual time. The LED
+ * pin summary (duty, frequency, period jitter), the first edges, the
+ * command replies and the firmware's own counters must match
+ * golden/<scenario>.txt exactly; the virtual clock makes the run
+ * independent of the host. A VCD file of each run is left in the build
+ * directory for a waveform viewer.
+ *
+ *   test_golden [--update] [build dir]
+ */
+
+#define GOLDEN_DIR          "golden"
+#define GOLDEN_COMMAND_AT   VM_MS(10)
+#define GOLDEN_FROM         VM_MS(200)
+#define GOLDEN_TO           VM_MS(1200)
+#define GOLDEN_EDGES        200
+#define GOLDEN_MAX_REPLIES  8
+
+typedef struct {
+    const char* name;
+    const char* about;
+    void (*commands)(LINK_CommandsTypeDef* cmds);   /* NULL: boot defaults only */
+} GOLDEN_ScenarioTypeDef;
+
+static const char* build_dir = "build";
+
+static void cmd_sequence(LINK_CommandsTypeDef* cmds)
+{
+    LINK_AddU8(cmds, UCMD_SET_WAVE_ENABLE, 0);
+    LINK_AddU32(cmds, UCMD_SET_SEQUENCE, 50);
+}
+
+static void cmd_wave_sequence(LINK_CommandsTypeDef* cmds)
+{
+    LINK_AddU32(cmds, UCMD_SET_SEQUENCE, 50);
+}
+
+static void cmd_dim(LINK_CommandsTypeDef* cmds)
+{
+    LINK_AddU8(cmds, UCMD_SET_BRIGHTNESS, 64);
+}
+
+static const GOLDEN_ScenarioTypeDef scenarios[] = {
+    { "wave",          "PWM wave from boot defaults",          NULL },
+    { "sequence",      "LED_Sequence 50 ms, wave off",         cmd_sequence },
+    { "wave_sequence", "LED_Sequence 50 ms over the wave",     cmd_wave_sequence },
+    { "dim",           "PWM wave at brightness 64",            cmd_dim },
+};
+
+#define GOLDEN_SCENARIOS    (sizeof(scenarios) / sizeof(scenarios[0]))
+
+/**
+  * @brief  One scenario on a fresh device, result in <build>/<name>.txt
+  * @retval 0, 1 if the output cannot be written
+  */
+static int run_scenario(void* arg)
+{
+    const GOLDEN_ScenarioTypeDef* s = arg;
+    LINK_ReplyTypeDef replies[GOLDEN_MAX_REPLIES];
+    uint32_t reply_count;
+    char path[512];
+    FILE* out;
+
+    VM_Boot();
+    WAVE_Init(WAVE_LedProbes, WAVE_LedProbeCount);
+
+    VM_RunUntil(GOLDEN_COMMAND_AT);
+    if (s->commands != NULL) {
+        LINK_CommandsTypeDef cmds = {0};
+
+        s->commands(&cmds);
+        LINK_Send(1, &cmds);
+    }
+    VM_RunUntil(GOLDEN_TO);
+    reply_count = LINK_PollReplies(replies, GOLDEN_MAX_REPLIES);
+
+    snprintf(path, sizeof(path), "%s/%s.vcd", build_dir, s->name);
+    WAVE_WriteVcd(path, GOLDEN_TO);
+
+    snprintf(path, sizeof(path), "%s/%s.txt", build_dir, s->name);
+    out = fopen(path, "w");
+    if (out == NULL) {
+        perror(path);
+        return 1;
+    }
+    fprintf(out, "# %s: %s\n", s->name, s->about);
+    for (uint32_t i = 0; i < reply_count; i++) {
+        fprintf(out, "reply seq %u status %u at %llu\n", replies[i].seq, replies[i].status,
+                (unsigned long long)replies[i].t);
+    }
+    fprintf(out, "frames %u timer1 %u overruns %u drops %u quality %u adc_blocks %u adc_overruns %u\n",
+            LED_GetFrameCount(), HD_GetTimer1Wakeups(), HD_GetOverrunCount(), LED_GetFrameDrops(),
+            (unsigned)LED_GetQualityLevel(), ADCIN_GetBlockCount(), ADCIN_GetOverrunCount());
+    fprintf(out, "# window %llu..%llu cycles\n", (unsigned long long)GOLDEN_FROM, (unsigned long long)GOLDEN_TO);
+    WAVE_WriteSummary(out, GOLDEN_FROM, GOLDEN_TO);
+    fprintf(out, "# first %u edges: cycle pin level\n", GOLDEN_EDGES);
+    WAVE_WriteEdges(out, GOLDEN_FROM, GOLDEN_TO, GOLDEN_EDGES);
+    fclose(out);
+    WAVE_Free();
+    return 0;
+}
+
+/* Whole file, NULL if missing */
+static char* read_file(const char* path, long* size)
+{
+    FILE* f = fopen(path, "rb");
+    char* data;
+
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    rewind(f);
+    data = malloc((size_t)*size + 1);
+    if (data != NULL && fread(data, 1, (size_t)*size, f) != (size_t)*size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+static int write_file(const char* path, const char* data, long size)
+{
+    FILE* f = fopen(path, "wb");
+
+    if (f == NULL) {
+        return -1;
+    }
+    fwrite(data, 1, (size_t)size, f);
+    return fclose(f);
+}
+
+/* First differing line, for the failure message */
+static void report_diff(const char* expected, const char* actual)
+{
+    uint32_t line = 1;
+
+    while (*expected != '\0' && *expected == *actual) {
+        if (*expected == '\n') {
+            line++;
+        }
+        expected++;
+        actual++;
+    }
+    while (line > 1 && expected[-1] != '\n') {
+        expected--;
+        actual--;
+    }
+    printf("    line %u\n    golden: %.*s\n    actual: %.*s\n", line,
+           (int)strcspn(expected, "\n"), expected, (int)strcspn(actual, "\n"), actual);
+}
+
+int main(int argc, char** argv)
+{
+    int update = 0;
+    int failed = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--update") == 0) {
+            update = 1;
+        } else {
+            build_dir = argv[i];
+        }
+    }
+
+    for (uint32_t i = 0; i < GOLDEN_SCENARIOS; i++) {
+        const GOLDEN_ScenarioTypeDef* s = &scenarios[i];
+        char actual_path[512], golden_path[512];
+        char *actual, *golden;
+        long actual_size, golden_size = 0;
+
+        snprintf(actual_path, sizeof(actual_path), "%s/%s.txt", build_dir, s->name);
+        snprintf(golden_path, sizeof(golden_path), "%s/%s.txt", GOLDEN_DIR, s->name);
+
+        if (VM_RunIsolated(run_scenario, (void*)s) != 0 ||
+            (actual = read_file(actual_path, &actual_size)) == NULL) {
+            printf("FAIL %-14s device run failed\n", s->name);
+            failed++;
+            continue;
+        }
+
+        if (update) {
+            if (write_file(golden_path, actual, actual_size) != 0) {
+                printf("FAIL %-14s cannot write %s\n", s->name, golden_path);
+                failed++;
+            } else {
+                printf("UPDATED %s\n", golden_path);
+            }
+        } else if ((golden = read_file(golden_path, &golden_size)) == NULL) {
+            printf("FAIL %-14s no %s, run make golden\n", s->name, golden_path);
+            failed++;
+        } else {
+            golden[golden_size] = '\0';
+            actual[actual_size] = '\0';
+            if (golden_size != actual_size || memcmp(golden, actual, (size_t)actual_size) != 0) {
+                printf("FAIL %-14s differs from %s\n", s->name, golden_path);
+                report_diff(golden, actual);
+                failed++;
+            } else {
+                printf("ok   %-14s %s\n", s->name, s->about);
+            }
+            free(golden);
+        }
+        free(actual);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,279 @@
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include "vmcu.h"
+#include "leds.h"
+#include "MDR32FxQI_port.h"
+
+/* LED port init generated from LED_PIN_MAP (LED_Init) against the hand
+ * written init it replaced (old_init, copied from the tree before it).
+ * Every store either makes to a PORT register or to a bit-band alias word
+ * of RXTX is recorded: the port and alias pages are kept read-only, a
+ * store faults, is single-stepped with the page writable and logged with
+ * the value it left. From the same start, ports with their pins driven
+ * high as a boot loader may leave them, both inits must
+ *   - end with the same PORT registers, alias stores applied to RXTX
+ *   - enable the same peripheral clocks
+ *   - only change bits that belong to LED pins
+ * The old init left the PORT_InitTypeDef fields it did not set to the
+ * stack; the copy zeroes them, which are the PORT_StructInit defaults. */
+
+#define INIT_TEST_MAX_STORES    256
+#define INIT_TEST_PORT_REGS     (sizeof(MDR_PORT_TypeDef) / sizeof(uint32_t))
+#define INIT_TEST_EFLAGS_TF     0x100UL     /* x86 trap flag */
+
+/* PORT registers as the pins see them */
+typedef struct {
+    uint32_t reg[VM_PORT_COUNT][INIT_TEST_PORT_REGS];
+    uint32_t per_clock;
+} INIT_TEST_StateTypeDef;
+
+typedef struct {
+    uintptr_t addr;
+    uint32_t value;
+} INIT_TEST_StoreTypeDef;
+
+static MDR_PORT_TypeDef* const ports[VM_PORT_COUNT] = {
+    MDR_PORTA, MDR_PORTB, MDR_PORTC, MDR_PORTD, MDR_PORTE, MDR_PORTF,
+};
+
+static const char* const reg_names[INIT_TEST_PORT_REGS] = {
+    "RXTX", "OE", "FUNC", "ANALOG", "PULL", "PD", "PWR", "GFEN", "SETTX", "CLRTX", "RDTX",
+};
+
+static const uint32_t led_mask[VM_PORT_COUNT] = {
+    LED_PORT_MASK(A), LED_PORT_MASK(B), LED_PORT_MASK(C), LED_PORT_MASK(D), LED_PORT_MASK(E), LED_PORT_MASK(F),
+};
+
+static const uint32_t led_mask2[VM_PORT_COUNT] = {
+    LED_PORT_MASK2(A), LED_PORT_MASK2(B), LED_PORT_MASK2(C), LED_PORT_MASK2(D), LED_PORT_MASK2(E), LED_PORT_MASK2(F),
+};
+
+static INIT_TEST_StoreTypeDef stores[INIT_TEST_MAX_STORES];
+static volatile uint32_t store_count;
+static volatile uintptr_t pending;
+static long page_size;
+
+/* Bit-band alias words of RXTX of a port */
+static uintptr_t rxtx_alias(uint32_t port)
+{
+    return 0x42000000UL + (((uintptr_t)&ports[port]->RXTX - 0x40000000UL) << 5);
+}
+
+static uintptr_t page_of(uintptr_t addr)
+{
+    return addr & ~(uintptr_t)(page_size - 1);
+}
+
+static void protect_all(int prot)
+{
+    for (uint32_t p = 0; p < VM_PORT_COUNT; p++) {
+        mprotect((void*)page_of((uintptr_t)ports[p]), (size_t)page_size, prot);
+        mprotect((void*)page_of(rxtx_alias(p)), (size_t)page_size, prot);
+    }
+}
+
+static int traced(uintptr_t addr)
+{
+    for (uint32_t p = 0; p < VM_PORT_COUNT; p++) {
+        if (page_of(addr) == page_of((uintptr_t)ports[p]) || page_of(addr) == page_of(rxtx_alias(p))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* A store to a traced page: let this one instruction through */
+static void store_fault(int sig, siginfo_t* info, void* context)
+{
+    ucontext_t* uc = context;
+    uintptr_t addr = (uintptr_t)info->si_addr;
+
+    if (!traced(addr)) {
+        signal(SIGSEGV, SIG_DFL);
+        return;
+    }
+    pending = addr & ~(uintptr_t)3;
+    mprotect((void*)page_of(addr), (size_t)page_size, PROT_READ | PROT_WRITE);
+    uc->uc_mcontext.gregs[REG_EFL] |= INIT_TEST_EFLAGS_TF;
+}
+
+/* The store is done: log what it left, close the page again */
+static void store_step(int sig, siginfo_t* info, void* context)
+{
+    ucontext_t* uc = context;
+
+    if (store_count < INIT_TEST_MAX_STORES) {
+        stores[store_count].addr = pending;
+        stores[store_count].value = *(volatile uint32_t*)pending;
+    }
+    store_count++;
+    mprotect((void*)page_of(pending), (size_t)page_size, PROT_READ);
+    uc->uc_mcontext.gregs[REG_EFL] &= ~INIT_TEST_EFLAGS_TF;
+}
+
+/* LED_Init and LED_AllOff port code before LED_PIN_MAP */
+static void old_init(void)
+{
+    PORT_InitTypeDef Port_InitStructure;
+
+    memset(&Port_InitStructure, 0, sizeof(Port_InitStructure));
+
+    /* Enable clocks for PORTA and PORTC */
+    RST_CLK_PCLKcmd(RST_CLK_PCLK_PORTA, ENABLE);
+    Port_InitStructure.PORT_Pin = PORT_Pin_1 | PORT_Pin_3 | PORT_Pin_5;
+    Port_InitStructure.PORT_OE = PORT_OE_OUT;
+    Port_InitStructure.PORT_MODE = PORT_MODE_DIGITAL;
+    Port_InitStructure.PORT_SPEED = PORT_SPEED_FAST;
+    PORT_Init(MDR_PORTA, &Port_InitStructure);
+
+    RST_CLK_PCLKcmd(RST_CLK_PCLK_PORTC, ENABLE);
+    Port_InitStructure.PORT_Pin = PORT_Pin_2;
+    Port_InitStructure.PORT_OE = PORT_OE_OUT;
+    Port_InitStructure.PORT_MODE = PORT_MODE_DIGITAL;
+    Port_InitStructure.PORT_SPEED = PORT_SPEED_FAST;
+    PORT_Init(MDR_PORTC, &Port_InitStructure);
+
+    /* Turn off all LEDs initially using bit operations */
+    BIT_CLR(MDR_PORTC->RXTX, 1UL << 2);
+    BIT_CLR(MDR_PORTA->RXTX, 1UL << 1);
+    BIT_CLR(MDR_PORTA->RXTX, 1UL << 5);
+    BIT_CLR(MDR_PORTA->RXTX, 1UL << 3);
+}
+
+static void new_init(void)
+{
+    LED_Init();
+}
+
+/* Bits of a PORT register that belong to LED pins */
+static uint32_t led_bits(uint32_t port, uint32_t reg)
+{
+    switch (reg) {
+    case 2: /* FUNC */
+    case 6: /* PWR */
+        return led_mask2[port];
+    case 4: /* PULL */
+    case 5: /* PD */
+        return led_mask[port] | (led_mask[port] << 16);
+    default:
+        return led_mask[port];
+    }
+}
+
+/**
+  * @brief  Runs one init from the start state, replays its stores
+  * @retval Number of failures
+  */
+static int trace_init(const char* name, void (*init)(void), INIT_TEST_StateTypeDef* state)
+{
+    int failed = 0;
+
+    protect_all(PROT_READ | PROT_WRITE);
+    for (uint32_t p = 0; p < VM_PORT_COUNT; p++) {
+        memset(ports[p], 0, sizeof(MDR_PORT_TypeDef));
+        ports[p]->RXTX = 0xFFFF;
+        for (uint32_t pin = 0; pin < 16; pin++) {
+            ((volatile uint32_t*)rxtx_alias(p))[pin] = 1;
+        }
+    }
+    MDR_RST_CLK->PER_CLOCK = 0;
+    memset(state, 0, sizeof(*state));
+    for (uint32_t p = 0; p < VM_PORT_COUNT; p++) {
+        state->reg[p][0] = 0xFFFF;
+    }
+    store_count = 0;
+
+    protect_all(PROT_READ);
+    init();
+    protect_all(PROT_READ | PROT_WRITE);
+
+    if (store_count > INIT_TEST_MAX_STORES) {
+        printf("FAIL %s: %u stores, log holds %u\n", name, store_count, INIT_TEST_MAX_STORES);
+        return 1;
+    }
+    for (uint32_t i = 0; i < store_count; i++) {
+        const INIT_TEST_StoreTypeDef* s = &stores[i];
+
+        for (uint32_t p = 0; p < VM_PORT_COUNT; p++) {
+            uintptr_t base = (uintptr_t)ports[p];
+            uintptr_t alias = rxtx_alias(p);
+            uint32_t reg;
+            uint32_t old;
+            uint32_t* rxtx = &state->reg[p][0];
+
+            if (s->addr >= alias && s->addr < alias + 16 * sizeof(uint32_t)) {
+                uint32_t bit = 1UL << ((s->addr - alias) / sizeof(uint32_t));
+
+                old = *rxtx;
+                *rxtx = (s->value & 1U) ? (*rxtx | bit) : (*rxtx & ~bit);
+                reg = 0;
+            } else if (s->addr >= base && s->addr < base + sizeof(MDR_PORT_TypeDef)) {
+                reg = (uint32_t)(s->addr - base) / sizeof(uint32_t);
+                old = *rxtx;
+                if (reg == 8) {         /* SETTX */
+                    *rxtx |= s->value;
+                    reg = 0;
+                } else if (reg == 9) {  /* CLRTX */
+                    *rxtx &= ~s->value;
+                    reg = 0;
+                } else {
+                    old = state->reg[p][reg];
+                    state->reg[p][reg] = s->value;
+                }
+            } else {
+                continue;
+            }
+            if ((old ^ state->reg[p][reg]) & ~led_bits(p, reg)) {
+                printf("FAIL %s: store %u changes PORT%c %s %04X -> %04X outside the LED pins\n", name, i + 1,
+                       'A' + p, reg_names[reg], old, state->reg[p][reg]);
+                failed++;
+            }
+        }
+    }
+    state->per_clock = MDR_RST_CLK->PER_CLOCK;
+    printf("%-4s init: %u stores to PORT registers and RXTX alias words\n", name, store_count);
+    return failed;
+}
+
+int main(void)
+{
+    INIT_TEST_StateTypeDef old_state;
+    INIT_TEST_StateTypeDef new_state;
+    struct sigaction action;
+    int failed = 0;
+
+    VM_Init();
+    page_size = sysconf(_SC_PAGESIZE);
+
+    memset(&action, 0, sizeof(action));
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    action.sa_sigaction = store_fault;
+    sigaction(SIGSEGV, &action, NULL);
+    action.sa_sigaction = store_step;
+    sigaction(SIGTRAP, &action, NULL);
+
+    failed += trace_init("old", old_init, &old_state);
+    failed += trace_init("new", new_init, &new_state);
+
+    for (uint32_t p = 0; p < VM_PORT_COUNT; p++) {
+        for (uint32_t reg = 0; reg < 8; reg++) {
+            if (old_state.reg[p][reg] != new_state.reg[p][reg]) {
+                printf("FAIL PORT%c %s: old init %04X, new init %04X\n", 'A' + p, reg_names[reg],
+                       old_state.reg[p][reg], new_state.reg[p][reg]);
+                failed++;
+            }
+        }
+    }
+    if (old_state.per_clock != new_state.per_clock) {
+        printf("FAIL PER_CLOCK: old init %08X, new init %08X\n", old_state.per_clock, new_state.per_clock);
+        failed++;
+    }
+    printf("%s LED port init against the hand written one\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
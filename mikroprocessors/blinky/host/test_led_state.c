@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "vmcu.h"
+#include "leds.h"
+#include "MDR32FxQI_adc.h"
+
+/* LED_On and LED_Off through the bit-band alias word of the pin, and
+ * LED_GetState as a pin readback. TIMER1 is masked once the device is up,
+ * so the PWM output leaves the pins to the calls under test. From a
+ * background of the other LEDs all off or all on and of the non-LED RXTX
+ * bits in a fixed pattern, every call must
+ *   - move its own pin to the new level
+ *   - leave every other bit of every port RXTX as it was
+ *   - be read back by LED_GetState, on the call's own LED and the others
+ * The calls run in host context; the stores reach the pins at the next
+ * CMSIS or SPL call of the firmware, so each is followed by a short run. */
+
+#define STATE_TEST_SETUP_AT VM_MS(10)       /* before the ADC's first block */
+#define STATE_TEST_SETTLE   VM_US(50)       /* a main loop pass or more */
+#define STATE_TEST_PATTERN  0xA5A5UL        /* non-LED RXTX bits */
+
+typedef struct {
+    VM_PortTypeDef port;
+    uint32_t pin;
+} STATE_TEST_PinTypeDef;
+
+typedef struct {
+    uint32_t calls;
+    uint32_t failures;
+} STATE_TEST_ResultTypeDef;
+
+#define STATE_TEST_PIN(arg, led, port, pin)     [led] = { VM_PORT_##port, pin },
+static const STATE_TEST_PinTypeDef led_pins[LED_COUNT] = {
+    LED_PIN_MAP(STATE_TEST_PIN, _)
+};
+
+static MDR_PORT_TypeDef* const ports[VM_PORT_COUNT] = {
+    MDR_PORTA, MDR_PORTB, MDR_PORTC, MDR_PORTD, MDR_PORTE, MDR_PORTF,
+};
+
+static const uint32_t led_mask[VM_PORT_COUNT] = {
+    LED_PORT_MASK(A), LED_PORT_MASK(B), LED_PORT_MASK(C), LED_PORT_MASK(D), LED_PORT_MASK(E), LED_PORT_MASK(F),
+};
+
+static STATE_TEST_ResultTypeDef* result;
+
+/* Other LEDs at level, non-LED bits at the pattern, all pins synced */
+static void background(uint32_t level)
+{
+    for (uint32_t p = 0; p < VM_PORT_COUNT; p++) {
+        ports[p]->RXTX = (STATE_TEST_PATTERN & ~led_mask[p]) | (level ? led_mask[p] : 0);
+    }
+    VM_RunFor(STATE_TEST_SETTLE);
+}
+
+/**
+  * @brief  Checks the pins and readback after one call on led
+  * @retval Number of failures
+  */
+static uint32_t check(const char* call, LED_TypeDef led, uint32_t level, const uint32_t* before)
+{
+    uint32_t failed = 0;
+
+    for (uint32_t p = 0; p < VM_PORT_COUNT; p++) {
+        uint32_t expect = before[p];
+
+        if (p == led_pins[led].port) {
+            uint32_t bit = 1UL << led_pins[led].pin;
+
+            expect = level ? (expect | bit) : (expect & ~bit);
+        }
+        if ((ports[p]->RXTX & 0xFFFFUL) != expect) {
+            printf("FAIL %s(LED%u): PORT%c RXTX %04X, expected %04X\n", call, led + 1, 'A' + p,
+                   ports[p]->RXTX & 0xFFFFU, expect);
+            failed++;
+        }
+    }
+    for (uint32_t i = 0; i < LED_COUNT; i++) {
+        uint32_t pin = VM_GetPin(led_pins[i].port, led_pins[i].pin);
+
+        if (i == (uint32_t)led && pin != level) {
+            printf("FAIL %s(LED%u): pin at %u\n", call, led + 1, pin);
+            failed++;
+        }
+        if (LED_GetState((LED_TypeDef)i) != pin) {
+            printf("FAIL %s(LED%u): LED_GetState(LED%u) %u, pin at %u\n", call, led + 1, i + 1,
+                   LED_GetState((LED_TypeDef)i), pin);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+static void call(const char* name, void (*fn)(LED_TypeDef), LED_TypeDef led, uint32_t level)
+{
+    uint32_t before[VM_PORT_COUNT];
+
+    for (uint32_t p = 0; p < VM_PORT_COUNT; p++) {
+        before[p] = ports[p]->RXTX & 0xFFFFUL;
+    }
+    fn(led);
+    VM_RunFor(STATE_TEST_SETTLE);
+    result->calls++;
+    result->failures += check(name, led, level, before);
+}
+
+static int run(void* arg)
+{
+    VM_Boot();
+    VM_RunUntil(STATE_TEST_SETUP_AT);
+    ADC1_Cmd(DISABLE);                      /* no ambient dimming */
+    NVIC_DisableIRQ(Timer1_IRQn);           /* no PWM output */
+
+    for (uint32_t level = 0; level < 2; level++) {
+        for (uint32_t led = 0; led < LED_COUNT; led++) {
+            background(level);
+            call("LED_On", LED_On, (LED_TypeDef)led, 1);
+            call("LED_Off", LED_Off, (LED_TypeDef)led, 0);
+            call("LED_On", LED_On, (LED_TypeDef)led, 1);
+        }
+    }
+    return 0;
+}
+
+static int boot_once(void* arg)
+{
+    VM_Boot();
+    VM_RunUntil(VM_MS(60));
+    return 0;
+}
+
+int main(void)
+{
+    result = mmap(NULL, sizeof(*result), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (result == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(result, 0, sizeof(*result));
+
+    /* First boot formats the parameter store */
+    if (VM_RunIsolated(boot_once, NULL) != 0 || VM_RunIsolated(run, NULL) != 0) {
+        printf("FAIL device run failed\n");
+        return 1;
+    }
+    printf("%u LED_On/LED_Off calls, %u failures\n", result->calls, result->failures);
+    if (result->calls == 0) {
+        printf("FAIL no calls made\n");
+        result->failures++;
+    }
+    printf("%s LED bit-band writes and pin readback\n", result->failures ? "FAIL" : "ok  ");
+    return result->failures ? 1 : 0;
+}
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vmcu.h"
+#include "wave.h"
+#include "link.h"
+#include "uart_cmd.h"
+#include "leds.h"
+#include "led_trace.h"
+
+/* On-target LED edge recorder (led_trace.c), firmware built with
+ * LED_TRACE, against the host pin recorder (wave.c) on the same run.
+ * Both are written as VCD and read back by the same parser:
+ *   - the recorder's timescale must be one VCD allows (1, 10 or 100 of
+ *     a unit), as strict readers such as GTKWave reject anything else
+ *   - the recorder keeps the last LTRACE_DEPTH changes: every one of
+ *     them, time and LED levels, must be a change wave.c saw, and wave.c
+ *     must have no change in that stretch the recorder missed
+ * The recorder's times are relative to its oldest kept event, so the
+ * two are aligned on their last change. */
+
+#define TR_TEST_COMMAND_AT  VM_MS(10)
+#define TR_TEST_TO          VM_MS(400)
+#define TR_MAX_INSTANTS     8192
+#define TR_VCD_SIZE         65536
+
+typedef struct {
+    const char* name;
+    void (*commands)(LINK_CommandsTypeDef* cmds);   /* NULL: boot defaults only */
+} TR_ScenarioTypeDef;
+
+/* LED levels after a change */
+typedef struct {
+    uint64_t t_ns;
+    uint32_t bits;
+} TR_InstantTypeDef;
+
+typedef struct {
+    char timescale[32];
+    uint32_t count;
+    TR_InstantTypeDef at[TR_MAX_INSTANTS];
+} TR_VcdTypeDef;
+
+static void cmd_sequence(LINK_CommandsTypeDef* cmds)
+{
+    LINK_AddU8(cmds, UCMD_SET_WAVE_ENABLE, 0);
+    LINK_AddU32(cmds, UCMD_SET_SEQUENCE, 20);
+}
+
+static void cmd_dim(LINK_CommandsTypeDef* cmds)
+{
+    LINK_AddU8(cmds, UCMD_SET_BRIGHTNESS, 64);
+}
+
+static const TR_ScenarioTypeDef scenarios[] = {
+    { "wave",     NULL },
+    { "sequence", cmd_sequence },
+    { "dim",      cmd_dim },
+};
+
+#define TR_SCENARIOS    (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static const char* build_dir = "build";
+static char vcd_text[TR_VCD_SIZE];
+static size_t vcd_length;
+
+static void vcd_puts(const char* text)
+{
+    size_t n = strlen(text);
+
+    if (vcd_length + n < sizeof(vcd_text)) {
+        memcpy(&vcd_text[vcd_length], text, n + 1);
+        vcd_length += n;
+    }
+}
+
+/**
+  * @brief  Reads a one-bit-per-LED VCD into the levels after each change
+  * @param  first_id: identifier of LED 1, the others follow it
+  * @retval 0, -1 on a line this parser does not know
+  */
+static int parse_vcd(const char* text, char first_id, TR_VcdTypeDef* vcd)
+{
+    uint64_t t = 0;
+    uint32_t bits = 0;
+
+    memset(vcd, 0, sizeof(*vcd));
+    while (*text != '\0') {
+        size_t len = strcspn(text, "\n");
+        char line[128];
+
+        snprintf(line, sizeof(line), "%.*s", (int)len, text);
+        text += len + (text[len] == '\n');
+
+        if (strncmp(line, "$timescale", 10) == 0) {
+            size_t end = strcspn(line + 11, "$");
+
+            while (end > 0 && line[11 + end - 1] == ' ') {
+                end--;
+            }
+            snprintf(vcd->timescale, sizeof(vcd->timescale), "%.*s", (int)end, line + 11);
+        } else if (line[0] == '$') {
+            continue;
+        } else if (line[0] == '#') {
+            t = strtoull(line + 1, NULL, 10);
+        } else if ((line[0] == '0' || line[0] == '1') && line[1] >= first_id && line[1] < first_id + LED_COUNT) {
+            uint32_t led = (uint32_t)(line[1] - first_id);
+
+            bits = (bits & ~(1UL << led)) | ((uint32_t)(line[0] - '0') << led);
+            if (vcd->count != 0 && vcd->at[vcd->count - 1].t_ns == t) {
+                vcd->at[vcd->count - 1].bits = bits;
+            } else if (vcd->count < TR_MAX_INSTANTS) {
+                vcd->at[vcd->count++] = (TR_InstantTypeDef){ t, bits };
+            } else {
+                return -1;
+            }
+        } else if (line[0] != '\0') {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* VCD allows 1, 10 or 100 of s, ms, us, ns, ps or fs */
+static int legal_timescale(const char* timescale)
+{
+    static const char* const units[] = { "s", "ms", "us", "ns", "ps", "fs" };
+    char* unit;
+    unsigned long n = strtoul(timescale, &unit, 10);
+
+    while (*unit == ' ') {
+        unit++;
+    }
+    if (n != 1 && n != 10 && n != 100) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+        size_t len = strlen(units[i]);
+
+        if (strncmp(unit, units[i], len) == 0 && (unit[len] == '\0' || unit[len] == ' ')) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+  * @brief  One scenario on a fresh device, both VCD files in the build dir
+  */
+static int run_scenario(void* arg)
+{
+    const TR_ScenarioTypeDef* s = arg;
+    char path[512];
+    FILE* out;
+
+    VM_Boot();
+    WAVE_Init(WAVE_LedProbes, WAVE_LedProbeCount);
+    VM_RunUntil(TR_TEST_COMMAND_AT);
+    if (s->commands != NULL) {
+        LINK_CommandsTypeDef cmds = {0};
+
+        s->commands(&cmds);
+        LINK_Send(1, &cmds);
+    }
+    VM_RunUntil(TR_TEST_TO);
+
+    snprintf(path, sizeof(path), "%s/trace_%s_wave.vcd", build_dir, s->name);
+    if (WAVE_WriteVcd(path, TR_TEST_TO) != 0) {
+        return 1;
+    }
+    vcd_length = 0;
+    vcd_text[0] = '\0';
+    LTRACE_ExportVCD(vcd_puts);
+    snprintf(path, sizeof(path), "%s/trace_%s_ltrace.vcd", build_dir, s->name);
+    out = fopen(path, "w");
+    if (out == NULL) {
+        return 1;
+    }
+    fputs(vcd_text, out);
+    WAVE_Free();
+    return fclose(out) == 0 ? 0 : 1;
+}
+
+static char* read_file(const char* path)
+{
+    FILE* f = fopen(path, "rb");
+    char* data;
+    long size;
+
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    data = malloc((size_t)size + 1);
+    if (data != NULL) {
+        data[fread(data, 1, (size_t)size, f)] = '\0';
+    }
+    fclose(f);
+    return data;
+}
+
+/* Wave instants in the recorder's stretch must be exactly its instants */
+static int compare(const char* name, const TR_VcdTypeDef* trace, const TR_VcdTypeDef* wave)
+{
+    uint64_t offset;
+    uint32_t w;
+
+    if (trace->count == 0 || wave->count < trace->count) {
+        printf("FAIL %s: %u recorded changes, %u pin changes\n", name, trace->count, wave->count);
+        return 1;
+    }
+    /* Align on the last change, the record ends there */
+    offset = wave->at[wave->count - 1].t_ns - trace->at[trace->count - 1].t_ns;
+    w = wave->count - trace->count;
+    for (uint32_t i = 0; i < trace->count; i++, w++) {
+        const TR_InstantTypeDef* a = &trace->at[i];
+        const TR_InstantTypeDef* b = &wave->at[w];
+
+        if (a->t_ns + offset != b->t_ns || a->bits != b->bits) {
+            printf("FAIL %s: recorded change %u at +%llu ns LEDs %X, pins change at +%llu ns to %X\n", name, i,
+                   (unsigned long long)a->t_ns, a->bits, (unsigned long long)(b->t_ns - offset), b->bits);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    static TR_VcdTypeDef trace, wave;
+    int failed = 0;
+
+    if (argc > 1) {
+        build_dir = argv[1];
+    }
+
+    for (uint32_t i = 0; i < TR_SCENARIOS; i++) {
+        const TR_ScenarioTypeDef* s = &scenarios[i];
+        char path[512];
+        char *trace_text, *wave_text;
+        int bad;
+
+        if (VM_RunIsolated(run_scenario, (void*)s) != 0) {
+            printf("FAIL %s: device run failed\n", s->name);
+            failed++;
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/trace_%s_ltrace.vcd", build_dir, s->name);
+        trace_text = read_file(path);
+        snprintf(path, sizeof(path), "%s/trace_%s_wave.vcd", build_dir, s->name);
+        wave_text = read_file(path);
+        if (trace_text == NULL || wave_text == NULL || parse_vcd(trace_text, 'a', &trace) != 0 ||
+            parse_vcd(wave_text, '!', &wave) != 0) {
+            printf("FAIL %s: VCD files missing or unreadable\n", s->name);
+            failed++;
+        } else if (!legal_timescale(trace.timescale)) {
+            printf("FAIL %s: recorder timescale \"%s\" is not legal VCD\n", s->name, trace.timescale);
+            failed++;
+        } else if ((bad = compare(s->name, &trace, &wave)) != 0) {
+            failed += bad;
+        } else {
+            printf("%-8s  timescale %s, %u recorded changes over %.1f ms match the pins\n", s->name,
+                   trace.timescale, trace.count, (double)trace.at[trace.count - 1].t_ns / 1e6);
+        }
+        free(trace_text);
+        free(wave_text);
+    }
+    printf("%s LED trace recorder against the pin record\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
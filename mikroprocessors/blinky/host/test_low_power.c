@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "vmcu.h"
+#include "wave.h"
+#include "link.h"
+#include "uart_cmd.h"
+#include "leds.h"
+#include "low_power.h"
+#include "hd_fast.h"
+#include "MDR32FxQI_adc.h"
+
+/* Wake latency and drift model of the RTC deep sleep (low_power.h),
+ * firmware built with HD_LOW_POWER. A 2 s LED_Sequence leaves long gaps
+ * that are slept on the RTC; every run checks
+ *   - wake latency: the core is awake no later than LP_WAKE_US after the
+ *     alarm (LP_GetStats late counts), and every LED step lands within
+ *     one tick of its 2 s schedule plus the RTC drift over it
+ *   - drift: the tick counter gains lse_ppm of the slept time against the
+ *     virtual clock, as LP_DRIFT_PPM = 0 predicts
+ *   - the core actually sleeps: most of the window in deep sleep, a few
+ *     wakes per second instead of 2000
+ * for an exact, a fast and a slow LSE and for the LSI fallback.
+ *   test_low_power [reference]
+ * reference is this test built without HD_LOW_POWER (low_power_default),
+ * run as "reference --wakeups": the exact LSE case must wake the virtual
+ * core (__WFI calls that waited) at most 1/LP_TEST_WAKE_RATIO as often as
+ * the same scenario on the default build, which sleeps between ticks. */
+
+#define LP_TEST_SETUP_AT    VM_MS(10)       /* warm boot, before the ADC's first block */
+#define LP_TEST_FROM        VM_MS(2000)
+#define LP_TEST_TO          VM_MS(22000)
+#define LP_TEST_STEP_MS     2000
+#define LP_TEST_TICK_US     1000.0
+#define LP_TEST_DRIFT_MS    2.0             /* ms rounding at the window ends */
+#define LP_TEST_MIN_ASLEEP  0.90
+#define LP_TEST_MAX_WAKES_S 10.0
+#define LP_TEST_WAKE_RATIO  100
+
+typedef struct {
+    const char* name;
+    int32_t lse_ppm;
+    uint8_t lse_fails;
+} LP_TEST_CaseTypeDef;
+
+typedef struct {
+    uint32_t rtc_hz;
+    uint32_t sleeps;
+    uint32_t slept_ms;
+    int32_t max_late_counts;
+    double tick_error_ms;           /* tick minus virtual time over the window */
+    double step_error_max_us;       /* LED steps against LP_TEST_STEP_MS */
+    uint32_t steps;
+    double asleep;                  /* share of the window in __WFI */
+    double wakes_per_s;
+    uint64_t wakeups;               /* virtual core, over the window */
+} LP_TEST_ResultTypeDef;
+
+static const LP_TEST_CaseTypeDef cases[] = {
+    { "lse exact",    0,    0 },
+    { "lse +200 ppm", 200,  0 },
+    { "lse -200 ppm", -200, 0 },
+    { "lsi fallback", 0,    1 },
+};
+
+#define LP_TEST_CASES   (sizeof(cases) / sizeof(cases[0]))
+
+static LP_TEST_ResultTypeDef* results;
+
+/* Runs on to the end of the current deep sleep, so the tick is current */
+static void run_to_wake(VM_Time t)
+{
+    VM_RunUntil(t);
+#ifdef HD_LOW_POWER
+    uint32_t sleeps = LP_GetStats()->sleeps;
+
+    while (LP_GetStats()->sleeps == sleeps) {
+        VM_RunFor(VM_US(100));
+    }
+#endif
+}
+
+static double cycles_to_ms(VM_Time cycles)
+{
+    return (double)cycles * 1000.0 / VM_CPU_HZ;
+}
+
+/* Largest distance of consecutive LED turn-ons from the step time */
+static double step_error_us(VM_Time from, VM_Time to, uint32_t* steps)
+{
+    const WAVE_EdgeTypeDef* edges = WAVE_GetEdges();
+    uint32_t count = WAVE_GetEdgeCount();
+    VM_Time last = 0;
+    double worst = 0;
+
+    *steps = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        double us;
+
+        if (edges[i].t < from || edges[i].t > to || edges[i].level == 0) {
+            continue;
+        }
+        if (last != 0) {
+            us = cycles_to_ms(edges[i].t - last) * 1000.0 - LP_TEST_STEP_MS * 1000.0;
+            if (us < 0) {
+                us = -us;
+            }
+            if (us > worst) {
+                worst = us;
+            }
+            (*steps)++;
+        }
+        last = edges[i].t;
+    }
+    return worst;
+}
+
+static int run_case(void* arg)
+{
+    uint32_t index = (uint32_t)(uintptr_t)arg;
+    LP_TEST_ResultTypeDef* r = &results[index];
+    LINK_CommandsTypeDef cmds = {0};
+    const LP_StatsTypeDef* lp = LP_GetStats();
+    uint32_t tick_from, sleeps_from, slept_from, wakes_from;
+    uint64_t asleep_from;
+    uint64_t wakeups_from;
+    VM_Time from, to;
+
+    VM_Config.lse_ppm = cases[index].lse_ppm;
+    VM_Config.lse_fails = cases[index].lse_fails;
+    VM_Boot();
+    WAVE_Init(WAVE_LedProbes, WAVE_LedProbeCount);
+
+    VM_RunUntil(LP_TEST_SETUP_AT);
+    /* No light sensor: its first block, filtered up from zero, would dim
+     * the LEDs into PWM (and ADC1, clocked from the CPU, converts at the
+     * RTC rate while asleep). Full level, one edge per step. */
+    ADC1_Cmd(DISABLE);
+    LINK_AddU8(&cmds, UCMD_SET_WAVE_ENABLE, 0);
+    LINK_AddU32(&cmds, UCMD_SET_SEQUENCE, LP_TEST_STEP_MS);
+    LINK_Send(1, &cmds);
+
+    run_to_wake(LP_TEST_FROM);
+    from = VM_Now();
+    tick_from = HD_GetTick();
+    sleeps_from = lp->sleeps;
+    slept_from = lp->slept_ms;
+    wakes_from = HD_GetTimer1Wakeups();
+    asleep_from = VM_GetStats()->sleep_cycles;
+    wakeups_from = VM_GetStats()->wakeups;
+
+    run_to_wake(LP_TEST_TO);
+    to = VM_Now();
+    r->rtc_hz = lp->rtc_hz;
+    r->sleeps = lp->sleeps - sleeps_from;
+    r->slept_ms = lp->slept_ms - slept_from;
+    r->max_late_counts = lp->max_late_counts;
+    r->tick_error_ms = (double)(HD_GetTick() - tick_from) - cycles_to_ms(to - from);
+    r->step_error_max_us = step_error_us(from, to, &r->steps);
+    r->asleep = (double)(VM_GetStats()->sleep_cycles - asleep_from) / (double)(to - from);
+    r->wakes_per_s = (r->sleeps + HD_GetTimer1Wakeups() - wakes_from) / (cycles_to_ms(to - from) / 1000.0);
+    r->wakeups = VM_GetStats()->wakeups - wakeups_from;
+    WAVE_Free();
+    return 0;
+}
+
+/* Warm-up boot: the first boot formats the shared parameter flash and
+ * starts UART and ADC late, done once here instead of in the first case */
+static int boot_once(void* arg)
+{
+    VM_Boot();
+    VM_RunUntil(VM_MS(60));
+    return 0;
+}
+
+/* Wakeups of the exact LSE case on the reference build, 0 if none */
+static uint64_t reference_wakeups(const char* program)
+{
+    char command[512];
+    unsigned long long wakeups = 0;
+    FILE* out;
+
+    snprintf(command, sizeof(command), "%s --wakeups", program);
+    out = popen(command, "r");
+    if (out == NULL) {
+        perror(program);
+        return 0;
+    }
+    if (fscanf(out, "%llu", &wakeups) != 1) {
+        wakeups = 0;
+    }
+    if (pclose(out) != 0) {
+        wakeups = 0;
+    }
+    return wakeups;
+}
+
+int main(int argc, char** argv)
+{
+    int failed = 0;
+
+    results = mmap(NULL, LP_TEST_CASES * sizeof(*results), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(results, 0, LP_TEST_CASES * sizeof(*results));
+    if (VM_RunIsolated(boot_once, NULL) != 0) {
+        printf("FAIL warm-up boot\n");
+        return 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "--wakeups") == 0) {
+        if (VM_RunIsolated(run_case, (void*)0) != 0) {
+            return 1;
+        }
+        printf("%llu\n", (unsigned long long)results[0].wakeups);
+        return 0;
+    }
+
+    printf("case          rtc Hz  sleeps  late us  tick error ms (model)  step error us  asleep  wakes/s\n");
+    for (uint32_t i = 0; i < LP_TEST_CASES; i++) {
+        const LP_TEST_CaseTypeDef* c = &cases[i];
+        LP_TEST_ResultTypeDef* r = &results[i];
+        double late_us, model_ms, step_limit_us;
+
+        if (VM_RunIsolated(run_case, (void*)(uintptr_t)i) != 0 || r->rtc_hz == 0) {
+            printf("FAIL %s: device run failed or no RTC clock\n", c->name);
+            failed++;
+            continue;
+        }
+        /* The RTC source runs lse_ppm fast, the slept ms are counted on it */
+        model_ms = r->slept_ms * (c->lse_fails ? 0.0 : c->lse_ppm * 1e-6);
+        late_us = r->max_late_counts * 1e6 / r->rtc_hz;
+        step_limit_us = LP_TEST_TICK_US + LP_TEST_STEP_MS * 1000.0 * abs(c->lse_ppm) * 1e-6;
+        printf("%-12s  %6u  %6u  %7.0f  %8.2f (%8.2f)    %13.0f  %5.1f%%  %7.1f\n", c->name, r->rtc_hz, r->sleeps,
+               late_us, r->tick_error_ms, model_ms, r->step_error_max_us, r->asleep * 100, r->wakes_per_s);
+
+        if (late_us > LP_WAKE_US) {
+            printf("FAIL %s: woke %.0f us after the alarm, model allows %u us\n", c->name, late_us, LP_WAKE_US);
+            failed++;
+        }
+        if (r->tick_error_ms < model_ms - LP_TEST_DRIFT_MS || r->tick_error_ms > model_ms + LP_TEST_DRIFT_MS) {
+            printf("FAIL %s: tick off by %.2f ms, drift model says %.2f ms\n", c->name, r->tick_error_ms, model_ms);
+            failed++;
+        }
+        if (r->steps == 0 || r->step_error_max_us > step_limit_us) {
+            printf("FAIL %s: %u LED steps, worst %.0f us off the schedule (limit %.0f us)\n", c->name, r->steps,
+                   r->step_error_max_us, step_limit_us);
+            failed++;
+        }
+        if (r->asleep < LP_TEST_MIN_ASLEEP || r->wakes_per_s > LP_TEST_MAX_WAKES_S) {
+            printf("FAIL %s: %.1f%% asleep, %.1f wakes/s\n", c->name, r->asleep * 100, r->wakes_per_s);
+            failed++;
+        }
+    }
+    if (argc > 1) {
+        uint64_t reference = reference_wakeups(argv[1]);
+
+        printf("lse exact: %llu core wakeups, %llu on the default build\n", (unsigned long long)results[0].wakeups,
+               (unsigned long long)reference);
+        if (reference == 0 || results[0].wakeups * LP_TEST_WAKE_RATIO > reference) {
+            printf("FAIL lse exact: wakeups not below 1/%u of the default build's\n", LP_TEST_WAKE_RATIO);
+            failed++;
+        }
+    }
+    printf("%s low-power wake latency and drift\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "vmcu.h"
+#include "wave.h"
+#include "link.h"
+#include "uart_cmd.h"
+#include "leds.h"
+#include "led_matrix.h"
+#include "MDR32FxQI_adc.h"
+
+/* Duty cycle simulation of the multiplexed matrix (led_matrix.c),
+ * firmware built with LED_MATRIX. The row and column pins are recorded
+ * and replayed: a pixel is lit while its row sources and its column
+ * sinks. Every case checks
+ *   - no ghosting: never two rows on at once
+ *   - duty per pixel: BAM code / (2^LMTX_BAM_BITS - 1) of its row slot,
+ *     i.e. divided by LMTX_ROWS over the whole refresh
+ *   - the refresh rate the slice lengths add up to
+ * for a test image with every BAM code set directly, and for the frames
+ * of the wave and the sequence engine, where each row band must show the
+ * brightness its LED channel has on the direct outputs over the same
+ * window.
+ *
+ * The VM applies the stores of one interrupt as one instant, so the
+ * order inside the scan handler (blank, columns, row on) is not visible
+ * here; what a missing blank would show, a second lit row, is. */
+
+#define MTX_SETUP_AT        VM_MS(10)       /* warm boot, before the ADC's first block */
+#define MTX_FROM            VM_MS(100)
+#define MTX_TO              VM_MS(600)
+#define MTX_DUTY_TOL        0.003           /* one partial refresh in the window */
+#define MTX_SEQUENCE_MS     10000           /* one static sequence frame */
+#define MTX_BRIGHTNESS      152             /* mid BAM step, away from rounding */
+
+#define MTX_PIXELS          (LMTX_ROWS * LMTX_COLS)
+#define MTX_CODES           ((1U << LMTX_BAM_BITS) - 1)
+#define MTX_REFRESH_US      (LMTX_ROWS * MTX_CODES * LMTX_BAM_BASE_US)
+
+#define MTX_ROW_PROBE(arg, idx, port, pin)  { "row" #idx, VM_PORT_##port, pin },
+#define MTX_COL_PROBE(arg, idx, port, pin)  { "col" #idx, VM_PORT_##port, pin },
+
+/* Rows first, then columns, then the direct LED outputs */
+static const WAVE_ProbeTypeDef matrix_probes[] = {
+    LMTX_ROW_MAP(MTX_ROW_PROBE, _)
+    LMTX_COL_MAP(MTX_COL_PROBE, _)
+};
+
+#define MTX_PROBES  (sizeof(matrix_probes) / sizeof(matrix_probes[0]))
+
+static WAVE_ProbeTypeDef probes[MTX_PROBES + LED_COUNT];
+
+typedef enum {
+    MTX_CASE_IMAGE = 0,         /* LMTX_SetPixels, every code */
+    MTX_CASE_WAVE,              /* boot default wave */
+    MTX_CASE_SEQUENCE,          /* one static sequence step */
+} MTX_CaseTypeDef;
+
+typedef struct {
+    const char* name;
+    MTX_CaseTypeDef kind;
+} MTX_TestTypeDef;
+
+typedef struct {
+    double duty[MTX_PIXELS];
+    double led_duty[LED_COUNT];
+    uint8_t image[MTX_PIXELS];
+    uint32_t ghost_rows;        /* instants with two rows on */
+    uint32_t refreshes;
+    uint64_t scan_calls;
+    double scan_ns;             /* host time per scan interrupt */
+} MTX_ResultTypeDef;
+
+static const MTX_TestTypeDef tests[] = {
+    { "image",    MTX_CASE_IMAGE },
+    { "wave",     MTX_CASE_WAVE },
+    { "sequence", MTX_CASE_SEQUENCE },
+};
+
+#define MTX_TESTS   (sizeof(tests) / sizeof(tests[0]))
+
+static MTX_ResultTypeDef* results;
+
+static double cycles_to_s(VM_Time cycles)
+{
+    return (double)cycles / VM_CPU_HZ;
+}
+
+/* Every code 0..MTX_CODES once per pixel row, with noise in the low bits
+ * BAM does not show */
+static void build_image(uint8_t* image)
+{
+    for (uint32_t r = 0; r < LMTX_ROWS; r++) {
+        for (uint32_t c = 0; c < LMTX_COLS; c++) {
+            uint32_t code = (r + 3 * c) % (MTX_CODES + 1);
+
+            image[r * LMTX_COLS + c] = (uint8_t)((code << (8 - LMTX_BAM_BITS)) | ((r ^ c) & 0x0F));
+        }
+    }
+}
+
+/* Pin levels at the start of the record */
+static void initial_levels(uint8_t* level)
+{
+    for (uint32_t i = 0; i < MTX_PROBES; i++) {
+        level[i] = (uint8_t)VM_GetPin(probes[i].port, probes[i].pin);
+    }
+}
+
+static int row_on(const uint8_t* level, uint32_t r)
+{
+    return level[r] == LMTX_ROW_ACTIVE_HIGH;
+}
+
+static int col_on(const uint8_t* level, uint32_t c)
+{
+    return level[LMTX_ROWS + c] == LMTX_COL_ACTIVE_HIGH;
+}
+
+/**
+  * @brief  Replays the pin record: lit time per pixel in [from, to),
+  *         ghosting check at every change
+  * @note   Edges of one instant come from one interrupt, so only the
+  *         state after the whole instant is ever visible
+  */
+static void replay(const uint8_t* start, VM_Time from, VM_Time to, MTX_ResultTypeDef* r)
+{
+    const WAVE_EdgeTypeDef* edges = WAVE_GetEdges();
+    uint32_t count = WAVE_GetEdgeCount();
+    uint8_t level[MTX_PROBES];
+    VM_Time lit[MTX_PIXELS] = {0};
+    VM_Time t = from;
+    uint32_t i = 0;
+
+    memcpy(level, start, sizeof(level));
+    while (i < count && edges[i].t < from) {
+        level[edges[i].probe] = edges[i].level;
+        i++;
+    }
+
+    while (t < to) {
+        VM_Time next = (i < count && edges[i].t < to) ? edges[i].t : to;
+        uint32_t rows = 0;
+
+        for (uint32_t row = 0; row < LMTX_ROWS; row++) {
+            if (!row_on(level, row)) {
+                continue;
+            }
+            for (uint32_t c = 0; c < LMTX_COLS; c++) {
+                if (col_on(level, c)) {
+                    lit[row * LMTX_COLS + c] += next - t;
+                }
+            }
+        }
+        t = next;
+        if (t >= to) {
+            break;
+        }
+
+        while (i < count && edges[i].t == t) {
+            level[edges[i].probe] = edges[i].level;
+            i++;
+        }
+        for (uint32_t row = 0; row < LMTX_ROWS; row++) {
+            rows += row_on(level, row);
+        }
+        if (rows > 1) {
+            r->ghost_rows++;
+        }
+    }
+
+    for (uint32_t p = 0; p < MTX_PIXELS; p++) {
+        r->duty[p] = (double)lit[p] / (double)(to - from);
+    }
+}
+
+static int run_case(void* arg)
+{
+    uint32_t index = (uint32_t)(uintptr_t)arg;
+    MTX_ResultTypeDef* r = &results[index];
+    LINK_CommandsTypeDef cmds = {0};
+    const VM_IrqStatsTypeDef* scan;
+    WAVE_SummaryTypeDef led;
+    uint8_t start[MTX_PROBES];
+    uint32_t refresh_from;
+    uint64_t calls_from, ns_from;
+
+    VM_Boot();
+    VM_RunUntil(MTX_SETUP_AT);
+    /* No light sensor, the engine frames stay at full ambient level */
+    ADC1_Cmd(DISABLE);
+
+    switch (tests[index].kind) {
+    case MTX_CASE_IMAGE:
+        LINK_AddU8(&cmds, UCMD_SET_WAVE_ENABLE, 0);
+        LINK_AddU32(&cmds, UCMD_SET_SEQUENCE, 0);
+        break;
+    case MTX_CASE_WAVE:
+        LINK_AddU8(&cmds, UCMD_SET_WAVE_ENABLE, 1);
+        LINK_AddU32(&cmds, UCMD_SET_SEQUENCE, 0);
+        break;
+    case MTX_CASE_SEQUENCE:
+        LINK_AddU8(&cmds, UCMD_SET_WAVE_ENABLE, 0);
+        LINK_AddU32(&cmds, UCMD_SET_SEQUENCE, MTX_SEQUENCE_MS);
+        LINK_AddU8(&cmds, UCMD_SET_BRIGHTNESS, MTX_BRIGHTNESS);
+        break;
+    }
+    LINK_Send(1, &cmds);
+
+    /* Effects stopped, the render leaves the matrix to the test image */
+    if (tests[index].kind == MTX_CASE_IMAGE) {
+        VM_RunUntil(MTX_FROM / 2);
+        build_image(r->image);
+        LMTX_SetPixels(r->image);
+    }
+
+    VM_RunUntil(MTX_FROM);
+    WAVE_Init(probes, MTX_PROBES + WAVE_LedProbeCount);
+    initial_levels(start);
+    refresh_from = LMTX_GetRefreshCount();
+    scan = VM_GetIrqStats(Timer2_IRQn);
+    calls_from = scan->count;
+    ns_from = scan->host_ns;
+
+    VM_RunUntil(MTX_TO);
+    replay(start, MTX_FROM, MTX_TO, r);
+    r->refreshes = LMTX_GetRefreshCount() - refresh_from;
+    r->scan_calls = scan->count - calls_from;
+    r->scan_ns = r->scan_calls ? (double)(scan->host_ns - ns_from) / r->scan_calls : 0;
+    for (uint32_t i = 0; i < WAVE_LedProbeCount; i++) {
+        WAVE_Summarize(MTX_PROBES + i, MTX_FROM, MTX_TO, &led);
+        r->led_duty[i] = led.duty;
+    }
+    WAVE_Free();
+    return 0;
+}
+
+/* Warm-up boot: the first boot formats the shared parameter flash and
+ * starts UART and ADC late, done once here instead of in the first case */
+static int boot_once(void* arg)
+{
+    VM_Boot();
+    VM_RunUntil(VM_MS(60));
+    return 0;
+}
+
+/* Image case: every pixel its own BAM code */
+static int check_image(const MTX_ResultTypeDef* r)
+{
+    double worst = 0;
+    int failed = 0;
+
+    for (uint32_t p = 0; p < MTX_PIXELS; p++) {
+        uint32_t code = r->image[p] >> (8 - LMTX_BAM_BITS);
+        double expected = (double)code / MTX_CODES / LMTX_ROWS;
+        double error = r->duty[p] - expected;
+
+        if (error < 0) {
+            error = -error;
+        }
+        if (error > worst) {
+            worst = error;
+        }
+        if (error > MTX_DUTY_TOL) {
+            printf("FAIL image: pixel %u,%u duty %.4f, code %u expects %.4f\n", p / LMTX_COLS, p % LMTX_COLS,
+                   r->duty[p], code, expected);
+            failed++;
+        }
+    }
+    printf("image     worst pixel error %.4f over %u pixels\n", worst, MTX_PIXELS);
+    return failed;
+}
+
+/* Engine cases: every pixel of a row band shows its LED channel, within
+ * one BAM step (BAM truncates the 8-bit level, PWM rounds it) */
+static int check_bands(const char* name, const MTX_ResultTypeDef* r)
+{
+    int failed = 0;
+
+    for (uint32_t row = 0; row < LMTX_ROWS; row++) {
+        uint32_t channel = (row * LCOMP_CHANNELS) / LMTX_ROWS;
+        double band = r->duty[row * LMTX_COLS] * LMTX_ROWS;
+
+        for (uint32_t c = 1; c < LMTX_COLS; c++) {
+            if (r->duty[row * LMTX_COLS + c] != r->duty[row * LMTX_COLS]) {
+                printf("FAIL %s: row %u not uniform, column %u %.4f vs %.4f\n", name, row, c,
+                       r->duty[row * LMTX_COLS + c], r->duty[row * LMTX_COLS]);
+                failed++;
+                break;
+            }
+        }
+        printf("%-8s  row %u  matrix %.3f  LED%u %.3f\n", name, row, band, channel + 1, r->led_duty[channel]);
+        if (band > r->led_duty[channel] + MTX_DUTY_TOL * LMTX_ROWS ||
+            band < r->led_duty[channel] - 1.0 / MTX_CODES - MTX_DUTY_TOL * LMTX_ROWS) {
+            printf("FAIL %s: row %u shows %.3f, LED%u is at %.3f\n", name, row, band, channel + 1,
+                   r->led_duty[channel]);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+int main(void)
+{
+    double refresh_hz = 1e6 / MTX_REFRESH_US;
+    int failed = 0;
+
+    results = mmap(NULL, MTX_TESTS * sizeof(*results), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(results, 0, MTX_TESTS * sizeof(*results));
+    memcpy(probes, matrix_probes, sizeof(matrix_probes));
+    memcpy(&probes[MTX_PROBES], WAVE_LedProbes, WAVE_LedProbeCount * sizeof(probes[0]));
+    if (VM_RunIsolated(boot_once, NULL) != 0) {
+        printf("FAIL warm-up boot\n");
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < MTX_TESTS; i++) {
+        const MTX_TestTypeDef* test = &tests[i];
+        MTX_ResultTypeDef* r = &results[i];
+        double hz;
+
+        if (VM_RunIsolated(run_case, (void*)(uintptr_t)i) != 0) {
+            printf("FAIL %s: device run failed\n", test->name);
+            failed++;
+            continue;
+        }
+        hz = r->refreshes / cycles_to_s(MTX_TO - MTX_FROM);
+        printf("%-8s  %u refreshes, %.1f Hz (model %.1f Hz), %llu scan interrupts, %.0f host ns each\n",
+               test->name, r->refreshes, hz, refresh_hz, (unsigned long long)r->scan_calls, r->scan_ns);
+
+        if (r->ghost_rows != 0) {
+            printf("FAIL %s: %u instants with two rows on\n", test->name, r->ghost_rows);
+            failed++;
+        }
+        if (hz < refresh_hz * 0.99 || hz > refresh_hz * 1.01) {
+            printf("FAIL %s: refresh %.1f Hz, slices add up to %.1f Hz\n", test->name, hz, refresh_hz);
+            failed++;
+        }
+        failed += (test->kind == MTX_CASE_IMAGE) ? check_image(r) : check_bands(test->name, r);
+    }
+    printf("%s LED matrix duty cycle\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "vmcu.h"
+#include "param_store.h"
+#include "hd_fast.h"
+
+/* Parameter store (param_store.c) on the flash model of spl.c. One run of
+ * PARAM_Set calls, each flushed before the next, that fills the first
+ * page and goes through a compaction:
+ *   - stall: the compaction's page erase masks interrupts for 40 ms;
+ *     HD_GetTick must still follow the virtual clock to within a tick
+ *   - power loss: the same run again with power cut at one flash erase or
+ *     write, for every one over the first appends and the whole compaction.
+ *     The cut operation is left torn (half a word programmed, half a page
+ *     erased). After the reboot PARAM_Get must give, for every key, the
+ *     value of the last set whose flash writes had all finished. */
+
+#define PS_TEST_SETUP_AT    VM_MS(60)       /* warm boot, PARAM_Init done */
+#define PS_TEST_SETTLE      VM_MS(1)        /* last word program finished */
+#define PS_TEST_SETS        520             /* 511 fill a page */
+#define PS_TEST_FIRST_CUTS  6
+#define PS_TEST_AFTER_CUTS  4               /* appends after the compaction */
+#define PS_TEST_TICK_TOL_MS 1
+
+typedef struct {
+    uint32_t valid;                         /* bit per key */
+    uint32_t value[PARAM_KEY_COUNT];
+} PS_TEST_ValuesTypeDef;
+
+/* Filled by the device runs */
+typedef struct {
+    PS_TEST_ValuesTypeDef committed;        /* after the last flushed set */
+    uint32_t sets_done;
+    uint32_t ops;                           /* flash erases and writes */
+    uint32_t erase_op;                      /* the compaction's erase */
+    uint32_t erase_ops;                     /* erase to last write of the compaction */
+    int32_t compaction_tick_error_ms;
+    int32_t run_tick_error_ms;
+    PS_TEST_ValuesTypeDef loaded;           /* after the reboot */
+} PS_TEST_SharedTypeDef;
+
+static PS_TEST_SharedTypeDef* shared;
+static uint8_t flash_image[2 * PARAM_PAGE_SIZE];
+
+static uint32_t value_of(uint32_t set)
+{
+    return 0xA5000000UL ^ (set * 0x9E3779B1UL);
+}
+
+static uint32_t flash_ops(void)
+{
+    return VM_GetStats()->flash_erases + VM_GetStats()->flash_writes;
+}
+
+static int32_t tick_error_ms(uint32_t tick_from, VM_Time from)
+{
+    return (int32_t)(HD_GetTick() - tick_from) - (int32_t)((VM_Now() - from) / VM_MS(1));
+}
+
+static void read_values(PS_TEST_ValuesTypeDef* v)
+{
+    memset(v, 0, sizeof(*v));
+    for (uint32_t key = 0; key < PARAM_KEY_COUNT; key++) {
+        if (PARAM_Get((PARAM_KeyTypeDef)key, &v->value[key]) == HD_OK) {
+            v->valid |= 1UL << key;
+        }
+    }
+}
+
+static int boot_once(void* arg)
+{
+    VM_Boot();
+    VM_RunUntil(PS_TEST_SETUP_AT);
+    return 0;
+}
+
+/**
+  * @brief  The run of sets, ends early in a power cut when one is set up
+  */
+static int run_sets(void* arg)
+{
+    uint32_t run_tick;
+    VM_Time run_from;
+
+    VM_Config.flash_cut_at = (uint32_t)(uintptr_t)arg;
+    VM_Boot();
+    VM_RunUntil(PS_TEST_SETUP_AT);
+    read_values(&shared->committed);
+    run_tick = HD_GetTick();
+    run_from = VM_Now();
+
+    for (uint32_t i = 0; i < PS_TEST_SETS; i++) {
+        uint32_t key = i % PARAM_KEY_COUNT;
+        uint32_t erases = VM_GetStats()->flash_erases;
+        uint32_t ops = flash_ops();
+        uint32_t tick = HD_GetTick();
+        VM_Time from = VM_Now();
+
+        PARAM_Set((PARAM_KeyTypeDef)key, value_of(i));
+        while (PARAM_IsBusy()) {
+            VM_RunFor(VM_US(100));
+        }
+        VM_RunFor(PS_TEST_SETTLE);
+
+        /* All its writes finished: a cut from here on leaves it in */
+        shared->committed.value[key] = value_of(i);
+        shared->committed.valid |= 1UL << key;
+        shared->sets_done = i + 1;
+        shared->ops = flash_ops();
+        if (VM_GetStats()->flash_erases != erases) {
+            shared->erase_op = ops + 1;
+            shared->erase_ops = flash_ops() - ops;
+            shared->compaction_tick_error_ms = tick_error_ms(tick, from);
+        }
+    }
+    shared->run_tick_error_ms = tick_error_ms(run_tick, run_from);
+    return 0;
+}
+
+static int load(void* arg)
+{
+    VM_Boot();
+    VM_RunUntil(PS_TEST_SETUP_AT);
+    read_values(&shared->loaded);
+    return 0;
+}
+
+static int tick_error_ok(int32_t error)
+{
+    return error >= -PS_TEST_TICK_TOL_MS && error <= PS_TEST_TICK_TOL_MS;
+}
+
+/**
+  * @brief  Power cut at one flash operation, then the reboot
+  * @retval Number of failures
+  */
+static int cut_at(uint32_t op)
+{
+    PS_TEST_ValuesTypeDef expected;
+    int status;
+
+    memcpy((void*)PARAM_PAGE0_ADDR, flash_image, sizeof(flash_image));
+    memset(shared, 0, sizeof(*shared));
+    status = VM_RunIsolated(run_sets, (void*)(uintptr_t)op);
+    expected = shared->committed;
+    if (status != VM_POWER_CUT) {
+        printf("FAIL cut at op %u: device run ended with %d, not in the cut\n", op, status);
+        return 1;
+    }
+    if (VM_RunIsolated(load, NULL) != 0) {
+        printf("FAIL cut at op %u: reboot failed\n", op);
+        return 1;
+    }
+    for (uint32_t key = 0; key < PARAM_KEY_COUNT; key++) {
+        uint32_t bit = 1UL << key;
+
+        if ((shared->loaded.valid & bit) != (expected.valid & bit) ||
+            ((expected.valid & bit) && shared->loaded.value[key] != expected.value[key])) {
+            printf("FAIL cut at op %u (after %u sets): key %u loads %s%08X, last committed %s%08X\n", op,
+                   shared->sets_done, key, (shared->loaded.valid & bit) ? "" : "nothing, was ",
+                   shared->loaded.value[key], (expected.valid & bit) ? "" : "nothing, was ", expected.value[key]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(void)
+{
+    PS_TEST_SharedTypeDef reference;
+    uint32_t cuts = 0;
+    int failed = 0;
+
+    shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    /* First boot formats the store, every run starts from that flash */
+    if (VM_RunIsolated(boot_once, NULL) != 0) {
+        printf("FAIL first boot\n");
+        return 1;
+    }
+    memcpy(flash_image, (const void*)PARAM_PAGE0_ADDR, sizeof(flash_image));
+
+    memset(shared, 0, sizeof(*shared));
+    if (VM_RunIsolated(run_sets, NULL) != 0 || shared->sets_done != PS_TEST_SETS || shared->erase_op == 0) {
+        printf("FAIL reference run: %u sets, no compaction\n", shared->sets_done);
+        return 1;
+    }
+    reference = *shared;
+    printf("%u sets, %u flash ops, compaction ops %u..%u\n", reference.sets_done, reference.ops,
+           reference.erase_op, reference.erase_op + reference.erase_ops - 1);
+    printf("tick - virtual time: %d ms over the compaction, %d ms over the run\n",
+           reference.compaction_tick_error_ms, reference.run_tick_error_ms);
+    if (!tick_error_ok(reference.compaction_tick_error_ms) || !tick_error_ok(reference.run_tick_error_ms)) {
+        printf("FAIL tick lost in the flash stall, tolerance %d ms\n", PS_TEST_TICK_TOL_MS);
+        failed++;
+    }
+
+    for (uint32_t op = 1; op <= reference.ops; op++) {
+        if (op > PS_TEST_FIRST_CUTS &&
+            (op < reference.erase_op || op >= reference.erase_op + reference.erase_ops + 2 * PS_TEST_AFTER_CUTS)) {
+            continue;
+        }
+        failed += cut_at(op);
+        cuts++;
+    }
+    printf("%u power cuts, %u failed\n", cuts, failed);
+    printf("%s parameter store across flash stalls and power loss\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
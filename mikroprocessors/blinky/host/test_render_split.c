@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "vmcu.h"
+#include "wave.h"
+#include "leds.h"
+#include "hardware_drivers.h"
+
+
+/* Render/output split: LED_Render is made slower and slower, both in
+ * host time and in virtual CPU cycles, while the PWM wave runs. The
+ * TIMER1 output handler only reads the front frame, so its host cost per
+ * call must not follow the render cost, no 1 ms tick may be lost and the
+ * LED duty must stay where the unloaded run has it. A slow render may
+ * drop frames, that is the render side's to report. Built with
+ * -Wl,--wrap=LED_Render. */
+
+#define SPLIT_RUN           VM_MS(1200)
+#define SPLIT_FROM          VM_MS(200)
+#define SPLIT_ISR_SLACK_NS  500.0       /* host timer noise on short handlers */
+#define SPLIT_DUTY_TOLERANCE 0.01       /* frame phase moves with the render */
+#define SPLIT_MAX_LEDS      8
+
+typedef struct {
+    uint32_t host_us;           /* extra host time per render */
+    uint32_t cycles;            /* extra virtual cycles per render */
+} SPLIT_LoadTypeDef;
+
+typedef struct {
+    uint64_t renders;
+    uint64_t render_ns;
+    uint64_t isr_count;
+    uint64_t isr_ns;
+    uint32_t overruns;
+    uint32_t drops;
+    double duty[SPLIT_MAX_LEDS];
+} SPLIT_ResultTypeDef;
+
+static const SPLIT_LoadTypeDef loads[] = {
+    { 0,   0 },
+    { 20,  800 },
+    { 100, 2400 },
+    { 400, 4000 },
+};
+
+#define SPLIT_LOADS     (sizeof(loads) / sizeof(loads[0]))
+
+static const SPLIT_LoadTypeDef* load;
+static SPLIT_ResultTypeDef* result;
+
+void __real_LED_Render(void);
+
+static uint64_t host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* The main loop's LED_Render, made as expensive as the load says */
+void __wrap_LED_Render(void)
+{
+    uint64_t start = host_ns();
+
+    while (host_ns() - start < load->host_us * 1000ULL) {
+    }
+    if (load->cycles != 0) {
+        VM_Busy(load->cycles);
+    }
+    __real_LED_Render();
+    result->renders++;
+    result->render_ns += host_ns() - start;
+}
+
+static int run_load(void* arg)
+{
+    const VM_IrqStatsTypeDef* isr;
+    WAVE_SummaryTypeDef wave;
+
+    load = arg;
+    VM_Boot();
+    WAVE_Init(WAVE_LedProbes, WAVE_LedProbeCount);
+    VM_RunUntil(SPLIT_RUN);
+
+    isr = VM_GetIrqStats(Timer1_IRQn);
+    result->isr_count = isr->count;
+    result->isr_ns = isr->host_ns;
+    result->overruns = HD_GetOverrunCount();
+    result->drops = LED_GetFrameDrops();
+    for (uint32_t i = 0; i < WAVE_LedProbeCount && i < SPLIT_MAX_LEDS; i++) {
+        WAVE_Summarize(i, SPLIT_FROM, SPLIT_RUN, &wave);
+        result->duty[i] = wave.duty;
+    }
+    WAVE_Free();
+    return 0;
+}
+
+int main(void)
+{
+    SPLIT_ResultTypeDef* results = mmap(NULL, SPLIT_LOADS * sizeof(*results), PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    double base_isr_ns = 0;
+    int failed = 0;
+
+    if (results == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(results, 0, SPLIT_LOADS * sizeof(*results));
+
+    printf("render load          render/call   TIMER1 calls  TIMER1/call  overruns drops  LED1 duty\n");
+    for (uint32_t i = 0; i < SPLIT_LOADS; i++) {
+        SPLIT_ResultTypeDef* r = &results[i];
+        double render_ns, isr_ns;
+
+        result = r;
+        if (VM_RunIsolated(run_load, (void*)&loads[i]) != 0 || r->renders == 0 || r->isr_count == 0) {
+            printf("FAIL device run failed\n");
+            return 1;
+        }
+        render_ns = (double)r->render_ns / r->renders;
+        isr_ns = (double)r->isr_ns / r->isr_count;
+        printf("%4u us + %4u cyc  %9.1f us  %12llu  %8.0f ns  %8u %5u  %9.4f\n",
+               loads[i].host_us, loads[i].cycles, render_ns / 1000.0, (unsigned long long)r->isr_count,
+               isr_ns, r->overruns, r->drops, r->duty[0]);
+
+        /* Every 1 ms tick of the wave is an output event */
+        if (r->isr_count < SPLIT_RUN / VM_MS(1)) {
+            printf("FAIL %llu TIMER1 calls, ticks were lost\n", (unsigned long long)r->isr_count);
+            failed++;
+        }
+
+        if (i == 0) {
+            base_isr_ns = isr_ns;
+            continue;
+        }
+        /* Output side must not follow the render side */
+        if (isr_ns > 2.0 * base_isr_ns + SPLIT_ISR_SLACK_NS) {
+            printf("FAIL TIMER1 cost %.0f ns grew with the render cost (%.0f ns unloaded)\n", isr_ns, base_isr_ns);
+            failed++;
+        }
+        if (r->overruns != 0) {
+            printf("FAIL %u TIMER1 overruns\n", r->overruns);
+            failed++;
+        }
+        for (uint32_t led = 0; led < WAVE_LedProbeCount && led < SPLIT_MAX_LEDS; led++) {
+            if (fabs(r->duty[led] - results[0].duty[led]) > SPLIT_DUTY_TOLERANCE) {
+                printf("FAIL %s duty %.4f, %.4f unloaded\n", WAVE_LedProbes[led].name,
+                       r->duty[led], results[0].duty[led]);
+                failed++;
+            }
+        }
+    }
+    printf("%s render/output split\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
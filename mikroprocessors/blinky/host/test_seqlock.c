@@ -0,0 +1,159 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "vmcu.h"
+#include "leds.h"
+
+/* Effect config seqlock of leds.c under real concurrency: a writer
+ * thread publishes configs as fast as it can while the reader thread
+ * renders frames, for both ways in:
+ *   - setters: LED_SetEffectConfig straight from the writer
+ *   - batches: LED_SubmitParams, applied by LED_Render itself
+ * Every config written has pwm_period and brightness derived from its
+ * wave_speed, so a torn copy shows as a config breaking that rule. The
+ * reader checks the config in use after every frame and the one
+ * LED_GetEffectConfig returns. It also counts frames that started while
+ * a publish was in progress, the race the seqlock is there for.
+ *
+ * The virtual MCU is not booted: register and CMSIS shims are plain
+ * memory then, and PRIMASK is per thread. */
+
+#define SQ_TEST_RUN_NS      1000000000ULL   /* per phase */
+
+typedef enum {
+    SQ_PHASE_SETTERS = 0,
+    SQ_PHASE_BATCHES,
+} SQ_PhaseTypeDef;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t taken;             /* new configs in use */
+    uint64_t in_progress;       /* frames started on an odd seq */
+    uint64_t torn;
+    uint64_t published;         /* configs or batches the writer got in */
+} SQ_ResultTypeDef;
+
+static LED_EngineTypeDef engine;
+static volatile int stop;
+static SQ_PhaseTypeDef phase;
+static uint64_t writes;
+
+static uint64_t host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static LED_EffectConfigTypeDef config_of(uint32_t n)
+{
+    return (LED_EffectConfigTypeDef){ .wave_speed = n, .pwm_period = n * 3 + 1, .brightness = (uint8_t)(n * 7) };
+}
+
+static int consistent(const LED_EffectConfigTypeDef* c)
+{
+    LED_EffectConfigTypeDef expected = config_of(c->wave_speed);
+
+    return c->pwm_period == expected.pwm_period && c->brightness == expected.brightness;
+}
+
+static void* writer(void* arg)
+{
+    for (uint32_t n = 2; !stop; n++) {
+        LED_EffectConfigTypeDef c = config_of(n);
+
+        if (phase == SQ_PHASE_SETTERS) {
+            writes += (LED_SetEffectConfig(&c) == HD_OK);
+        } else {
+            LED_ParamsTypeDef p = {
+                .fields = LED_PARAM_WAVE_SPEED | LED_PARAM_PWM_PERIOD | LED_PARAM_BRIGHTNESS,
+                .wave_speed = c.wave_speed,
+                .pwm_period = c.pwm_period,
+                .brightness = c.brightness,
+            };
+
+            writes += (LED_SubmitParams(&p) == HD_OK);
+        }
+    }
+    return NULL;
+}
+
+static int run_phase(SQ_PhaseTypeDef which, SQ_ResultTypeDef* r)
+{
+    LED_EffectConfigTypeDef first = config_of(1);
+    uint32_t seq_in_use;
+    uint64_t end;
+    pthread_t thread;
+
+    LED_EngineInit(&engine);
+    engine.wave_active = 1;
+    LED_SetEngine(&engine);
+    LED_SetEffectConfig(&first);
+    engine.frame_request = 1;
+    LED_Render();               /* the defaults do not follow config_of */
+
+    memset(r, 0, sizeof(*r));
+    seq_in_use = engine.config_seq;
+    phase = which;
+    writes = 0;
+    stop = 0;
+    if (pthread_create(&thread, NULL, writer, NULL) != 0) {
+        return -1;
+    }
+
+    end = host_ns() + SQ_TEST_RUN_NS;
+    while (host_ns() < end) {
+        LED_EffectConfigTypeDef latest;
+
+        r->in_progress += engine.published.seq & 1U;
+        engine.frame_request = 1;
+        LED_Render();
+        r->frames++;
+        if (engine.config_seq != seq_in_use) {
+            seq_in_use = engine.config_seq;
+            r->taken++;
+        }
+        LED_GetEffectConfig(&latest);
+        r->torn += !consistent(&engine.config) + !consistent(&latest);
+    }
+
+    stop = 1;
+    pthread_join(thread, NULL);
+    r->published = writes;
+    LED_SetEngine(NULL);
+    return 0;
+}
+
+int main(void)
+{
+    static const char* const names[] = { "setters", "batches" };
+    int failed = 0;
+
+    VM_Init();
+
+    printf("phase     frames    configs taken  in progress  torn  writes\n");
+    for (SQ_PhaseTypeDef p = SQ_PHASE_SETTERS; p <= SQ_PHASE_BATCHES; p++) {
+        SQ_ResultTypeDef r;
+
+        if (run_phase(p, &r) != 0) {
+            printf("FAIL %s: no writer thread\n", names[p]);
+            failed++;
+            continue;
+        }
+        printf("%-8s  %8llu  %13llu  %11llu  %4llu  %6llu\n", names[p], (unsigned long long)r.frames,
+               (unsigned long long)r.taken, (unsigned long long)r.in_progress, (unsigned long long)r.torn,
+               (unsigned long long)r.published);
+        if (r.torn != 0) {
+            printf("FAIL %s: %llu torn configs\n", names[p], (unsigned long long)r.torn);
+            failed++;
+        }
+        if (r.taken == 0) {
+            printf("FAIL %s: the renderer never took a new config\n", names[p]);
+            failed++;
+        }
+    }
+    printf("%s effect config seqlock under racing threads\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "vmcu.h"
+#include "link.h"
+#include "uart_cmd.h"
+
+/* UART command link loopback: frames go to the firmware on the virtual
+ * UART2 line and the replies come back with their delimiter times.
+ *
+ * Latency: single frames on an idle line, from the last byte of the
+ * command frame on the wire to the reply delimiter, minus the reply's
+ * own wire time. Throughput: a burst of frames back to back, every one
+ * must be answered OK in order and the frame rate must reach the line
+ * rate (the UART, not the parser, is the bottleneck). Lap: the main loop
+ * stalls (UCMD_Process wrapped, -Wl,--wrap) while more frames arrive than
+ * the RX ring holds; the link must count one lap, execute none of the
+ * overwritten frames and answer every frame after it. */
+
+#define LOOP_START          VM_MS(60)   /* after the first boot's parameter page format */
+#define LOOP_SINGLES        16
+#define LOOP_SINGLE_GAP     VM_US(5300) /* walks the send time across the 1 ms tick */
+#define LOOP_BURST          200
+#define LOOP_TIMEOUT        VM_MS(500)
+#define LOOP_REPLY_BYTES    4           /* COBS code, seq, status, 0 */
+#define LOOP_MAX_LATENCY_US 2000.0      /* main loop pass plus one LED tick */
+#define LOOP_MIN_LINE_SHARE 0.90
+#define LOOP_LAP_FRAMES     12          /* about 1.4 rings */
+#define LOOP_LAP_STALL      VM_MS(25)   /* longer than their wire time */
+#define LOOP_AFTER_LAP      5
+
+typedef struct {
+    uint32_t replies;
+    uint32_t ok;
+    uint32_t in_order;
+    double latency_min_us;
+    double latency_max_us;
+    double latency_sum_us;
+    double frames_per_s;
+    double line_frames_per_s;
+    uint32_t frame_bytes;
+    UCMD_StatsTypeDef link;
+    uint32_t uart_rx_overflows;
+    uint32_t lap_replies;           /* to frames sent during the stall */
+    uint32_t after_lap_ok;          /* in order */
+} LOOP_ResultTypeDef;
+
+static LOOP_ResultTypeDef* result;
+static VM_Time stall;
+
+void __real_UCMD_Process(void);
+
+/* Main loop busy elsewhere once, before the next UCMD_Process */
+void __wrap_UCMD_Process(void)
+{
+    if (stall != 0) {
+        VM_Busy(stall);
+        stall = 0;
+    }
+    __real_UCMD_Process();
+}
+
+/* Brightness and wave speed in one batch, the usual live update */
+static uint32_t build_commands(uint32_t i, LINK_CommandsTypeDef* cmds)
+{
+    uint8_t frame[2 * LINK_MAX_FRAME];
+
+    memset(cmds, 0, sizeof(*cmds));
+    LINK_AddU8(cmds, UCMD_SET_BRIGHTNESS, (uint8_t)(128 + i % 128));
+    LINK_AddU32(cmds, UCMD_SET_WAVE_SPEED, 1 + i % 4);
+    return LINK_BuildFrame((uint8_t)i, cmds, frame);
+}
+
+static VM_Time wire_time(uint32_t bytes)
+{
+    return ((VM_Time)bytes * 10 * VM_CPU_HZ + VM_Config.uart_baud - 1) / VM_Config.uart_baud;
+}
+
+static void check_reply(const LINK_ReplyTypeDef* reply, uint8_t seq)
+{
+    result->replies++;
+    if (reply->status == UCMD_REPLY_OK) {
+        result->ok++;
+    }
+    if (reply->seq == seq) {
+        result->in_order++;
+    }
+}
+
+static int run_link(void* arg)
+{
+    LINK_ReplyTypeDef replies[LOOP_BURST];
+    LINK_CommandsTypeDef cmds;
+    VM_Time start, last = 0;
+    uint32_t count = 0;
+
+    VM_Boot();
+    VM_RunUntil(LOOP_START);
+    result->latency_min_us = 1e9;
+
+    /* Latency, one frame at a time */
+    for (uint32_t i = 0; i < LOOP_SINGLES; i++) {
+        uint32_t len = build_commands(i, &cmds);
+        VM_Time sent_end;
+        double us;
+
+        start = VM_Now();
+        sent_end = start + wire_time(len);
+        LINK_Send((uint8_t)i, &cmds);
+        VM_RunUntil(start + LOOP_SINGLE_GAP);
+        if (LINK_PollReplies(replies, 1) != 1) {
+            continue;
+        }
+        check_reply(&replies[0], (uint8_t)i);
+        us = (double)(replies[0].t - sent_end - wire_time(LOOP_REPLY_BYTES)) * 1e6 / VM_CPU_HZ;
+        result->latency_sum_us += us;
+        if (us < result->latency_min_us) {
+            result->latency_min_us = us;
+        }
+        if (us > result->latency_max_us) {
+            result->latency_max_us = us;
+        }
+    }
+
+    /* Throughput, the whole burst queued on the line at once */
+    start = VM_Now();
+    for (uint32_t i = 0; i < LOOP_BURST; i++) {
+        result->frame_bytes = build_commands(i, &cmds);
+        LINK_Send((uint8_t)i, &cmds);
+    }
+    while (count < LOOP_BURST && VM_Now() < start + LOOP_TIMEOUT) {
+        uint32_t n;
+
+        VM_RunFor(VM_MS(1));
+        n = LINK_PollReplies(&replies[count], LOOP_BURST - count);
+        for (uint32_t i = 0; i < n; i++) {
+            check_reply(&replies[count + i], (uint8_t)(count + i));
+            last = replies[count + i].t;
+        }
+        count += n;
+    }
+    if (count != 0) {
+        result->frames_per_s = count * (double)VM_CPU_HZ / (double)(last - start);
+    }
+    result->line_frames_per_s = VM_Config.uart_baud / 10.0 / result->frame_bytes;
+    result->uart_rx_overflows = VM_GetStats()->uart_rx_overflows;
+
+    /* Lap, then frames that must all get through again */
+    stall = LOOP_LAP_STALL;
+    for (uint32_t i = 0; i < LOOP_LAP_FRAMES; i++) {
+        build_commands(i, &cmds);
+        LINK_Send((uint8_t)(0x40 + i), &cmds);
+    }
+    VM_RunFor(LOOP_LAP_STALL + VM_MS(10));
+    result->lap_replies = LINK_PollReplies(replies, LOOP_BURST);
+    for (uint32_t i = 0; i < LOOP_AFTER_LAP; i++) {
+        build_commands(i, &cmds);
+        LINK_Send((uint8_t)(0x80 + i), &cmds);
+        VM_RunFor(LOOP_SINGLE_GAP);
+        if (LINK_PollReplies(replies, 1) == 1 && replies[0].seq == 0x80 + i &&
+            replies[0].status == UCMD_REPLY_OK) {
+            result->after_lap_ok++;
+        }
+    }
+    result->link = *UCMD_GetStats();
+    return 0;
+}
+
+int main(void)
+{
+    LOOP_ResultTypeDef* r = mmap(NULL, sizeof(*r), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    uint32_t expected = LOOP_SINGLES + LOOP_BURST;
+    int failed = 0;
+
+    if (r == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(r, 0, sizeof(*r));
+    result = r;
+    if (VM_RunIsolated(run_link, NULL) != 0) {
+        printf("FAIL device run failed\n");
+        return 1;
+    }
+
+    printf("latency   %u frames  min %.1f us  mean %.1f us  max %.1f us (reply after the last command byte)\n",
+           LOOP_SINGLES, r->latency_min_us, r->latency_sum_us / LOOP_SINGLES, r->latency_max_us);
+    printf("burst     %u frames of %u bytes  %.1f frames/s, line limit %.1f frames/s at %u baud\n",
+           LOOP_BURST, r->frame_bytes, r->frames_per_s, r->line_frames_per_s, VM_Config.uart_baud);
+    printf("lap       %u frames in a %.0f ms stall: %u laps, %u answered; %u of %u after it answered\n",
+           LOOP_LAP_FRAMES, (double)LOOP_LAP_STALL * 1000.0 / VM_CPU_HZ, r->link.rx_lapped, r->lap_replies,
+           r->after_lap_ok, LOOP_AFTER_LAP);
+    printf("link      ok %u bad %u busy %u rx bytes %u rx overruns %u fifo overflows %u replies dropped %u\n",
+           r->link.frames_ok, r->link.frames_bad, r->link.frames_busy, r->link.bytes_rx,
+           r->link.rx_overruns, r->uart_rx_overflows, r->link.replies_dropped);
+
+    if (r->replies != expected || r->ok != expected || r->in_order != expected) {
+        printf("FAIL %u of %u frames answered, %u OK, %u in order\n", r->replies, expected, r->ok, r->in_order);
+        failed++;
+    }
+    if (r->latency_max_us > LOOP_MAX_LATENCY_US) {
+        printf("FAIL latency %.1f us over %.1f us\n", r->latency_max_us, LOOP_MAX_LATENCY_US);
+        failed++;
+    }
+    if (r->frames_per_s < LOOP_MIN_LINE_SHARE * r->line_frames_per_s) {
+        printf("FAIL burst below %.0f%% of the line rate\n", LOOP_MIN_LINE_SHARE * 100);
+        failed++;
+    }
+    if (r->link.rx_overruns != 0 || r->uart_rx_overflows != 0) {
+        printf("FAIL receive data lost\n");
+        failed++;
+    }
+    if (r->link.rx_lapped != 1 || r->lap_replies != 0 || r->after_lap_ok != LOOP_AFTER_LAP ||
+        r->link.frames_bad != 0 || r->link.frames_ok != expected + LOOP_AFTER_LAP) {
+        printf("FAIL ring lap: %u laps, %u overwritten frames answered, %u bad\n", r->link.rx_lapped,
+               r->lap_replies, r->link.frames_bad);
+        failed++;
+    }
+    if (r->link.replies_dropped != 0) {
+        printf("FAIL %u replies dropped\n", r->link.replies_dropped);
+        failed++;
+    }
+    printf("%s UART loopback\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
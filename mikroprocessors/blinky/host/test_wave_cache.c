@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "vmcu.h"
+#include "wave.h"
+#include "leds.h"
+#include "MDR32FxQI_adc.h"
+
+/* Wave frame cache of leds.c under repeated and changing wave parameters.
+ * Every LED_Render is watched (-Wl,--wrap=LED_Render) on an engine owned
+ * by the test: from the wave position it rendered, a model of the cache
+ * says whether the frame must be a hit (position rendered before since
+ * the last invalidation), a miss, or bypassed (cycle over the budget);
+ * LED_GetWaveCacheStats must count exactly that. Phases:
+ *   - boot defaults, period 1500 speed 1: 1500-frame cycle
+ *   - speed 4: the cycle shrinks to 375 frames, cache rebuilt
+ *   - period 7000: 1750 frames, over LED_WAVE_CACHE_FRAMES, bypassed
+ *   - period 1500 again: rebuilt, hits after the first 375 ms
+ * The output repeats every WAVE_TEST_PERIOD (wave cycle and the 100-step
+ * PWM pattern), so the LED pins over a stretch played from the cache
+ * must match, shifted by one repeat, the stretch that filled it. */
+
+#define WAVE_TEST_SETUP_AT  VM_MS(10)       /* before the ADC's first block */
+#define WAVE_TEST_PERIOD    VM_MS(1500)     /* lcm(cycle ms, LED_PWM_STEPS) */
+#define WAVE_TEST_SETTLE    VM_MS(10)       /* after a change, before a window */
+#define WAVE_TEST_SLIP      VM_MS(1)        /* one tick, see compare_output */
+
+typedef struct {
+    const char* name;
+    uint32_t pwm_period;
+    uint32_t wave_speed;
+    VM_Time length;
+    uint8_t compare;                        /* check the output repeats */
+} WAVE_TEST_PhaseTypeDef;
+
+typedef struct {
+    uint32_t cycle_frames;
+    uint32_t renders;                       /* wave frames rendered */
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t bypassed;
+    uint32_t wrong;                         /* counted other than the model */
+    uint32_t edges;
+    uint32_t edge_mismatches;
+    VM_Time shift;                          /* output repeats after */
+} WAVE_TEST_ResultTypeDef;
+
+static const WAVE_TEST_PhaseTypeDef phases[] = {
+    { "defaults",    1500, 1, 2 * WAVE_TEST_PERIOD + WAVE_TEST_SETTLE, 1 },
+    { "speed 4",     1500, 4, 2 * WAVE_TEST_PERIOD + WAVE_TEST_SETTLE, 1 },
+    { "period 7000", 7000, 4, VM_MS(1000),                             0 },
+    { "period 1500", 1500, 4, 2 * WAVE_TEST_PERIOD + WAVE_TEST_SETTLE, 1 },
+};
+
+#define WAVE_TEST_PHASES    (sizeof(phases) / sizeof(phases[0]))
+
+static WAVE_TEST_ResultTypeDef* results;
+static LED_EngineTypeDef engine;
+static uint32_t model_valid[(LED_WAVE_CACHE_FRAMES + 31) / 32];
+static uint32_t model_seq;
+static uint32_t phase;
+static uint8_t watching;                    /* engine is the test's */
+
+void __real_LED_Render(void);
+void __real_LED_StartPWMWave(void);
+
+static void model_reset(void)
+{
+    memset(model_valid, 0, sizeof(model_valid));
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b != 0) {
+        uint32_t t = a % b;
+
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* A restart drops the cache */
+void __wrap_LED_StartPWMWave(void)
+{
+    model_reset();
+    __real_LED_StartPWMWave();
+}
+
+void __wrap_LED_Render(void)
+{
+    LED_WaveCacheStatsTypeDef before = *LED_GetWaveCacheStats();
+    const LED_WaveCacheStatsTypeDef* after;
+    WAVE_TEST_ResultTypeDef* r = &results[phase];
+    uint32_t step;
+    uint32_t index;
+    uint32_t bit;
+
+    __real_LED_Render();
+    after = LED_GetWaveCacheStats();
+    if (!watching ||
+        after->hits + after->misses + after->bypassed == before.hits + before.misses + before.bypassed) {
+        return;                             /* no wave frame this time */
+    }
+
+    /* A new config is taken at the frame boundary, before the lookup */
+    if (engine.config_seq != model_seq) {
+        model_seq = engine.config_seq;
+        model_reset();
+    }
+    step = gcd(engine.config.pwm_period, engine.config.wave_speed % engine.config.pwm_period);
+    index = engine.pwm_counter / step;
+    bit = 1UL << (index % 32);
+    r->renders++;
+    r->cycle_frames = after->cycle_frames;
+
+    if (engine.config.pwm_period / step > LED_WAVE_CACHE_FRAMES) {
+        r->bypassed++;
+        r->wrong += (after->bypassed != before.bypassed + 1);
+    } else if (model_valid[index / 32] & bit) {
+        r->hits++;
+        r->wrong += (after->hits != before.hits + 1);
+    } else {
+        model_valid[index / 32] |= bit;
+        r->misses++;
+        r->wrong += (after->misses != before.misses + 1);
+    }
+}
+
+/* LED pins over [from, from + WAVE_TEST_PERIOD) against one period later:
+ * the same edges in the same order. TIMER1 places the edges and SysTick
+ * moves the wave, the two drift apart by about 1 us per TIMER1 wakeup, so
+ * the repeat is taken from the first edge and each edge may be one tick
+ * (WAVE_TEST_SLIP) off it. A wrong frame moves edges by its duty error
+ * in ticks on every PWM period it is shown. */
+static void compare_output(VM_Time from, WAVE_TEST_ResultTypeDef* r)
+{
+    const WAVE_EdgeTypeDef* edges = WAVE_GetEdges();
+    uint32_t count = WAVE_GetEdgeCount();
+    uint32_t a = 0;
+    uint32_t b = 0;
+    VM_Time shift;
+
+    while (a < count && edges[a].t < from) {
+        a++;
+    }
+    while (b < count && edges[b].t < from + WAVE_TEST_PERIOD - WAVE_TEST_SLIP) {
+        b++;
+    }
+    if (a >= count || b >= count) {
+        return;
+    }
+    shift = edges[b].t - edges[a].t;
+    r->shift = shift;
+    if (shift + WAVE_TEST_SLIP < WAVE_TEST_PERIOD || shift > WAVE_TEST_PERIOD + WAVE_TEST_SLIP) {
+        r->edge_mismatches++;
+    }
+    for (; a < count && edges[a].t < from + WAVE_TEST_PERIOD; a++, b++) {
+        r->edges++;
+        if (b >= count || edges[b].t + WAVE_TEST_SLIP < edges[a].t + shift ||
+            edges[b].t > edges[a].t + shift + WAVE_TEST_SLIP || edges[b].probe != edges[a].probe ||
+            edges[b].level != edges[a].level) {
+            r->edge_mismatches++;
+        }
+    }
+    if (b < count && edges[b].t + WAVE_TEST_SLIP < from + WAVE_TEST_PERIOD + shift) {
+        r->edge_mismatches++;               /* edges the first period lacks */
+    }
+}
+
+static int run(void* arg)
+{
+    VM_Time at;
+
+    VM_Boot();
+    LED_EngineInit(&engine);
+    LED_SetEngine(&engine);
+    model_seq = engine.config_seq;
+    watching = 1;
+    WAVE_Init(WAVE_LedProbes, WAVE_LedProbeCount);
+
+    VM_RunUntil(WAVE_TEST_SETUP_AT);
+    ADC1_Cmd(DISABLE);                      /* no ambient dimming */
+    at = VM_Now();
+
+    for (phase = 0; phase < WAVE_TEST_PHASES; phase++) {
+        const WAVE_TEST_PhaseTypeDef* p = &phases[phase];
+
+        if (engine.config.pwm_period != p->pwm_period) {
+            LED_SetPWMPeriod(p->pwm_period);
+        }
+        if (engine.config.wave_speed != p->wave_speed) {
+            LED_SetWaveSpeed(p->wave_speed);
+        }
+        VM_RunUntil(at + p->length);
+        if (p->compare) {
+            compare_output(at + WAVE_TEST_SETTLE, &results[phase]);
+        }
+        at += p->length;
+    }
+    return 0;
+}
+
+static int boot_once(void* arg)
+{
+    VM_Boot();
+    VM_RunUntil(VM_MS(60));
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    results = mmap(NULL, WAVE_TEST_PHASES * sizeof(*results), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                   -1, 0);
+    if (results == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(results, 0, WAVE_TEST_PHASES * sizeof(*results));
+
+    /* First boot formats the parameter store */
+    if (VM_RunIsolated(boot_once, NULL) != 0 || VM_RunIsolated(run, NULL) != 0) {
+        printf("FAIL device run failed\n");
+        return 1;
+    }
+
+    printf("phase         cycle  frames    hits  misses  bypassed  edges compared  repeat ms\n");
+    for (uint32_t i = 0; i < WAVE_TEST_PHASES; i++) {
+        const WAVE_TEST_PhaseTypeDef* p = &phases[i];
+        const WAVE_TEST_ResultTypeDef* r = &results[i];
+        uint32_t cycle = p->pwm_period / gcd(p->pwm_period, p->wave_speed % p->pwm_period);
+
+        printf("%-12s %6u  %6u  %6u  %6u  %8u  %14u  %9.3f\n", p->name, r->cycle_frames, r->renders, r->hits,
+               r->misses, r->bypassed, r->edges, (double)r->shift * 1000.0 / VM_CPU_HZ);
+        if (r->wrong != 0) {
+            printf("FAIL %s: %u frames counted other than hit/miss/bypass model\n", p->name, r->wrong);
+            failed++;
+        }
+        if (r->cycle_frames != cycle) {
+            printf("FAIL %s: cycle of %u frames, expected %u\n", p->name, r->cycle_frames, cycle);
+            failed++;
+        }
+        if (cycle > LED_WAVE_CACHE_FRAMES ? (r->hits + r->misses != 0 || r->bypassed != r->renders)
+                                          : (r->misses == 0 || r->misses > cycle || r->hits < r->misses)) {
+            printf("FAIL %s: %u hits, %u misses, %u bypassed\n", p->name, r->hits, r->misses, r->bypassed);
+            failed++;
+        }
+        if (p->compare && (r->edges == 0 || r->edge_mismatches != 0)) {
+            printf("FAIL %s: %u of %u edges differ from the period before\n", p->name, r->edge_mismatches,
+                   r->edges);
+            failed++;
+        }
+    }
+    printf("%s wave cache hits, misses and output\n", failed ? "FAIL" : "ok  ");
+    return failed ? 1 : 0;
+}
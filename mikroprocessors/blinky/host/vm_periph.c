@@ -0,0 +1,763 @@
+#include <math.h>
+#include <string.h>
+#include "vmcu.h"
+#include "vmcu_int.h"
+#include "MDR32FxQI_dma.h"
+#include "MDR32FxQI_uart.h"
+#include "MDR32FxQI_adc.h"
+#include "MDR32FxQI_bkp.h"
+#include "MDR32FxQI_rst_clk.h"
+
+/* Peripheral models behind the SPL calls the firmware makes: the PL230
+ * DMA controller, UART2, ADC1, the backup domain RTC and the clock
+ * sources. Firmware reaches these only through the SPL (and the DMA
+ * control table), so the SPL functions below change model state directly
+ * and sync_out publishes it to the registers. */
+
+static VM_Time never(void)
+{
+    return VM_NEVER;
+}
+
+static void nothing(void)
+{
+}
+
+/* Clocks ------------------------------------------------------------------*/
+
+static struct {
+    uint8_t hsi_on;
+    VM_Time hsi_ready;
+    uint8_t lse_on;
+    uint8_t lsi_on;
+} clocks;
+
+uint32_t vm_hsi_running(void)
+{
+    return clocks.hsi_on && vm_now >= clocks.hsi_ready;
+}
+
+void RST_CLK_LSEconfig(RST_CLK_LSE_Mode RST_CLK_LSE)
+{
+    clocks.lse_on = (RST_CLK_LSE != RST_CLK_LSE_OFF) && !VM_Config.lse_fails;
+}
+
+ErrorStatus RST_CLK_LSEstatus(void)
+{
+    return clocks.lse_on ? SUCCESS : ERROR;
+}
+
+void RST_CLK_LSIcmd(FunctionalState NewState)
+{
+    clocks.lsi_on = (NewState != DISABLE);
+}
+
+ErrorStatus RST_CLK_LSIstatus(void)
+{
+    return clocks.lsi_on ? SUCCESS : ERROR;
+}
+
+void RST_CLK_HSIcmd(FunctionalState NewState)
+{
+    vm_call_begin();
+    if (NewState == DISABLE) {
+        clocks.hsi_on = 0;
+    } else if (!clocks.hsi_on) {
+        clocks.hsi_on = 1;
+        clocks.hsi_ready = vm_now + VM_US(VM_Config.hsi_start_us);
+    }
+    vm_call_end();
+}
+
+/**
+  * @brief  Waits for the HSI to start, VM_Config.hsi_start_us after enable
+  */
+ErrorStatus RST_CLK_HSIstatus(void)
+{
+    vm_call_begin();
+    vm_wait_until(clocks.hsi_ready);
+    vm_call_end();
+    return clocks.hsi_on ? SUCCESS : ERROR;
+}
+
+void RST_CLK_CPUclkSelection(uint32_t CPU_CLK)
+{
+    MDR_RST_CLK->CPU_CLOCK = (MDR_RST_CLK->CPU_CLOCK & ~0x300UL) | CPU_CLK;
+}
+
+void RST_CLK_GetClocksFreq(RST_CLK_FreqTypeDef* RST_CLK_Clocks)
+{
+    memset(RST_CLK_Clocks, 0, sizeof(*RST_CLK_Clocks));
+    RST_CLK_Clocks->CPU_CLK_Frequency = (uint32_t)VM_CPU_HZ;
+    RST_CLK_Clocks->ADC_CLK_Frequency = (uint32_t)VM_CPU_HZ;
+}
+
+/* DMA ---------------------------------------------------------------------*/
+
+/* Channel control table, the real SPL keeps it in RAM the same way */
+static DMA_CtrlDataTypeDef dma_table[2 * DMA_Channels_Number] __attribute__((aligned(1024)));
+
+static struct {
+    uint32_t enabled;
+    uint32_t alternate;
+} dma;
+
+static void dma_reset(void)
+{
+    memset(&dma, 0, sizeof(dma));
+    memset(dma_table, 0, sizeof(dma_table));
+}
+
+static void dma_sync_out(void)
+{
+    MDR_DMA_TypeDef* regs = MDR_DMA;
+
+    regs->CTRL_BASE_PTR = (uint32_t)(uintptr_t)dma_table;
+    *(volatile uint32_t*)&regs->ALT_CTRL_BASE_PTR = (uint32_t)(uintptr_t)&dma_table[DMA_Channels_Number];
+    regs->CHNL_ENABLE_SET = dma.enabled;
+    regs->CHNL_PRI_ALT_SET = dma.alternate;
+}
+
+const VM_DeviceTypeDef VM_DmaDevice = { dma_reset, nothing, dma_sync_out, never, NULL };
+
+/**
+  * @brief  One request from a peripheral: one item moved, PL230 rules
+  * @note   A structure reading cycle_ctrl 0 (stop) ends the channel; the
+  *         last item of a cycle sets cycle_ctrl to 0, raises the DMA
+  *         interrupt and, in ping-pong mode, switches to the other one
+  * @retval 1 if an item was moved, 0 if the channel is off or stopped
+  */
+uint32_t vm_dma_request(uint32_t channel)
+{
+    uint32_t bit = 1UL << channel;
+    DMA_CtrlDataTypeDef* s;
+    uint32_t ctrl, mode, size, src_inc, dst_inc, n;
+    uintptr_t src, dst;
+
+    if (!(dma.enabled & bit)) {
+        return 0;
+    }
+    s = &dma_table[channel + ((dma.alternate & bit) ? DMA_Channels_Number : 0)];
+    ctrl = s->DMA_Control;
+    mode = ctrl & DMA_CTRL_CYCLE_Msk;
+    if (mode == DMA_Mode_Stop) {
+        dma.enabled &= ~bit;
+        return 0;
+    }
+
+    size = (ctrl >> DMA_CTRL_DST_SIZE_Pos) & 3U;
+    src_inc = (ctrl >> DMA_CTRL_SRC_INC_Pos) & 3U;
+    dst_inc = (ctrl >> DMA_CTRL_DST_INC_Pos) & 3U;
+    n = (ctrl & DMA_CTRL_N_MINUS_1_Msk) >> DMA_CTRL_N_MINUS_1_Pos;
+    src = s->DMA_SourceEndAddr - (src_inc == DMA_INC_NONE ? 0 : (n << src_inc));
+    dst = s->DMA_DestEndAddr - (dst_inc == DMA_INC_NONE ? 0 : (n << dst_inc));
+    memcpy((void*)dst, (const void*)src, 1UL << size);
+
+    if (n == 0) {
+        s->DMA_Control = ctrl & ~(DMA_CTRL_CYCLE_Msk | DMA_CTRL_N_MINUS_1_Msk);
+        vm_irq_pend(DMA_IRQn);
+        if (mode == DMA_Mode_PingPong) {
+            dma.alternate ^= bit;
+        } else {
+            dma.enabled &= ~bit;
+        }
+    } else {
+        s->DMA_Control = (ctrl & ~DMA_CTRL_N_MINUS_1_Msk) | ((n - 1) << DMA_CTRL_N_MINUS_1_Pos);
+    }
+    return 1;
+}
+
+void DMA_DeInit(void)
+{
+    dma_reset();
+}
+
+/**
+  * @brief  Writes the control table entry of a channel
+  */
+void DMA_CtrlInit(uint8_t DMA_Channel, uint8_t DMA_CtrlDataType, DMA_CtrlDataInitTypeDef* DMA_CtrlStruct)
+{
+    DMA_CtrlDataTypeDef* s = &dma_table[DMA_Channel + (DMA_CtrlDataType ? DMA_Channels_Number : 0)];
+    uint32_t last = DMA_CtrlStruct->DMA_CycleSize - 1;
+    uint32_t src_inc = DMA_CtrlStruct->DMA_SourceIncSize >> DMA_CTRL_SRC_INC_Pos;
+    uint32_t dst_inc = DMA_CtrlStruct->DMA_DestIncSize >> DMA_CTRL_DST_INC_Pos;
+
+    vm_call_begin();
+    s->DMA_SourceEndAddr = DMA_CtrlStruct->DMA_SourceBaseAddr + (src_inc == DMA_INC_NONE ? 0 : (last << src_inc));
+    s->DMA_DestEndAddr = DMA_CtrlStruct->DMA_DestBaseAddr + (dst_inc == DMA_INC_NONE ? 0 : (last << dst_inc));
+    s->DMA_Control = DMA_CtrlStruct->DMA_DestIncSize | DMA_CtrlStruct->DMA_SourceIncSize |
+                     DMA_CtrlStruct->DMA_MemoryDataSize | DMA_CtrlStruct->DMA_NumContinuous |
+                     DMA_CtrlStruct->DMA_SourceProtCtrl | DMA_CtrlStruct->DMA_DestProtCtrl |
+                     (last << DMA_CTRL_N_MINUS_1_Pos) | DMA_CtrlStruct->DMA_Mode;
+    vm_call_end();
+}
+
+void DMA_Init(uint8_t DMA_Channel, DMA_ChannelInitTypeDef* DMA_InitStruct)
+{
+    uint32_t bit = 1UL << DMA_Channel;
+
+    DMA_CtrlInit(DMA_Channel, DMA_CTRL_DATA_PRIMARY, DMA_InitStruct->DMA_PriCtrlData);
+    if (DMA_InitStruct->DMA_AltCtrlData != NULL) {
+        DMA_CtrlInit(DMA_Channel, DMA_CTRL_DATA_ALTERNATE, DMA_InitStruct->DMA_AltCtrlData);
+    }
+    vm_call_begin();
+    if (DMA_InitStruct->DMA_SelectDataStructure == DMA_CTRL_DATA_ALTERNATE) {
+        dma.alternate |= bit;
+    } else {
+        dma.alternate &= ~bit;
+    }
+    vm_call_end();
+}
+
+void DMA_Cmd(uint8_t DMA_Channel, FunctionalState NewState)
+{
+    vm_call_begin();
+    if (NewState != DISABLE) {
+        dma.enabled |= 1UL << DMA_Channel;
+    } else {
+        dma.enabled &= ~(1UL << DMA_Channel);
+    }
+    vm_call_end();
+}
+
+FlagStatus DMA_GetFlagStatus(uint8_t DMA_Channel, uint8_t DMA_Flag)
+{
+    uint32_t bit = 1UL << DMA_Channel;
+
+    vm_call_begin();
+    switch (DMA_Flag) {
+    case DMA_FLAG_CHNL_ENA:
+        return (dma.enabled & bit) ? SET : RESET;
+    case DMA_FLAG_CHNL_ALT:
+        return (dma.alternate & bit) ? SET : RESET;
+    default:
+        return RESET;
+    }
+}
+
+/**
+  * @brief  Items left in a structure, n_minus_1 + 1 as in the real SPL
+  */
+uint32_t DMA_GetCurrTransferCounter(uint8_t DMA_Channel, uint8_t DMA_CtrlData)
+{
+    const DMA_CtrlDataTypeDef* s = &dma_table[DMA_Channel + (DMA_CtrlData ? DMA_Channels_Number : 0)];
+
+    vm_call_begin();
+    return ((s->DMA_Control & DMA_CTRL_N_MINUS_1_Msk) >> DMA_CTRL_N_MINUS_1_Pos) + 1;
+}
+
+/* UART2 -------------------------------------------------------------------*/
+
+#define VM_UART_FIFO        16
+#define VM_UART_FRAME_BITS  10          /* start, 8 data, stop */
+#define VM_UART_QUEUE       4096        /* bytes on the line towards the chip */
+#define VM_UART_LOG         4096        /* bytes sent by the chip, not yet read */
+
+typedef struct {
+    VM_Time t;
+    uint8_t byte;
+} VM_UartByteTypeDef;
+
+static struct {
+    uint8_t enabled;
+    uint8_t rx_dma;
+    /* Line towards the chip, arrival time of each byte */
+    VM_UartByteTypeDef line[VM_UART_QUEUE];
+    uint32_t line_head, line_count;
+    VM_Time line_start;                 /* start bit of a back-to-back run */
+    uint64_t line_bits;                 /* bits sent since line_start */
+    /* RX FIFO */
+    uint8_t rx[VM_UART_FIFO];
+    uint32_t rx_head, rx_count;
+    /* TX: end of each byte on the line, oldest not yet read by the test */
+    VM_UartByteTypeDef tx[VM_UART_LOG];
+    uint32_t tx_head, tx_count;
+    VM_Time tx_free;                    /* shift register idle from here */
+} uart;
+
+/* Line time of 'bits' at the test side baud rate, rounded up */
+static VM_Time uart_bits_time(uint64_t bits)
+{
+    return (bits * VM_CPU_HZ + VM_Config.uart_baud - 1) / VM_Config.uart_baud;
+}
+
+static void uart_reset(void)
+{
+    memset(&uart, 0, sizeof(uart));
+}
+
+/* RX FIFO to the DMA while the UART requests it */
+static void uart_service(void)
+{
+    while (uart.rx_count != 0 && uart.rx_dma) {
+        MDR_UART2->DR = uart.rx[uart.rx_head];
+        if (!vm_dma_request(DMA_Channel_UART2_RX)) {
+            break;
+        }
+        uart.rx_head = (uart.rx_head + 1) % VM_UART_FIFO;
+        uart.rx_count--;
+    }
+}
+
+/* Bytes the transmitter still holds, FIFO plus shift register */
+static uint32_t uart_tx_pending(void)
+{
+    uint32_t pending = 0;
+
+    for (uint32_t i = 0; i < uart.tx_count; i++) {
+        if (uart.tx[(uart.tx_head + uart.tx_count - 1 - i) % VM_UART_LOG].t <= vm_now) {
+            break;
+        }
+        pending++;
+    }
+    return pending;
+}
+
+static void uart_sync_out(void)
+{
+    uint32_t pending = uart_tx_pending();
+    uint32_t fr = 0;
+
+    if (uart.rx_count == 0) {
+        fr |= UART_FLAG_RXFE;
+    }
+    if (uart.rx_count == VM_UART_FIFO) {
+        fr |= UART_FLAG_RXFF;
+    }
+    if (pending == 0) {
+        fr |= UART_FLAG_TXFE;
+    } else {
+        fr |= UART_FLAG_BUSY;
+    }
+    if (pending > VM_UART_FIFO) {
+        fr |= UART_FLAG_TXFF;
+    }
+    MDR_UART2->FR = fr;
+}
+
+static VM_Time uart_next_event(void)
+{
+    return uart.line_count ? uart.line[uart.line_head].t : VM_NEVER;
+}
+
+/* Byte fully received: into the FIFO, lost if HSI is off or FIFO full */
+static void uart_fire(VM_Time t)
+{
+    uint8_t byte = uart.line[uart.line_head].byte;
+
+    (void)t;
+    uart.line_head = (uart.line_head + 1) % VM_UART_QUEUE;
+    uart.line_count--;
+
+    if (!vm_hsi_running()) {
+        vm_stats.uart_rx_asleep++;
+    } else if (!uart.enabled) {
+        return;
+    } else if (uart.rx_count == VM_UART_FIFO) {
+        vm_stats.uart_rx_overflows++;
+    } else {
+        uart.rx[(uart.rx_head + uart.rx_count) % VM_UART_FIFO] = byte;
+        uart.rx_count++;
+    }
+    uart_service();
+}
+
+/* A re-armed DMA channel takes what waited in the FIFO */
+const VM_DeviceTypeDef VM_UartDevice = { uart_reset, uart_service, uart_sync_out, uart_next_event, uart_fire };
+
+/**
+  * @brief  Puts bytes on the line towards UART2, back to back from now
+  *         or after the bytes still being sent
+  */
+void VM_UartSend(const uint8_t* data, uint32_t len)
+{
+    VM_Time end = uart.line_start + uart_bits_time(uart.line_bits);
+
+    if (end <= vm_now) {
+        uart.line_start = vm_now;
+        uart.line_bits = 0;
+    }
+    for (uint32_t i = 0; i < len && uart.line_count < VM_UART_QUEUE; i++) {
+        VM_UartByteTypeDef* b = &uart.line[(uart.line_head + uart.line_count) % VM_UART_QUEUE];
+
+        uart.line_bits += VM_UART_FRAME_BITS;
+        b->t = uart.line_start + uart_bits_time(uart.line_bits);
+        b->byte = data[i];
+        uart.line_count++;
+    }
+}
+
+/**
+  * @brief  Takes the bytes UART2 has finished sending
+  * @param  times: stop bit end of each byte, may be NULL
+  * @retval Number of bytes stored
+  */
+uint32_t VM_UartReceive(uint8_t* data, uint32_t max, VM_Time* times)
+{
+    uint32_t n = 0;
+
+    while (n < max && uart.tx_count != 0 && uart.tx[uart.tx_head].t <= vm_now) {
+        if (times != NULL) {
+            times[n] = uart.tx[uart.tx_head].t;
+        }
+        data[n++] = uart.tx[uart.tx_head].byte;
+        uart.tx_head = (uart.tx_head + 1) % VM_UART_LOG;
+        uart.tx_count--;
+    }
+    return n;
+}
+
+ErrorStatus UART_Init(MDR_UART_TypeDef* UARTx, UART_InitTypeDef* UART_InitStruct)
+{
+    (void)UARTx;
+    UARTx->CR = UART_InitStruct->UART_HardwareFlowControl;
+    UARTx->LCR_H = UART_InitStruct->UART_WordLength | UART_InitStruct->UART_FIFOMode;
+    return SUCCESS;
+}
+
+void UART_StructInit(UART_InitTypeDef* UART_InitStruct)
+{
+    UART_InitStruct->UART_BaudRate = 9600;
+    UART_InitStruct->UART_WordLength = UART_WordLength8b;
+    UART_InitStruct->UART_StopBits = UART_StopBits1;
+    UART_InitStruct->UART_Parity = UART_Parity_No;
+    UART_InitStruct->UART_FIFOMode = UART_FIFO_ON;
+    UART_InitStruct->UART_HardwareFlowControl = UART_HardwareFlowControl_RXE | UART_HardwareFlowControl_TXE;
+}
+
+void UART_Cmd(MDR_UART_TypeDef* UARTx, FunctionalState NewState)
+{
+    vm_call_begin();
+    if (UARTx == MDR_UART2) {
+        uart.enabled = (NewState != DISABLE);
+    }
+    vm_call_end();
+}
+
+void UART_BRGInit(MDR_UART_TypeDef* UARTx, uint32_t UART_BRG)
+{
+    (void)UARTx;
+    (void)UART_BRG;
+}
+
+void UART_DMACmd(MDR_UART_TypeDef* UARTx, uint32_t UART_DMAReq, FunctionalState NewState)
+{
+    vm_call_begin();
+    if (UARTx == MDR_UART2 && (UART_DMAReq & UART_DMA_RXE)) {
+        uart.rx_dma = (NewState != DISABLE);
+    }
+    vm_call_end();
+}
+
+/**
+  * @brief  Queues a byte for sending, lost if the TX FIFO is full
+  */
+void UART_SendData(MDR_UART_TypeDef* UARTx, uint16_t Data)
+{
+    VM_UartByteTypeDef* b;
+    VM_Time start;
+
+    vm_call_begin();
+    if (UARTx == MDR_UART2 && uart.enabled && uart_tx_pending() <= VM_UART_FIFO && uart.tx_count < VM_UART_LOG) {
+        start = (uart.tx_free > vm_now) ? uart.tx_free : vm_now;
+        uart.tx_free = start + uart_bits_time(VM_UART_FRAME_BITS);
+        b = &uart.tx[(uart.tx_head + uart.tx_count) % VM_UART_LOG];
+        b->t = uart.tx_free;
+        b->byte = (uint8_t)Data;
+        uart.tx_count++;
+    }
+    vm_call_end();
+}
+
+uint16_t UART_ReceiveData(MDR_UART_TypeDef* UARTx)
+{
+    uint16_t byte = 0;
+
+    vm_call_begin();
+    if (UARTx == MDR_UART2 && uart.rx_count != 0) {
+        byte = uart.rx[uart.rx_head];
+        uart.rx_head = (uart.rx_head + 1) % VM_UART_FIFO;
+        uart.rx_count--;
+    }
+    vm_call_end();
+    return byte;
+}
+
+/**
+  * @brief  FR flag of UART2
+  */
+FlagStatus UART_GetFlagStatus(MDR_UART_TypeDef* UARTx, uint32_t UART_Flag)
+{
+    vm_call_begin();
+    vm_call_end();
+    return (UARTx->FR & UART_Flag) ? SET : RESET;
+}
+
+/* ADC1 --------------------------------------------------------------------*/
+
+#define VM_ADC_CONVERSION_CLOCKS    28      /* ADC clocks per conversion */
+#define VM_ADC_DEFAULT_SAMPLE       0x800U  /* mid-scale without a source */
+
+static struct {
+    uint8_t on;
+    uint8_t cyclic;
+    uint8_t started;
+    uint32_t div;
+    VM_Time next;
+} adc;
+
+static void adc_reset(void)
+{
+    memset(&adc, 0, sizeof(adc));
+}
+
+static VM_Time adc_period(void)
+{
+    return (VM_Time)VM_ADC_CONVERSION_CLOCKS << adc.div;
+}
+
+static VM_Time adc_next_event(void)
+{
+    return (adc.on && adc.started) ? adc.next : VM_NEVER;
+}
+
+/* Conversion done: result register, then a DMA request */
+static void adc_fire(VM_Time t)
+{
+    uint16_t sample = VM_ADC_DEFAULT_SAMPLE;
+
+    adc.next = t + adc_period();
+    if (!adc.cyclic) {
+        adc.started = 0;
+    }
+    if (!vm_hsi_running()) {
+        return;
+    }
+    if (VM_Config.adc_source != NULL) {
+        sample = VM_Config.adc_source(t, VM_Config.adc_arg) & 0xFFFU;
+    }
+    MDR_ADC->ADC1_RESULT = sample;
+    vm_stats.adc_samples++;
+    if (!vm_dma_request(DMA_Channel_ADC1)) {
+        vm_stats.adc_dropped++;
+    }
+}
+
+const VM_DeviceTypeDef VM_AdcDevice = { adc_reset, nothing, nothing, adc_next_event, adc_fire };
+
+void ADC_DeInit(void)
+{
+    adc_reset();
+}
+
+void ADC_StructInit(ADC_InitTypeDef* ADC_InitStruct)
+{
+    memset(ADC_InitStruct, 0, sizeof(*ADC_InitStruct));
+}
+
+void ADC_Init(const ADC_InitTypeDef* ADC_InitStruct)
+{
+    (void)ADC_InitStruct;
+}
+
+void ADCx_StructInit(ADCx_InitTypeDef* ADCx_InitStruct)
+{
+    memset(ADCx_InitStruct, 0, sizeof(*ADCx_InitStruct));
+}
+
+void ADC1_Init(const ADCx_InitTypeDef* ADCx_InitStruct)
+{
+    adc.cyclic = (ADCx_InitStruct->ADC_SamplingMode == ADC_SAMPLING_MODE_CYCLIC_CONV);
+    adc.div = (ADCx_InitStruct->ADC_Prescaler >> 12) & 0xFU;
+    MDR_ADC->ADC1_CHSEL = 1UL << ADCx_InitStruct->ADC_ChannelNumber;
+}
+
+void ADC1_Cmd(FunctionalState NewState)
+{
+    vm_call_begin();
+    adc.on = (NewState != DISABLE);
+    vm_call_end();
+}
+
+void ADC1_Start(void)
+{
+    vm_call_begin();
+    adc.started = 1;
+    adc.next = vm_now + adc_period();
+    vm_call_end();
+}
+
+/* RTC ---------------------------------------------------------------------*/
+
+static struct {
+    uint32_t source;
+    uint32_t prescaler;
+    uint8_t enabled;
+    uint32_t ie;
+    uint8_t alrf;
+    uint8_t armed;
+    uint32_t alarm;
+    uint32_t count_base;
+    VM_Time t_base;
+} rtc;
+
+/* CPU cycles per RTC count, LSE with its frequency error */
+static long double rtc_cycles_per_count(void)
+{
+    long double hz = (rtc.source == BKP_RTC_LSEclk)
+                     ? (long double)LSE_Value * (1.0L + VM_Config.lse_ppm * 1e-6L)
+                     : (long double)LSI_Value;
+
+    return (long double)VM_CPU_HZ * rtc.prescaler / hz;
+}
+
+static uint8_t rtc_running(void)
+{
+    return rtc.enabled && rtc.prescaler != 0 &&
+           (rtc.source == BKP_RTC_LSEclk ? clocks.lse_on : clocks.lsi_on);
+}
+
+/* Counts since t_base, whole counts only */
+static uint64_t rtc_elapsed(VM_Time t)
+{
+    if (!rtc_running() || t < rtc.t_base) {
+        return 0;
+    }
+    return (uint64_t)floorl((long double)(t - rtc.t_base) / rtc_cycles_per_count());
+}
+
+static uint32_t rtc_count(void)
+{
+    return rtc.count_base + (uint32_t)rtc_elapsed(vm_now);
+}
+
+/* Restarts the count from its current value, e.g. before a rate change */
+static void rtc_rebase(void)
+{
+    rtc.count_base = rtc_count();
+    rtc.t_base = vm_now;
+}
+
+static void rtc_reset(void)
+{
+    memset(&rtc, 0, sizeof(rtc));
+    memset(&clocks, 0, sizeof(clocks));
+    clocks.hsi_on = 1;
+}
+
+/* The alarm handler clears ALRF with a read-modify-write of RTC_CS */
+static void rtc_sync_in(void)
+{
+    if (MDR_BKP->RTC_CS & BKP_RTC_CS_ALRF) {
+        MDR_BKP->RTC_CS &= ~BKP_RTC_CS_ALRF;
+        rtc.alrf = 0;
+    }
+    vm_irq_level(BACKUP_IRQn, rtc.alrf && (rtc.ie & BKP_RTC_IT_ALRF));
+}
+
+static void rtc_sync_out(void)
+{
+    MDR_BKP->RTC_CNT = rtc_count();
+    MDR_BKP->RTC_ALRM = rtc.alarm;
+    MDR_BKP->RTC_PRL = rtc.prescaler;
+    MDR_BKP->RTC_CS = rtc.ie;
+}
+
+/* Time the count reaches the alarm value */
+static VM_Time rtc_next_event(void)
+{
+    uint64_t counts;
+
+    if (!rtc.armed || !rtc_running()) {
+        return VM_NEVER;
+    }
+    counts = rtc_elapsed(vm_now) + (uint32_t)(rtc.alarm - rtc_count());
+    return rtc.t_base + (VM_Time)ceill(counts * rtc_cycles_per_count());
+}
+
+static void rtc_fire(VM_Time t)
+{
+    (void)t;
+    rtc.armed = 0;
+    rtc.alrf = 1;
+    vm_irq_level(BACKUP_IRQn, rtc.ie & BKP_RTC_IT_ALRF);
+}
+
+const VM_DeviceTypeDef VM_RtcDevice = { rtc_reset, rtc_sync_in, rtc_sync_out, rtc_next_event, rtc_fire };
+
+void BKP_RTCclkSource(uint32_t RTC_CLK)
+{
+    vm_call_begin();
+    rtc_rebase();
+    rtc.source = RTC_CLK;
+    vm_call_end();
+}
+
+void BKP_RTC_Enable(FunctionalState NewState)
+{
+    vm_call_begin();
+    rtc_rebase();
+    rtc.enabled = (NewState != DISABLE);
+    vm_call_end();
+}
+
+void BKP_RTC_Reset(FunctionalState NewState)
+{
+    if (NewState != DISABLE) {
+        rtc_reset();
+    }
+}
+
+void BKP_RTC_WaitForUpdate(void)
+{
+}
+
+void BKP_RTC_SetCounter(uint32_t CounterValue)
+{
+    vm_call_begin();
+    rtc.count_base = CounterValue;
+    rtc.t_base = vm_now;
+    vm_call_end();
+}
+
+uint32_t BKP_RTC_GetCounter(void)
+{
+    vm_call_begin();
+    return rtc_count();
+}
+
+void BKP_RTC_SetAlarm(uint32_t AlarmValue)
+{
+    vm_call_begin();
+    rtc.alarm = AlarmValue;
+    rtc.armed = 1;
+    vm_call_end();
+}
+
+void BKP_RTC_SetPrescaler(uint32_t PrescalerValue)
+{
+    vm_call_begin();
+    rtc_rebase();
+    rtc.prescaler = PrescalerValue;
+    vm_call_end();
+}
+
+void BKP_RTC_ITConfig(uint32_t RTC_IT, FunctionalState NewState)
+{
+    vm_call_begin();
+    if (NewState != DISABLE) {
+        rtc.ie |= RTC_IT;
+    } else {
+        rtc.ie &= ~RTC_IT;
+    }
+    vm_call_end();
+}
+
+FlagStatus BKP_RTC_GetFlagStatus(uint32_t RTC_FLAG)
+{
+    vm_call_begin();
+    if (RTC_FLAG == BKP_RTC_FLAG_ALRF) {
+        return rtc.alrf ? SET : RESET;
+    }
+    return RESET;
+}
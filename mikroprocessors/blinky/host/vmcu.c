@@ -0,0 +1,1027 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "vmcu.h"
+#include "vmcu_int.h"
+
+/* Core of the virtual MCU: memory map, virtual clock, NVIC and the CMSIS
+ * intrinsics, GPIO with bit-band aliases, DWT, SysTick and TIMER1..3.
+ * DMA, UART2, ADC1 and the RTC are in vm_periph.c. */
+
+VM_ConfigTypeDef VM_Config = {
+    .loop_cycles = 100,
+    .lse_ppm = 0,
+    .lse_fails = 0,
+    .hsi_start_us = 200,
+    .uart_baud = 115200,
+};
+
+VM_Time vm_now = 0;
+VM_StatsTypeDef vm_stats;
+
+/* Memory map --------------------------------------------------------------*/
+
+typedef struct {
+    uintptr_t base;
+    size_t size;
+    uint8_t shared;         /* flash: one copy for all isolated devices */
+} VM_RegionTypeDef;
+
+static const VM_RegionTypeDef regions[] = {
+    { 0x08000000UL, 0x00020000UL, 1 },  /* main flash, 128 KB */
+    { 0x40000000UL, 0x00100000UL, 0 },  /* peripherals */
+    { 0x42000000UL, 0x02000000UL, 0 },  /* peripheral bit-band alias */
+    { 0xE0000000UL, 0x00100000UL, 0 },  /* core peripherals */
+};
+
+#define VM_REGION_COUNT     (sizeof(regions) / sizeof(regions[0]))
+#define VM_FLASH_REGION     0
+
+static uint8_t mapped = 0;
+
+/* Firmware context ----------------------------------------------------------*/
+
+#define VM_STACK_SIZE       (256 * 1024)
+#define VM_NOP_LOOP_CYCLES  3
+
+extern int firmware_main(void);
+
+static ucontext_t host_ctx;
+static ucontext_t fw_ctx;
+static uint8_t fw_stack[VM_STACK_SIZE] __attribute__((aligned(16)));
+static uint8_t booted = 0;
+static uint8_t in_fw = 0;           // running on the firmware stack
+static uint8_t fw_returned = 0;
+static uint8_t slept = 0;           // __WFI since the last main loop pass
+static VM_Time deadline = 0;
+
+/* PRIMASK per host thread, stress tests call firmware code from several */
+static __thread uint32_t primask = 0;
+
+/* NVIC --------------------------------------------------------------------*/
+
+#define VM_IRQ_SLOTS        (16 + 32)
+#define VM_SLOT(irq)        ((int)(irq) + 16)
+#define VM_THREAD_PRIORITY  0x100U
+
+typedef void (*VM_HandlerTypeDef)(void);
+
+/* Handlers the firmware may or may not define */
+extern void SysTick_Handler(void) __attribute__((weak));
+extern void DMA_IRQHandler(void) __attribute__((weak));
+extern void Timer1_IRQHandler(void) __attribute__((weak));
+extern void Timer2_IRQHandler(void) __attribute__((weak));
+extern void Timer3_IRQHandler(void) __attribute__((weak));
+extern void BACKUP_IRQHandler(void) __attribute__((weak));
+
+static struct {
+    uint8_t enabled[VM_IRQ_SLOTS];
+    uint8_t pending[VM_IRQ_SLOTS];
+    uint8_t level[VM_IRQ_SLOTS];
+    uint32_t priority[VM_IRQ_SLOTS];
+    int active[VM_IRQ_SLOTS];
+    int depth;
+    uint64_t taken;
+} nvic;
+
+static VM_IrqStatsTypeDef irq_stats[VM_IRQ_SLOTS];
+static uint64_t irq_ns_total = 0;
+
+/* GPIO --------------------------------------------------------------------*/
+
+#define VM_PORT_PINS        16
+#define VM_PORT_PIN_MASK    0xFFFFUL
+
+static MDR_PORT_TypeDef* const ports[VM_PORT_COUNT] = {
+    MDR_PORTA, MDR_PORTB, MDR_PORTC, MDR_PORTD, MDR_PORTE, MDR_PORTF
+};
+
+typedef struct {
+    uint32_t latch;         /* output register */
+    uint32_t input;         /* levels driven from outside, 1 = pulled up */
+    uint32_t level;         /* pins as seen on the package */
+    uint32_t published;     /* RXTX as last written or taken */
+    uint32_t aliased;       /* RXTX alias words as last written or taken */
+} VM_PinStateTypeDef;
+
+static VM_PinStateTypeDef pins[VM_PORT_COUNT];
+static VM_PinHookTypeDef pin_hook = NULL;
+
+/* Access to a port's alias page since the last sync, see alias_fault */
+typedef enum {
+    VM_ALIAS_CLOSED = 0,    /* no access, words match the last sync */
+    VM_ALIAS_READ,          /* read, words refreshed from RXTX */
+    VM_ALIAS_OPEN,          /* stored to, page writable */
+} VM_AliasStateTypeDef;
+
+/* Alias stores caught by write faults since the last sync, pin masks */
+static volatile uint32_t alias_stored[VM_PORT_COUNT];
+static volatile uint8_t alias_state[VM_PORT_COUNT];
+
+/* DWT, SysTick, TIMER -------------------------------------------------------*/
+
+static uint32_t cyccnt_offset = 0;
+static uint32_t cyccnt_published = 0;
+
+typedef struct {
+    uint32_t load;
+    uint32_t ctrl;
+    VM_Time reload_at;      /* counter was LOAD here, running only */
+    uint32_t held;          /* counter value while stopped */
+    uint32_t published;
+    uint8_t running;
+} VM_SysTickTypeDef;
+
+static VM_SysTickTypeDef systick;
+
+typedef struct {
+    MDR_TIMER_TypeDef* regs;
+    IRQn_Type irq;
+    uint32_t cnt;           /* count at 'base' */
+    VM_Time base;           /* start of a prescaler period */
+    uint32_t arr;
+    uint32_t psg;
+    uint32_t ie;
+    uint32_t status;
+    uint32_t published_cnt;
+    uint32_t published_status;
+    uint8_t running;
+} VM_TimerTypeDef;
+
+static VM_TimerTypeDef timers[3] = {
+    { .regs = MDR_TIMER1, .irq = Timer1_IRQn },
+    { .regs = MDR_TIMER2, .irq = Timer2_IRQn },
+    { .regs = MDR_TIMER3, .irq = Timer3_IRQn },
+};
+
+#define VM_TIMER_COUNT      (sizeof(timers) / sizeof(timers[0]))
+
+static void dispatch(void);
+static volatile uint32_t* pin_alias(uint32_t port);
+
+static uintptr_t alias_page(uint32_t port)
+{
+    return (uintptr_t)pin_alias(port) & ~((uintptr_t)sysconf(_SC_PAGESIZE) - 1);
+}
+
+static void alias_protect(uint32_t port, int prot)
+{
+    mprotect((void*)alias_page(port), (size_t)sysconf(_SC_PAGESIZE), prot);
+}
+
+/* Alias words of the pins RXTX changed since the last sync and no alias
+ * store touched, so a read sees the RXTX store before it */
+static void alias_refresh(uint32_t port)
+{
+    const VM_PinStateTypeDef* s = &pins[port];
+    volatile uint32_t* alias = pin_alias(port);
+    uint32_t rxtx = ports[port]->RXTX;
+    uint32_t changed = (rxtx ^ s->published) & ~alias_stored[port] & VM_PORT_PIN_MASK;
+
+    for (uint32_t pin = 0; changed != 0; pin++, changed >>= 1) {
+        if ((changed & 1U) && alias[pin] == ((s->aliased >> pin) & 1U)) {
+            alias[pin] = (rxtx >> pin) & 1U;
+        }
+    }
+}
+
+/* Alias pages are closed at every sync. The first access of a call
+ * refreshes the words from RXTX and leaves the page readable; the first
+ * store (faulting again if it was the first access) notes its pin and
+ * opens the page until the next sync. */
+static void alias_fault(int sig, siginfo_t* info, void* context)
+{
+    uintptr_t addr = (uintptr_t)info->si_addr;
+    long page = sysconf(_SC_PAGESIZE);
+
+    for (uint32_t p = 0; p < VM_PORT_COUNT; p++) {
+        uintptr_t words = (uintptr_t)pin_alias(p);
+
+        if (addr < alias_page(p) || addr >= alias_page(p) + (uintptr_t)page) {
+            continue;
+        }
+        if (alias_state[p] == VM_ALIAS_CLOSED) {
+            alias_protect(p, PROT_READ | PROT_WRITE);
+            alias_refresh(p);
+            alias_protect(p, PROT_READ);
+            alias_state[p] = VM_ALIAS_READ;
+        } else {
+            if (addr >= words && addr < words + VM_PORT_PINS * sizeof(uint32_t)) {
+                alias_stored[p] |= 1UL << ((addr - words) / sizeof(uint32_t));
+            }
+            alias_protect(p, PROT_READ | PROT_WRITE);
+            alias_state[p] = VM_ALIAS_OPEN;
+        }
+        return;
+    }
+    /* Not an alias access: fault again without the handler */
+    signal(SIGSEGV, SIG_DFL);
+}
+
+/**
+  * @brief  Maps the device address ranges, once per process
+  * @note   Call before forking devices so they share the flash
+  */
+void VM_Init(void)
+{
+    struct sigaction action;
+
+    if (mapped) {
+        return;
+    }
+    for (uint32_t i = 0; i < VM_REGION_COUNT; i++) {
+        int flags = MAP_ANONYMOUS | MAP_FIXED_NOREPLACE | MAP_NORESERVE |
+                    (regions[i].shared ? MAP_SHARED : MAP_PRIVATE);
+        void* p = mmap((void*)regions[i].base, regions[i].size, PROT_READ | PROT_WRITE, flags, -1, 0);
+
+        if (p != (void*)regions[i].base) {
+            fprintf(stderr, "vmcu: cannot map %#lx, link with -no-pie\n", (unsigned long)regions[i].base);
+            exit(2);
+        }
+    }
+    memset((void*)regions[VM_FLASH_REGION].base, 0xFF, regions[VM_FLASH_REGION].size);
+
+    /* Alias pages are closed between syncs, see alias_fault */
+    action.sa_sigaction = alias_fault;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, NULL);
+    for (uint32_t p = 0; p < VM_PORT_COUNT; p++) {
+        alias_state[p] = VM_ALIAS_OPEN;
+    }
+    mapped = 1;
+}
+
+/* Bit-band alias words of RXTX of a port */
+static volatile uint32_t* pin_alias(uint32_t port)
+{
+    uintptr_t rxtx = (uintptr_t)&ports[port]->RXTX;
+
+    return (volatile uint32_t*)(0x42000000UL + ((rxtx - 0x40000000UL) << 5));
+}
+
+/* GPIO --------------------------------------------------------------------*/
+
+/* Recomputes the package levels of a port and reports output edges */
+static void gpio_update(uint32_t port)
+{
+    VM_PinStateTypeDef* s = &pins[port];
+    uint32_t oe = ports[port]->OE & VM_PORT_PIN_MASK;
+    uint32_t level = (s->latch & oe) | (s->input & ~oe & VM_PORT_PIN_MASK);
+    uint32_t changed = (level ^ s->level) & oe;
+
+    s->level = level;
+    for (uint32_t pin = 0; changed != 0; pin++, changed >>= 1) {
+        if ((changed & 1U) && pin_hook != NULL) {
+            pin_hook(vm_now, (VM_PortTypeDef)port, pin, (level >> pin) & 1U);
+        }
+    }
+}
+
+/* RXTX stores and bit-band alias stores, an alias wins for its bit.
+ * An alias word is taken when it changed or when its store faulted, so
+ * the first store to a port's alias page since the last sync counts even
+ * if it writes the word's old value (RXTX blanks the pin, the alias sets
+ * it again). Later same-value stores to that page are merged. Taking
+ * twice without a sync_out in between changes nothing. */
+static void gpio_sync_in(void)
+{
+    for (uint32_t p = 0; p < VM_PORT_COUNT; p++) {
+        VM_PinStateTypeDef* s = &pins[p];
+        volatile uint32_t* alias = pin_alias(p);
+        uint32_t latch = s->latch;
+        uint32_t stored = alias_stored[p];
+
+        if (ports[p]->RXTX != s->published) {
+            s->published = ports[p]->RXTX;
+            latch = s->published;
+        }
+        /* A closed page was not touched, its words are s->aliased */
+        if (alias_state[p] != VM_ALIAS_CLOSED) {
+            uint32_t aliased = 0;
+
+            for (uint32_t pin = 0; pin < VM_PORT_PINS; pin++) {
+                uint32_t bit = alias[pin] & 1U;
+
+                if (((stored >> pin) & 1U) || bit != ((s->aliased >> pin) & 1U)) {
+                    latch = (latch & ~(1UL << pin)) | (bit << pin);
+                }
+                aliased |= bit << pin;
+            }
+            s->aliased = aliased;
+            alias_protect(p, PROT_NONE);
+            alias_state[p] = VM_ALIAS_CLOSED;
+        }
+        alias_stored[p] = 0;
+        s->latch = latch & VM_PORT_PIN_MASK;
+        gpio_update(p);
+    }
+}
+
+static void gpio_sync_out(void)
+{
+    for (uint32_t p = 0; p < VM_PORT_COUNT; p++) {
+        VM_PinStateTypeDef* s = &pins[p];
+        volatile uint32_t* alias = pin_alias(p);
+
+        ports[p]->RXTX = s->level;
+        s->published = s->level;
+        if (s->aliased == s->level && alias_state[p] == VM_ALIAS_CLOSED) {
+            continue;
+        }
+        alias_protect(p, PROT_READ | PROT_WRITE);
+        for (uint32_t pin = 0; pin < VM_PORT_PINS; pin++) {
+            alias[pin] = (s->level >> pin) & 1U;
+        }
+        s->aliased = s->level;
+        alias_protect(p, PROT_NONE);
+        alias_state[p] = VM_ALIAS_CLOSED;
+    }
+}
+
+/* DWT ---------------------------------------------------------------------*/
+
+static void dwt_sync_in(void)
+{
+    /* A write is taken once, a later sync must not rebase on it again */
+    if (DWT->CYCCNT != cyccnt_published) {
+        cyccnt_published = DWT->CYCCNT;
+        cyccnt_offset = cyccnt_published - (uint32_t)vm_now;
+    }
+}
+
+static void dwt_sync_out(void)
+{
+    cyccnt_published = (uint32_t)vm_now + cyccnt_offset;
+    DWT->CYCCNT = cyccnt_published;
+}
+
+/* SysTick -----------------------------------------------------------------*/
+
+static uint32_t systick_value(void)
+{
+    return systick.running ? systick.load - (uint32_t)(vm_now - systick.reload_at) : systick.held;
+}
+
+static void systick_reset(void)
+{
+    memset(&systick, 0, sizeof(systick));
+}
+
+static void systick_sync_in(void)
+{
+    uint32_t load = SysTick->LOAD & SysTick_LOAD_RELOAD_Msk;
+    uint32_t ctrl = SysTick->CTRL;
+    uint8_t run = (ctrl & SysTick_CTRL_ENABLE_Msk) && load != 0;
+
+    if (systick.running && !run) {
+        systick.held = systick_value();
+    }
+    systick.load = load;
+    /* Any write clears the counter, it reloads on the next clock */
+    if (SysTick->VAL != systick.published) {
+        systick.published = SysTick->VAL;
+        systick.held = load;
+        systick.reload_at = vm_now;
+    }
+    if (run && !systick.running) {
+        systick.reload_at = vm_now - (load - (systick.held > load ? load : systick.held));
+    }
+    systick.running = run;
+    systick.ctrl = ctrl;
+}
+
+static void systick_sync_out(void)
+{
+    systick.published = systick_value();
+    SysTick->VAL = systick.published;
+}
+
+static VM_Time systick_next_event(void)
+{
+    return systick.running ? systick.reload_at + systick.load + 1 : VM_NEVER;
+}
+
+static void systick_fire(VM_Time t)
+{
+    systick.reload_at = t;
+    if (systick.ctrl & SysTick_CTRL_TICKINT_Msk) {
+        vm_irq_pend(SysTick_IRQn);
+    }
+}
+
+static const VM_DeviceTypeDef systick_device = {
+    systick_reset, systick_sync_in, systick_sync_out, systick_next_event, systick_fire
+};
+
+/* TIMER -------------------------------------------------------------------*/
+
+/* Moves the count to the last prescaler edge, keeping the phase */
+static void timer_rebase(VM_TimerTypeDef* t)
+{
+    uint64_t div = (uint64_t)t->psg + 1;
+    uint64_t ticks;
+
+    if (!t->running) {
+        t->base = vm_now;
+        return;
+    }
+    ticks = (vm_now - t->base) / div;
+    t->cnt = (uint32_t)((t->cnt + ticks) & TIMER_CNT_Msk);
+    t->base += ticks * div;
+}
+
+static void timer_reset(void)
+{
+    for (uint32_t i = 0; i < VM_TIMER_COUNT; i++) {
+        VM_TimerTypeDef* t = &timers[i];
+
+        t->cnt = t->arr = t->psg = t->ie = t->status = 0;
+        t->base = 0;
+        t->published_cnt = t->published_status = 0;
+        t->running = 0;
+    }
+}
+
+static void timer_sync_in(void)
+{
+    for (uint32_t i = 0; i < VM_TIMER_COUNT; i++) {
+        VM_TimerTypeDef* t = &timers[i];
+        MDR_TIMER_TypeDef* regs = t->regs;
+        uint8_t run = (regs->CNTRL & TIMER_CNTRL_CNT_EN) != 0;
+        uint32_t psg = regs->PSG & 0xFFFFUL;
+        uint32_t arr = regs->ARR & TIMER_CNT_Msk;
+
+        /* STATUS flags clear on a 0 written to them */
+        if (regs->STATUS != t->published_status) {
+            t->published_status = regs->STATUS;
+            t->status &= t->published_status;
+        }
+        if (regs->CNT != t->published_cnt) {
+            t->published_cnt = regs->CNT;
+            timer_rebase(t);
+            t->cnt = t->published_cnt & TIMER_CNT_Msk;
+        } else if (run != t->running || psg != t->psg || arr != t->arr) {
+            timer_rebase(t);
+        }
+        t->running = run;
+        t->psg = psg;
+        t->arr = arr;
+        t->ie = regs->IE;
+        vm_irq_level(t->irq, t->status & t->ie);
+    }
+}
+
+static void timer_sync_out(void)
+{
+    for (uint32_t i = 0; i < VM_TIMER_COUNT; i++) {
+        VM_TimerTypeDef* t = &timers[i];
+        uint32_t cnt = t->cnt;
+
+        if (t->running) {
+            cnt = (uint32_t)((t->cnt + (vm_now - t->base) / ((uint64_t)t->psg + 1)) & TIMER_CNT_Msk);
+        }
+        t->regs->CNT = cnt;
+        t->regs->STATUS = t->status;
+        t->published_cnt = cnt;
+        t->published_status = t->status;
+    }
+}
+
+/* Counts from 'cnt' to the ARR -> 0 wrap, through 0xFFFF if past ARR */
+static VM_Time timer_event(const VM_TimerTypeDef* t)
+{
+    uint64_t counts;
+
+    if (!t->running) {
+        return VM_NEVER;
+    }
+    counts = (t->cnt <= t->arr) ? (t->arr - t->cnt + 1) : (TIMER_CNT_Msk + 1 - t->cnt + t->arr + 1);
+    return t->base + counts * ((uint64_t)t->psg + 1);
+}
+
+static VM_Time timer_next_event(void)
+{
+    VM_Time next = VM_NEVER;
+
+    for (uint32_t i = 0; i < VM_TIMER_COUNT; i++) {
+        VM_Time e = timer_event(&timers[i]);
+
+        if (e < next) {
+            next = e;
+        }
+    }
+    return next;
+}
+
+static void timer_fire(VM_Time now)
+{
+    for (uint32_t i = 0; i < VM_TIMER_COUNT; i++) {
+        VM_TimerTypeDef* t = &timers[i];
+
+        if (timer_event(t) == now) {
+            t->cnt = 0;
+            t->base = now;
+            t->status |= TIMER_STATUS_CNT_ARR | TIMER_STATUS_CNT_ZERO;
+            vm_irq_level(t->irq, t->status & t->ie);
+        }
+    }
+}
+
+static const VM_DeviceTypeDef timer_device = {
+    timer_reset, timer_sync_in, timer_sync_out, timer_next_event, timer_fire
+};
+
+/* Device list, events due at the same time fire in this order */
+static const VM_DeviceTypeDef* const devices[] = {
+    &systick_device, &timer_device, &VM_DmaDevice, &VM_UartDevice, &VM_AdcDevice, &VM_RtcDevice
+};
+
+#define VM_DEVICE_COUNT     (sizeof(devices) / sizeof(devices[0]))
+
+/* Synchronisation and time ------------------------------------------------*/
+
+static void sync_in(void)
+{
+    gpio_sync_in();
+    dwt_sync_in();
+    for (uint32_t i = 0; i < VM_DEVICE_COUNT; i++) {
+        devices[i]->sync_in();
+    }
+}
+
+static void sync_out(void)
+{
+    for (uint32_t i = 0; i < VM_DEVICE_COUNT; i++) {
+        devices[i]->sync_out();
+    }
+    gpio_sync_out();
+    dwt_sync_out();
+}
+
+static VM_Time next_event(void)
+{
+    VM_Time next = VM_NEVER;
+
+    for (uint32_t i = 0; i < VM_DEVICE_COUNT; i++) {
+        VM_Time e = devices[i]->next_event();
+
+        if (e < next) {
+            next = e;
+        }
+    }
+    return next;
+}
+
+/* Fires every event up to t in time order, taking interrupts between */
+static void advance_to(VM_Time t)
+{
+    VM_Time next;
+
+    while ((next = next_event()) <= t) {
+        vm_now = next;
+        for (uint32_t i = 0; i < VM_DEVICE_COUNT; i++) {
+            if (devices[i]->next_event() == next) {
+                devices[i]->fire(next);
+            }
+        }
+        dispatch();
+    }
+    vm_now = t;
+}
+
+/* Back to the test until VM_RunUntil sets a later deadline */
+static void vm_yield(void)
+{
+    sync_out();
+    swapcontext(&fw_ctx, &host_ctx);
+    sync_in();
+}
+
+/* Any enabled interrupt pending, masked or not: ends __WFI */
+static uint32_t wakeup_pending(void)
+{
+    for (int s = 0; s < VM_IRQ_SLOTS; s++) {
+        if (nvic.enabled[s] && (nvic.pending[s] || nvic.level[s])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+  * @brief  Lets virtual time pass in firmware code
+  * @param  until: stop time, ignored when sleeping
+  * @param  sleep: __WFI, stop at the first interrupt instead
+  */
+static void spend_time(VM_Time until, uint32_t sleep)
+{
+    uint64_t taken = nvic.taken;
+
+    while (sleep ? (!wakeup_pending() && nvic.taken == taken) : (vm_now < until)) {
+        VM_Time stop = sleep ? next_event() : until;
+
+        if (vm_now >= deadline) {
+            vm_yield();
+            continue;
+        }
+        if (stop > deadline) {
+            stop = deadline;
+        }
+        advance_to(stop);
+    }
+}
+
+void vm_wait_until(VM_Time t)
+{
+    if (in_fw) {
+        spend_time(t, 0);
+    }
+}
+
+void vm_call_begin(void)
+{
+    if (booted) {
+        sync_in();
+        vm_wait_until(vm_now + VM_Config.call_cycles);
+    }
+}
+
+void vm_call_end(void)
+{
+    if (booted) {
+        sync_in();
+        dispatch();
+        sync_out();
+    }
+}
+
+/* NVIC --------------------------------------------------------------------*/
+
+static VM_HandlerTypeDef irq_handler(int slot)
+{
+    switch (slot - 16) {
+    case SysTick_IRQn:  return SysTick_Handler;
+    case DMA_IRQn:      return DMA_IRQHandler;
+    case Timer1_IRQn:   return Timer1_IRQHandler;
+    case Timer2_IRQn:   return Timer2_IRQHandler;
+    case Timer3_IRQn:   return Timer3_IRQHandler;
+    case BACKUP_IRQn:   return BACKUP_IRQHandler;
+    default:            return NULL;
+    }
+}
+
+static uint64_t host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Takes pending interrupts above the current execution priority */
+static void dispatch(void)
+{
+    if (!in_fw || primask) {
+        return;
+    }
+    for (;;) {
+        uint32_t current = nvic.depth ? nvic.priority[nvic.active[nvic.depth - 1]] : VM_THREAD_PRIORITY;
+        VM_HandlerTypeDef handler;
+        uint64_t start, nested, self;
+        int slot = -1;
+
+        for (int s = 0; s < VM_IRQ_SLOTS; s++) {
+            if (nvic.enabled[s] && (nvic.pending[s] || nvic.level[s]) && nvic.priority[s] < current &&
+                (slot < 0 || nvic.priority[s] < nvic.priority[slot])) {
+                slot = s;
+            }
+        }
+        if (slot < 0) {
+            return;
+        }
+
+        nvic.pending[slot] = 0;
+        handler = irq_handler(slot);
+        if (handler == NULL) {
+            fprintf(stderr, "vmcu: IRQ %d enabled without a handler, disabled\n", slot - 16);
+            nvic.enabled[slot] = 0;
+            continue;
+        }
+
+        nvic.active[nvic.depth++] = slot;
+        nvic.taken++;
+        sync_out();
+        nested = irq_ns_total;
+        start = host_ns();
+        handler();
+        self = (host_ns() - start) - (irq_ns_total - nested);
+        irq_ns_total += self;
+        irq_stats[slot].count++;
+        irq_stats[slot].host_ns += self;
+        if (self > irq_stats[slot].max_host_ns) {
+            irq_stats[slot].max_host_ns = self;
+        }
+        sync_in();
+        nvic.depth--;
+    }
+}
+
+void vm_irq_pend(IRQn_Type irq)
+{
+    nvic.pending[VM_SLOT(irq)] = 1;
+}
+
+void vm_irq_level(IRQn_Type irq, uint32_t asserted)
+{
+    nvic.level[VM_SLOT(irq)] = (asserted != 0);
+}
+
+void NVIC_EnableIRQ(IRQn_Type irq)
+{
+    vm_call_begin();
+    nvic.enabled[VM_SLOT(irq)] = 1;
+    vm_call_end();
+}
+
+void NVIC_DisableIRQ(IRQn_Type irq)
+{
+    nvic.enabled[VM_SLOT(irq)] = 0;
+}
+
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority)
+{
+    nvic.priority[VM_SLOT(irq)] = priority & 0xFFU;
+}
+
+void NVIC_SetPendingIRQ(IRQn_Type irq)
+{
+    vm_call_begin();
+    nvic.pending[VM_SLOT(irq)] = 1;
+    vm_call_end();
+}
+
+void NVIC_ClearPendingIRQ(IRQn_Type irq)
+{
+    nvic.pending[VM_SLOT(irq)] = 0;
+}
+
+uint32_t NVIC_GetPendingIRQ(IRQn_Type irq)
+{
+    return nvic.pending[VM_SLOT(irq)] || nvic.level[VM_SLOT(irq)];
+}
+
+uint32_t SysTick_Config(uint32_t ticks)
+{
+    if (ticks == 0 || ticks - 1 > SysTick_LOAD_RELOAD_Msk) {
+        return 1;
+    }
+    vm_call_begin();
+    SysTick->LOAD = ticks - 1;
+    NVIC_SetPriority(SysTick_IRQn, 7);
+    SysTick->VAL = 0;
+    SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
+    vm_call_end();
+    return 0;
+}
+
+/* CMSIS intrinsics --------------------------------------------------------*/
+
+void __disable_irq(void)
+{
+    primask = 1;
+    vm_call_begin();
+    vm_call_end();
+}
+
+/**
+  * @brief  Unmasks interrupts
+  * @note   At thread level this is the end of a main loop pass (HD_Idle),
+  *         a pass that did not sleep costs VM_Config.loop_cycles
+  */
+void __enable_irq(void)
+{
+    primask = 0;
+    if (!booted) {
+        return;
+    }
+    sync_in();
+    if (in_fw && nvic.depth == 0) {
+        if (!slept) {
+            spend_time(vm_now + VM_Config.loop_cycles, 0);
+        }
+        slept = 0;
+    }
+    dispatch();
+    sync_out();
+}
+
+uint32_t __get_PRIMASK(void)
+{
+    return primask;
+}
+
+void __set_PRIMASK(uint32_t value)
+{
+    primask = value & 1U;
+    vm_call_begin();
+    vm_call_end();
+}
+
+void __WFI(void)
+{
+    VM_Time start = vm_now;
+
+    if (!booted || !in_fw) {
+        return;
+    }
+    sync_in();
+    spend_time(VM_NEVER, 1);
+    if (vm_now != start) {
+        vm_stats.sleep_cycles += vm_now - start;
+        vm_stats.wakeups++;
+    }
+    slept = 1;
+    dispatch();
+    sync_out();
+}
+
+/**
+  * @brief  __NOP in a delay loop, a pass of HD_Delay_us_blocking's loop
+  *         costs 3 cycles on the chip
+  */
+void VMCU_Nop(void)
+{
+    VM_Busy(VM_NOP_LOOP_CYCLES);
+}
+
+/**
+  * @brief  Charges execution time to the firmware code calling it
+  * @note   For test wrappers around firmware functions (-Wl,--wrap),
+  *         does nothing outside the firmware context
+  */
+void VM_Busy(VM_Time cycles)
+{
+    if (!booted || !in_fw) {
+        return;
+    }
+    sync_in();
+    spend_time(vm_now + cycles, 0);
+    dispatch();
+    sync_out();
+}
+
+/* Device control ------------------------------------------------------------*/
+
+static void firmware_entry(void)
+{
+    firmware_main();
+    fw_returned = 1;
+    fprintf(stderr, "vmcu: firmware main returned\n");
+}
+
+/**
+  * @brief  Power-on reset: clears registers and starts the firmware main
+  * @note   The firmware runs up to its first wait on the first VM_RunUntil
+  */
+void VM_Boot(void)
+{
+    VM_Init();
+    for (uint32_t i = 0; i < VM_REGION_COUNT; i++) {
+        if (!regions[i].shared) {
+            madvise((void*)regions[i].base, regions[i].size, MADV_DONTNEED);
+        }
+    }
+
+    vm_now = 0;
+    deadline = 0;
+    primask = 0;
+    slept = 0;
+    fw_returned = 0;
+    memset(&nvic, 0, sizeof(nvic));
+    memset(irq_stats, 0, sizeof(irq_stats));
+    memset(&vm_stats, 0, sizeof(vm_stats));
+    irq_ns_total = 0;
+    nvic.enabled[VM_SLOT(SysTick_IRQn)] = 1;
+    cyccnt_offset = cyccnt_published = 0;
+    for (uint32_t p = 0; p < VM_PORT_COUNT; p++) {
+        pins[p] = (VM_PinStateTypeDef){ .input = VM_PORT_PIN_MASK };
+        alias_stored[p] = 0;
+    }
+    for (uint32_t i = 0; i < VM_DEVICE_COUNT; i++) {
+        devices[i]->reset();
+    }
+
+    getcontext(&fw_ctx);
+    fw_ctx.uc_stack.ss_sp = fw_stack;
+    fw_ctx.uc_stack.ss_size = sizeof(fw_stack);
+    fw_ctx.uc_link = &host_ctx;
+    makecontext(&fw_ctx, firmware_entry, 0);
+
+    booted = 1;
+    for (uint32_t p = 0; p < VM_PORT_COUNT; p++) {
+        gpio_update(p);
+    }
+    sync_out();
+}
+
+/**
+  * @brief  Runs the firmware until the virtual clock reaches t
+  */
+void VM_RunUntil(VM_Time t)
+{
+    if (!booted || t <= vm_now) {
+        return;
+    }
+    deadline = t;
+    if (fw_returned) {
+        vm_now = t;
+        return;
+    }
+    in_fw = 1;
+    swapcontext(&host_ctx, &fw_ctx);
+    in_fw = 0;
+}
+
+void VM_RunFor(VM_Time cycles)
+{
+    VM_RunUntil(vm_now + cycles);
+}
+
+VM_Time VM_Now(void)
+{
+    return vm_now;
+}
+
+/**
+  * @brief  Runs one test device in a child process
+  * @note   Firmware statics start from their initial values in every
+  *         child; flash content carries over from child to child
+  * @retval Exit status of test(arg), 128 + signal if it crashed
+  */
+int VM_RunIsolated(int (*test)(void* arg), void* arg)
+{
+    pid_t pid;
+    int status;
+
+    VM_Init();
+    fflush(NULL);
+    pid = fork();
+    if (pid < 0) {
+        perror("vmcu: fork");
+        return 127;
+    }
+    if (pid == 0) {
+        int rc = test(arg);
+
+        fflush(NULL);
+        _exit(rc & 0xFF);
+    }
+    if (waitpid(pid, &status, 0) < 0) {
+        return 127;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+/* Pins ----------------------------------------------------------------------*/
+
+void VM_SetPinHook(VM_PinHookTypeDef hook)
+{
+    pin_hook = hook;
+}
+
+/**
+  * @brief  Drives an input pin from outside (buttons), 1 = released
+  */
+void VM_SetInput(VM_PortTypeDef port, uint32_t pin, uint32_t level)
+{
+    pins[port].input = (pins[port].input & ~(1UL << pin)) | ((level & 1U) << pin);
+    if (booted) {
+        sync_in();
+        sync_out();
+    }
+}
+
+uint32_t VM_GetPin(VM_PortTypeDef port, uint32_t pin)
+{
+    return (pins[port].level >> pin) & 1U;
+}
+
+/* Statistics ----------------------------------------------------------------*/
+
+const VM_IrqStatsTypeDef* VM_GetIrqStats(IRQn_Type irq)
+{
+    return &irq_stats[VM_SLOT(irq)];
+}
+
+const VM_StatsTypeDef* VM_GetStats(void)
+{
+    return &vm_stats;
+}
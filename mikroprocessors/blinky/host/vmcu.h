@@ -0,0 +1,120 @@
+#ifndef VMCU_H
+#define VMCU_H
+
+#include <stdint.h>
+#include "MDR32F9Q2I.h"
+
+/* Virtual MDR32F9Q2I for host tests.
+ *
+ * The unmodified firmware sources are linked against the mock SPL in
+ * include/ and run on a virtual clock counted in 8 MHz CPU cycles.
+ * Peripheral registers live at their real addresses (mapped by VM_Init),
+ * so direct register and bit-band access works as on the chip.
+ *
+ * Firmware code itself takes no virtual time. Time moves only in __WFI,
+ * in the main loop pass (VM_Config.loop_cycles per HD_Idle that did not
+ * sleep), in __NOP, in busy waits on peripherals (HSI start), in flash
+ * erase and program and, when VM_Config.call_cycles is set, in every SPL
+ * or CMSIS call. Peripheral events fire at their exact times and
+ * interrupts are taken at the next CMSIS call with PRIMASK clear,
+ * honouring the NVIC priorities and preemption.
+ *
+ * The firmware main() (built as firmware_main) runs as a coroutine:
+ * VM_RunUntil() switches to it and it switches back once the virtual
+ * clock reaches the deadline. Register writes made by firmware code are
+ * picked up at the next CMSIS or SPL call, with that call's timestamp;
+ * bit-band alias words read back the pin levels of that call too. Alias
+ * pages fault on first access after each call: the first read of a port
+ * sees its RXTX stores made before it, and the first store counts even
+ * when it rewrites the level the pin had (an RXTX blank followed by a
+ * bit-band set lands as the set). Later RXTX stores in the same stretch
+ * of firmware code are not seen by alias reads until the next call.
+ *
+ * Firmware statics are not reset by VM_Boot, so boot every device in a
+ * fresh process (VM_RunIsolated). Flash is shared by all such processes
+ * and keeps its content across them, like the chip across a reset. */
+
+#define VM_CPU_HZ           8000000ULL
+#define VM_US(us)           ((VM_Time)(us) * (VM_CPU_HZ / 1000000ULL))
+#define VM_MS(ms)           ((VM_Time)(ms) * (VM_CPU_HZ / 1000ULL))
+#define VM_NEVER            UINT64_MAX
+
+/* VM_RunIsolated status of a device whose power failed (flash_cut_at) */
+#define VM_POWER_CUT        100
+
+/* Virtual time in CPU cycles since VM_Boot */
+typedef uint64_t VM_Time;
+
+/* Port index of MDR_PORTA..MDR_PORTF */
+typedef enum {
+    VM_PORT_A = 0,
+    VM_PORT_B = 1,
+    VM_PORT_C = 2,
+    VM_PORT_D = 3,
+    VM_PORT_E = 4,
+    VM_PORT_F = 5,
+    VM_PORT_COUNT
+} VM_PortTypeDef;
+
+/* Device model settings, read at VM_Boot */
+typedef struct {
+    uint32_t loop_cycles;       /* main loop pass that did not sleep */
+    int32_t lse_ppm;            /* LSE (RTC) frequency error, + = fast */
+    uint8_t lse_fails;          /* LSE does not start, RTC falls back to LSI */
+    uint32_t hsi_start_us;      /* HSI restart after deep sleep */
+    uint32_t uart_baud;         /* line rate of the test side of UART2 */
+    uint16_t (*adc_source)(VM_Time t, void* arg);  /* 12-bit ADC7 samples */
+    void* adc_arg;
+    uint32_t flash_cut_at;      /* power fails during this flash erase or
+                                   write since boot (1 = first), 0 = never */
+    uint32_t call_cycles;       /* charged per SPL or CMSIS call made in
+                                   firmware context, 0 = calls are free */
+} VM_ConfigTypeDef;
+
+/* Handler statistics, host time excludes nested handlers */
+typedef struct {
+    uint64_t count;
+    uint64_t host_ns;
+    uint64_t max_host_ns;
+} VM_IrqStatsTypeDef;
+
+/* Peripheral counters the firmware cannot see */
+typedef struct {
+    uint64_t sleep_cycles;      /* in __WFI */
+    uint64_t wakeups;           /* __WFI calls that waited */
+    uint32_t uart_rx_overflows; /* bytes lost to a full RX FIFO */
+    uint32_t uart_rx_asleep;    /* bytes lost while HSI was off */
+    uint32_t adc_samples;
+    uint32_t adc_dropped;       /* samples the DMA did not take */
+    uint32_t flash_erases;
+    uint32_t flash_writes;
+} VM_StatsTypeDef;
+
+/* Called for every level change of an output pin */
+typedef void (*VM_PinHookTypeDef)(VM_Time t, VM_PortTypeDef port, uint32_t pin, uint32_t level);
+
+extern VM_ConfigTypeDef VM_Config;
+
+/* Function prototypes - Device */
+void VM_Init(void);
+void VM_Boot(void);
+void VM_RunUntil(VM_Time t);
+void VM_RunFor(VM_Time cycles);
+VM_Time VM_Now(void);
+int VM_RunIsolated(int (*test)(void* arg), void* arg);
+void VM_Busy(VM_Time cycles);
+
+/* Function prototypes - Pins */
+void VM_SetPinHook(VM_PinHookTypeDef hook);
+void VM_SetInput(VM_PortTypeDef port, uint32_t pin, uint32_t level);
+uint32_t VM_GetPin(VM_PortTypeDef port, uint32_t pin);
+
+/* Function prototypes - UART2 line, test side */
+void VM_UartSend(const uint8_t* data, uint32_t len);
+uint32_t VM_UartReceive(uint8_t* data, uint32_t max, VM_Time* times);
+
+/* Function prototypes - Statistics */
+const VM_IrqStatsTypeDef* VM_GetIrqStats(IRQn_Type irq);
+const VM_StatsTypeDef* VM_GetStats(void);
+
+#endif /* VMCU_H */
@@ -0,0 +1,48 @@
+#ifndef VMCU_INT_H
+#define VMCU_INT_H
+
+#include "vmcu.h"
+
+/* Interface between the virtual MCU core (vmcu.c) and the peripheral
+ * models (vm_periph.c) and SPL functions (spl.c). Not for tests. */
+
+/* A peripheral model. Registers are plain memory, so the model keeps its
+ * own state and reconciles it with the registers at every CMSIS or SPL
+ * call: sync_in takes what the firmware wrote since the last sync_out,
+ * sync_out publishes the state at the current time. */
+typedef struct {
+    void (*reset)(void);
+    void (*sync_in)(void);
+    void (*sync_out)(void);
+    VM_Time (*next_event)(void);    /* VM_NEVER if none */
+    void (*fire)(VM_Time t);        /* event due at t, vm_now == t */
+} VM_DeviceTypeDef;
+
+extern const VM_DeviceTypeDef VM_DmaDevice;
+extern const VM_DeviceTypeDef VM_UartDevice;
+extern const VM_DeviceTypeDef VM_AdcDevice;
+extern const VM_DeviceTypeDef VM_RtcDevice;
+
+extern VM_Time vm_now;
+extern VM_StatsTypeDef vm_stats;
+
+/* SPL and CMSIS calls: sync_in at entry, end takes further register
+ * writes, runs due handlers and publishes the state */
+void vm_call_begin(void);
+void vm_call_end(void);
+
+/* Busy wait from firmware code, runs handlers meanwhile; returns at
+ * once outside the firmware context */
+void vm_wait_until(VM_Time t);
+
+/* Interrupt lines: edge sources pend once, level sources stay asserted */
+void vm_irq_pend(IRQn_Type irq);
+void vm_irq_level(IRQn_Type irq, uint32_t asserted);
+
+/* Peripheral requests into the DMA controller, 1 if a transfer was made */
+uint32_t vm_dma_request(uint32_t channel);
+
+/* HSI state, UART and ADC are clocked from it */
+uint32_t vm_hsi_running(void);
+
+#endif /* VMCU_INT_H */
@@ -0,0 +1,214 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wave.h"
+#include "leds.h"
+
+#define WAVE_NS_PER_CYCLE   (1000000000ULL / VM_CPU_HZ)
+
+#define WAVE_LED_PROBE(arg, led, port, pin)     { #led, VM_PORT_##port, pin },
+
+const WAVE_ProbeTypeDef WAVE_LedProbes[] = {
+    LED_PIN_MAP(WAVE_LED_PROBE, _)
+};
+
+const uint32_t WAVE_LedProbeCount = sizeof(WAVE_LedProbes) / sizeof(WAVE_LedProbes[0]);
+
+static const WAVE_ProbeTypeDef* probes = NULL;
+static uint32_t probe_count = 0;
+static uint8_t initial[WAVE_MAX_PROBES];
+static uint8_t probe_of[VM_PORT_COUNT][16];     /* probe index + 1, 0 if none */
+
+static WAVE_EdgeTypeDef* edges = NULL;
+static uint32_t edge_count = 0;
+static uint32_t edge_capacity = 0;
+
+static void record(VM_Time t, VM_PortTypeDef port, uint32_t pin, uint32_t level)
+{
+    uint8_t probe = probe_of[port][pin];
+
+    if (probe == 0) {
+        return;
+    }
+    if (edge_count == edge_capacity) {
+        edge_capacity = edge_capacity ? 2 * edge_capacity : 4096;
+        edges = realloc(edges, edge_capacity * sizeof(*edges));
+        if (edges == NULL) {
+            perror("wave");
+            exit(2);
+        }
+    }
+    edges[edge_count++] = (WAVE_EdgeTypeDef){ t, (uint8_t)(probe - 1), (uint8_t)level };
+}
+
+/**
+  * @brief  Starts recording the probes, from their current levels
+  * @note   Call after VM_Boot, the probe array must stay valid
+  */
+void WAVE_Init(const WAVE_ProbeTypeDef* list, uint32_t count)
+{
+    if (count > WAVE_MAX_PROBES) {
+        count = WAVE_MAX_PROBES;
+    }
+    probes = list;
+    probe_count = count;
+    edge_count = 0;
+    memset(probe_of, 0, sizeof(probe_of));
+    for (uint32_t i = 0; i < count; i++) {
+        probe_of[list[i].port][list[i].pin] = (uint8_t)(i + 1);
+        initial[i] = (uint8_t)VM_GetPin(list[i].port, list[i].pin);
+    }
+    VM_SetPinHook(record);
+}
+
+void WAVE_Free(void)
+{
+    VM_SetPinHook(NULL);
+    free(edges);
+    edges = NULL;
+    edge_count = edge_capacity = 0;
+}
+
+uint32_t WAVE_GetEdgeCount(void)
+{
+    return edge_count;
+}
+
+const WAVE_EdgeTypeDef* WAVE_GetEdges(void)
+{
+    return edges;
+}
+
+static double cycles_to_us(double cycles)
+{
+    return cycles * 1e6 / (double)VM_CPU_HZ;
+}
+
+/**
+  * @brief  Duty cycle, frequency and period jitter of one probe in [from, to)
+  */
+void WAVE_Summarize(uint32_t probe, VM_Time from, VM_Time to, WAVE_SummaryTypeDef* summary)
+{
+    uint8_t level = initial[probe];
+    VM_Time since = from;
+    VM_Time high = 0;
+    VM_Time last_rise = 0;
+    uint8_t have_rise = 0;
+    double sum = 0, sum_sq = 0;
+
+    memset(summary, 0, sizeof(*summary));
+    for (uint32_t i = 0; i < edge_count && edges[i].t < to; i++) {
+        const WAVE_EdgeTypeDef* e = &edges[i];
+
+        if (e->probe != probe) {
+            continue;
+        }
+        if (e->t < from) {
+            level = e->level;
+            continue;
+        }
+        if (level) {
+            high += e->t - since;
+        }
+        since = e->t;
+        level = e->level;
+        summary->edges++;
+
+        if (e->level) {
+            if (have_rise) {
+                double period = cycles_to_us((double)(e->t - last_rise));
+
+                if (summary->periods == 0 || period < summary->period_min_us) {
+                    summary->period_min_us = period;
+                }
+                if (period > summary->period_max_us) {
+                    summary->period_max_us = period;
+                }
+                sum += period;
+                sum_sq += period * period;
+                summary->periods++;
+            }
+            last_rise = e->t;
+            have_rise = 1;
+        }
+    }
+    if (level) {
+        high += to - since;
+    }
+
+    summary->duty = (to > from) ? (double)high / (double)(to - from) : 0.0;
+    if (summary->periods != 0) {
+        double mean = sum / summary->periods;
+        double var = sum_sq / summary->periods - mean * mean;
+
+        summary->freq_hz = 1e6 / mean;
+        summary->jitter_us = var > 0 ? sqrt(var) : 0.0;
+    }
+}
+
+/**
+  * @brief  One summary line per probe, stable text for golden files
+  */
+void WAVE_WriteSummary(FILE* out, VM_Time from, VM_Time to)
+{
+    for (uint32_t i = 0; i < probe_count; i++) {
+        WAVE_SummaryTypeDef s;
+
+        WAVE_Summarize(i, from, to, &s);
+        fprintf(out, "%-6s edges %6u duty %.4f freq %9.3f Hz period %9.3f..%9.3f us jitter %8.3f us\n",
+                probes[i].name, s.edges, s.duty, s.freq_hz, s.period_min_us, s.period_max_us, s.jitter_us);
+    }
+}
+
+/**
+  * @brief  Edges in [from, to) as "cycle probe level" lines
+  * @param  max_edges: stop after this many, 0 for all
+  */
+void WAVE_WriteEdges(FILE* out, VM_Time from, VM_Time to, uint32_t max_edges)
+{
+    uint32_t written = 0;
+
+    for (uint32_t i = 0; i < edge_count && edges[i].t < to; i++) {
+        if (edges[i].t < from) {
+            continue;
+        }
+        if (max_edges != 0 && written == max_edges) {
+            break;
+        }
+        fprintf(out, "%llu %s %u\n", (unsigned long long)edges[i].t, probes[edges[i].probe].name, edges[i].level);
+        written++;
+    }
+}
+
+/**
+  * @brief  Writes the record up to end as a VCD file, 1 ns resolution
+  * @retval 0, -1 if the file cannot be written
+  */
+int WAVE_WriteVcd(const char* path, VM_Time end)
+{
+    FILE* f = fopen(path, "w");
+    VM_Time last = VM_NEVER;
+
+    if (f == NULL) {
+        return -1;
+    }
+    fprintf(f, "$timescale 1ns $end\n$scope module blinky $end\n");
+    for (uint32_t i = 0; i < probe_count; i++) {
+        fprintf(f, "$var wire 1 %c %s $end\n", '!' + i, probes[i].name);
+    }
+    fprintf(f, "$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n");
+    for (uint32_t i = 0; i < probe_count; i++) {
+        fprintf(f, "%u%c\n", initial[i], '!' + i);
+    }
+    fprintf(f, "$end\n");
+
+    for (uint32_t i = 0; i < edge_count && edges[i].t <= end; i++) {
+        if (edges[i].t != last) {
+            last = edges[i].t;
+            fprintf(f, "#%llu\n", (unsigned long long)(last * WAVE_NS_PER_CYCLE));
+        }
+        fprintf(f, "%u%c\n", edges[i].level, '!' + edges[i].probe);
+    }
+    fprintf(f, "#%llu\n", (unsigned long long)(end * WAVE_NS_PER_CYCLE));
+    return fclose(f) == 0 ? 0 : -1;
+}
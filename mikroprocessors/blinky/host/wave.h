@@ -0,0 +1,54 @@
+#ifndef WAVE_H
+#define WAVE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "vmcu.h"
+
+/* Pin waveform recorder for host tests. Every level change of a probed
+ * output pin is stored with its virtual clock timestamp; the record can
+ * be summarized per pin, listed as text for golden files or written as
+ * a VCD file for a waveform viewer (GTKWave, PulseView). */
+
+#define WAVE_MAX_PROBES     32
+
+/* A named pin to record */
+typedef struct {
+    const char* name;
+    VM_PortTypeDef port;
+    uint32_t pin;
+} WAVE_ProbeTypeDef;
+
+/* One level change */
+typedef struct {
+    VM_Time t;
+    uint8_t probe;
+    uint8_t level;
+} WAVE_EdgeTypeDef;
+
+/* Per pin measurements over a time window */
+typedef struct {
+    uint32_t edges;
+    uint32_t periods;           /* rising edge to rising edge */
+    double duty;                /* high time / window */
+    double freq_hz;             /* periods / their total time */
+    double period_min_us;
+    double period_max_us;
+    double jitter_us;           /* standard deviation of the period */
+} WAVE_SummaryTypeDef;
+
+/* Probes of the LED pins, from LED_PIN_MAP */
+extern const WAVE_ProbeTypeDef WAVE_LedProbes[];
+extern const uint32_t WAVE_LedProbeCount;
+
+/* Function prototypes */
+void WAVE_Init(const WAVE_ProbeTypeDef* probes, uint32_t count);
+void WAVE_Free(void);
+uint32_t WAVE_GetEdgeCount(void);
+const WAVE_EdgeTypeDef* WAVE_GetEdges(void);
+void WAVE_Summarize(uint32_t probe, VM_Time from, VM_Time to, WAVE_SummaryTypeDef* summary);
+void WAVE_WriteSummary(FILE* out, VM_Time from, VM_Time to);
+void WAVE_WriteEdges(FILE* out, VM_Time from, VM_Time to, uint32_t max_edges);
+int WAVE_WriteVcd(const char* path, VM_Time end);
+
+#endif /* WAVE_H */
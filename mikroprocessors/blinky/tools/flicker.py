@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Compares the visible flicker of the LED output modes (leds.c).
+
+Simulates one LED at the 1 ms TIMER1 tick for PWM (LED_PWM_STEPS ticks
+per period), first- and second-order sigma-delta, using the same integer
+arithmetic as the firmware. For each level it prints the AC energy of
+the on/off waveform below the flicker cut-off frequency, as a fraction
+of the total AC energy. Lower is better.
+
+    python tools/flicker.py [--cutoff 80] [--seconds 2]
+"""
+import argparse
+import math
+
+TICK_HZ = 1000
+PWM_STEPS = 100
+FULL = 255
+
+
+def pwm(value, n):
+    level = (value * PWM_STEPS + 127) // 255
+    return [1 if (t % PWM_STEPS) < level else 0 for t in range(n)]
+
+
+def sd1(value, n):
+    acc, out = 0, []
+    for _ in range(n):
+        acc += value
+        if acc >= FULL:
+            acc -= FULL
+            out.append(1)
+        else:
+            out.append(0)
+    return out
+
+
+def sd2(value, n):
+    acc1, acc2, out = 0, -1, []
+    for _ in range(n):
+        y = FULL if acc2 >= 0 else -FULL
+        acc1 += (2 * value - FULL) - y
+        acc2 += acc1 - y
+        out.append(1 if acc2 >= 0 else 0)
+    return out
+
+
+def low_band_share(samples, cutoff_hz):
+    """Share of the AC energy in 1 Hz .. cutoff_hz (plain DFT)"""
+    n = len(samples)
+    mean = sum(samples) / n
+    ac = [s - mean for s in samples]
+    total = sum(a * a for a in ac) * n / 2
+    if total == 0:
+        return 0.0
+    low = 0.0
+    for k in range(1, int(cutoff_hz * n / TICK_HZ) + 1):
+        re = sum(a * math.cos(2 * math.pi * k * t / n) for t, a in enumerate(ac))
+        im = sum(a * math.sin(2 * math.pi * k * t / n) for t, a in enumerate(ac))
+        low += re * re + im * im
+    return low / total
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    ap.add_argument('--cutoff', type=float, default=80.0, help='flicker band edge, Hz')
+    ap.add_argument('--seconds', type=float, default=1.0, help='simulated time')
+    args = ap.parse_args()
+
+    n = int(args.seconds * TICK_HZ)
+    print('level   mean(pwm/sd1/sd2)        low-band energy share (pwm / sd1 / sd2)')
+    for value in (3, 16, 64, 128, 192, 250):
+        outs = [f(value, n) for f in (pwm, sd1, sd2)]
+        means = '/'.join('%.3f' % (sum(o) / n) for o in outs)
+        shares = ' / '.join('%6.3f' % low_band_share(o, args.cutoff) for o in outs)
+        print('%5d   %-24s %s' % (value, means, shares))
+
+
+if __name__ == '__main__':
+    main()
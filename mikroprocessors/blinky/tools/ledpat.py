@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""Compiles LED frame sequences into the compressed pattern format read by
+hardware_drivers/Src/led_pattern.c (format described in led_pattern.h).
+
+Input is a text file with one frame per line, one level 0..255 per LED,
+separated by spaces or commas. Empty lines and '#' comments are ignored.
+
+    python tools/ledpat.py show.txt -o Logic/Src/show_pattern.c --name show --loop
+
+The output is a C file with a const array for flash and its size, for
+LED_StartPattern(show_pattern, show_pattern_size). Every compiled
+pattern is decoded again by a reference decoder and compared with the
+input, and the compression ratio and decoder throughput are printed.
+"""
+import argparse
+import collections
+import struct
+import sys
+import time
+
+CHANNELS = 4
+VERSION = 1
+HEADER_SIZE = 9
+PALETTE_MAX = 64
+FLAG_LOOP = 0x01
+OP_PAL, OP_RUN, OP_DELTA = 0x00, 0x40, 0x80
+RUN_MAX = 64
+
+
+def read_frames(path):
+    frames = []
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.split('#', 1)[0].replace(',', ' ').split()
+            if not line:
+                continue
+            if len(line) > CHANNELS:
+                sys.exit('%s:%d: more than %d levels' % (path, lineno, CHANNELS))
+            levels = [int(v, 0) for v in line] + [0] * (CHANNELS - len(line))
+            if any(v < 0 or v > 255 for v in levels):
+                sys.exit('%s:%d: level out of 0..255' % (path, lineno))
+            frames.append(tuple(levels))
+    return frames
+
+
+def pack(frame):
+    return sum(v << (8 * i) for i, v in enumerate(frame))
+
+
+def delta_op(prev, frame):
+    mask = 0
+    data = []
+    for i in range(CHANNELS):
+        if frame[i] != prev[i]:
+            mask |= 1 << i
+            data.append((frame[i] - prev[i]) & 0xFF)
+    return bytes([OP_DELTA | mask] + data)
+
+
+def choose_palette(frames):
+    """Frames worth a palette slot: a PAL opcode is 1 byte against up to
+    1 + CHANNELS for a DELTA, an entry costs 4 bytes once."""
+    counts = collections.Counter()
+    prev = None
+    for frame in frames:
+        if frame != prev:
+            counts[frame] += 1
+        prev = frame
+    palette = [f for f, n in counts.most_common() if n * 2 > 4]
+    return palette[:PALETTE_MAX]
+
+
+def compile_pattern(frames, frame_ms, loop):
+    if not frames:
+        sys.exit('no frames')
+    if len(frames) > 0xFFFF:
+        sys.exit('more than 65535 frames')
+    palette = choose_palette(frames)
+    index = {f: i for i, f in enumerate(palette)}
+
+    stream = bytearray()
+    prev = (0,) * CHANNELS
+    n = 0
+    while n < len(frames):
+        frame = frames[n]
+        if frame == prev and n > 0:
+            run = 1
+            while run < RUN_MAX and n + run < len(frames) and frames[n + run] == prev:
+                run += 1
+            stream.append(OP_RUN | (run - 1))
+            n += run
+            continue
+        delta = delta_op(prev, frame)
+        if frame in index and len(delta) > 1:
+            stream.append(OP_PAL | index[frame])
+        else:
+            stream += delta
+        prev = frame
+        n += 1
+
+    header = struct.pack('<2sBBHHB', b'LP', VERSION, FLAG_LOOP if loop else 0,
+                         len(frames), frame_ms, len(palette))
+    header += b''.join(struct.pack('<I', pack(f)) for f in palette)
+    return header + bytes(stream)
+
+
+def decode(image):
+    """Reference decoder, same rules as led_pattern.c"""
+    magic, version, flags, count, frame_ms, pal_size = struct.unpack_from('<2sBBHHB', image)
+    assert magic == b'LP' and version == VERSION
+    palette = [struct.unpack_from('<I', image, HEADER_SIZE + 4 * i)[0] for i in range(pal_size)]
+    pos = HEADER_SIZE + 4 * pal_size
+    frame = [0] * CHANNELS
+    out = []
+    while pos < len(image):
+        op = image[pos]
+        pos += 1
+        kind = op & 0xC0
+        if kind == OP_PAL:
+            frame = [(palette[op] >> (8 * i)) & 0xFF for i in range(CHANNELS)]
+            out.append(tuple(frame))
+        elif kind == OP_RUN:
+            out.extend([tuple(frame)] * ((op & 0x3F) + 1))
+        else:
+            assert op & 0xF0 == OP_DELTA, 'bad opcode 0x%02X' % op
+            for i in range(CHANNELS):
+                if op & (1 << i):
+                    frame[i] = (frame[i] + image[pos]) & 0xFF
+                    pos += 1
+            out.append(tuple(frame))
+    assert len(out) == count, 'frame count mismatch'
+    return out
+
+
+def write_c(path, name, image, source):
+    with open(path, 'w', newline='\n') as f:
+        f.write('/* Generated by tools/ledpat.py from %s, do not edit */\n' % source)
+        f.write('#include <stdint.h>\n\n')
+        f.write('const uint8_t %s_pattern[%d] = {\n' % (name, len(image)))
+        for i in range(0, len(image), 12):
+            f.write('    ' + ', '.join('0x%02X' % b for b in image[i:i + 12]) + ',\n')
+        f.write('};\n\n')
+        f.write('const uint32_t %s_pattern_size = sizeof(%s_pattern);\n' % (name, name))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    ap.add_argument('input', help='frame text file')
+    ap.add_argument('-o', '--output', help='C file to write')
+    ap.add_argument('--name', default='led', help='array name prefix')
+    ap.add_argument('--frame-ms', type=int, default=20, help='frame time in ms')
+    ap.add_argument('--loop', action='store_true', help='restart after the last frame')
+    args = ap.parse_args()
+
+    if not 1 <= args.frame_ms <= 0xFFFF:
+        sys.exit('--frame-ms must be 1..65535')
+
+    frames = read_frames(args.input)
+    image = compile_pattern(frames, args.frame_ms, args.loop)
+
+    start = time.perf_counter()
+    decoded = decode(image)
+    elapsed = time.perf_counter() - start
+    if decoded != frames:
+        sys.exit('internal error: decoded frames differ from the input')
+
+    raw = len(frames) * CHANNELS
+    print('%d frames, %d bytes raw, %d bytes compressed, ratio %.2f:1'
+          % (len(frames), raw, len(image), raw / len(image)))
+    print('reference decoder: %.0f frames/s' % (len(frames) / elapsed if elapsed else 0))
+    if args.output:
+        write_c(args.output, args.name, image, args.input)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""Converts an event trace dump (hd_trace.h) to Chrome/Perfetto JSON.
+
+Dump sizeof(HD_TraceBuffer) bytes starting at &HD_TraceBuffer with the
+debugger (stop recording first with HD_TraceBuffer.enabled = 0), then
+
+    python tools/trace2json.py dump.bin > trace.json
+
+and open trace.json in ui.perfetto.dev or chrome://tracing. Interrupt
+slices share one track, so preemption shows as nesting; frames,
+sequence steps and commands are instants on the thread track. Event
+names come from HD_TRACE_EVENTS in hd_trace.h.
+"""
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+
+HEADER = os.path.join(os.path.dirname(__file__), '..', 'hardware_drivers', 'Inc', 'hd_trace.h')
+MAGIC = 0x52544448
+TRACK_THREAD = 0
+TRACK_IRQ = 1
+
+
+def load_events(header):
+    """Event id -> (kind, label), ids start at 1 in list order"""
+    with open(header) as f:
+        text = f.read()
+    entries = re.findall(r'X\((\w+),\s*(BEGIN|END|INSTANT),\s*"([^"]*)"\)', text)
+    return {i + 1: (kind, label) for i, (_, kind, label) in enumerate(entries)}
+
+
+def decode(data, events):
+    magic, clock_hz, depth, state, _ = struct.unpack_from('<5I', data, 0)
+    if magic != MAGIC:
+        raise ValueError('not an HD_TraceBuffer dump (magic %08x)' % magic)
+    records = [struct.unpack_from('<2I', data, 20 + 8 * i) for i in range(depth)]
+
+    out = []
+    cycles = None
+    open_slices = 0
+    first = state & (depth - 1)
+    for n in range(depth):
+        stamp, arg = records[(first + n) % depth]
+        if stamp == 0:
+            continue
+        # The oldest kept record's delta refers to an overwritten one
+        cycles = 0 if cycles is None else cycles + (stamp >> 8)
+        kind, label = events.get(stamp & 0xFF, ('INSTANT', 'event %d' % (stamp & 0xFF)))
+        ev = {'name': label, 'pid': 1, 'ts': cycles * 1e6 / clock_hz}
+        if kind == 'INSTANT':
+            ev.update(ph='i', s='t', tid=TRACK_THREAD, args={'arg': arg})
+        elif kind == 'BEGIN':
+            ev.update(ph='B', tid=TRACK_IRQ)
+            open_slices += 1
+        elif open_slices > 0:
+            ev.update(ph='E', tid=TRACK_IRQ)
+            open_slices -= 1
+        else:
+            # Its BEGIN was overwritten
+            continue
+        out.append(ev)
+
+    meta = [
+        {'name': 'thread_name', 'ph': 'M', 'pid': 1, 'tid': TRACK_THREAD, 'args': {'name': 'thread'}},
+        {'name': 'thread_name', 'ph': 'M', 'pid': 1, 'tid': TRACK_IRQ, 'args': {'name': 'interrupts'}},
+    ]
+    return {'traceEvents': meta + out, 'displayTimeUnit': 'ns'}
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    ap.add_argument('dump', help='raw HD_TraceBuffer bytes')
+    ap.add_argument('--header', default=HEADER, help='hd_trace.h with the event list')
+    args = ap.parse_args()
+
+    with open(args.dump, 'rb') as f:
+        data = f.read()
+    json.dump(decode(data, load_events(args.header)), sys.stdout, indent=1)
+    sys.stdout.write('\n')
+
+
+if __name__ == '__main__':
+    main()
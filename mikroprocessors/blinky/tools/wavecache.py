@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""Hit rate and memory use of the wave frame cache (leds.c).
+
+Replays the wave position the way LED_Render advances it, one frame per
+rendered tick, through the same lazily filled cache: a frame is computed
+the first time its position plays and looked up after that. Prints the
+cycle length, cache memory and hit rate for each period/speed pair.
+
+    python tools/wavecache.py [--budget 6144] [--seconds 10] [--every 1]
+        [PERIOD:SPEED ...]
+"""
+import argparse
+import math
+
+DEFAULT_PAIRS = ['1500:1', '1500:4', '1500:7', '1000:3', '4096:1', '7000:3']
+
+
+def simulate(period, speed, budget_frames, ticks, every):
+    step = math.gcd(period, speed % period) or period
+    cycle = period // step
+    cached = cycle <= budget_frames
+    valid = set()
+    hits = misses = bypassed = 0
+    counter = 0
+    for _ in range(0, ticks, every):
+        counter = (counter + speed * every) % period
+        index = counter // step
+        if not cached:
+            bypassed += 1
+        elif index in valid:
+            hits += 1
+        else:
+            valid.add(index)
+            misses += 1
+    used = cycle * 4 + ((cycle + 31) // 32) * 4 if cached else 0
+    return cycle, used, hits, misses, bypassed
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    ap.add_argument('pairs', nargs='*', default=DEFAULT_PAIRS, help='PERIOD:SPEED')
+    ap.add_argument('--budget', type=int, default=6144, help='LED_WAVE_CACHE_BYTES')
+    ap.add_argument('--seconds', type=float, default=10.0, help='simulated time')
+    ap.add_argument('--every', type=int, default=1, help='ticks per rendered frame')
+    args = ap.parse_args()
+
+    ticks = int(args.seconds * 1000)
+    print('period speed   cycle   bytes    hits  misses  bypass  hit rate')
+    for pair in args.pairs:
+        period, speed = (int(v) for v in pair.split(':'))
+        cycle, used, hits, misses, bypassed = simulate(period, speed, args.budget // 4,
+                                                       ticks, args.every)
+        total = hits + misses + bypassed
+        print('%6d %5d %7d %7d %7d %7d %7d  %6.1f%%' %
+              (period, speed, cycle, used, hits, misses, bypassed, 100.0 * hits / total))
+
+
+if __name__ == '__main__':
+    main()